@@ -49,6 +49,28 @@ static int vm_printf(const char *fmt, ...)
 	return r;
 }
 
+// device whose access statistics are printed at exit
+static struct umr_asic *stats_asic;
+
+static void print_access_stats(void)
+{
+	if (stats_asic) {
+		umr_print_access_stats(stats_asic, stderr, stats_asic->options.access_stats == 2);
+		stats_asic = NULL;
+	}
+}
+
+// device whose deferred register writes are flushed at exit
+static struct umr_asic *defer_asic;
+
+static void flush_deferred_writes(void)
+{
+	if (defer_asic) {
+		umr_flush_writes(defer_asic);
+		defer_asic = NULL;
+	}
+}
+
 static struct umr_asic *get_asic(void)
 {
 	struct umr_asic *asic;
@@ -71,6 +93,35 @@ static struct umr_asic *get_asic(void)
 
 	asic->reg_funcs.read_reg = umr_read_reg;
 	asic->reg_funcs.write_reg = umr_write_reg;
+	asic->reg_funcs.read_regs = umr_read_regs_batch;
+	asic->reg_funcs.write_regs = umr_write_regs_batch;
+
+	// traced below the statistics and deferred writes so the trace
+	// holds the accesses that actually reach the device
+	if (options.trace == 1 && umr_record_trace(asic, options.trace_name))
+		exit(EXIT_FAILURE);
+	if (options.trace == 2) {
+		if (umr_replay_trace(asic, options.trace_name))
+			exit(EXIT_FAILURE);
+		// take the access paths of the recording
+		options.no_kernel = asic->options.no_kernel;
+		options.use_pci = asic->options.use_pci;
+	}
+
+	if (asic->options.vm_cache)
+		umr_vm_cache_enable(asic, asic->options.vm_cache_ms);
+
+	if (asic->options.access_stats && !umr_enable_access_stats(asic)) {
+		stats_asic = asic;
+		atexit(print_access_stats);
+	}
+
+	// installed over the statistics so they see the flushed batches,
+	// registered after them so the writes are flushed first at exit
+	if (asic->options.defer_writes && !umr_defer_writes(asic, 1)) {
+		defer_asic = asic;
+		atexit(flush_deferred_writes);
+	}
 
 	return asic;
 }
@@ -147,6 +198,23 @@ static void parse_options(char *str)
 			options.no_disasm = 1;
 		} else if (!strcmp(option, "disasm_anyways")) {
 			options.disasm_anyways = 1;
+		} else if (!strcmp(option, "access_stats")) {
+			options.access_stats = 1;
+		} else if (!strcmp(option, "access_stats_json")) {
+			options.access_stats = 2;
+		} else if (!strcmp(option, "defer_writes")) {
+			options.defer_writes = 1;
+		} else if (!strcmp(option, "no_io_uring")) {
+			options.no_io_uring = 1;
+		} else if (!strcmp(option, "sweep_banks")) {
+			options.sweep_banks = 1;
+		} else if (!strcmp(option, "vm_cache")) {
+			options.vm_cache = 1;
+		} else if (!strncmp(option, "vm_cache=", 9)) {
+			options.vm_cache = 1;
+			options.vm_cache_ms = atoi(option + 9);
+		} else if (!strncmp(option, "threads=", 8)) {
+			options.dump_threads = atoi(option + 8);
 		} else {
 			printf("error: Unknown option [%s]\n", option);
 			exit(EXIT_FAILURE);
@@ -239,6 +307,20 @@ int main(int argc, char **argv)
 				printf("--pci requires domain:bus:slot.function\n");
 				return EXIT_FAILURE;
 			}
+		} else if (!strcmp(argv[i], "--record") || !strcmp(argv[i], "-rec") ||
+			   !strcmp(argv[i], "--replay") || !strcmp(argv[i], "-rep")) {
+			if (i + 1 < argc) {
+				if (asic) {
+					printf("%s must be specified before any commands\n", argv[i]);
+					return EXIT_FAILURE;
+				}
+				options.trace = (!strcmp(argv[i], "--record") || !strcmp(argv[i], "-rec")) ? 1 : 2;
+				strncpy(options.trace_name, argv[i+1], sizeof(options.trace_name) - 1);
+				++i;
+			} else {
+				printf("%s requires a filename\n", argv[i]);
+				return EXIT_FAILURE;
+			}
 		} else if (!strcmp(argv[i], "--config") || !strcmp(argv[i], "-c")) {
 			if (!asic)
 				asic = get_asic();
@@ -256,7 +338,7 @@ int main(int argc, char **argv)
 				if (!blockname)
 					return EXIT_FAILURE;
 				for (j = 0; j < asic->no_blocks; j++)
-					if (!strcmp(asic->blocks[j]->ipname, blockname))
+					if (!strcmp(asic->blocks[j]->ipname, blockname) && !umr_materialize_ip_block(asic->blocks[j]))
 						for (k = 0; k < asic->blocks[j]->no_regs; k++) {
 							printf("\t%s.%s.%s => 0x%05lx\n", asic->asicname, asic->blocks[j]->ipname, asic->blocks[j]->regs[k].regname, (unsigned long)asic->blocks[j]->regs[k].addr);
 							if (options.bitfields) {
@@ -286,7 +368,7 @@ int main(int argc, char **argv)
 				if (!asic)
 					asic = get_asic();
 				if (!memcmp(argv[i+1], "0x", 2) && sscanf(argv[i+1], "%"SCNx32, &reg) == 1 && sscanf(argv[i+2], "%"SCNx32, &val) == 1)
-					umr_write_reg(asic, reg, val, REG_MMIO);
+					asic->reg_funcs.write_reg(asic, reg, val, REG_MMIO);
 				else
 					umr_set_register(asic, argv[i+1], argv[i+2]);
 				i += 2;
@@ -339,7 +421,7 @@ int main(int argc, char **argv)
 					asic = get_asic();
 
 				if (!memcmp(argv[i+1], "0x", 2) && sscanf(argv[i+1], "%"SCNx32, &reg) == 1) {
-					reg = umr_read_reg(asic, reg, REG_MMIO);
+					reg = asic->reg_funcs.read_reg(asic, reg, REG_MMIO);
 					printf("0x%08lx\n", (unsigned long)reg);
 				} else {
 					str = strstr(argv[i+1], ".");
@@ -601,6 +683,40 @@ int main(int argc, char **argv)
 				printf("--vm-disasm requires two parameters\n");
 				return EXIT_FAILURE;
 			}
+		} else if (!strcmp(argv[i], "-vmma") || !strcmp(argv[i], "--vm-map-all")) {
+			if (!asic)
+				asic = get_asic();
+			if (umr_vm_map_print_all(asic))
+				return EXIT_FAILURE;
+		} else if (!strcmp(argv[i], "-vmm") || !strcmp(argv[i], "--vm-map") ||
+			   !strcmp(argv[i], "-vms") || !strcmp(argv[i], "--vm-map-save")) {
+			int save = !strcmp(argv[i], "-vms") || !strcmp(argv[i], "--vm-map-save");
+
+			if (i + 1 + save < argc) {
+				uint32_t vmid;
+
+				if (!asic)
+					asic = get_asic();
+
+				// allow specifying the vmid in hex as well so
+				// people can add the HUB flags more easily
+				if (sscanf(argv[i+1], "0x%"SCNx32, &vmid) != 1 &&
+				    sscanf(argv[i+1], "%"SCNu32, &vmid) != 1) {
+					fprintf(stderr, "[ERROR]: Must specify a VMID for the %s command\n", argv[i]);
+					return EXIT_FAILURE;
+				}
+
+				// imply user hub if hub name specified
+				if (options.hub_name[0])
+					vmid |= UMR_USER_HUB;
+
+				if (save ? umr_vm_map_save(asic, vmid, argv[i+2]) : umr_vm_map_print(asic, vmid))
+					return EXIT_FAILURE;
+				i += 1 + save;
+			} else {
+				printf("%s requires %s\n", argv[i], save ? "two parameters" : "a parameter");
+				return EXIT_FAILURE;
+			}
 		} else if (!strcmp(argv[i], "-prof") || !strcmp(argv[i], "--profiler")) {
 			if (i + 1 < argc) {
 				int n = 0, samples = -1, type = -1;
@@ -644,11 +760,46 @@ int main(int argc, char **argv)
 				printf("--update requires one parameter\n");
 				return EXIT_FAILURE;
 			}
+		} else if (!strcmp(argv[i], "--save-regdb") || !strcmp(argv[i], "-sr")) {
+			if (i + 1 < argc) {
+				if (!asic)
+					asic = get_asic();
+				if (umr_regdb_write(asic, argv[i+1]))
+					return EXIT_FAILURE;
+				++i;
+			} else {
+				printf("--save-regdb requires one parameter\n");
+				return EXIT_FAILURE;
+			}
+		} else if (!strcmp(argv[i], "--snapshot") || !strcmp(argv[i], "-ss")) {
+			if (i + 2 < argc) {
+				if (!asic)
+					asic = get_asic();
+				if (umr_snapshot_save(asic, argv[i+1], argv[i+2]))
+					return EXIT_FAILURE;
+				i += 2;
+			} else {
+				printf("--snapshot requires two parameters\n");
+				return EXIT_FAILURE;
+			}
+		} else if (!strcmp(argv[i], "--snapshot-diff") || !strcmp(argv[i], "-sd")) {
+			if (i + 2 < argc) {
+				if (!asic)
+					asic = get_asic();
+				if (umr_snapshot_print_diff(asic, argv[i+1], argv[i+2]))
+					return EXIT_FAILURE;
+				i += 2;
+			} else {
+				printf("--snapshot-diff requires two parameters\n");
+				return EXIT_FAILURE;
+			}
 		} else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
 			printf("User Mode Register debugger v%s for AMDGPU devices (build: %s), Copyright (c) 2019, AMD Inc.\n"
 "\n*** Device Selection ***\n"
 "\n\t--option -O <string>[,<string>,...]\n\t\tEnable various flags: bits, bitsfull, empty_log, follow, no_follow_ib, named, many,"
-	"\n\t\tuse_pci, use_colour, read_smc, quiet, no_kernel, verbose, halt_waves, disasm_early_term, no_disasm, disasm_anyways"
+	"\n\t\tuse_pci, use_colour, read_smc, quiet, no_kernel, verbose, halt_waves, disasm_early_term, no_disasm, disasm_anyways,"
+	"\n\t\tthreads=<n>, access_stats, access_stats_json, defer_writes, no_io_uring, sweep_banks, vm_cache,"
+	"\n\t\tvm_cache=<ms>"
 "\n\t--instance, -i <number>\n\t\tSelect a device instance to investigate. (default: 0)"
 	"\n\t\tThe instance is the directory name under /sys/kernel/debug/dri/"
 	"\n\t\tof the card you want to work with.\n"
@@ -662,6 +813,18 @@ int main(int argc, char **argv)
 	"\n\t\tSpecify update file to add, change, or delete registers from the register"
 	"\n\t\tdatabase.  Useful for adding registers that are not including in the kernel headers.  See"
 	"\n\t\tthe content under demo/update/ for an example.\n"
+"\n\t--save-regdb, -sr <filename>"
+	"\n\t\tWrite the register database of the selected device to a binary regdb file."
+	"\n\t\tThe file can be loaded much faster than an NPI script with --force '@<filename>'.\n"
+"\n\t--record, -rec <filename>"
+	"\n\t\tRecord every register, memory and debugfs access of the following commands along with"
+	"\n\t\tits result to a trace file.  Must precede the commands.\n"
+"\n\t--replay, -rep <filename>"
+	"\n\t\tServe the accesses of the following commands from a trace file made with --record instead"
+	"\n\t\tof the device.  Writes are ignored.  Use --force '.<asicname>' to replay without a GPU.\n",
+	UMR_BUILD_VER, UMR_BUILD_REV);
+
+printf(
 "\n*** Bank Selection ***\n"
 "\n\t--bank, -b <se> <sh> <instance>\n\t\tSelect a GRBM se/sh/instance bank in decimal. Can use 'x' to denote broadcast.\n"
 "\n\t--sbank, -sb <me> <pipe> <queue>\n\t\tSelect a SRBM me/pipe/queue bank in decimal.\n"
@@ -687,6 +850,10 @@ int main(int argc, char **argv)
 	"\n\t\tCan be used multiple times.\n"
 "\n\t--logscan, -ls\n\t\tRead and display contents of the MMIO register log (usually specified with"
 	"\n\t\t'-O bits,follow,empty_log' to continually dump the trace log.)\n"
+"\n\t--snapshot, -ss <string> <filename>\n\t\tRead registers specified as a register path in the form <asicname.ipname.regname>"
+	"\n\t\tand save their values to a binary snapshot file.  The ipname and regname can"
+	"\n\t\tuse '*' and '?' wildcards, for instance \"*.gfx90.*\".\n"
+"\n\t--snapshot-diff, -sd <filename> <filename>\n\t\tPrint the registers and bitfields that differ between two snapshot files.\n"
 "\n*** Device Utilization ***\n"
 "\n\t--top, -t\n\t\tSummarize GPU utilization.  Can select a SE block with --bank.  Can use"
 	"\n\t\toptions 'use_colour' to colourize output and 'use_pci' to improve efficiency.\n"
@@ -698,8 +865,7 @@ int main(int argc, char **argv)
 "\n\t--profiler, -prof [pixel= | vertex= | compute=]<nsamples> [ring]"
 	"\n\t\tCapture 'nsamples' samples of wave data. Optionally specify a ring to search"
 	"\n\t\tfor IBs that point to shaders.  Defaults to 'gfx'.  Additionally, the type"
-	"\n\t\tof shader can be selected for as well to only profile a given type.\n",
-	UMR_BUILD_VER, UMR_BUILD_REV);
+	"\n\t\tof shader can be selected for as well to only profile a given type.\n");
 
 printf(
 "\n*** Virtual Memory Access ***\n"
@@ -723,6 +889,15 @@ printf(
 "\n\t--vm-disasm, -vdis [<vmid>@]<address> <size>"
 	"\n\t\tDisassemble 'size' bytes (in hex) from a given address (in hex).  The size can"
 	"\n\t\tbe specified as zero to have umr try and compute the shader size.\n"
+"\n\t--vm-map, -vmm <vmid>"
+	"\n\t\tPrint the memory mapped by the page tables of a VMID as ranges of contiguous"
+	"\n\t\tmappings with the same attributes (AI and newer).\n"
+"\n\t--vm-map-save, -vms <vmid> <filename>"
+	"\n\t\tSave the ranges printed by --vm-map to a binary file.\n"
+"\n\t--vm-map-all, -vmma"
+	"\n\t\tPrint the --vm-map ranges of every VMID on the GFX and MM hubs that maps memory."
+	"\n\t\tThe VMIDs are walked by as many threads as the 'threads=<n>' option (default: one"
+	"\n\t\tper CPU) and page tables used by several VMIDs are read once.\n"
 "\n*** Ring and PM4 decoding ***\n"
 "\n\t--ring, -R <string>([from:to])\n\t\tRead the contents of a ring named by the string without the amdgpu_ring_ prefix. "
 	"\n\t\tBy default it will read and display the entire ring.  A starting and ending "
@@ -754,6 +929,9 @@ printf(
 	if (options.print)
 		umr_print_asic(asic, "");
 
+	flush_deferred_writes();
+	print_access_stats();
+
 	if (options.use_xgmi) {
 		// the parent 'asic' is included in the nodes array
 		int n;
@@ -27,16 +27,19 @@
 void umr_print_asic(struct umr_asic *asic, char *ipname)
 {
 	int i, j, k;
-	uint32_t v;
+	uint32_t v, *values;
 	for (i = 0; i < asic->no_blocks; i++) {
-		if (ipname[0] == 0 || !strcmp(ipname, asic->blocks[i]->ipname)) {
+		if ((ipname[0] == 0 || !strcmp(ipname, asic->blocks[i]->ipname)) && !umr_materialize_ip_block(asic->blocks[i])) {
+			values = umr_get_reg_values(asic, i);
+			if (!values)
+				return;
 			for (j = 0; j < asic->blocks[i]->no_regs; j++) {
 				if (asic->blocks[i]->regs[j].type == REG_SMC && !options.read_smc)
 					continue;
-				printf("%s.%s.%s%s%s == %s0x%08lx%s\n", asic->asicname, asic->blocks[i]->ipname, CYAN, asic->blocks[i]->regs[j].regname, RST, YELLOW, (unsigned long)asic->blocks[i]->regs[j].value, RST);
+				printf("%s.%s.%s%s%s == %s0x%08lx%s\n", asic->asicname, asic->blocks[i]->ipname, CYAN, asic->blocks[i]->regs[j].regname, RST, YELLOW, (unsigned long)values[j], RST);
 				for (k = 0; k < asic->blocks[i]->regs[j].no_bits; k++) {
 					v = (1UL << (asic->blocks[i]->regs[j].bits[k].stop + 1 - asic->blocks[i]->regs[j].bits[k].start)) - 1;
-					v &= (asic->blocks[i]->regs[j].value >> asic->blocks[i]->regs[j].bits[k].start);
+					v &= (values[j] >> asic->blocks[i]->regs[j].bits[k].start);
 					asic->blocks[i]->regs[j].bits[k].bitfield_print(asic, asic->asicname, asic->blocks[i]->ipname, asic->blocks[i]->regs[j].regname, asic->blocks[i]->regs[j].bits[k].regname, asic->blocks[i]->regs[j].bits[k].start, asic->blocks[i]->regs[j].bits[k].stop, v);
 				}
 			}
@@ -23,13 +23,303 @@
  *
  */
 #include "umrapp.h"
+#include <errno.h>
+#include <time.h>
 
+// don't hand a worker fewer registers than this
+#define SCAN_MIN_REGS_PER_THREAD 32
+
+// the banks read with the "sweep_banks" option
+#define SCAN_NO_SE(asic) ((asic)->config.gfx.max_shader_engines ? (int)(asic)->config.gfx.max_shader_engines : 1)
+#define SCAN_NO_SH(asic) ((asic)->config.gfx.max_sh_per_se ? (int)(asic)->config.gfx.max_sh_per_se : 1)
+#define SCAN_NO_CU(asic) ((asic)->config.gfx.max_cu_per_sh ? (int)(asic)->config.gfx.max_cu_per_sh : 1)
+
+struct scan_worker {
+	struct umr_asic *asic;
+	struct umr_ip_block *ip;
+	int *idx, first, last;
+	int fd[UMR_NUM_REGCLASS];
+	uint64_t bank;
+	// reads the runs of registers concurrently (owned by the worker unless it is the first)
+	struct umr_aio *aio;
+
+	// scratch space indexed like idx[] (each worker uses its own part)
+	struct umr_reg_addr *addrs;
+	uint32_t *values;
+
+	// the values of the block kept by the asic, indexed like ip->regs[]
+	uint32_t *regvals;
+
+	// position in idx[] of the first register that failed or -1
+	int failed, err;
+	pthread_t thread;
+};
+
+enum scan_access {
+	SCAN_DEBUGFS,    // pread() from the worker's file
+	SCAN_CALLBACK,   // asic register callbacks
+	SCAN_SKIP,       // not readable without debugfs
+};
+
+static enum scan_access scan_access_type(struct scan_worker *w, struct umr_reg *reg)
+{
+	if (w->fd[reg->type] >= 0)
+		return SCAN_DEBUGFS;
+	if (reg->type == REG_MMIO || reg->type == REG_SMC || w->asic->options.use_pci)
+		return SCAN_CALLBACK;
+	return SCAN_SKIP;
+}
+
+static uint64_t scan_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * scan_read_regs - Read a run of registers of an IP block
+ *
+ * Reads @w->idx[first..last) into the register values of the asic (see
+ * umr_get_reg_values(), the register arrays may be shared so their
+ * value fields are not used).  Registers are
+ * read with umr_aio_read_regs() on the worker's debugfs files so workers
+ * never share a file position, adjacent registers are read together and
+ * separate runs are in flight at the same time.
+ * Without debugfs the access goes through the asic register callbacks
+ * which must then be safe to call from several threads at once.
+ */
+static void *scan_read_regs(void *data)
+{
+	struct scan_worker *w = data;
+	struct umr_reg *reg;
+	enum scan_access access;
+	uint64_t t;
+	int x, y, got;
+
+	for (x = w->first; x < w->last; x = y) {
+		access = scan_access_type(w, &w->ip->regs[w->idx[x]]);
+		for (y = x; y < w->last; y++) {
+			reg = &w->ip->regs[w->idx[y]];
+			if (scan_access_type(w, reg) != access)
+				break;
+			w->addrs[y].addr = reg->addr * (reg->type == REG_MMIO ? 4 : 1);
+			if (reg->type == REG_MMIO && access == SCAN_DEBUGFS)
+				w->addrs[y].addr |= w->bank;
+			w->addrs[y].type = reg->type;
+		}
+
+		got = y - x;
+		if (access == SCAN_DEBUGFS) {
+			t = w->asic->access_stats ? scan_clock() : 0;
+			got = umr_aio_read_regs(w->aio, w->fd, &w->addrs[x], &w->values[x], y - x);
+			if (w->asic->access_stats)
+				umr_count_reg_reads(w->asic, &w->addrs[x], got, scan_clock() - t);
+			if (got < y - x) {
+				w->failed = x + got;
+				w->err = errno;
+			}
+		} else if (access == SCAN_CALLBACK) {
+			umr_read_regs(w->asic, &w->addrs[x], &w->values[x], y - x);
+		} else {
+			continue;
+		}
+
+		while (got--)
+			w->regvals[w->idx[x + got]] = w->values[x + got];
+		if (w->failed != -1)
+			break;
+	}
+	return NULL;
+}
+
+/**
+ * scan_open_fds - Open the debugfs register files for a worker
+ *
+ * Worker 0 runs on the calling thread and uses the asic's own files,
+ * the others re-open them so each has its own file description.  If a
+ * file can't be re-opened the worker shares the asic's (pread() does not
+ * move the file position so this is still safe).  Without debugfs (direct
+ * PCI access or no kernel) or with an access trace all files are -1.
+ */
+static void scan_open_fds(struct umr_asic *asic, struct scan_worker *w, int n)
+{
+	char fname[64];
+	int x, k;
+
+	w->fd[REG_MMIO] = asic->fd.mmio;
+	w->fd[REG_DIDT] = asic->fd.didt;
+	w->fd[REG_PCIE] = asic->fd.pcie;
+	w->fd[REG_SMC] = asic->fd.smc;
+	if (asic->pci.mem || asic->trace)
+		for (k = 0; k < UMR_NUM_REGCLASS; k++)
+			w->fd[k] = -1;
+	w->aio = umr_get_aio(asic);
+
+	for (x = 1; x < n; x++) {
+		w[x].aio = umr_aio_create(UMR_AIO_DEPTH, asic->options.no_io_uring ? UMR_AIO_NO_URING : 0);
+		for (k = 0; k < UMR_NUM_REGCLASS; k++) {
+			w[x].fd[k] = -1;
+			if (w->fd[k] >= 0) {
+				snprintf(fname, sizeof(fname)-1, "/proc/self/fd/%d", w->fd[k]);
+				w[x].fd[k] = open(fname, O_RDWR);
+			}
+		}
+	}
+}
+
+static void scan_close_fds(struct scan_worker *w, int n)
+{
+	int x, k;
+
+	for (x = 1; x < n; x++) {
+		for (k = 0; k < UMR_NUM_REGCLASS; k++)
+			if (w[x].fd[k] >= 0)
+				close(w[x].fd[k]);
+		umr_aio_destroy(w[x].aio);
+	}
+}
+
+/**
+ * scan_read_block - Read a list of registers of an IP block
+ *
+ * Splits @idx into contiguous runs and reads them with up to @nthreads
+ * workers (the calling thread being one of them).  Returns the position
+ * in @idx of the first register that could not be read with errno set
+ * accordingly or -1 if all registers were read.
+ */
+static int scan_read_block(struct umr_asic *asic, struct umr_ip_block *ip, int *idx, int n,
+			   struct umr_reg_addr *addrs, uint32_t *values, uint32_t *regvals,
+			   struct scan_worker *w, int nthreads)
+{
+	int x, failed, err;
+
+	if (nthreads > (n + SCAN_MIN_REGS_PER_THREAD - 1) / SCAN_MIN_REGS_PER_THREAD)
+		nthreads = (n + SCAN_MIN_REGS_PER_THREAD - 1) / SCAN_MIN_REGS_PER_THREAD;
+	if (nthreads < 1)
+		nthreads = 1;
+
+	for (x = 0; x < nthreads; x++) {
+		w[x].asic = asic;
+		w[x].ip = ip;
+		w[x].idx = idx;
+		w[x].addrs = addrs;
+		w[x].values = values;
+		w[x].regvals = regvals;
+		w[x].first = (int)(((int64_t)n * x) / nthreads);
+		w[x].last = (int)(((int64_t)n * (x + 1)) / nthreads);
+		w[x].bank = umr_apply_bank_selection_address(asic);
+		w[x].failed = -1;
+		w[x].err = 0;
+	}
+
+	for (x = 1; x < nthreads; x++) {
+		if (pthread_create(&w[x].thread, NULL, scan_read_regs, &w[x])) {
+			// run it here instead
+			w[x].thread = 0;
+			scan_read_regs(&w[x]);
+		}
+	}
+	scan_read_regs(&w[0]);
+	for (x = 1; x < nthreads; x++)
+		if (w[x].thread)
+			pthread_join(w[x].thread, NULL);
+
+	// runs are in order so the first failure is in the first failing run
+	failed = -1;
+	err = 0;
+	for (x = 0; x < nthreads; x++) {
+		if (w[x].failed != -1) {
+			failed = w[x].failed;
+			err = w[x].err;
+			break;
+		}
+	}
+	errno = err;
+	return failed;
+}
+
+/**
+ * scan_sweep_block - Read a list of registers of an IP block in every bank
+ *
+ * Reads the registers in every SE/SH/CU combination of the asic into
+ * @values (n values per bank) with umr_read_regs_all_banks().  Returns
+ * the number of banks or -1 on error.
+ */
+static int scan_sweep_block(struct umr_asic *asic, struct umr_ip_block *ip, int *idx, int n,
+			    struct umr_reg_addr *addrs, uint32_t **values, int *values_size)
+{
+	int x, no_banks;
+
+	no_banks = SCAN_NO_SE(asic) * SCAN_NO_SH(asic) * SCAN_NO_CU(asic);
+	if (*values_size < n * no_banks) {
+		free(*values);
+		*values_size = n * no_banks;
+		*values = calloc(*values_size, sizeof **values);
+		if (!*values) {
+			*values_size = 0;
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+			return -1;
+		}
+	}
+
+	for (x = 0; x < n; x++) {
+		addrs[x].addr = ip->regs[idx[x]].addr * (ip->regs[idx[x]].type == REG_MMIO ? 4 : 1);
+		addrs[x].type = ip->regs[idx[x]].type;
+	}
+	if (umr_read_regs_all_banks(asic, addrs, *values, n, SCAN_NO_SE(asic), SCAN_NO_SH(asic), SCAN_NO_CU(asic)))
+		return -1;
+	return no_banks;
+}
+
+static void scan_print_reg(struct umr_asic *asic, struct umr_ip_block *ip, struct umr_reg *reg, uint32_t value, int named, const char *bank)
+{
+	uint32_t v;
+	int j;
+
+	if (named)
+		printf("%s%s.%s%s", CYAN, ip->ipname, reg->regname, RST);
+	if (named || bank[0])
+		printf("%s => ", bank);
+	printf("%s0x%08lx%s\n", YELLOW, (unsigned long)value, RST);
+	if (asic->options.bitfields)
+		for (j = 0; j < reg->no_bits; j++) {
+			v = (1UL << (reg->bits[j].stop + 1 - reg->bits[j].start)) - 1;
+			v &= (value >> reg->bits[j].start);
+			reg->bits[j].bitfield_print(asic, asic->asicname, ip->ipname, reg->regname, reg->bits[j].regname, reg->bits[j].start, reg->bits[j].stop, v);
+		}
+}
+
+/**
+ * umr_scan_asic - Read and optionally print registers
+ *
+ * Reads the registers matching @asicname.@ipname.@regname into the
+ * register values of the asic (see umr_get_reg_values()).  If @regname
+ * is not empty the values are printed as well.
+ *
+ * Each IP block is granted, all of its selected registers read and then
+ * released before moving onto the next one.  With the "threads=<n>"
+ * option the registers of a block are split over up to <n> threads when
+ * reading through debugfs.  The values are printed once the block has
+ * been read so the output does not depend on the number of threads.
+ *
+ * Without debugfs a GRBM bank selected with --bank is selected once
+ * for the whole scan.  With the "sweep_banks" option the registers are
+ * read and printed in every SE/SH/CU bank instead.
+ */
 int umr_scan_asic(struct umr_asic *asic, char *asicname, char *ipname, char *regname)
 {
-	int r, fd, many = asic->options.many, named = asic->options.named,
-	    first, i, j, k, count = 0;
-	uint64_t addr, scale;
-	char buf[256], regname_copy[256];
+	int r, many = asic->options.many, named = asic->options.named,
+	    i, j, k, n, failed, bad_type, nthreads, count = 0, selected = 0,
+	    b, no_banks = 0, sweep_size = 0;
+	char buf[256], regname_copy[256], bank[48];
+	struct umr_reg_pattern *pat = NULL;
+	struct umr_ip_block *ip;
+	struct scan_worker *workers = NULL;
+	struct umr_reg_addr *addrs = NULL;
+	uint32_t *values = NULL, *sweep = NULL, *regvals;
+	int *idx = NULL, idx_size = 0;
 
 	// does the register name contain a trailing star?
 	strcpy(regname_copy, regname);
@@ -39,87 +329,139 @@ int umr_scan_asic(struct umr_asic *asic, char *asicname, char *ipname, char *reg
 		regname_copy[strlen(regname_copy)-1] = 0;
 	}
 
+	// match "many" names as substrings with a compiled pattern
+	if (many) {
+		snprintf(buf, sizeof(buf)-1, "*%s*", regname_copy);
+		pat = umr_compile_reg_pattern(buf);
+		if (!pat)
+			return -1;
+	}
+
+	// SMC registers are read through an index/data pair with direct PCI access
+	nthreads = asic->options.dump_threads;
+	if (nthreads < 1 || asic->pci.mem)
+		nthreads = 1;
+	workers = calloc(nthreads, sizeof workers[0]);
+	if (!workers) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		r = -1;
+		goto error;
+	}
+	scan_open_fds(asic, workers, nthreads);
+
+	// the workers read the debugfs files directly
+	umr_flush_writes(asic);
+
+	// without debugfs the bank is selected once for the whole scan
+	if (workers->fd[REG_MMIO] < 0 && asic->options.use_bank == 1 && !asic->options.sweep_banks) {
+		umr_lock_hw(asic);
+		umr_grbm_select_index(asic, asic->options.bank.grbm.se, asic->options.bank.grbm.sh, asic->options.bank.grbm.instance);
+		selected = 1;
+	}
+
 	/* scan them all in order */
 	if (!asicname[0] || !strcmp(asicname, "*") || !strcmp(asicname, asic->asicname)) {
 		for (i = 0; i < asic->no_blocks; i++) {
-			if (!ipname[0] || ipname[0] == '*' || !strcmp(ipname, asic->blocks[i]->ipname)) {
-				first = 1;
-				for (j = 0; j < asic->blocks[i]->no_regs; j++) {
-					if (!regname[0] || !strcmp(regname, "*") || !strcmp(regname, asic->blocks[i]->regs[j].regname) ||
-					(many && strstr(asic->blocks[i]->regs[j].regname, regname_copy))) {
-						++ count;
-
-						// only grant if any regspec matches otherwise it's a waste
-						if (first && asic->blocks[i]->grant) {
-							first = 0;
-							r = asic->blocks[i]->grant(asic);
-							if (r) {
-								if (ipname[0]) {
-									exit(EXIT_FAILURE);
-								}
-								continue;
-							}
-						}
-						if (asic->pci.mem == NULL) {
-							switch(asic->blocks[i]->regs[j].type) {
-							case REG_MMIO: fd = asic->fd.mmio; scale = 4; break;
-							case REG_DIDT: fd = asic->fd.didt; scale = 1; break;
-							case REG_PCIE: fd = asic->fd.pcie; scale = 1; break;
-							case REG_SMC:
-								if (asic->options.read_smc) {
-									fd = asic->fd.smc; scale = 1;
-								} else {
-									continue;
-								}
-								break;
-							default: return -1;
-							}
-
-							if (asic->blocks[i]->regs[j].type == REG_MMIO)
-								addr = umr_apply_bank_selection_address(asic);
-							else
-								addr = 0;
-
-							if (lseek(fd, addr|(asic->blocks[i]->regs[j].addr*scale), SEEK_SET) == -1) {
-								snprintf(buf, sizeof(buf)-1, "Could not seek reading register %s.%s.%s", asic->asicname, asic->blocks[i]->ipname, asic->blocks[i]->regs[j].regname);
-								perror(buf);
-								r = -1;
-								goto error;
-							}
-							if (read(fd, &asic->blocks[i]->regs[j].value, 4) != 4) {
-								snprintf(buf, sizeof(buf)-1, "Could not read register %s.%s.%s", asic->asicname, asic->blocks[i]->ipname, asic->blocks[i]->regs[j].regname);
-								perror(buf);
-								r = -1;
-								goto error;
-							}
-						} else if (asic->blocks[i]->regs[j].type == REG_MMIO || asic->blocks[i]->regs[j].type == REG_SMC) {
-							// TODO: Add nokernel version of srbm select
-							if (asic->options.use_bank == 1)
-								umr_grbm_select_index(asic, asic->options.bank.grbm.se, asic->options.bank.grbm.sh, asic->options.bank.grbm.instance);
-							asic->blocks[i]->regs[j].value = umr_read_reg(asic, asic->blocks[i]->regs[j].addr * (asic->blocks[i]->regs[j].type == REG_MMIO ? 4 : 1), asic->blocks[i]->regs[j].type);
-							if (asic->options.use_bank == 1)
-								umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
-						}
-						if (regname[0]) {
-							if (named)
-								printf("%s%s.%s%s => ", CYAN, asic->blocks[i]->ipname,  asic->blocks[i]->regs[j].regname, RST);
-							printf("%s0x%08lx%s\n", YELLOW, (unsigned long)asic->blocks[i]->regs[j].value, RST);
-							if (asic->options.bitfields)
-								for (k = 0; k < asic->blocks[i]->regs[j].no_bits; k++) {
-									uint32_t v;
-									v = (1UL << (asic->blocks[i]->regs[j].bits[k].stop + 1 - asic->blocks[i]->regs[j].bits[k].start)) - 1;
-									v &= (asic->blocks[i]->regs[j].value >> asic->blocks[i]->regs[j].bits[k].start);
-									asic->blocks[i]->regs[j].bits[k].bitfield_print(asic, asic->asicname, asic->blocks[i]->ipname, asic->blocks[i]->regs[j].regname, asic->blocks[i]->regs[j].bits[k].regname, asic->blocks[i]->regs[j].bits[k].start, asic->blocks[i]->regs[j].bits[k].stop, v);
-								}
+			ip = asic->blocks[i];
+			if ((ipname[0] && ipname[0] != '*' && strcmp(ipname, ip->ipname)) || umr_materialize_ip_block(ip))
+				continue;
+			regvals = umr_get_reg_values(asic, i);
+			if (!regvals) {
+				r = -1;
+				goto error;
+			}
+
+			if (idx_size < ip->no_regs) {
+				free(idx);
+				free(addrs);
+				free(values);
+				idx_size = ip->no_regs;
+				idx = calloc(idx_size, sizeof idx[0]);
+				addrs = calloc(idx_size, sizeof addrs[0]);
+				values = calloc(idx_size, sizeof values[0]);
+				if (!idx || !addrs || !values) {
+					fprintf(stderr, "[ERROR]: Out of memory\n");
+					r = -1;
+					goto error;
+				}
+			}
+
+			// gather the selected registers
+			bad_type = 0;
+			for (n = j = 0; j < ip->no_regs; j++) {
+				if (!regname[0] || !strcmp(regname, "*") || !strcmp(regname, ip->regs[j].regname) ||
+				(many && umr_reg_pattern_matches(pat, ip->regs[j].regname))) {
+					++count;
+					if (!asic->pci.mem) {
+						if (ip->regs[j].type > REG_PCIE) {
+							bad_type = 1;
+							break;
 						}
+						if (ip->regs[j].type == REG_SMC && !asic->options.read_smc)
+							continue;
+					}
+					idx[n++] = j;
+				}
+			}
+
+			// only grant if any regspec matches otherwise it's a waste
+			if (n && ip->grant) {
+				r = ip->grant(asic);
+				if (r) {
+					if (ipname[0]) {
+						if (selected)
+							umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
+						exit(EXIT_FAILURE);
 					}
+					continue;
+				}
+			}
+
+			if (asic->options.sweep_banks) {
+				failed = -1;
+				if (n) {
+					no_banks = scan_sweep_block(asic, ip, idx, n, addrs, &sweep, &sweep_size);
+					if (no_banks < 0)
+						failed = 0;
 				}
-				// only release if granted
-				if (!first && asic->blocks[i]->release) {
-					r = asic->blocks[i]->release(asic);
-					if (r)
-						goto error;
+			} else {
+				failed = n ? scan_read_block(asic, ip, idx, n, addrs, values, regvals, workers, nthreads) : -1;
+			}
+
+			// only release if granted
+			if (n && ip->release) {
+				r = ip->release(asic);
+				if (r)
+					goto error;
+			}
+
+			for (k = 0; k < n; k++) {
+				struct umr_reg *reg = &ip->regs[idx[k]];
+
+				if (k == failed) {
+					snprintf(buf, sizeof(buf)-1, "Could not read register %s.%s.%s", asic->asicname, ip->ipname, reg->regname);
+					perror(buf);
+					r = -1;
+					goto error;
 				}
+				if (asic->options.sweep_banks) {
+					// banks are in SE, SH, CU order
+					for (b = 0; regname[0] && b < no_banks; b++) {
+						snprintf(bank, sizeof(bank)-1, "[%d.%d.%d]",
+							 b / (SCAN_NO_SH(asic) * SCAN_NO_CU(asic)),
+							 (b / SCAN_NO_CU(asic)) % SCAN_NO_SH(asic),
+							 b % SCAN_NO_CU(asic));
+						scan_print_reg(asic, ip, reg, sweep[n * b + k], named, bank);
+					}
+					// the register keeps the value of the first bank
+					regvals[idx[k]] = sweep[k];
+				} else if (regname[0]) {
+					scan_print_reg(asic, ip, reg, regvals[idx[k]], named, "");
+				}
+			}
+			if (bad_type) {
+				r = -1;
+				goto error;
 			}
 		}
 	}
@@ -129,6 +471,18 @@ int umr_scan_asic(struct umr_asic *asic, char *asicname, char *ipname, char *reg
 
 	r = 0;
 error:
-
+	if (selected) {
+		umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
+		umr_unlock_hw(asic);
+	}
+	if (workers) {
+		scan_close_fds(workers, nthreads);
+		free(workers);
+	}
+	free(idx);
+	free(addrs);
+	free(values);
+	free(sweep);
+	umr_free_reg_pattern(pat);
 	return r;
 }
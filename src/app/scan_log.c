@@ -24,46 +24,50 @@
  */
 #include "umrapp.h"
 
-#define LIST_SIZE (1UL << 18)
-
-int umr_create_mmio_accel(struct umr_asic *asic)
+/**
+ * find_reg_at_or_below - Find the MMIO register closest below an address
+ *
+ * Binary searches the sorted MMIO address index once for the last
+ * register at or below @addr and then steps the index back to the
+ * first register (in block order) sharing its address.  @delta is
+ * set to the distance from that register to @addr.
+ */
+static struct umr_reg *find_reg_at_or_below(struct umr_asic *asic, unsigned long addr,
+					    struct umr_ip_block **ip, unsigned long *delta)
 {
-	int i, j;
+	struct umr_addr_index_entry *e;
+	uint32_t lo, hi, mid;
 
-	// create flat array of registers
-	asic->mmio_accel.reglist = calloc(LIST_SIZE, sizeof *asic->mmio_accel.reglist);
-	asic->mmio_accel.iplist  = calloc(LIST_SIZE, sizeof *asic->mmio_accel.iplist);
-	if (!asic->mmio_accel.reglist || !asic->mmio_accel.iplist) {
-		free(asic->mmio_accel.iplist);
-		free(asic->mmio_accel.reglist);
-		asic->mmio_accel.iplist  = NULL;
-		asic->mmio_accel.reglist = NULL;
-		return -1;
-	}
+	e  = asic->mmio_accel.entries[REG_MMIO];
+	lo = 0;
+	hi = asic->mmio_accel.no_entries[REG_MMIO];
 
-	for (i = 0; i < asic->no_blocks; i++) {
-		for (j = 0; j < asic->blocks[i]->no_regs; j++) {
-			if (asic->blocks[i]->regs[j].type == REG_MMIO) {
-				if (asic->blocks[i]->regs[j].addr >= LIST_SIZE) {
-					fprintf(stderr, "[BUG]: Register address width too large for scan_log\n");
-					continue;
-				}
-				asic->mmio_accel.reglist[asic->blocks[i]->regs[j].addr] = &asic->blocks[i]->regs[j];
-				asic->mmio_accel.iplist[asic->blocks[i]->regs[j].addr]  = asic->blocks[i];
-			}
-		}
+	// find the first entry with an address > addr
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (e[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-	return 0;
+	if (!lo)
+		return NULL;
+
+	for (--lo; lo && e[lo - 1].addr == e[lo].addr; --lo);
+
+	*delta = addr - e[lo].addr;
+	*ip = asic->blocks[e[lo].ip];
+	return &asic->blocks[e[lo].ip]->regs[e[lo].reg];
 }
 
 void umr_scan_log(struct umr_asic *asic)
 {
 	char line[256], *chr;
 	FILE *f;
-	int k, found;
+	int k;
 	unsigned long delta, did, regno, value, write;
-	struct umr_reg **reglist;
-	struct umr_ip_block **iplist;
+	struct umr_reg *reg;
+	struct umr_ip_block *ip;
 
 	f = fopen("/sys/kernel/debug/tracing/trace", "r");
 	if (!f) {
@@ -71,17 +75,13 @@ void umr_scan_log(struct umr_asic *asic)
 		return;
 	}
 
-	if (!asic->mmio_accel.reglist) {
-		if (umr_create_mmio_accel(asic)) {
-			return;
-		}
+	if (!asic->mmio_accel.built && umr_create_mmio_accel(asic)) {
+		fprintf(stderr, "[ERROR]: Out of memory building the register address index\n");
+		fclose(f);
+		return;
 	}
 
-	reglist = asic->mmio_accel.reglist;
-	iplist  = asic->mmio_accel.iplist;
-
 	while (fgets(line, sizeof(line), f)) {
-		found = 0;
 		delta = 0;
 		write = 0;
 
@@ -96,33 +96,27 @@ void umr_scan_log(struct umr_asic *asic)
 			}
 
 			if (did == asic->did) {
-				do {
-					if (reglist[regno] != NULL) {
-						// bingo
-						if (write)
-							printf("%s.%s.%s +0x%04lx <= 0x%08lx\n",
-								asic->asicname, iplist[regno]->ipname, reglist[regno]->regname,
-								(unsigned long)delta,
-								(unsigned long)value);
-						else
-							printf("%s.%s.%s +0x%04lx => 0x%08lx\n",
-								asic->asicname, iplist[regno]->ipname, reglist[regno]->regname,
-								(unsigned long)delta,
-								(unsigned long)value);
-						if (asic->options.bitfields)
-							for (k = 0; k < reglist[regno]->no_bits; k++) {
-								uint32_t v;
-								v = (1UL << (reglist[regno]->bits[k].stop + 1 - reglist[regno]->bits[k].start)) - 1;
-								v &= (value >> reglist[regno]->bits[k].start);
-								reglist[regno]->bits[k].bitfield_print(asic, asic->asicname, iplist[regno]->ipname, reglist[regno]->regname, reglist[regno]->bits[k].regname, reglist[regno]->bits[k].start, reglist[regno]->bits[k].stop, v);
-							}
-						found = 1;
-						goto out;
-					}
-out:
-					regno -= 1;
-					delta += 1;
-				} while (!found);
+				// find the register at or closest below the logged offset
+				reg = find_reg_at_or_below(asic, regno, &ip, &delta);
+				if (reg) {
+					if (write)
+						printf("%s.%s.%s +0x%04lx <= 0x%08lx\n",
+							asic->asicname, ip->ipname, reg->regname,
+							(unsigned long)delta,
+							(unsigned long)value);
+					else
+						printf("%s.%s.%s +0x%04lx => 0x%08lx\n",
+							asic->asicname, ip->ipname, reg->regname,
+							(unsigned long)delta,
+							(unsigned long)value);
+					if (asic->options.bitfields)
+						for (k = 0; k < reg->no_bits; k++) {
+							uint32_t v;
+							v = (1UL << (reg->bits[k].stop + 1 - reg->bits[k].start)) - 1;
+							v &= (value >> reg->bits[k].start);
+							reg->bits[k].bitfield_print(asic, asic->asicname, ip->ipname, reg->regname, reg->bits[k].regname, reg->bits[k].start, reg->bits[k].stop, v);
+						}
+				}
 			}
 		}
 	}
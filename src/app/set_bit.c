@@ -44,7 +44,7 @@ int umr_set_register_bit(struct umr_asic *asic, char *regpath, char *regvalue)
 	if (asicname[0] == '*' || !strcmp(asicname, asic->asicname)) {
 		/* scan until we compare with regpath... */
 		for (i = 0; i < asic->no_blocks; i++) {
-			if (ipname[0] == '*' || !strcmp(ipname, asic->blocks[i]->ipname)) {
+			if ((ipname[0] == '*' || !strcmp(ipname, asic->blocks[i]->ipname)) && !umr_materialize_ip_block(asic->blocks[i])) {
 				for (j = 0; j < asic->blocks[i]->no_regs; j++) {
 					if (!strcmp(regname, asic->blocks[i]->regs[j].regname) && asic->blocks[i]->regs[j].bits) {
 						for (k = 0; k < asic->blocks[i]->regs[j].no_bits; k++) {
@@ -102,6 +102,13 @@ int umr_set_register_bit(struct umr_asic *asic, char *regpath, char *regvalue)
 									if (asic->options.use_bank && asic->options.no_kernel)
 										umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
 									if (!asic->options.quiet) printf("%s <= 0x%08lx\n", regpath, (unsigned long)copy);
+								} else {
+									// indirect classes go through their index/data registers
+									copy = asic->reg_funcs.read_reg(asic, asic->blocks[i]->regs[j].addr, asic->blocks[i]->regs[j].type) & ~mask;
+									copy |= (value << asic->blocks[i]->regs[j].bits[k].start) & mask;
+									if (asic->reg_funcs.write_reg(asic, asic->blocks[i]->regs[j].addr, copy, asic->blocks[i]->regs[j].type))
+										return -1;
+									if (!asic->options.quiet) printf("%s <= 0x%08lx\n", regpath, (unsigned long)copy);
 								}
 								return 0;
 							}
@@ -44,7 +44,7 @@ int umr_set_register(struct umr_asic *asic, char *regpath, char *regvalue)
 	if (asicname[0] == '*' || !strcmp(asicname, asic->asicname)) {
 		// scan all ip blocks for matching entry
 		for (i = 0; i < asic->no_blocks; i++) {
-			if (ipname[0] == '*' || !strcmp(ipname, asic->blocks[i]->ipname)) {
+			if ((ipname[0] == '*' || !strcmp(ipname, asic->blocks[i]->ipname)) && !umr_materialize_ip_block(asic->blocks[i])) {
 				for (j = 0; j < asic->blocks[i]->no_regs; j++) {
 					if (!strcmp(regname, asic->blocks[i]->regs[j].regname)) {
 						sscanf(regvalue, "%"SCNx32, &value);
@@ -85,6 +85,10 @@ int umr_set_register(struct umr_asic *asic, char *regpath, char *regvalue)
 							asic->pci.mem[asic->blocks[i]->regs[j].addr] = value;
 							if (asic->options.use_bank)
 								umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
+						} else {
+							// indirect classes go through their index/data registers
+							if (asic->reg_funcs.write_reg(asic, asic->blocks[i]->regs[j].addr, value, asic->blocks[i]->regs[j].type))
+								return -1;
 						}
 						return 0;
 					}
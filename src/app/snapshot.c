@@ -0,0 +1,105 @@
+/*
+ * Copyright 2018 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umrapp.h"
+
+/**
+ * umr_snapshot_save - Capture registers and save them to a file
+ *
+ * @regpath: Registers to capture in the form asicname.ipname.regname
+ * where ipname and regname can use '*' and '?' wildcards.
+ */
+int umr_snapshot_save(struct umr_asic *asic, char *regpath, char *filename)
+{
+	char asicname[128], ipname[128], regname[128], *p, *q;
+	struct umr_reg_snapshot *snap;
+	int r;
+
+	p = strchr(regpath, '.');
+	q = p ? strchr(p + 1, '.') : NULL;
+	if (!p || !q || p - regpath >= (int)sizeof asicname || q - p > (int)sizeof ipname || strlen(q) > sizeof regname) {
+		fprintf(stderr, "[ERROR]: Invalid asicname.ipname.regname syntax <%s>\n", regpath);
+		return -1;
+	}
+	memset(asicname, 0, sizeof asicname);
+	memset(ipname, 0, sizeof ipname);
+	memcpy(asicname, regpath, p - regpath);
+	memcpy(ipname, p + 1, q - p - 1);
+	strcpy(regname, q + 1);
+
+	if (strcmp(asicname, "*") && strcmp(asicname, asic->asicname)) {
+		fprintf(stderr, "[ERROR]: Invalid asicname <%s>\n", asicname);
+		return -1;
+	}
+
+	snap = umr_snapshot_capture(asic, ipname, regname);
+	if (!snap) {
+		fprintf(stderr, "[ERROR]: No registers match <%s>\n", regpath);
+		return -1;
+	}
+	r = umr_snapshot_write(snap, filename);
+	if (!r && !options.quiet)
+		printf("Saved %lu registers to %s\n", (unsigned long)snap->no_regs, filename);
+	umr_snapshot_free(snap);
+	return r;
+}
+
+static void print_change(void *data, struct umr_ip_block *ip, struct umr_reg *reg, uint32_t a, uint32_t b)
+{
+	struct umr_asic *asic = data;
+	uint32_t mask;
+	int k;
+
+	printf("%s.%s.%s%s%s: %s0x%08lx%s => %s0x%08lx%s\n", asic->asicname, ip->ipname, CYAN, reg->regname, RST,
+		YELLOW, (unsigned long)a, RST, YELLOW, (unsigned long)b, RST);
+	for (k = 0; k < reg->no_bits; k++) {
+		mask = (1ULL << (reg->bits[k].stop + 1 - reg->bits[k].start)) - 1;
+		if (((a ^ b) >> reg->bits[k].start) & mask)
+			printf("\t.%s%s%s[%d:%d]: 0x%lx => 0x%lx\n", CYAN, reg->bits[k].regname, RST,
+				reg->bits[k].start, reg->bits[k].stop,
+				(unsigned long)((a >> reg->bits[k].start) & mask),
+				(unsigned long)((b >> reg->bits[k].start) & mask));
+	}
+}
+
+/**
+ * umr_snapshot_print_diff - Print the registers that differ between two snapshot files
+ */
+int umr_snapshot_print_diff(struct umr_asic *asic, char *file_a, char *file_b)
+{
+	struct umr_reg_snapshot *a, *b;
+	int r;
+
+	a = umr_snapshot_read(asic, file_a);
+	b = a ? umr_snapshot_read(asic, file_b) : NULL;
+	r = -1;
+	if (a && b) {
+		r = umr_snapshot_diff(a, b, print_change, asic);
+		if (r >= 0 && !options.quiet)
+			printf("%d registers differ\n", r);
+	}
+	umr_snapshot_free(a);
+	umr_snapshot_free(b);
+	return r < 0 ? -1 : 0;
+}
@@ -327,16 +327,13 @@ static volatile uint32_t gpu_power_data[32];
 static volatile struct umr_bitfield *sensor_bits = NULL;
 static void *gpu_sensor_thread(void *data)
 {
-	struct umr_asic asic = *((struct umr_asic*)data);
+	struct umr_asic *asic = data; // a clone owned by this thread
 	int size, rem, off, x;
-	char fname[128];
 	struct timespec ts;
 
 	ts.tv_sec = 0;
 	ts.tv_nsec = 1000000000UL / 50; // limit to 50Hz
 
-	snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_sensors", asic.instance);
-	asic.fd.sensors = open(fname, O_RDWR);
 	while (!sensor_thread_quit) {
 		rem = sizeof gpu_power_data;
 		off = 0;
@@ -347,7 +344,7 @@ static void *gpu_sensor_thread(void *data)
 					break;
 			}
 			if (size <= rem)
-				umr_read_sensor(&asic, sensor_bits[x].start, (uint32_t*)&gpu_power_data[off], &size);
+				umr_read_sensor(asic, sensor_bits[x].start, (uint32_t*)&gpu_power_data[off], &size);
 			off += size / 4;
 			rem -= size;
 			x   += size / 4;
@@ -355,7 +352,6 @@ static void *gpu_sensor_thread(void *data)
 
 		nanosleep(&ts, NULL);
 	}
-	close(asic.fd.sensors);
 	return NULL;
 }
 
@@ -619,21 +615,13 @@ static void print_iov(uint64_t *counts)
 	}
 }
 
-static void parse_bits(struct umr_asic *asic, uint32_t addr, struct umr_bitfield *bits, uint64_t *counts, uint32_t *mask, uint32_t *cmp, uint64_t addr_mask)
+static void parse_bits(struct umr_asic *asic, uint32_t addr, struct umr_bitfield *bits, uint64_t *counts, uint32_t *mask, uint32_t *cmp, uint32_t value)
 {
 	int j;
-	uint32_t value;
+
+	(void)asic;
 
 	if (addr) {
-		if (addr_mask && asic->fd.mmio < 0) {
-			value = 0;
-		} else if (!addr_mask && asic->pci.mem) {
-			value = asic->pci.mem[addr>>2];
-		} else {
-			lseek(asic->fd.mmio, addr | addr_mask, SEEK_SET);
-			if (read(asic->fd.mmio, &value, 4) != 4)
-				value = 0;
-		}
 		for (j = 0; bits[j].regname; j++)
 			if (bits[j].start != 255) {
 				if (bits[j].start == bits[j].stop) {
@@ -713,24 +701,15 @@ static void parse_drm(struct umr_asic *asic, uint32_t addr, struct umr_bitfield
 	}
 }
 
-static void parse_iov(struct umr_asic *asic, uint32_t addr, struct umr_bitfield *bits, uint64_t *counts, uint32_t *mask, uint32_t *cmp, uint64_t addr_mask)
+static void parse_iov(struct umr_asic *asic, uint32_t addr, struct umr_bitfield *bits, uint64_t *counts, uint32_t *mask, uint32_t *cmp, uint32_t value)
 {
 	int j;
-	uint32_t value;
 
+	(void)asic;
 	(void)mask;
 	(void)cmp;
 
 	if (addr) {
-		if (addr_mask && asic->fd.mmio < 0) {
-			value = 0;
-		} else if (!addr_mask && asic->pci.mem) {
-			value = asic->pci.mem[addr>>2];
-		} else {
-			lseek(asic->fd.mmio, addr | addr_mask, SEEK_SET);
-			if (read(asic->fd.mmio, &value, 4) != 4)
-				value = 0;
-		}
 		for (j = 0; bits[j].regname; j++)
 			if (bits[j].start != 255) {
 				if (bits[j].stop == IOV_VF) {
@@ -897,6 +876,38 @@ static struct {
 #define ENTRY(_j, _name, _bits, _opt, _tag) do { int _i = (_j); stat_counters[_i].name = _name; stat_counters[_i].bits = _bits; stat_counters[_i].opt = _opt; stat_counters[_i].tag = _tag; } while (0)
 #define ENTRY_SENSOR(_j, _name, _bits, _opt, _tag) do { int _i = (_j); stat_counters[_i].name = _name; stat_counters[_i].bits = _bits; stat_counters[_i].opt = _opt; stat_counters[_i].tag = _tag; stat_counters[_i].is_sensor = 1; } while (0)
 
+/**
+ * read_counters - Read the registers of the enabled counters
+ *
+ * Reads the register of every enabled counter with a single batched
+ * access into @values (indexed like stat_counters).  Registers that
+ * can't be read are returned as 0.
+ */
+static void read_counters(struct umr_asic *asic, uint32_t *values)
+{
+	struct umr_reg_addr regs[64];
+	uint32_t tmp[64];
+	int j, k, slot[64];
+
+	for (k = j = 0; stat_counters[j].name; j++) {
+		values[j] = 0;
+		if (!(top_options.all || *stat_counters[j].opt) || !stat_counters[j].addr)
+			continue;
+		if (stat_counters[j].is_sensor != 0 && stat_counters[j].is_sensor != 3)
+			continue;
+		if (stat_counters[j].addr_mask && asic->fd.mmio < 0)
+			continue;
+		regs[k].addr = stat_counters[j].addr | stat_counters[j].addr_mask;
+		regs[k].type = REG_MMIO;
+		slot[k++] = j;
+	}
+
+	umr_flush_writes(asic);
+	asic->reg_funcs.read_regs(asic, regs, tmp, k);
+	while (k--)
+		values[slot[k]] = tmp[k];
+}
+
 static void vi_handle_keys(int i)
 {
 	switch(i) {
@@ -1107,8 +1118,7 @@ int get_active_vf(struct umr_asic *asic, uint32_t addr)
 		if (asic->pci.mem) {
 			value = asic->pci.mem[addr>>2];
 		} else {
-			lseek(asic->fd.mmio, addr, SEEK_SET);
-			if (read(asic->fd.mmio, &value, 4) != 4)
+			if (pread(asic->fd.mmio, &value, 4, addr) != 4)
 				return 0;
 		}
 		value &= 0xF;
@@ -1125,7 +1135,9 @@ void umr_top(struct umr_asic *asic)
 	uint64_t ts;
 	char hostname[64] = { 0 };
 	char fname[64];
+	uint32_t values[64];
 	pthread_t sensor_thread;
+	struct umr_asic *sensor_asic;
 
 	// open drm file if not already open
 	if (asic->fd.drm < 0) {
@@ -1135,6 +1147,10 @@ void umr_top(struct umr_asic *asic)
 
 	if (getenv("HOSTNAME")) strcpy(hostname, getenv("HOSTNAME"));
 
+	// the counters below are found by walking every IP block
+	if (umr_materialize_asic(asic))
+		return;
+
 	// init stats
 	memset(&stat_counters, 0, sizeof stat_counters);
 	load_options();
@@ -1157,9 +1173,15 @@ void umr_top(struct umr_asic *asic)
 
 	sensor_thread_quit = 0;
 
-	// start thread to grab sensor data
-	if (pthread_create(&sensor_thread, NULL, gpu_sensor_thread, asic)) {
+	// start thread to grab sensor data with its own handle
+	sensor_asic = umr_clone_asic(asic);
+	if (!sensor_asic) {
+		fprintf(stderr, "[ERROR]: Cannot clone asic for gpu_sensor_thread\n");
+		return;
+	}
+	if (pthread_create(&sensor_thread, NULL, gpu_sensor_thread, sensor_asic)) {
 		fprintf(stderr, "[ERROR]: Cannot create gpu_sensor_thread\n");
+		umr_close_asic(sensor_asic);
 		return;
 	}
 
@@ -1192,16 +1214,17 @@ void umr_top(struct umr_asic *asic)
 		for (i = 0; i < (int)rep / (top_options.high_frequency ? 10 : 1); i++) {
 			if (!top_options.sriov.num_vf || top_options.sriov.active_vf < 0 ||
 				top_options.sriov.active_vf == get_active_vf(asic, stat_counters[2].addr)) {
+				read_counters(asic, values);
 				for (j = 0; stat_counters[j].name; j++) {
 					if (top_options.all || *stat_counters[j].opt) {
 						if (stat_counters[j].is_sensor == 0)
-							parse_bits(asic, stat_counters[j].addr, stat_counters[j].bits, stat_counters[j].counts, stat_counters[j].mask, stat_counters[j].cmp, stat_counters[j].addr_mask);
+							parse_bits(asic, stat_counters[j].addr, stat_counters[j].bits, stat_counters[j].counts, stat_counters[j].mask, stat_counters[j].cmp, values[j]);
 						else if (i == 0 && stat_counters[j].is_sensor == 1) // only parse sensors on first go-around per display
 							parse_sensors(asic, stat_counters[j].addr, stat_counters[j].bits, stat_counters[j].counts, stat_counters[j].mask, stat_counters[j].cmp, stat_counters[j].addr_mask);
 						else if (i == 0 && stat_counters[j].is_sensor == 2) // only parse drm on first go-around per display
 							parse_drm(asic, stat_counters[j].addr, stat_counters[j].bits, stat_counters[j].counts, stat_counters[j].mask, stat_counters[j].cmp, stat_counters[j].addr_mask);
 						else if (stat_counters[j].is_sensor == 3)
-							parse_iov(asic, stat_counters[j].addr, stat_counters[j].bits, stat_counters[j].counts, stat_counters[j].mask, stat_counters[j].cmp, stat_counters[j].addr_mask);
+							parse_iov(asic, stat_counters[j].addr, stat_counters[j].bits, stat_counters[j].counts, stat_counters[j].mask, stat_counters[j].cmp, values[j]);
 					}
 				}
 			}
@@ -1327,4 +1350,5 @@ void umr_top(struct umr_asic *asic)
 
 	sensor_thread_quit = 1;
 	pthread_join(sensor_thread, NULL);
+	umr_close_asic(sensor_asic);
 }
@@ -34,6 +34,8 @@ void umr_lookup(struct umr_asic *asic, char *address, char *value)
 	sscanf(value, "%"SCNx32, &num);
 
 	if (byaddress) {
+		if (umr_materialize_asic(asic))
+			return;
 		for (i = 0; i < asic->no_blocks; i++)
 		for (j = 0; j < asic->blocks[i]->no_regs; j++)
 			if (asic->blocks[i]->regs[j].type == REG_MMIO &&
@@ -60,7 +62,7 @@ void umr_lookup(struct umr_asic *asic, char *address, char *value)
 		strcpy(regname, p + 1);
 
 		for (i = 0; i < asic->no_blocks; i++)
-			if (!strcmp(asic->blocks[i]->ipname, ipname)) {
+			if (!strcmp(asic->blocks[i]->ipname, ipname) && !umr_materialize_ip_block(asic->blocks[i])) {
 				for (j = 0; j < asic->blocks[i]->no_regs; j++) {
 					if (asic->blocks[i]->regs[j].type == REG_MMIO &&
 					    !strcmp(asic->blocks[i]->regs[j].regname, regname)) {
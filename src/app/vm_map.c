@@ -0,0 +1,153 @@
+/*
+ * Copyright 2018 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umrapp.h"
+
+/* names of the PTE attribute bits printed with a range */
+static const struct {
+	int bit;
+	char *name;
+} vm_flag_names[] = {
+	{ 1, "S" },
+	{ 2, "SNOOP" },
+	{ 4, "X" },
+	{ 5, "R" },
+	{ 6, "W" },
+	{ 61, "PRT" },
+};
+
+/**
+ * print_vm_map - Print the ranges of a map
+ *
+ * Prints one line per range of contiguous mappings with the same
+ * attributes: the virtual range, the physical start address, the size
+ * and the PTE attribute bits.  Returns the number of bytes mapped.
+ */
+static uint64_t print_vm_map(struct umr_asic *asic, struct umr_vm_map *map)
+{
+	struct umr_vm_range *r;
+	uint64_t n, mapped;
+	unsigned k;
+
+	mapped = 0;
+	for (n = 0; n < map->no_ranges; n++) {
+		r = &map->ranges[n];
+		printf("%s0x%012" PRIx64 "%s-%s0x%012" PRIx64 "%s => ",
+			BLUE, r->va, RST, BLUE, r->va + r->size - 1, RST);
+		if (r->flags & 1)
+			printf("%s %s0x%012" PRIx64 "%s", (r->flags & 2) ? "sys " : "vram", YELLOW, r->pa, RST);
+		else
+			printf("%-19s", "none");
+		printf(" %8" PRIu64 " KB flags=0x%016" PRIx64, r->size >> 10, r->flags);
+		for (k = 0; k < sizeof(vm_flag_names) / sizeof(vm_flag_names[0]); k++)
+			if ((r->flags >> vm_flag_names[k].bit) & 1)
+				printf(" %s", vm_flag_names[k].name);
+		printf("\n");
+		mapped += r->size;
+	}
+	return mapped;
+}
+
+/**
+ * umr_vm_map_print - Print the address space map of a VMID
+ */
+int umr_vm_map_print(struct umr_asic *asic, uint32_t vmid)
+{
+	struct umr_vm_map *map;
+	uint64_t mapped;
+
+	map = umr_vm_map_capture(asic, vmid);
+	if (!map)
+		return -1;
+
+	mapped = print_vm_map(asic, map);
+	if (!options.quiet)
+		printf("%" PRIu64 " ranges, %" PRIu64 " KB mapped, %" PRIu64 " page tables read\n",
+			map->no_ranges, mapped >> 10, map->no_tables);
+	umr_vm_map_free(map);
+	return 0;
+}
+
+/**
+ * umr_vm_map_save - Save the address space map of a VMID to a file
+ */
+int umr_vm_map_save(struct umr_asic *asic, uint32_t vmid, char *filename)
+{
+	struct umr_vm_map *map;
+	int r;
+
+	map = umr_vm_map_capture(asic, vmid);
+	if (!map)
+		return -1;
+	r = umr_vm_map_write(map, filename);
+	if (!r && !options.quiet)
+		printf("Saved %" PRIu64 " ranges to %s\n", map->no_ranges, filename);
+	umr_vm_map_free(map);
+	return r;
+}
+
+/**
+ * umr_vm_map_print_all - Print the address space maps of every VMID
+ *
+ * Walks VMIDs 0..15 of the GFX hub and (on AI and newer) the MM hub
+ * concurrently with the "threads=<n>" option number of threads (one
+ * per CPU by default) and prints the maps of the VMIDs that map any
+ * memory in order.
+ */
+int umr_vm_map_print_all(struct umr_asic *asic)
+{
+	struct umr_vm_map *maps[32];
+	uint32_t vmids[32];
+	uint64_t ranges, walked;
+	int64_t reads;
+	int n, x, used;
+
+	for (n = x = 0; x < 16; x++) {
+		vmids[n++] = UMR_GFX_HUB | x;
+		vmids[n++] = UMR_MM_HUB | x;
+	}
+
+	reads = umr_vm_map_capture_many(asic, vmids, n, asic->options.dump_threads, maps);
+	if (reads < 0)
+		return -1;
+
+	ranges = walked = 0;
+	for (used = x = 0; x < n; x++) {
+		if (!maps[x])
+			continue;
+		walked += maps[x]->no_tables;
+		if (maps[x]->no_ranges) {
+			printf("%s%s VMID %u%s:\n", CYAN, (vmids[x] & 0xFF00) == UMR_MM_HUB ? "mmhub" : "gfx",
+				(unsigned)(vmids[x] & 0xFF), RST);
+			print_vm_map(asic, maps[x]);
+			ranges += maps[x]->no_ranges;
+			++used;
+		}
+		umr_vm_map_free(maps[x]);
+	}
+	if (!options.quiet)
+		printf("%d VMIDs with mappings, %" PRIu64 " ranges, %" PRIu64 " page tables walked, %" PRId64 " read\n",
+			used, ranges, walked, reads);
+	return 0;
+}
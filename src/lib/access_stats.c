@@ -0,0 +1,552 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <time.h>
+
+/*
+ * Access statistics are gathered by replacing the register and memory
+ * callbacks of a device with wrappers that time and count each call
+ * before handing it to the original callback.  Nothing is installed
+ * unless umr_enable_access_stats() is called so there is no cost when
+ * they are not wanted.
+ *
+ * Latencies are kept in log-linear histograms: values below 8ns have a
+ * bucket each and every power of two above that is split into 8 equal
+ * buckets so a bucket is never more than 12.5% wide.
+ */
+#define STATS_SUB_BITS    3
+#define STATS_SUB         (1 << STATS_SUB_BITS)
+#define STATS_BUCKETS     ((64 - STATS_SUB_BITS + 1) * STATS_SUB)
+#define STATS_TOP_REGS    16
+
+enum stats_kind {
+	STATS_REG_READ,
+	STATS_REG_WRITE = STATS_REG_READ + UMR_NUM_REGCLASS,
+	STATS_REG_BATCH = STATS_REG_WRITE + UMR_NUM_REGCLASS,
+	STATS_REG_BATCH_WRITE,
+	STATS_SRAM_READ,
+	STATS_SRAM_WRITE,
+	STATS_VRAM_READ,
+	STATS_VRAM_WRITE,
+	STATS_NUM_KINDS,
+};
+
+static const char *regclass_names[UMR_NUM_REGCLASS] = { "mmio", "didt", "smc", "pcie" };
+
+struct stats_hist {
+	uint64_t count, bytes, total_ns, min_ns, max_ns;
+	uint64_t buckets[STATS_BUCKETS];
+};
+
+struct stats_reg {
+	uint64_t addr, reads, writes, total_ns;
+	enum regclass type;
+	int used;
+};
+
+struct umr_access_stats {
+	// the device that installed the wrappers (NULL once disabled)
+	struct umr_asic *owner;
+	// devices using these statistics (XGMI nodes share the owner's)
+	int refs;
+	struct umr_register_access_funcs reg_funcs;
+	struct umr_memory_access_funcs mem_funcs;
+
+	pthread_mutex_t lock;
+	struct stats_hist hist[STATS_NUM_KINDS];
+	struct stats_reg *regs;
+	uint32_t no_regs, regs_mask;
+};
+
+static uint64_t stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int stats_bucket(uint64_t ns)
+{
+	int msb;
+
+	if (ns < STATS_SUB)
+		return ns;
+	msb = 63 - __builtin_clzll(ns);
+	return (msb - STATS_SUB_BITS + 1) * STATS_SUB + ((ns >> (msb - STATS_SUB_BITS)) & (STATS_SUB - 1));
+}
+
+/* smallest latency that falls in bucket @b */
+static uint64_t stats_bucket_floor(int b)
+{
+	int msb;
+
+	if (b < STATS_SUB)
+		return b;
+	msb = b / STATS_SUB + STATS_SUB_BITS - 1;
+	return (uint64_t)(STATS_SUB + (b % STATS_SUB)) << (msb - STATS_SUB_BITS);
+}
+
+static void stats_hist_add(struct stats_hist *h, uint64_t ns, uint64_t bytes)
+{
+	if (!h->count || ns < h->min_ns)
+		h->min_ns = ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+	++h->count;
+	h->bytes += bytes;
+	h->total_ns += ns;
+	++h->buckets[stats_bucket(ns)];
+}
+
+static uint64_t stats_hist_percentile(struct stats_hist *h, int pct)
+{
+	uint64_t want, seen;
+	int b;
+
+	want = (h->count * pct + 99) / 100;
+	for (seen = b = 0; b < STATS_BUCKETS; b++) {
+		seen += h->buckets[b];
+		if (seen >= want && seen)
+			break;
+	}
+	if (b == STATS_BUCKETS || stats_bucket_floor(b) > h->max_ns)
+		return h->max_ns;
+	if (stats_bucket_floor(b) < h->min_ns)
+		return h->min_ns;
+	return stats_bucket_floor(b);
+}
+
+static uint32_t stats_hash(uint64_t addr, enum regclass type)
+{
+	uint64_t h = (addr ^ ((uint64_t)type << 56)) * 0x9E3779B97F4A7C15ULL;
+	return h >> 32;
+}
+
+/* find or add the counters for a register, returns NULL if out of memory */
+static struct stats_reg *stats_find_reg(struct umr_access_stats *st, uint64_t addr, enum regclass type)
+{
+	struct stats_reg *e, *old;
+	uint32_t x, n, slot;
+
+	if (st->no_regs * 2 >= st->regs_mask) {
+		old = st->regs;
+		n = st->regs_mask + 1;
+		e = calloc(n * 2, sizeof e[0]);
+		if (!e)
+			return NULL;
+		st->regs = e;
+		st->regs_mask = n * 2 - 1;
+		for (x = 0; old && x < n; x++) {
+			if (!old[x].used)
+				continue;
+			slot = stats_hash(old[x].addr, old[x].type) & st->regs_mask;
+			while (st->regs[slot].used)
+				slot = (slot + 1) & st->regs_mask;
+			st->regs[slot] = old[x];
+		}
+		free(old);
+	}
+
+	slot = stats_hash(addr, type) & st->regs_mask;
+	for (;;) {
+		e = &st->regs[slot];
+		if (!e->used) {
+			e->used = 1;
+			e->addr = addr;
+			e->type = type;
+			++st->no_regs;
+			return e;
+		}
+		if (e->addr == addr && e->type == type)
+			return e;
+		slot = (slot + 1) & st->regs_mask;
+	}
+}
+
+static void stats_count_reg(struct umr_access_stats *st, uint64_t addr, enum regclass type, int write, uint64_t ns)
+{
+	struct stats_reg *e;
+
+	if ((unsigned)type >= UMR_NUM_REGCLASS)
+		return;
+	e = stats_find_reg(st, addr, type);
+	if (e) {
+		if (write)
+			++e->writes;
+		else
+			++e->reads;
+		e->total_ns += ns;
+	}
+}
+
+static uint32_t stats_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
+{
+	struct umr_access_stats *st = asic->access_stats;
+	uint64_t t;
+	uint32_t value;
+
+	t = stats_now();
+	value = st->reg_funcs.read_reg(asic, addr, type);
+	t = stats_now() - t;
+
+	pthread_mutex_lock(&st->lock);
+	if ((unsigned)type < UMR_NUM_REGCLASS)
+		stats_hist_add(&st->hist[STATS_REG_READ + type], t, 4);
+	stats_count_reg(st, addr, type, 0, t);
+	pthread_mutex_unlock(&st->lock);
+	return value;
+}
+
+static int stats_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
+{
+	struct umr_access_stats *st = asic->access_stats;
+	uint64_t t;
+	int r;
+
+	t = stats_now();
+	r = st->reg_funcs.write_reg(asic, addr, value, type);
+	t = stats_now() - t;
+
+	pthread_mutex_lock(&st->lock);
+	if ((unsigned)type < UMR_NUM_REGCLASS)
+		stats_hist_add(&st->hist[STATS_REG_WRITE + type], t, 4);
+	stats_count_reg(st, addr, type, 1, t);
+	pthread_mutex_unlock(&st->lock);
+	return r;
+}
+
+/* a batch is timed as a whole, its registers are counted individually */
+static int stats_read_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n)
+{
+	struct umr_access_stats *st = asic->access_stats;
+	uint64_t t;
+	int r;
+
+	t = stats_now();
+	r = st->reg_funcs.read_regs(asic, regs, values, n);
+	t = stats_now() - t;
+
+	umr_count_reg_reads(asic, regs, n, t);
+	return r;
+}
+
+static int stats_write_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, const uint32_t *values, int n)
+{
+	struct umr_access_stats *st = asic->access_stats;
+	uint64_t t;
+	int r, x;
+
+	t = stats_now();
+	r = st->reg_funcs.write_regs(asic, regs, values, n);
+	t = stats_now() - t;
+
+	if (n <= 0)
+		return r;
+	pthread_mutex_lock(&st->lock);
+	stats_hist_add(&st->hist[STATS_REG_BATCH_WRITE], t, 4 * (uint64_t)n);
+	for (x = 0; x < n; x++)
+		stats_count_reg(st, regs[x].addr, regs[x].type, 1, t / n);
+	pthread_mutex_unlock(&st->lock);
+	return r;
+}
+
+/**
+ * umr_count_reg_reads - Add register reads made outside of the callbacks
+ *
+ * For code that reads registers directly (for instance from its own
+ * debugfs descriptors) to report a batch of @n reads of @regs that took
+ * @ns nanoseconds.  Does nothing if statistics are not enabled.
+ */
+void umr_count_reg_reads(struct umr_asic *asic, const struct umr_reg_addr *regs, int n, uint64_t ns)
+{
+	struct umr_access_stats *st = asic->access_stats;
+	int x;
+
+	if (!st || n <= 0)
+		return;
+
+	pthread_mutex_lock(&st->lock);
+	stats_hist_add(&st->hist[STATS_REG_BATCH], ns, 4 * (uint64_t)n);
+	for (x = 0; x < n; x++)
+		stats_count_reg(st, regs[x].addr, regs[x].type, 0, ns / n);
+	pthread_mutex_unlock(&st->lock);
+}
+
+static int stats_access_sram(struct umr_asic *asic, uint64_t address, uint32_t size, void *dst, int write_en)
+{
+	struct umr_access_stats *st = asic->access_stats;
+	uint64_t t;
+	int r;
+
+	t = stats_now();
+	r = st->mem_funcs.access_sram(asic, address, size, dst, write_en);
+	t = stats_now() - t;
+
+	pthread_mutex_lock(&st->lock);
+	stats_hist_add(&st->hist[write_en ? STATS_SRAM_WRITE : STATS_SRAM_READ], t, size);
+	pthread_mutex_unlock(&st->lock);
+	return r;
+}
+
+static int stats_access_linear_vram(struct umr_asic *asic, uint64_t address, uint32_t size, void *data, int write_en)
+{
+	struct umr_access_stats *st = asic->access_stats;
+	uint64_t t;
+	int r;
+
+	t = stats_now();
+	r = st->mem_funcs.access_linear_vram(asic, address, size, data, write_en);
+	t = stats_now() - t;
+
+	pthread_mutex_lock(&st->lock);
+	stats_hist_add(&st->hist[write_en ? STATS_VRAM_WRITE : STATS_VRAM_READ], t, size);
+	pthread_mutex_unlock(&st->lock);
+	return r;
+}
+
+/**
+ * umr_enable_access_stats - Start gathering register and memory access statistics
+ *
+ * Wraps the register and memory callbacks of @asic so that every
+ * access is counted and timed.  Callbacks must be assigned before this
+ * is called.  Callbacks later copied to XGMI nodes with
+ * umr_apply_callbacks() are counted as well.
+ *
+ * Returns 0 on success.
+ */
+int umr_enable_access_stats(struct umr_asic *asic)
+{
+	struct umr_access_stats *st;
+
+	if (asic->access_stats)
+		return 0;
+
+	st = calloc(1, sizeof *st);
+	if (!st) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return -1;
+	}
+	st->owner = asic;
+	st->refs = 1;
+	st->reg_funcs = asic->reg_funcs;
+	st->mem_funcs = asic->mem_funcs;
+	pthread_mutex_init(&st->lock, NULL);
+
+	if (asic->reg_funcs.read_reg)
+		asic->reg_funcs.read_reg = stats_read_reg;
+	if (asic->reg_funcs.write_reg)
+		asic->reg_funcs.write_reg = stats_write_reg;
+	if (asic->reg_funcs.read_regs)
+		asic->reg_funcs.read_regs = stats_read_regs;
+	if (asic->reg_funcs.write_regs)
+		asic->reg_funcs.write_regs = stats_write_regs;
+	if (asic->mem_funcs.access_sram)
+		asic->mem_funcs.access_sram = stats_access_sram;
+	if (asic->mem_funcs.access_linear_vram)
+		asic->mem_funcs.access_linear_vram = stats_access_linear_vram;
+	asic->access_stats = st;
+	return 0;
+}
+
+/**
+ * umr_share_access_stats - Count the accesses of another device
+ *
+ * Used when the callbacks of @asic are copied to @node so the wrappers
+ * called on behalf of @node find the statistics of @asic.
+ */
+void umr_share_access_stats(struct umr_asic *asic, struct umr_asic *node)
+{
+	if (node == asic || node->access_stats == asic->access_stats)
+		return;
+	umr_disable_access_stats(node);
+	node->access_stats = asic->access_stats;
+	if (node->access_stats)
+		++node->access_stats->refs;
+}
+
+/**
+ * umr_disable_access_stats - Stop gathering access statistics
+ *
+ * Restores the callbacks that were in place when
+ * umr_enable_access_stats() was called.  The statistics are freed once
+ * no device refers to them anymore.
+ */
+void umr_disable_access_stats(struct umr_asic *asic)
+{
+	struct umr_access_stats *st = asic->access_stats;
+
+	if (!st)
+		return;
+	asic->access_stats = NULL;
+	if (st->owner == asic) {
+		asic->reg_funcs = st->reg_funcs;
+		asic->mem_funcs = st->mem_funcs;
+		st->owner = NULL;
+	}
+	if (--st->refs)
+		return;
+
+	pthread_mutex_destroy(&st->lock);
+	free(st->regs);
+	free(st);
+}
+
+static const char *stats_kind_name(int k, char *buf)
+{
+	if (k < STATS_REG_WRITE)
+		sprintf(buf, "%s_read", regclass_names[k - STATS_REG_READ]);
+	else if (k < STATS_REG_BATCH)
+		sprintf(buf, "%s_write", regclass_names[k - STATS_REG_WRITE]);
+	else if (k == STATS_REG_BATCH)
+		strcpy(buf, "reg_batch_read");
+	else if (k == STATS_REG_BATCH_WRITE)
+		strcpy(buf, "reg_batch_write");
+	else if (k == STATS_SRAM_READ)
+		strcpy(buf, "sram_read");
+	else if (k == STATS_SRAM_WRITE)
+		strcpy(buf, "sram_write");
+	else if (k == STATS_VRAM_READ)
+		strcpy(buf, "vram_read");
+	else
+		strcpy(buf, "vram_write");
+	return buf;
+}
+
+/* name of a counted register or NULL if not in the database */
+static const char *stats_reg_name(struct umr_asic *asic, struct stats_reg *e, char *buf, int size)
+{
+	struct umr_ip_block *ip;
+	struct umr_reg *reg;
+	uint64_t addr = e->addr;
+
+	// drop bank selection bits
+	if (addr & (3ULL << 61))
+		addr &= 0xFFFFFF;
+	if (e->type == REG_MMIO)
+		addr /= 4;
+	reg = umr_find_reg_by_addr_type(asic, addr, e->type, &ip);
+	if (!reg)
+		return NULL;
+	snprintf(buf, size, "%s.%s", ip->ipname, reg->regname);
+	return buf;
+}
+
+static int stats_reg_cmp(const void *a, const void *b)
+{
+	const struct stats_reg *ra = *(const struct stats_reg **)a, *rb = *(const struct stats_reg **)b;
+	uint64_t na = ra->reads + ra->writes, nb = rb->reads + rb->writes;
+
+	if (na != nb)
+		return na > nb ? -1 : 1;
+	return ra->addr < rb->addr ? -1 : ra->addr > rb->addr;
+}
+
+/**
+ * umr_print_access_stats - Print the gathered access statistics
+ *
+ * @f: Where to print to
+ * @json: Print a JSON object instead of text
+ *
+ * Prints the number of accesses, bytes and a latency summary for every
+ * class of access seen followed by the most frequently accessed
+ * registers.  Can be called any number of times while the statistics
+ * are enabled.
+ */
+void umr_print_access_stats(struct umr_asic *asic, FILE *f, int json)
+{
+	struct umr_access_stats *st = asic->access_stats;
+	struct stats_reg **top;
+	struct stats_hist *h;
+	char kind[32], name[256];
+	const char *regname;
+	uint32_t x, no_top;
+	int k, first;
+
+	if (!st)
+		return;
+
+	pthread_mutex_lock(&st->lock);
+
+	// most accessed registers
+	top = calloc(st->no_regs + 1, sizeof top[0]);
+	no_top = 0;
+	if (top) {
+		for (x = 0; st->regs && x <= st->regs_mask; x++)
+			if (st->regs[x].used)
+				top[no_top++] = &st->regs[x];
+		qsort(top, no_top, sizeof top[0], stats_reg_cmp);
+		if (no_top > STATS_TOP_REGS)
+			no_top = STATS_TOP_REGS;
+	}
+
+	if (json) {
+		fprintf(f, "{\n\t\"asic\": \"%s\",\n\t\"accesses\": {", asic->asicname);
+		for (first = 1, k = 0; k < STATS_NUM_KINDS; k++) {
+			h = &st->hist[k];
+			if (!h->count)
+				continue;
+			fprintf(f, "%s\n\t\t\"%s\": { \"count\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"total_ns\": %" PRIu64
+				", \"min_ns\": %" PRIu64 ", \"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64
+				", \"max_ns\": %" PRIu64 " }",
+				first ? "" : ",", stats_kind_name(k, kind), h->count, h->bytes, h->total_ns,
+				h->min_ns, stats_hist_percentile(h, 50), stats_hist_percentile(h, 90),
+				stats_hist_percentile(h, 99), h->max_ns);
+			first = 0;
+		}
+		fprintf(f, "\n\t},\n\t\"registers_accessed\": %" PRIu32 ",\n\t\"top_registers\": [", st->no_regs);
+		for (x = 0; x < no_top; x++) {
+			regname = stats_reg_name(asic, top[x], name, sizeof name);
+			fprintf(f, "%s\n\t\t{ \"name\": \"%s\", \"class\": \"%s\", \"addr\": \"0x%" PRIx64 "\", \"reads\": %" PRIu64
+				", \"writes\": %" PRIu64 ", \"total_ns\": %" PRIu64 " }",
+				x ? "," : "", regname ? regname : "", regclass_names[top[x]->type], top[x]->addr,
+				top[x]->reads, top[x]->writes, top[x]->total_ns);
+		}
+		fprintf(f, "\n\t]\n}\n");
+	} else {
+		fprintf(f, "Access statistics for %s:\n", asic->asicname);
+		fprintf(f, "%-16s %10s %12s %12s %10s %10s %10s %10s %10s\n",
+			"access", "count", "bytes", "total_us", "min_ns", "p50_ns", "p90_ns", "p99_ns", "max_ns");
+		for (k = 0; k < STATS_NUM_KINDS; k++) {
+			h = &st->hist[k];
+			if (!h->count)
+				continue;
+			fprintf(f, "%-16s %10" PRIu64 " %12" PRIu64 " %12" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+				stats_kind_name(k, kind), h->count, h->bytes, h->total_ns / 1000,
+				h->min_ns, stats_hist_percentile(h, 50), stats_hist_percentile(h, 90),
+				stats_hist_percentile(h, 99), h->max_ns);
+		}
+		fprintf(f, "\n%" PRIu32 " registers accessed, most frequent:\n", st->no_regs);
+		for (x = 0; x < no_top; x++) {
+			regname = stats_reg_name(asic, top[x], name, sizeof name);
+			fprintf(f, "\t%-48s %s 0x%08" PRIx64 " reads %" PRIu64 " writes %" PRIu64 " total %" PRIu64 " us\n",
+				regname ? regname : "<unknown>", regclass_names[top[x]->type], top[x]->addr,
+				top[x]->reads, top[x]->writes, top[x]->total_ns / 1000);
+		}
+	}
+
+	free(top);
+	pthread_mutex_unlock(&st->lock);
+}
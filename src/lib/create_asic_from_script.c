@@ -23,6 +23,7 @@
  *
  */
 #include "umr.h"
+#include <inttypes.h>
 
 static void skip_whitespace(char **t)
 {
@@ -131,6 +132,7 @@ static int add_bit(struct umr_asic *asic, char **t)
 {
 	char ipname[512], regname[512], bitname[512], start[512], stop[512];
 	int i, j, k, istart, istop;
+	void *tmp;
 
 	memset(ipname, 0, sizeof ipname);
 	memset(regname, 0, sizeof regname);
@@ -163,25 +165,30 @@ static int add_bit(struct umr_asic *asic, char **t)
 		return -1;
 	}
 
-	// find reg
-	for (k = -1, j = 0; j < asic->blocks[i]->no_regs; j++) {
-		if (!strcmp(asic->blocks[i]->regs[j].regname, regname)) {
-			k = j;
-			break;
+	// bits normally follow the register they belong to so try the
+	// last register added to the block before searching for it
+	j = asic->blocks[i]->no_regs - 1;
+	if (j >= 0 && strcmp(asic->blocks[i]->regs[j].regname, regname)) {
+		for (k = -1, j = 0; j < asic->blocks[i]->no_regs; j++) {
+			if (!strcmp(asic->blocks[i]->regs[j].regname, regname)) {
+				k = j;
+				break;
+			}
 		}
+		j = k;
 	}
-	j = k;
 
 	if (j == -1) {
 		fprintf(stderr, "[ERROR]: Cannot add bit to register that is not defined\n");
 		return -1;
 	}
 
-	// allocate bit array if needed
-	if (!asic->blocks[i]->regs[j].no_bits) {
-		asic->blocks[i]->regs[j].bits = calloc(64, sizeof(struct umr_bitfield));
-		if (!asic->blocks[i]->regs[j].bits)
+	// grow bit array if necessary
+	if (!(asic->blocks[i]->regs[j].no_bits & 31)) {
+		tmp = realloc(asic->blocks[i]->regs[j].bits, (asic->blocks[i]->regs[j].no_bits + 32) * sizeof(struct umr_bitfield));
+		if (!tmp)
 			goto out_of_mem;
+		asic->blocks[i]->regs[j].bits = tmp;
 	}
 
 	// add bit
@@ -207,6 +214,21 @@ static void chomp(char *str)
 	}
 }
 
+/* does @name point at a binary regdb file rather than a script */
+static int is_regdb(char *name)
+{
+	char magic[8];
+	FILE *f;
+	int r;
+
+	f = fopen(name, "rb");
+	if (!f)
+		return 0;
+	r = fread(magic, 1, sizeof magic, f) == sizeof magic && !memcmp(magic, UMR_REGDB_MAGIC, sizeof magic);
+	fclose(f);
+	return r;
+}
+
 // create an asic from a script with multiples of the following lines
 // reg ${ipname} ${regname} ${type} ${addr}
 // bit ${ipname} ${regname} ${bitname} ${start} ${stop}
@@ -286,6 +308,9 @@ error:
  * @options - The options to bind to the asic
  * @name - The path to the NPI script file
  *
+ * If the file is a binary regdb (see umr_regdb_write()) it is
+ * loaded with umr_create_asic_from_regdb() instead.
+ *
  * Returns an asic device on success or NULL if failure
  */
 struct umr_asic *umr_create_asic_from_script(struct umr_options *options, char *name)
@@ -297,6 +322,9 @@ struct umr_asic *umr_create_asic_from_script(struct umr_options *options, char *
 	if (!options->use_pci)
 		fprintf(stderr, "[WARNING]: Should use --pci when using create_asic_from_script()\n");
 
+	if (is_regdb(name))
+		return umr_create_asic_from_regdb(options, name);
+
 	txt = name + strlen(name) - 1;
 	// walk back to start or first
 	while (txt != name) {
@@ -24,41 +24,95 @@
  */
 #include "umr.h"
 
-#define LIST_SIZE (1UL << 18)
+static int comp_addr_entries(const void *A, const void *B)
+{
+	const struct umr_addr_index_entry *a = A, *b = B;
+
+	if (a->addr != b->addr)
+		return a->addr < b->addr ? -1 : 1;
+	if (a->ip != b->ip)
+		return a->ip < b->ip ? -1 : 1;
+	return a->reg < b->reg ? -1 : (a->reg > b->reg);
+}
 
 /**
- * umr_create_mmio_accel - Create MMIO accelerator table
+ * umr_free_mmio_accel - Free the register address lookup tables
+ */
+void umr_free_mmio_accel(struct umr_asic *asic)
+{
+	int t;
+
+	for (t = 0; t < UMR_NUM_REGCLASS; t++) {
+		// tables adopted from a regdb file live in its mapping
+		if (!asic->mmio_accel.mapped)
+			free(asic->mmio_accel.entries[t]);
+		asic->mmio_accel.entries[t] = NULL;
+		asic->mmio_accel.no_entries[t] = 0;
+	}
+	asic->mmio_accel.built = 0;
+	asic->mmio_accel.mapped = 0;
+}
+
+/**
+ * umr_create_mmio_accel - Create register address lookup tables
  *
  * @asic:  Device to create accelerator for
  *
- * This function creates lookup tables that quickly convert
- * an offsetted MMIO address into a pointer to register and ip
- * block structures.
+ * This function creates one table per register class (MMIO, DIDT,
+ * SMC and PCIE) sorted by register address.  Each entry holds
+ * the IP block and register index so a binary search converts an
+ * address into the register and IP block structures without any
+ * limit on the width of the address.  Registers sharing an address
+ * are ordered by IP block and register index.
  */
 int umr_create_mmio_accel(struct umr_asic *asic)
 {
-	int i, j;
+	uint32_t n[UMR_NUM_REGCLASS];
+	int i, j, t;
 
-	// create flat array of registers
-	asic->mmio_accel.reglist = calloc(LIST_SIZE, sizeof *asic->mmio_accel.reglist);
-	asic->mmio_accel.iplist  = calloc(LIST_SIZE, sizeof *asic->mmio_accel.iplist);
-	if (!asic->mmio_accel.reglist || !asic->mmio_accel.iplist) {
-		free(asic->mmio_accel.iplist);
-		free(asic->mmio_accel.reglist);
+	umr_free_mmio_accel(asic);
+	if (umr_materialize_asic(asic))
 		return -1;
+	umr_attach_shared_indices(asic);
+	if (asic->mmio_accel.built)
+		return 0;
+
+	// count registers per class
+	memset(n, 0, sizeof n);
+	for (i = 0; i < asic->no_blocks; i++)
+		for (j = 0; j < asic->blocks[i]->no_regs; j++)
+			if ((unsigned)asic->blocks[i]->regs[j].type < UMR_NUM_REGCLASS)
+				++n[asic->blocks[i]->regs[j].type];
+
+	for (t = 0; t < UMR_NUM_REGCLASS; t++) {
+		if (!n[t])
+			continue;
+		asic->mmio_accel.entries[t] = calloc(n[t], sizeof asic->mmio_accel.entries[t][0]);
+		if (!asic->mmio_accel.entries[t]) {
+			umr_free_mmio_accel(asic);
+			return -1;
+		}
 	}
 
+	// populate and sort them
 	for (i = 0; i < asic->no_blocks; i++) {
 		for (j = 0; j < asic->blocks[i]->no_regs; j++) {
-			if (asic->blocks[i]->regs[j].type == REG_MMIO) {
-				if (asic->blocks[i]->regs[j].addr >= LIST_SIZE) {
-					fprintf(stderr, "[BUG]: Register address width too large for scan_log\n");
-					continue;
-				}
-				asic->mmio_accel.reglist[asic->blocks[i]->regs[j].addr] = &asic->blocks[i]->regs[j];
-				asic->mmio_accel.iplist[asic->blocks[i]->regs[j].addr]  = asic->blocks[i];
-			}
+			struct umr_addr_index_entry *e;
+
+			t = asic->blocks[i]->regs[j].type;
+			if ((unsigned)t >= UMR_NUM_REGCLASS)
+				continue;
+			e = &asic->mmio_accel.entries[t][asic->mmio_accel.no_entries[t]++];
+			e->addr = asic->blocks[i]->regs[j].addr;
+			e->ip   = i;
+			e->reg  = j;
 		}
 	}
+	for (t = 0; t < UMR_NUM_REGCLASS; t++)
+		if (asic->mmio_accel.no_entries[t])
+			qsort(asic->mmio_accel.entries[t], asic->mmio_accel.no_entries[t], sizeof asic->mmio_accel.entries[t][0], comp_addr_entries);
+
+	asic->mmio_accel.built = 1;
+	umr_publish_shared_indices(asic);
 	return 0;
 }
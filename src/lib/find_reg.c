@@ -48,43 +48,286 @@ int istr_cmp(const char* a, const char* b)
 	return 1;
 }
 
-int expression_matches(const char* str, const char* pattern)
+/* case insensitive FNV-1a hash of a register name */
+static uint32_t istr_hash(const char *str)
 {
-	const char *cp = NULL, *mp = NULL;
+	uint32_t h = 2166136261UL;
 
-	while ((*str) && (*pattern != '*')) {
-		if ((toupper(*pattern) != toupper(*str)) && (*pattern != '?')) {
-			return 0;
+	while (*str) {
+		h ^= (uint32_t)toupper((unsigned char)*str++);
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+/* name of register @j of @ip without building the block's register array */
+static const char *block_regname(const struct umr_ip_block *ip, int j)
+{
+	if (ip->regs)
+		return ip->regs[j].regname;
+	return ip->soc15.regs ? ip->soc15.regs[j].regname : NULL;
+}
+
+/**
+ * umr_create_name_index - Create register name lookup table
+ *
+ * @asic:  Device to create the index for
+ *
+ * Builds an open addressed hash table that maps (case insensitive)
+ * register names to their IP block and register indices.  Registers
+ * are inserted in block order so that probing visits registers
+ * sharing a name in the same order a linear scan would find them.
+ */
+int umr_create_name_index(struct umr_asic *asic)
+{
+	struct umr_name_index_entry *table;
+	uint32_t n, size, h, x;
+	int i, j;
+
+	umr_attach_shared_indices(asic);
+	if (asic->name_index.table)
+		return 0;
+
+	for (n = 0, i = 0; i < asic->no_blocks; i++)
+		n += asic->blocks[i]->no_regs;
+
+	// keep the load factor at or below 50%
+	for (size = 16; size < 2 * n; size <<= 1);
+
+	table = calloc(size, sizeof *table);
+	if (!table)
+		return -1;
+
+	for (i = 0; i < asic->no_blocks; i++) {
+		for (j = 0; j < asic->blocks[i]->no_regs; j++) {
+			const char *name = block_regname(asic->blocks[i], j);
+
+			if (!name)
+				continue;
+			h = istr_hash(name);
+			for (x = h & (size - 1); table[x].ip; x = (x + 1) & (size - 1));
+			table[x].hash = h;
+			table[x].ip   = i + 1;
+			table[x].reg  = j;
 		}
-		str++;
-		pattern++;
 	}
 
-	while (*str) {
-		if (*pattern == '*') {
-			if (!*++pattern) {
-				return 1;
+	asic->name_index.table = table;
+	asic->name_index.mask  = size - 1;
+	umr_publish_shared_indices(asic);
+	return 0;
+}
+
+/**
+ * umr_invalidate_reg_indices - Drop lookup tables built from the register database
+ *
+ * Must be called whenever IP blocks, registers or bitfields of @asic
+ * are added, edited or removed.  The tables are rebuilt on the next
+ * lookup that needs them.  Register values kept by @asic are dropped
+ * as well since they are laid out like the blocks.
+ */
+void umr_invalidate_reg_indices(struct umr_asic *asic)
+{
+	umr_free_mmio_accel(asic);
+	if (!asic->name_index.mapped)
+		free(asic->name_index.table);
+	asic->name_index.table = NULL;
+	asic->name_index.mask = 0;
+	asic->name_index.mapped = 0;
+	if (!asic->trigram_index.mapped) {
+		free(asic->trigram_index.offsets);
+		free(asic->trigram_index.ids);
+	}
+	asic->trigram_index.offsets = NULL;
+	asic->trigram_index.ids = NULL;
+	asic->trigram_index.mapped = 0;
+	umr_release_shared_indices(asic);
+	umr_free_reg_values(asic);
+	memset(&asic->handle_cache, 0, sizeof asic->handle_cache);
+}
+
+/* find the first register named @regname in a block whose name starts with @ip (if not NULL) */
+static struct umr_reg *find_reg_by_name(struct umr_asic *asic, const char *ip, const char *regname)
+{
+	struct umr_name_index_entry *e;
+	struct umr_ip_block *blk;
+	uint32_t h, x;
+	int i, j;
+
+	if (!regname)
+		return NULL;
+
+	if (!asic->name_index.table && umr_create_name_index(asic)) {
+		// no memory for the index so fall back to a linear scan
+		for (i = 0; i < asic->no_blocks; i++) {
+			if (ip && strncmp(asic->blocks[i]->ipname, ip, strlen(ip)))
+				continue;
+			if (umr_materialize_ip_block(asic->blocks[i]))
+				return NULL;
+			for (j = 0; j < asic->blocks[i]->no_regs; j++)
+				if (istr_cmp(asic->blocks[i]->regs[j].regname, regname))
+					return &asic->blocks[i]->regs[j];
+		}
+		return NULL;
+	}
+
+	h = istr_hash(regname);
+	for (x = h & asic->name_index.mask; asic->name_index.table[x].ip; x = (x + 1) & asic->name_index.mask) {
+		e = &asic->name_index.table[x];
+		if (e->hash != h)
+			continue;
+		blk = asic->blocks[e->ip - 1];
+		if (ip && strncmp(blk->ipname, ip, strlen(ip)))
+			continue;
+		if (istr_cmp(block_regname(blk, e->reg), regname))
+			return umr_materialize_ip_block(blk) ? NULL : &blk->regs[e->reg];
+	}
+	return NULL;
+}
+
+#define TRIGRAM_BITS     14
+#define TRIGRAM_REG_BITS 20
+
+/* bucket of the (case insensitive) three characters at @s */
+static uint32_t trigram_bucket(const char *s)
+{
+	uint32_t v;
+
+	v = ((uint32_t)toupper((unsigned char)s[0]) << 16) |
+	    ((uint32_t)toupper((unsigned char)s[1]) << 8) |
+	    (uint32_t)toupper((unsigned char)s[2]);
+	return (uint32_t)(v * 2654435761UL) >> (32 - TRIGRAM_BITS);
+}
+
+/**
+ * umr_create_trigram_index - Create register name trigram index
+ *
+ * Builds posting lists that map every (case insensitive) three
+ * character substring of the register names to the registers that
+ * contain it.  Each register appears at most once per list and lists
+ * are in block then register order.  Entries are the block index
+ * shifted left by TRIGRAM_REG_BITS ORed with the register index.
+ */
+int umr_create_trigram_index(struct umr_asic *asic)
+{
+	uint32_t *offsets, *last, *ids, id, b;
+	const char *name;
+	int i, j, x, len, pass;
+
+	umr_attach_shared_indices(asic);
+	if (asic->trigram_index.offsets)
+		return 0;
+
+	if (asic->no_blocks >= (1 << (32 - TRIGRAM_REG_BITS)))
+		return -1;
+	for (i = 0; i < asic->no_blocks; i++)
+		if (asic->blocks[i]->no_regs >= (1 << TRIGRAM_REG_BITS))
+			return -1;
+
+	offsets = calloc((1 << TRIGRAM_BITS) + 1, sizeof offsets[0]);
+	last = calloc(1 << TRIGRAM_BITS, sizeof last[0]);
+	ids = NULL;
+	if (!offsets || !last)
+		goto error;
+
+	// count the lists on the first pass then fill them on the second
+	for (pass = 0; pass < 2; pass++) {
+		memset(last, 0xFF, (1 << TRIGRAM_BITS) * sizeof last[0]);
+		for (i = 0; i < asic->no_blocks; i++) {
+			for (j = 0; j < asic->blocks[i]->no_regs; j++) {
+				name = block_regname(asic->blocks[i], j);
+				if (!name)
+					continue;
+				id = ((uint32_t)i << TRIGRAM_REG_BITS) | j;
+				len = strlen(name);
+				for (x = 0; x + 3 <= len; x++) {
+					b = trigram_bucket(name + x);
+					if (last[b] == id)
+						continue;
+					last[b] = id;
+					if (pass)
+						ids[offsets[b]++] = id;
+					else
+						++offsets[b + 1];
+				}
 			}
-			mp = pattern;
-			cp = str + 1;
-		} else if ((toupper(*pattern) == toupper(*str)) || (*pattern == '?')) {
-			pattern++;
-			str++;
-		} else {
-			pattern = mp;
-			str = cp++;
+		}
+		if (!pass) {
+			for (b = 0; b < (1 << TRIGRAM_BITS); b++)
+				offsets[b + 1] += offsets[b];
+			ids = calloc(offsets[1 << TRIGRAM_BITS] + 1, sizeof ids[0]);
+			if (!ids)
+				goto error;
 		}
 	}
 
-	while (*pattern == '*') {
-		pattern++;
+	// the fill pass moved every offset to the start of the next list
+	memmove(&offsets[1], &offsets[0], (1 << TRIGRAM_BITS) * sizeof offsets[0]);
+	offsets[0] = 0;
+
+	free(last);
+	asic->trigram_index.offsets = offsets;
+	asic->trigram_index.ids = ids;
+	umr_publish_shared_indices(asic);
+	return 0;
+error:
+	free(offsets);
+	free(last);
+	free(ids);
+	return -1;
+}
+
+struct trigram_pick {
+	uint32_t *offsets;
+	uint32_t best, best_n;
+	int found;
+};
+
+/* find the trigram of a literal run with the shortest posting list */
+static void pick_trigram(void *data, const char *str, int len)
+{
+	struct trigram_pick *pick = data;
+	uint32_t b, n;
+	int x;
+
+	for (x = 0; x + 3 <= len; x++) {
+		if (pick->offsets) {
+			b = trigram_bucket(str + x);
+			n = pick->offsets[b + 1] - pick->offsets[b];
+			if (pick->found && n >= pick->best_n)
+				continue;
+			pick->best = b;
+			pick->best_n = n;
+		}
+		pick->found = 1;
 	}
-	return !*pattern;
 }
 
+static void free_iter(struct umr_find_reg_iter *iter)
+{
+	umr_free_reg_pattern(iter->ip_pat);
+	umr_free_reg_pattern(iter->reg_pat);
+	free(iter->ip);
+	free(iter->reg);
+	free(iter);
+}
+
+/**
+ * umr_find_reg_wild_first - Start a wildcard search for registers
+ *
+ * @asic: The device to search
+ * @ip: Pattern IP block names must match (or NULL for any)
+ * @reg: Pattern register names must match
+ *
+ * Patterns may use '*' and '?' and are case insensitive.  Results are
+ * returned by umr_find_reg_wild_next() in block and register order.
+ * When the register pattern contains three or more literal characters
+ * in a row only registers sharing its least common trigram are visited.
+ */
 struct umr_find_reg_iter* umr_find_reg_wild_first(struct umr_asic* asic, const char* ip, const char* reg)
 {
 	struct umr_find_reg_iter* iter;
+	struct trigram_pick pick;
 
 	iter = calloc(1, sizeof(*iter));
 	if (!iter) {
@@ -94,40 +337,82 @@ struct umr_find_reg_iter* umr_find_reg_wild_first(struct umr_asic* asic, const c
 	iter->asic = asic;
 	iter->ip = ip ? strdup(ip) : NULL;
 	iter->reg = strdup(reg);
+	iter->ip_pat = ip ? umr_compile_reg_pattern(ip) : NULL;
+	iter->reg_pat = umr_compile_reg_pattern(reg);
+	if (!iter->reg || !iter->reg_pat || (ip && (!iter->ip || !iter->ip_pat))) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		free_iter(iter);
+		return NULL;
+	}
 
 	iter->ip_i = -1;
 	iter->reg_i = -1;
+
+	// only index the names if the pattern can make use of it
+	memset(&pick, 0, sizeof pick);
+	umr_reg_pattern_literals(iter->reg_pat, pick_trigram, &pick);
+	if (pick.found && (asic->trigram_index.offsets || !umr_create_trigram_index(asic))) {
+		pick.offsets = asic->trigram_index.offsets;
+		pick.found = 0;
+		umr_reg_pattern_literals(iter->reg_pat, pick_trigram, &pick);
+		iter->cand = &asic->trigram_index.ids[pick.offsets[pick.best]];
+		iter->no_cand = pick.best_n;
+	}
 	return iter;
 }
 
+/**
+ * umr_find_reg_wild_next - Return the next register of a wildcard search
+ *
+ * Returns the next matching register and its IP block.  Both are NULL
+ * once the search is exhausted at which point @iter has been freed.
+ */
 struct umr_find_reg_iter_result umr_find_reg_wild_next(struct umr_find_reg_iter* iter)
 {
 	struct umr_find_reg_iter_result res;
+	struct umr_ip_block *ip;
+	uint32_t id;
+
+	// search only the candidates from the trigram index
+	if (iter->cand) {
+		while (iter->cand_i < iter->no_cand) {
+			id = iter->cand[iter->cand_i++];
+			ip = iter->asic->blocks[id >> TRIGRAM_REG_BITS];
+			id &= (1UL << TRIGRAM_REG_BITS) - 1;
+			if ((iter->ip_pat && !umr_reg_pattern_matches(iter->ip_pat, ip->ipname)) ||
+			    !umr_reg_pattern_matches(iter->reg_pat, block_regname(ip, id)) ||
+			    umr_materialize_ip_block(ip))
+				continue;
+			res.reg = &ip->regs[id];
+			res.ip = ip;
+			return res;
+		}
+		goto done;
+	}
+
 	for (;;) {
 		// if reg_i == -1 find the next IP block
 		if (iter->reg_i == -1) {
 			++(iter->ip_i);
 			while ((iter->ip_i < iter->asic->no_blocks) &&
-				   (iter->ip && !expression_matches(iter->asic->blocks[iter->ip_i]->ipname, iter->ip))) {
+				   (iter->ip_pat && !umr_reg_pattern_matches(iter->ip_pat, iter->asic->blocks[iter->ip_i]->ipname))) {
 				++(iter->ip_i);
 			}
 
 			// no more blocks
-			if (iter->ip_i >= iter->asic->no_blocks) {
-				free(iter->ip);
-				free(iter->reg);
-				free(iter);
-				res.ip = NULL;
-				res.reg = NULL;
-				return res;
-			}
+			if (iter->ip_i >= iter->asic->no_blocks)
+				goto done;
 
 			// start search inside block from the first register
 			iter->reg_i = 0;
+			if (umr_materialize_ip_block(iter->asic->blocks[iter->ip_i])) {
+				iter->reg_i = -1;
+				continue;
+			}
 		}
 
 		while (iter->reg_i < iter->asic->blocks[iter->ip_i]->no_regs) {
-			if (expression_matches(iter->asic->blocks[iter->ip_i]->regs[iter->reg_i].regname, iter->reg)) {
+			if (umr_reg_pattern_matches(iter->reg_pat, iter->asic->blocks[iter->ip_i]->regs[iter->reg_i].regname)) {
 				res.reg = &iter->asic->blocks[iter->ip_i]->regs[iter->reg_i++];
 				res.ip = iter->asic->blocks[iter->ip_i];
 				return res;
@@ -138,6 +423,12 @@ struct umr_find_reg_iter_result umr_find_reg_wild_next(struct umr_find_reg_iter*
 		// no match go to next block
 		iter->reg_i = -1;
 	}
+
+done:
+	free_iter(iter);
+	res.ip = NULL;
+	res.reg = NULL;
+	return res;
 }
 
 /**
@@ -146,12 +437,11 @@ struct umr_find_reg_iter_result umr_find_reg_wild_next(struct umr_find_reg_iter*
  * Returns the offset of the register if found or 0xFFFFFFFF if not.
  */
 uint32_t umr_find_reg(struct umr_asic* asic, const char* regname) {
-	int i, j;
+	struct umr_reg *reg;
 
-	for (i = 0; i < asic->no_blocks; i++)
-		for (j = 0; j < asic->blocks[i]->no_regs; j++)
-			if (istr_cmp(asic->blocks[i]->regs[j].regname, regname))
-				return asic->blocks[i]->regs[j].addr;
+	reg = find_reg_by_name(asic, NULL, regname);
+	if (reg)
+		return reg->addr;
 	fprintf(stderr, "[BUG]: reg [%s] not found on asic [%s]\n", regname, asic->asicname);
 	return 0xFFFFFFFF;
 }
@@ -164,15 +454,11 @@ uint32_t umr_find_reg(struct umr_asic* asic, const char* regname) {
  * is only compared as a prefix (e.g., "gfx" will match "gfx90").
  */
 struct umr_reg* umr_find_reg_data_by_ip(struct umr_asic* asic, const char* ip, const char* regname) {
-	int i, j;
+	struct umr_reg *reg;
 
-	for (i = 0; i < asic->no_blocks; i++) {
-		if (ip && memcmp(asic->blocks[i]->ipname, ip, strlen(ip)))
-			continue;
-		for (j = 0; j < asic->blocks[i]->no_regs; j++)
-			if (istr_cmp(asic->blocks[i]->regs[j].regname, regname))
-				return &asic->blocks[i]->regs[j];
-	}
+	reg = find_reg_by_name(asic, ip, regname);
+	if (reg)
+		return reg;
 	fprintf(stderr, "[BUG]: reg [%s] not found on asic [%s]\n", regname, asic->asicname);
 	return NULL;
 }
@@ -188,32 +474,71 @@ struct umr_reg* umr_find_reg_data(struct umr_asic* asic, char* regname) {
 }
 
 /**
- * umr_find_reg_by_addr - Find a register by addressable offset
+ * umr_find_reg_by_addr_type - Find a register by class and address
  *
- * Returns the umr_reg structure (if found) for a register at a
- * given address.  If @ip is not NULL it will also store the IP block
- * pointer for the register as well.
+ * Returns the umr_reg structure (if found) for a register of class
+ * @type at the address @addr.  If @ip is not NULL it will also store
+ * the IP block pointer for the register as well.  If more than one
+ * register shares the address the first one in block order is
+ * returned.
  */
-struct umr_reg* umr_find_reg_by_addr(struct umr_asic* asic, uint64_t addr, struct umr_ip_block** ip) {
-	int i, j;
+struct umr_reg *umr_find_reg_by_addr_type(struct umr_asic *asic, uint64_t addr, enum regclass type, struct umr_ip_block **ip)
+{
+	struct umr_addr_index_entry *e;
+	uint32_t lo, hi, mid;
 
 	if (ip)
 		*ip = NULL;
 
-	if (asic->mmio_accel.reglist && asic->mmio_accel.reglist[addr]) {
-		if (ip && asic->mmio_accel.iplist)
-			*ip = asic->mmio_accel.iplist[addr];
-		return asic->mmio_accel.reglist[addr];
+	if ((unsigned)type >= UMR_NUM_REGCLASS || addr > 0xFFFFFFFFULL)
+		return NULL;
+
+	if (!asic->mmio_accel.built && umr_create_mmio_accel(asic)) {
+		int i, j;
+
+		// no memory for the tables so fall back to a linear scan
+		for (i = 0; i < asic->no_blocks; i++) {
+			if (umr_materialize_ip_block(asic->blocks[i]))
+				return NULL;
+			for (j = 0; j < asic->blocks[i]->no_regs; j++)
+				if (asic->blocks[i]->regs[j].type == type && asic->blocks[i]->regs[j].addr == addr) {
+					if (ip)
+						*ip = asic->blocks[i];
+					return &asic->blocks[i]->regs[j];
+				}
+		}
+		return NULL;
+	}
+
+	// find the first entry with an address >= addr
+	e  = asic->mmio_accel.entries[type];
+	lo = 0;
+	hi = asic->mmio_accel.no_entries[type];
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (e[mid].addr < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	for (i = 0; i < asic->no_blocks; i++)
-		for (j = 0; j < asic->blocks[i]->no_regs; j++)
-			if (asic->blocks[i]->regs[j].type == REG_MMIO && asic->blocks[i]->regs[j].addr == addr) {
-				if (ip)
-					*ip = asic->blocks[i];
-				return &asic->blocks[i]->regs[j];
-			}
-	return NULL;
+	if (lo == asic->mmio_accel.no_entries[type] || e[lo].addr != addr)
+		return NULL;
+
+	if (ip)
+		*ip = asic->blocks[e[lo].ip];
+	return &asic->blocks[e[lo].ip]->regs[e[lo].reg];
+}
+
+/**
+ * umr_find_reg_by_addr - Find a register by addressable offset
+ *
+ * Returns the umr_reg structure (if found) for an MMIO register at
+ * a given address.  If @ip is not NULL it will also store the IP
+ * block pointer for the register as well.
+ */
+struct umr_reg* umr_find_reg_by_addr(struct umr_asic* asic, uint64_t addr, struct umr_ip_block** ip) {
+	return umr_find_reg_by_addr_type(asic, addr, REG_MMIO, ip);
 }
 
 /**
@@ -0,0 +1,459 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+
+/*
+ * An indirect register window is an index/data register pair.  The
+ * index last written is remembered so that accessing the same index
+ * again (or the next one when the hardware auto increments the index
+ * after every data access) does not write the index register again.
+ *
+ * The low level register writers report every MMIO write with
+ * umr_ind_note_write() so a write of a different value to an index
+ * register (for instance by the user) drops the remembered state.
+ * Writes by the kernel can't be seen so windows the kernel also uses
+ * (all but SMC_IND_INDEX_1) only keep their state within one call
+ * unless the kernel is out of the picture ('no_kernel').  Whether the
+ * SMC window already auto increments is read from its control register
+ * on first use and then followed through umr_ind_note_write().  The SQ
+ * index additionally depends on the GRBM bank.  Each call holds the
+ * hardware lock and while a device has clones (umr_clone_asic()) starts
+ * from invalidated windows since other handles may have moved an index,
+ * as does the first call after the last clone was closed.
+ */
+
+static void ind_resolve(struct umr_asic *asic, enum umr_ind_window_id id, struct umr_ind_window *w)
+{
+	const struct umr_sq_ind_handles *sq;
+	struct umr_reg *index = NULL, *index_hi = NULL, *data = NULL, *cntl = NULL;
+	int data_follows = 0;
+
+	switch (id) {
+		case UMR_IND_SMC:
+			switch (asic->config.gfx.family) {
+				case 110: // SI
+				case 120: // CIK
+				case 125: // KV
+				case 130: // VI
+					index = umr_find_reg_data(asic, "mmSMC_IND_INDEX_1");
+					data = umr_find_reg_data(asic, "mmSMC_IND_DATA_1");
+					cntl = umr_find_reg_data(asic, "mmSMC_IND_ACCESS_CNTL");
+					break;
+				case 135: // CZ
+					index = umr_find_reg_data(asic, "mmMP0PUB_IND_INDEX_1");
+					data = umr_find_reg_data(asic, "mmMP0PUB_IND_DATA_1");
+					cntl = umr_find_reg_data(asic, "mmMP0_IND_ACCESS_CNTL");
+					break;
+			}
+			if (cntl)
+				umr_bitfield_handle_init(asic, cntl, "AUTO_INCREMENT_IND_1", &w->auto_incr);
+			w->stride = 4;
+			break;
+		case UMR_IND_MM:
+			index = umr_find_reg_data(asic, "mmMM_INDEX");
+			index_hi = umr_find_reg_data(asic, "mmMM_INDEX_HI");
+			data = umr_find_reg_data(asic, "mmMM_DATA");
+			w->stride = 4;
+			w->shared = 1;
+			break;
+		case UMR_IND_DIDT:
+			if (asic->family >= FAMILY_CIK) {
+				index = umr_find_reg_data(asic, "mmDIDT_IND_INDEX");
+				data = umr_find_reg_data(asic, "mmDIDT_IND_DATA");
+			}
+			w->addr_shift = 2;
+			w->stride = 1;
+			w->shared = 1;
+			break;
+		case UMR_IND_PCIE:
+			// the kernel programs a byte address on SOC15 and a register number before
+			if (asic->family >= FAMILY_AI) {
+				index = umr_find_reg_data(asic, "mmPCIE_INDEX2");
+				data = umr_find_reg_data(asic, "mmPCIE_DATA2");
+				w->stride = 4;
+			} else {
+				// not every BIF register list has PCIE_DATA, it always follows PCIE_INDEX
+				index = umr_find_reg_data(asic, "mmPCIE_INDEX");
+				data = index;
+				data_follows = 1;
+				w->addr_shift = 2;
+				w->stride = 1;
+			}
+			w->shared = 1;
+			break;
+		case UMR_IND_SQ:
+			sq = umr_get_sq_ind_handles(asic);
+			if (sq) {
+				index = sq->index;
+				data = sq->data;
+				w->auto_incr = sq->auto_incr;
+				w->stride = 1ULL << sq->index_field.shift;
+			}
+			w->shared = 1;
+			break;
+		default:
+			break;
+	}
+
+	w->resolved = 1;
+	if (!index || !data || (id == UMR_IND_MM && !index_hi))
+		return;
+	w->index = (uint64_t)index->addr * 4;
+	w->data = ((uint64_t)data->addr + data_follows) * 4;
+	if (index_hi)
+		w->index_hi = (uint64_t)index_hi->addr * 4;
+	if (cntl && w->auto_incr.mask)
+		w->cntl = (uint64_t)cntl->addr * 4;
+	w->present = 1;
+}
+
+/* start a call on a window, forgetting its state if the kernel or another handle may have touched it */
+static struct umr_ind_window *ind_begin(struct umr_asic *asic, enum umr_ind_window_id id)
+{
+	struct umr_ind_window *w;
+	int x;
+
+	w = umr_get_ind_window(asic, id);
+	if (!w) {
+		fprintf(stderr, "[BUG]: Indirect register window %d not found on asic [%s]\n", (int)id, asic->asicname);
+		return NULL;
+	}
+	umr_lock_hw(asic);
+	if (umr_hw_shared(asic)) {
+		for (x = 0; x < UMR_NUM_IND_WINDOWS; x++)
+			asic->ind_windows[x].valid = 0;
+	} else if (w->shared && !asic->options.no_kernel) {
+		w->valid = 0;
+	}
+
+	// auto increment may have been enabled before umr touched the window
+	if (w->cntl && !w->incr_known) {
+		w->incr_hw = !!umr_bitslice_by_handle(&w->auto_incr, asic->reg_funcs.read_reg(asic, w->cntl, REG_MMIO));
+		w->incr_known = 1;
+	}
+	return w;
+}
+
+/**
+ * umr_get_ind_window - Get an indirect register window
+ *
+ * The registers of the window are looked up on first use.  Returns
+ * NULL if the window does not exist on this ASIC.
+ */
+struct umr_ind_window *umr_get_ind_window(struct umr_asic *asic, enum umr_ind_window_id id)
+{
+	struct umr_ind_window *w;
+
+	if ((unsigned)id >= UMR_NUM_IND_WINDOWS)
+		return NULL;
+	w = &asic->ind_windows[id];
+	if (!w->resolved)
+		ind_resolve(asic, id, w);
+	return w->present ? w : NULL;
+}
+
+#define IND_WRITE_LO  1
+#define IND_WRITE_HI  2
+
+// dwords per write_regs() call when streaming writes
+#define IND_BATCH     64
+
+/*
+ * Record @index as selected and return which of the index registers
+ * have to be written (with @lo and @hi) for that to be true.  The
+ * state is updated first so umr_ind_note_write() sees matching values
+ * when the caller writes them.
+ */
+static int ind_plan(enum umr_ind_window_id id, struct umr_ind_window *w, uint64_t index, uint32_t *lo, uint32_t *hi)
+{
+	int writes = 0;
+
+	if (w->valid && w->last == index)
+		return 0;
+
+	if (id == UMR_IND_MM) {
+		*lo = (uint32_t)index | 0x80000000;
+		*hi = index >> 31;
+	} else {
+		*lo = index;
+		*hi = 0;
+	}
+
+	if (!w->valid || w->last_lo != *lo)
+		writes |= IND_WRITE_LO;
+	if (w->index_hi && (!w->valid || w->last_hi != *hi))
+		writes |= IND_WRITE_HI;
+	w->last_lo = *lo;
+	w->last_hi = *hi;
+	w->last = index;
+	w->valid = 1;
+	return writes;
+}
+
+/* program @index into the window unless it already holds it */
+static int ind_select(struct umr_asic *asic, enum umr_ind_window_id id, struct umr_ind_window *w, uint64_t index)
+{
+	uint32_t lo, hi;
+	int r = 0, writes;
+
+	writes = ind_plan(id, w, index, &lo, &hi);
+	if (writes & IND_WRITE_LO)
+		r |= asic->reg_funcs.write_reg(asic, w->index, lo, REG_MMIO);
+	if (writes & IND_WRITE_HI)
+		r |= asic->reg_funcs.write_reg(asic, w->index_hi, hi, REG_MMIO);
+	if (r) {
+		w->valid = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/* account for the hardware advancing the index after a data access */
+static void ind_advance(struct umr_ind_window *w)
+{
+	if (w->incr_on || w->incr_hw || (!w->cntl && (w->last_lo & umr_bitslice_compose_by_handle(&w->auto_incr, 1)))) {
+		w->last += w->stride;
+		w->last_lo = w->last;
+	}
+}
+
+/**
+ * umr_ind_read - Read a register through an indirect window
+ *
+ * @index: The index to select, see enum umr_ind_window_id
+ *
+ * The index register is only written if the window does not hold
+ * @index already.  Returns the value of the data register.
+ */
+uint32_t umr_ind_read(struct umr_asic *asic, enum umr_ind_window_id id, uint64_t index)
+{
+	struct umr_ind_window *w;
+	uint32_t value;
+
+	w = ind_begin(asic, id);
+	if (!w)
+		return 0;
+	ind_select(asic, id, w, index);
+	value = asic->reg_funcs.read_reg(asic, w->data, REG_MMIO);
+	ind_advance(w);
+	umr_unlock_hw(asic);
+	return value;
+}
+
+/**
+ * umr_ind_write - Write a register through an indirect window
+ *
+ * Like umr_ind_read() but writes @value.  Returns 0 on success.
+ */
+int umr_ind_write(struct umr_asic *asic, enum umr_ind_window_id id, uint64_t index, uint32_t value)
+{
+	struct umr_ind_window *w;
+	int r;
+
+	w = ind_begin(asic, id);
+	if (!w)
+		return -1;
+	r = ind_select(asic, id, w, index);
+	if (!r) {
+		r = asic->reg_funcs.write_reg(asic, w->data, value, REG_MMIO);
+		ind_advance(w);
+	}
+	umr_unlock_hw(asic);
+	return r;
+}
+
+/* can the window be driven through the PCI BAR without the callbacks */
+static int ind_direct(struct umr_asic *asic, struct umr_ind_window *w)
+{
+	// not if anything (statistics, deferred writes, ...) sits on top of them
+	return asic->pci.mem &&
+	       asic->reg_funcs.read_reg == umr_read_reg &&
+	       asic->reg_funcs.write_reg == umr_write_reg &&
+	       w->index < asic->pci.mem_size &&
+	       w->index_hi < asic->pci.mem_size &&
+	       w->data < asic->pci.mem_size;
+}
+
+static void ind_access_direct(struct umr_asic *asic, enum umr_ind_window_id id, struct umr_ind_window *w,
+			      uint64_t index, uint32_t *values, int n, int write_en)
+{
+	volatile uint32_t *mem = asic->pci.mem;
+	uint32_t lo, hi;
+	int x, writes;
+
+	for (x = 0; x < n; x++, index += w->stride) {
+		writes = ind_plan(id, w, index, &lo, &hi);
+		if (writes & IND_WRITE_LO)
+			mem[w->index / 4] = lo;
+		if (writes & IND_WRITE_HI)
+			mem[w->index_hi / 4] = hi;
+		if (write_en)
+			mem[w->data / 4] = values[x];
+		else
+			values[x] = mem[w->data / 4];
+		ind_advance(w);
+	}
+}
+
+/* queue the index and data writes of up to IND_BATCH registers per write_regs() call */
+static int ind_write_batch(struct umr_asic *asic, enum umr_ind_window_id id, struct umr_ind_window *w,
+			   uint64_t index, const uint32_t *values, int n)
+{
+	struct umr_reg_addr regs[3 * IND_BATCH];
+	uint32_t vals[3 * IND_BATCH], lo, hi;
+	int x, k, writes, valid, r = 0;
+
+	while (n) {
+		for (k = x = 0; x < n && x < IND_BATCH; x++, index += w->stride) {
+			writes = ind_plan(id, w, index, &lo, &hi);
+			if (writes & IND_WRITE_LO) {
+				regs[k].addr = w->index;
+				regs[k].type = REG_MMIO;
+				vals[k++] = lo;
+			}
+			if (writes & IND_WRITE_HI) {
+				regs[k].addr = w->index_hi;
+				regs[k].type = REG_MMIO;
+				vals[k++] = hi;
+			}
+			regs[k].addr = w->data;
+			regs[k].type = REG_MMIO;
+			vals[k++] = values[x];
+			ind_advance(w);
+		}
+
+		// earlier index writes of the batch don't match the final state
+		valid = w->valid;
+		w->valid = 0;
+		if (asic->reg_funcs.write_regs(asic, regs, vals, k)) {
+			valid = 0;
+			r = -1;
+		}
+		w->valid = valid;
+		values += x;
+		n -= x;
+	}
+	return r;
+}
+
+/**
+ * umr_ind_access - Access consecutive registers through an indirect window
+ *
+ * @index: The first index, the others follow at the stride of the
+ * window (4 bytes for SMC and MM, one register for SQ)
+ * @values: The @n values to read or write
+ * @write_en: non-zero to write @values
+ *
+ * Windows with an auto increment control register (SMC) have auto
+ * increment enabled for the duration of longer runs (unless it already
+ * is) so only the first index is written.  Afterwards cntl is read again
+ * and only the auto increment bit is cleared.  For SQ set AUTO_INCR in
+ * @index.
+ *
+ * With the Linux callbacks and a mapped PCI BAR the registers are
+ * accessed directly in one loop.  Otherwise writes are handed to the
+ * write_regs() callback in batches if there is one.  Returns 0 on
+ * success.
+ */
+int umr_ind_access(struct umr_asic *asic, enum umr_ind_window_id id, uint64_t index, uint32_t *values, int n, int write_en)
+{
+	struct umr_ind_window *w;
+	uint32_t cntl = 0;
+	int x, r = 0;
+
+	w = ind_begin(asic, id);
+	if (!w)
+		return -1;
+
+	// toggling auto increment costs three accesses
+	if (w->cntl && n > 3 && !w->incr_hw) {
+		cntl = asic->reg_funcs.read_reg(asic, w->cntl, REG_MMIO);
+		if (!asic->reg_funcs.write_reg(asic, w->cntl, cntl | umr_bitslice_compose_by_handle(&w->auto_incr, 1), REG_MMIO)) {
+			// start the run with an index written while incrementing
+			w->incr_on = 1;
+			w->valid = 0;
+		}
+	}
+
+	if (ind_direct(asic, w)) {
+		ind_access_direct(asic, id, w, index, values, n, write_en);
+	} else if (write_en && asic->reg_funcs.write_regs) {
+		r |= ind_write_batch(asic, id, w, index, values, n);
+	} else {
+		for (x = 0; x < n; x++, index += w->stride) {
+			r |= ind_select(asic, id, w, index);
+			if (write_en)
+				r |= asic->reg_funcs.write_reg(asic, w->data, values[x], REG_MMIO);
+			else
+				values[x] = asic->reg_funcs.read_reg(asic, w->data, REG_MMIO);
+			ind_advance(w);
+		}
+	}
+
+	if (w->incr_on) {
+		// the kernel may have changed other bits of cntl meanwhile, only clear ours
+		w->incr_on = 0;
+		cntl = asic->reg_funcs.read_reg(asic, w->cntl, REG_MMIO);
+		r |= asic->reg_funcs.write_reg(asic, w->cntl, cntl & ~umr_bitslice_compose_by_handle(&w->auto_incr, 1), REG_MMIO);
+	}
+	umr_unlock_hw(asic);
+	return r ? -1 : 0;
+}
+
+/**
+ * umr_ind_invalidate - Forget what an indirect window holds
+ *
+ * The next access through the window writes its index registers.
+ */
+void umr_ind_invalidate(struct umr_asic *asic, enum umr_ind_window_id id)
+{
+	if ((unsigned)id < UMR_NUM_IND_WINDOWS)
+		asic->ind_windows[id].valid = 0;
+}
+
+/**
+ * umr_ind_note_write - Report a MMIO register write
+ *
+ * Called by register write implementations for every MMIO write so
+ * that windows whose index register is written with something else
+ * are invalidated and writes to an auto increment control register
+ * are tracked.
+ */
+void umr_ind_note_write(struct umr_asic *asic, uint64_t addr, uint32_t value)
+{
+	struct umr_ind_window *w;
+	int x;
+
+	for (x = 0; x < UMR_NUM_IND_WINDOWS; x++) {
+		w = &asic->ind_windows[x];
+		if (w->cntl && addr == w->cntl)
+			w->incr_hw = !!umr_bitslice_by_handle(&w->auto_incr, value);
+		if (!w->valid)
+			continue;
+		if ((addr == w->index && value != w->last_lo) ||
+		    (w->index_hi && addr == w->index_hi && value != w->last_hi))
+			w->valid = 0;
+	}
+}
@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_dce120(struct umr_ip_offsets_soc15 *soc15_offset
 
 	ip->ipname = "dce120";
 	ip->no_regs = sizeof(dce120_registers)/sizeof(dce120_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "DCE", dce120_registers, ip)) {
 		free(ip);
 		return NULL;
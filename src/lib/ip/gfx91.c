@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_gfx91(struct umr_ip_offsets_soc15 *soc15_offsets
 
 	ip->ipname = "gfx91";
 	ip->no_regs = sizeof(gfx91_registers)/sizeof(gfx91_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "GC", gfx91_registers, ip)) {
 		free(ip);
 		return NULL;
@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_mmhub930(struct umr_ip_offsets_soc15 *soc15_offs
 
 	ip->ipname = "mmhub930";
 	ip->no_regs = sizeof(mmhub930_registers)/sizeof(mmhub930_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "MMHUB", mmhub930_registers, ip)) {
 		free(ip);
 		return NULL;
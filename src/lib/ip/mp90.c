@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_mp90(struct umr_ip_offsets_soc15 *soc15_offsets,
 
 	ip->ipname = "mp90";
 	ip->no_regs = sizeof(mp90_registers)/sizeof(mp90_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "MP0", mp90_registers, ip)) { // this might be broken because there is MP1/2 as well
 		free(ip);
 		return NULL;
@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_nbio61(struct umr_ip_offsets_soc15 *soc15_offset
 
 	ip->ipname = "nbio61";
 	ip->no_regs = sizeof(nbio61_registers)/sizeof(nbio61_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "NBIO", nbio61_registers, ip)) {
 		free(ip);
 		return NULL;
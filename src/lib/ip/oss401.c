@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_oss401(struct umr_ip_offsets_soc15 *soc15_offset
 
 	ip->ipname = "oss401";
 	ip->no_regs = sizeof(oss401_registers)/sizeof(oss401_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "OSSSYS", oss401_registers, ip)) {
 		free(ip);
 		return NULL;
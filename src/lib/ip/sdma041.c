@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_sdma041(struct umr_ip_offsets_soc15 *soc15_offse
 
 	ip->ipname = "sdma041";
 	ip->no_regs = sizeof(sdma041_registers)/sizeof(sdma041_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "SDMA0", sdma041_registers, ip)) {
 		free(ip);
 		return NULL;
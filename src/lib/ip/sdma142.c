@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_sdma142(struct umr_ip_offsets_soc15 *soc15_offse
 
 	ip->ipname = "sdma142";
 	ip->no_regs = sizeof(sdma142_registers)/sizeof(sdma142_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "SDMA1", sdma142_registers, ip)) {
 		free(ip);
 		return NULL;
@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_thm90(struct umr_ip_offsets_soc15 *soc15_offsets
 
 	ip->ipname = "thm90";
 	ip->no_regs = sizeof(thm90_registers)/sizeof(thm90_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "THM", thm90_registers, ip)) {
 		free(ip);
 		return NULL;
@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_vce40(struct umr_ip_offsets_soc15 *soc15_offsets
 
 	ip->ipname = "vce40";
 	ip->no_regs = sizeof(vce40_registers)/sizeof(vce40_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "VCE", vce40_registers, ip)) {
 		free(ip);
 		return NULL;
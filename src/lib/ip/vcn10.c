@@ -40,12 +40,6 @@ struct umr_ip_block *umr_create_vcn10(struct umr_ip_offsets_soc15 *soc15_offsets
 
 	ip->ipname = "vcn10";
 	ip->no_regs = sizeof(vcn10_registers)/sizeof(vcn10_registers[0]);
-	ip->regs = calloc(ip->no_regs, sizeof(ip->regs[0]));
-	if (!ip->regs) {
-		free(ip);
-		return NULL;
-	}
-
 	if (umr_transfer_soc15_to_reg(options, soc15_offsets, "VCN", vcn10_registers, ip)) {
 		free(ip);
 		return NULL;
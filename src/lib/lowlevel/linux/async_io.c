@@ -0,0 +1,450 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <errno.h>
+
+#ifndef UMR_NO_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+/*
+ * Reads of debugfs files are queued with umr_aio_read() and completed
+ * by umr_aio_wait() which calls the callback of every request.  With
+ * io_uring up to 'depth' reads are in flight at once and are submitted
+ * with a single system call.  The debugfs files have no asynchronous
+ * read method so the kernel runs them on its worker threads, in
+ * parallel.  Without io_uring (not built in, not permitted or
+ * UMR_AIO_NO_URING) the queued reads are done with pread() in order
+ * when waiting.
+ *
+ * Requests complete in any order.  An engine may only be used by one
+ * thread at a time.
+ */
+
+struct umr_aio_req {
+	umr_aio_callback cb;
+	void *data;
+	int fd;
+	void *buf;
+	uint32_t size;
+	uint64_t offset;
+};
+
+struct umr_aio {
+	int depth;
+	struct umr_aio_req *reqs;
+	// free request slots, and slots queued but not submitted in order
+	int *free_slots, no_free;
+	int *queued, no_queued;
+	int in_flight;
+
+#ifndef UMR_NO_IO_URING
+	int ring_fd;
+	// entries in the submission ring the kernel has not consumed yet
+	unsigned sq_entries, unsubmitted;
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	struct io_uring_sqe *sqes;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+#endif
+};
+
+#ifndef UMR_NO_IO_URING
+static int aio_ring_setup(struct umr_aio *aio)
+{
+	struct io_uring_params p;
+	void *ring;
+
+	memset(&p, 0, sizeof p);
+	aio->ring_fd = syscall(__NR_io_uring_setup, aio->depth, &p);
+	if (aio->ring_fd < 0)
+		return -1;
+
+	// IORING_OP_READ came with the same kernel (5.6)
+	if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+		close(aio->ring_fd);
+		aio->ring_fd = -1;
+		return -1;
+	}
+
+	aio->sq_entries = p.sq_entries;
+	aio->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	aio->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (aio->cq_ring_size > aio->sq_ring_size)
+			aio->sq_ring_size = aio->cq_ring_size;
+		aio->cq_ring_size = aio->sq_ring_size;
+	}
+
+	ring = mmap(NULL, aio->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring_fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED)
+		goto err;
+	aio->sq_ring = ring;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		aio->cq_ring = NULL;
+		ring = aio->sq_ring;
+	} else {
+		ring = mmap(NULL, aio->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring_fd, IORING_OFF_CQ_RING);
+		if (ring == MAP_FAILED)
+			goto err;
+		aio->cq_ring = ring;
+	}
+
+	aio->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring_fd, IORING_OFF_SQES);
+	if (aio->sqes == MAP_FAILED) {
+		aio->sqes = NULL;
+		goto err;
+	}
+
+	aio->sq_tail  = (unsigned *)((char *)aio->sq_ring + p.sq_off.tail);
+	aio->sq_mask  = (unsigned *)((char *)aio->sq_ring + p.sq_off.ring_mask);
+	aio->sq_array = (unsigned *)((char *)aio->sq_ring + p.sq_off.array);
+	aio->cq_head  = (unsigned *)((char *)ring + p.cq_off.head);
+	aio->cq_tail  = (unsigned *)((char *)ring + p.cq_off.tail);
+	aio->cq_mask  = (unsigned *)((char *)ring + p.cq_off.ring_mask);
+	aio->cqes     = (struct io_uring_cqe *)((char *)ring + p.cq_off.cqes);
+	return 0;
+err:
+	if (aio->sq_ring)
+		munmap(aio->sq_ring, aio->sq_ring_size);
+	if (aio->cq_ring)
+		munmap(aio->cq_ring, aio->cq_ring_size);
+	aio->sq_ring = aio->cq_ring = NULL;
+	close(aio->ring_fd);
+	aio->ring_fd = -1;
+	return -1;
+}
+
+/* hand the queued requests to the kernel and wait for at least @min_complete */
+static int aio_ring_enter(struct umr_aio *aio, unsigned min_complete)
+{
+	unsigned tail;
+	struct io_uring_sqe *sqe;
+	struct umr_aio_req *req;
+	int x, r;
+
+	tail = *aio->sq_tail;
+	for (x = 0; x < aio->no_queued; x++) {
+		req = &aio->reqs[aio->queued[x]];
+		sqe = &aio->sqes[tail & *aio->sq_mask];
+		memset(sqe, 0, sizeof *sqe);
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = req->fd;
+		sqe->addr = (uintptr_t)req->buf;
+		sqe->len = req->size;
+		sqe->off = req->offset;
+		sqe->user_data = aio->queued[x];
+		aio->sq_array[tail & *aio->sq_mask] = tail & *aio->sq_mask;
+		++tail;
+	}
+	__atomic_store_n(aio->sq_tail, tail, __ATOMIC_RELEASE);
+	aio->unsubmitted += aio->no_queued;
+	aio->in_flight += aio->no_queued;
+	aio->no_queued = 0;
+
+	do {
+		r = syscall(__NR_io_uring_enter, aio->ring_fd, aio->unsubmitted, min_complete,
+			    min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if (r >= 0)
+			aio->unsubmitted -= r;
+	} while (r < 0 && errno == EINTR);
+	return r < 0 ? -1 : 0;
+}
+
+/* run the callbacks of completed requests, returns how many completed */
+static int aio_ring_reap(struct umr_aio *aio)
+{
+	unsigned head, tail;
+	struct io_uring_cqe *cqe;
+	struct umr_aio_req req;
+	int slot, n = 0;
+
+	head = *aio->cq_head;
+	for (;;) {
+		tail = __atomic_load_n(aio->cq_tail, __ATOMIC_ACQUIRE);
+		if (head == tail)
+			break;
+		cqe = &aio->cqes[head & *aio->cq_mask];
+		slot = (int)cqe->user_data;
+		req = aio->reqs[slot];
+		++head;
+		__atomic_store_n(aio->cq_head, head, __ATOMIC_RELEASE);
+
+		// the slot can be reused by the callback
+		aio->free_slots[aio->no_free++] = slot;
+		--aio->in_flight;
+		++n;
+		if (req.cb)
+			req.cb(req.data, cqe->res);
+	}
+	return n;
+}
+#endif
+
+/* do the queued requests with pread() */
+static void aio_pread_queued(struct umr_aio *aio)
+{
+	struct umr_aio_req req;
+	ssize_t r;
+	int x, slot;
+
+	// callbacks may queue more requests
+	while (aio->no_queued) {
+		slot = aio->queued[0];
+		memmove(aio->queued, aio->queued + 1, --aio->no_queued * sizeof aio->queued[0]);
+		req = aio->reqs[slot];
+		aio->free_slots[aio->no_free++] = slot;
+		r = pread(req.fd, req.buf, req.size, req.offset);
+		x = r < 0 ? -errno : (int)r;
+		if (req.cb)
+			req.cb(req.data, x);
+	}
+}
+
+/**
+ * umr_aio_create - Create an asynchronous reader
+ *
+ * @depth: The largest number of reads in flight
+ * @flags: UMR_AIO_NO_URING to always use pread()
+ *
+ * Returns NULL if out of memory.  Falls back to pread() silently if
+ * io_uring can't be used.
+ */
+struct umr_aio *umr_aio_create(int depth, int flags)
+{
+	struct umr_aio *aio;
+	int x;
+
+	aio = calloc(1, sizeof *aio);
+	if (!aio)
+		goto oom;
+	aio->depth = depth;
+	aio->reqs = calloc(depth, sizeof aio->reqs[0]);
+	aio->free_slots = calloc(depth, sizeof aio->free_slots[0]);
+	aio->queued = calloc(depth, sizeof aio->queued[0]);
+	if (!aio->reqs || !aio->free_slots || !aio->queued)
+		goto oom;
+	for (x = 0; x < depth; x++)
+		aio->free_slots[aio->no_free++] = depth - 1 - x;
+
+#ifndef UMR_NO_IO_URING
+	aio->ring_fd = -1;
+	if (!(flags & UMR_AIO_NO_URING))
+		aio_ring_setup(aio);
+#else
+	(void)flags;
+#endif
+	return aio;
+oom:
+	fprintf(stderr, "[ERROR]: Out of memory\n");
+	umr_aio_destroy(aio);
+	return NULL;
+}
+
+/**
+ * umr_aio_destroy - Wait for and free an asynchronous reader
+ */
+void umr_aio_destroy(struct umr_aio *aio)
+{
+	if (!aio)
+		return;
+	if (aio->reqs)
+		umr_aio_wait(aio);
+#ifndef UMR_NO_IO_URING
+	if (aio->ring_fd >= 0) {
+		munmap(aio->sqes, aio->sq_entries * sizeof(struct io_uring_sqe));
+		munmap(aio->sq_ring, aio->sq_ring_size);
+		if (aio->cq_ring)
+			munmap(aio->cq_ring, aio->cq_ring_size);
+		close(aio->ring_fd);
+	}
+#endif
+	free(aio->reqs);
+	free(aio->free_slots);
+	free(aio->queued);
+	free(aio);
+}
+
+/**
+ * umr_aio_is_async - Does the reader keep reads in flight
+ *
+ * Returns 1 if reads go through io_uring or 0 if they are done with
+ * pread().
+ */
+int umr_aio_is_async(struct umr_aio *aio)
+{
+#ifndef UMR_NO_IO_URING
+	return aio->ring_fd >= 0;
+#else
+	(void)aio;
+	return 0;
+#endif
+}
+
+/**
+ * umr_aio_read - Queue a read
+ *
+ * @fd: The file to read from
+ * @buf: Receives the data, must stay valid until the read completes
+ * @size: The number of bytes to read
+ * @offset: The file offset to read at
+ * @cb: Called with @data and the number of bytes read or a negative
+ * errno once the read completes (may be NULL)
+ *
+ * The read is started no later than the next umr_aio_wait().  If every
+ * request slot is busy the queued reads are submitted and this waits
+ * for one of them to complete (running its callback).  Returns 0 on
+ * success.
+ */
+int umr_aio_read(struct umr_aio *aio, int fd, void *buf, uint32_t size, uint64_t offset, umr_aio_callback cb, void *data)
+{
+	struct umr_aio_req *req;
+	int slot;
+
+	if (!aio->no_free) {
+#ifndef UMR_NO_IO_URING
+		if (umr_aio_is_async(aio)) {
+			if (aio_ring_enter(aio, 1))
+				return -1;
+			aio_ring_reap(aio);
+		} else
+#endif
+			aio_pread_queued(aio);
+	}
+
+	slot = aio->free_slots[--aio->no_free];
+	req = &aio->reqs[slot];
+	req->cb = cb;
+	req->data = data;
+	req->fd = fd;
+	req->buf = buf;
+	req->size = size;
+	req->offset = offset;
+	aio->queued[aio->no_queued++] = slot;
+	return 0;
+}
+
+/**
+ * umr_aio_wait - Complete every queued read
+ *
+ * Runs the callbacks of all reads, including reads queued by the
+ * callbacks themselves.  Returns 0 on success or -1 if io_uring failed.
+ */
+int umr_aio_wait(struct umr_aio *aio)
+{
+#ifndef UMR_NO_IO_URING
+	if (umr_aio_is_async(aio)) {
+		while (aio->no_queued || aio->in_flight) {
+			if (aio_ring_enter(aio, aio->in_flight + aio->no_queued) && !aio_ring_reap(aio)) {
+				fprintf(stderr, "[ERROR]: io_uring_enter failed: %s\n", strerror(errno));
+				return -1;
+			}
+			aio_ring_reap(aio);
+		}
+		return 0;
+	}
+#endif
+	aio_pread_queued(aio);
+	return 0;
+}
+
+struct aio_run {
+	int x, run, res;
+};
+
+static void aio_run_done(void *data, int result)
+{
+	((struct aio_run *)data)->res = result;
+}
+
+/**
+ * umr_aio_read_regs - Read a list of registers from debugfs files
+ *
+ * Like umr_pread_regs() but the runs of adjacent registers are read
+ * concurrently through @aio.  Returns the number of registers read,
+ * less than @n if a read failed (errno is set).
+ */
+int umr_aio_read_regs(struct umr_aio *aio, const int *fds, const struct umr_reg_addr *regs, uint32_t *values, int n)
+{
+	struct aio_run *runs;
+	int x, k, no_runs, got;
+
+	if (!aio || !umr_aio_is_async(aio))
+		return umr_pread_regs(fds, regs, values, n);
+
+	// a single run is one pread() either way
+	for (x = 1; x < n && regs[x].type == regs[0].type && regs[x].addr == regs[0].addr + 4 * x; x++);
+	if (x == n)
+		return umr_pread_regs(fds, regs, values, n);
+
+	runs = calloc(n, sizeof runs[0]);
+	if (!runs)
+		return umr_pread_regs(fds, regs, values, n);
+
+	for (no_runs = x = 0; x < n; x += runs[no_runs++].run) {
+		runs[no_runs].x = x;
+		for (runs[no_runs].run = 1; x + runs[no_runs].run < n &&
+			regs[x + runs[no_runs].run].type == regs[x].type &&
+			regs[x + runs[no_runs].run].addr == regs[x].addr + 4 * runs[no_runs].run; runs[no_runs].run++);
+		umr_aio_read(aio, fds[regs[x].type], &values[x], 4 * runs[no_runs].run, regs[x].addr, aio_run_done, &runs[no_runs]);
+	}
+	umr_aio_wait(aio);
+
+	// runs the kernel stopped early are finished one register at a time
+	for (k = 0; k < no_runs; k++) {
+		got = runs[k].res > 0 ? runs[k].res / 4 : 0;
+		if (got < runs[k].run) {
+			got = runs[k].x + got;
+			got += umr_pread_regs(fds, &regs[got], &values[got], runs[k].x + runs[k].run - got);
+			if (got < runs[k].x + runs[k].run) {
+				free(runs);
+				return got;
+			}
+		}
+	}
+	free(runs);
+	return n;
+}
+
+/**
+ * umr_get_aio - Get the asynchronous reader of a device handle
+ *
+ * Created on first use and freed with the handle.  Returns NULL if it
+ * could not be created or an access trace is active.
+ */
+struct umr_aio *umr_get_aio(struct umr_asic *asic)
+{
+	// reads of a trace are made one at a time with umr_trace_pread()
+	if (asic->trace)
+		return NULL;
+	if (!asic->aio)
+		asic->aio = umr_aio_create(UMR_AIO_DEPTH, asic->options.no_io_uring ? UMR_AIO_NO_URING : 0);
+	return asic->aio;
+}
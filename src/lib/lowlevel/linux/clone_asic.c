@@ -0,0 +1,211 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+
+/*
+ * A device handle may only be used by one thread at a time.  Other
+ * threads use clones made with umr_clone_asic() which share the
+ * register database, lookup tables and PCI mapping of the device but
+ * have their own debugfs files, options (and thus bank selection),
+ * register callbacks, indirect window state and page table walk cache.
+ *
+ * Register accesses through debugfs are serialised by the kernel.
+ * Direct accesses that program shared hardware state (an index/data
+ * pair or GRBM_GFX_INDEX) are made under the hardware lock of the
+ * device which is created with the first clone.  The lock counts the
+ * open clones so that a handle can tell (umr_hw_shared()) whether
+ * another one may have moved an index since it last looked.
+ */
+struct umr_hw_lock {
+	pthread_mutex_t lock;
+
+	// open clones and the number of times that changed
+	int clones;
+	uint32_t generation;
+};
+
+static int create_hw_lock(struct umr_asic *asic)
+{
+	pthread_mutexattr_t attr;
+	struct umr_hw_lock *hl;
+
+	if (asic->hw_lock)
+		return 0;
+
+	hl = calloc(1, sizeof *hl);
+	if (!hl) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return -1;
+	}
+
+	// sequences nest (a GRBM selection around SQ window accesses)
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&hl->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	asic->hw_lock = hl;
+	return 0;
+}
+
+/**
+ * umr_clone_asic - Create another handle for a device
+ *
+ * @asic: The device to clone (not itself a clone)
+ *
+ * The clone refers to the IP blocks, lookup tables and PCI mapping of
+ * @asic, which are fully built first so that no thread modifies them
+ * afterwards.  It opens its own debugfs files and starts with a copy of
+ * the options and register callbacks of @asic.  Deferred writes and
+ * access statistics carry over (the statistics and any access trace
+ * are shared).
+ *
+ * Must be called from the thread owning @asic and every clone must be
+ * closed with umr_close_asic() before @asic is.
+ *
+ * Returns NULL on error.
+ */
+struct umr_asic *umr_clone_asic(struct umr_asic *asic)
+{
+	struct umr_asic *clone;
+	int x;
+
+	if (asic->parent) {
+		fprintf(stderr, "[BUG]: Cannot clone a cloned asic handle\n");
+		return NULL;
+	}
+
+	// build everything that is otherwise built on first use
+	if ((!asic->mmio_accel.built && umr_create_mmio_accel(asic)) ||
+	    umr_create_name_index(asic) ||
+	    umr_create_trigram_index(asic) ||
+	    create_hw_lock(asic))
+		return NULL;
+
+	clone = calloc(1, sizeof *clone);
+	if (!clone) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return NULL;
+	}
+	*clone = *asic;
+	clone->parent = asic;
+
+	// borrowed from the device
+	clone->mmio_accel.mapped = 1;
+	clone->name_index.mapped = 1;
+	clone->trigram_index.mapped = 1;
+	clone->shared_indices = NULL;
+	memset(&clone->reg_values, 0, sizeof clone->reg_values);
+	memset(&clone->regdb, 0, sizeof clone->regdb);
+	clone->maps = NULL;
+	clone->aio = NULL;
+	clone->vm_cache = NULL;
+
+	for (x = 0; x < UMR_NUM_IND_WINDOWS; x++)
+		clone->ind_windows[x].valid = 0;
+
+	umr_open_debugfs(clone);
+	if (asic->fd.drm >= 0)
+		clone->fd.drm = dup(asic->fd.drm);
+
+	clone->trace = NULL;
+	umr_share_trace(asic, clone);
+	clone->access_stats = NULL;
+	umr_share_access_stats(asic, clone);
+	clone->write_queue = NULL;
+	umr_share_write_queue(asic, clone);
+
+	pthread_mutex_lock(&asic->hw_lock->lock);
+	++asic->hw_lock->clones;
+	++asic->hw_lock->generation;
+	pthread_mutex_unlock(&asic->hw_lock->lock);
+	return clone;
+}
+
+/**
+ * umr_lock_hw - Begin a sequence of accesses to shared hardware state
+ *
+ * Taken around direct index/data and GRBM bank selection sequences.
+ * Does nothing until a clone of the device exists.  May be nested.
+ */
+void umr_lock_hw(struct umr_asic *asic)
+{
+	if (asic->hw_lock)
+		pthread_mutex_lock(&asic->hw_lock->lock);
+}
+
+/**
+ * umr_unlock_hw - End a sequence started with umr_lock_hw()
+ *
+ * Deferred writes of the sequence are issued before the lock is
+ * released.
+ */
+void umr_unlock_hw(struct umr_asic *asic)
+{
+	if (asic->hw_lock) {
+		umr_flush_writes(asic);
+		pthread_mutex_unlock(&asic->hw_lock->lock);
+	}
+}
+
+/**
+ * umr_hw_shared - Check whether other handles may have used the hardware
+ *
+ * Returns non-zero if a clone of the device is open or one was opened
+ * or closed since the previous call on @asic, in which case state such
+ * as the index of an indirect window may have been changed by another
+ * handle.  Must be called with the hardware lock held.
+ */
+int umr_hw_shared(struct umr_asic *asic)
+{
+	struct umr_hw_lock *hl = asic->hw_lock;
+	int shared;
+
+	if (!hl)
+		return 0;
+	shared = hl->clones || asic->hw_generation != hl->generation;
+	asic->hw_generation = hl->generation;
+	return shared;
+}
+
+/**
+ * umr_free_hw_lock - Free the hardware lock of a device
+ *
+ * Called by umr_free_asic(), for a clone this drops it from the count
+ * of open clones.  The device itself is freed once the clones are
+ * closed.
+ */
+void umr_free_hw_lock(struct umr_asic *asic)
+{
+	if (asic->hw_lock && asic->parent) {
+		pthread_mutex_lock(&asic->hw_lock->lock);
+		--asic->hw_lock->clones;
+		++asic->hw_lock->generation;
+		pthread_mutex_unlock(&asic->hw_lock->lock);
+	} else if (asic->hw_lock) {
+		pthread_mutex_destroy(&asic->hw_lock->lock);
+		free(asic->hw_lock);
+	}
+	asic->hw_lock = NULL;
+}
@@ -94,6 +94,56 @@ static int find_pci_instance(const char* pci_string)
 	return -1;
 }
 
+/**
+ * umr_open_debugfs - Open the debugfs files of a device
+ *
+ * Opens the register, sensor, wave, VRAM and other debugfs files of
+ * the DRM instance of @asic.  Files that can't be opened and every
+ * file in 'no_kernel' mode are set to -1.
+ */
+void umr_open_debugfs(struct umr_asic *asic)
+{
+	char fname[256];
+
+	if (!asic->options.no_kernel) {
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_regs", asic->instance);
+		asic->fd.mmio = open(fname, O_RDWR);
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_regs_didt", asic->instance);
+		asic->fd.didt = open(fname, O_RDWR);
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_regs_pcie", asic->instance);
+		asic->fd.pcie = open(fname, O_RDWR);
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_regs_smc", asic->instance);
+		asic->fd.smc = open(fname, O_RDWR);
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_sensors", asic->instance);
+		asic->fd.sensors = open(fname, O_RDWR);
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_wave", asic->instance);
+		asic->fd.wave = open(fname, O_RDWR);
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_vram", asic->instance);
+		asic->fd.vram = open(fname, O_RDWR);
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_gpr", asic->instance);
+		asic->fd.gpr = open(fname, O_RDWR);
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_iova", asic->instance);
+		asic->fd.iova = open(fname, O_RDWR);
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_iomem", asic->instance);
+		asic->fd.iomem = open(fname, O_RDWR);
+		asic->fd.drm = -1; // default to closed
+		// if appending to the fd list remember to update close_asic(), clone_asic() and discover_by_did()...
+	} else {
+		// no files open!
+		asic->fd.mmio = -1;
+		asic->fd.didt = -1;
+		asic->fd.pcie = -1;
+		asic->fd.smc = -1;
+		asic->fd.sensors = -1;
+		asic->fd.wave = -1;
+		asic->fd.vram = -1;
+		asic->fd.gpr = -1;
+		asic->fd.drm = -1;
+		asic->fd.iova = -1;
+		asic->fd.iomem = -1;
+	}
+}
+
 /**
  * umr_discover_asic - Search for an asic in the system
  *
@@ -120,7 +170,7 @@ static int find_pci_instance(const char* pci_string)
  */
 struct umr_asic *umr_discover_asic(struct umr_options *options)
 {
-	char driver[512], name[256], fname[256];
+	char driver[512], name[256];
 	FILE *f;
 	unsigned did;
 	struct umr_asic *asic;
@@ -242,43 +292,7 @@ struct umr_asic *umr_discover_asic(struct umr_options *options)
 
 	if (asic) {
 		memcpy(&asic->options, options, sizeof(*options));
-		if (!asic->options.no_kernel) {
-			snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_regs", asic->instance);
-			asic->fd.mmio = open(fname, O_RDWR);
-			snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_regs_didt", asic->instance);
-			asic->fd.didt = open(fname, O_RDWR);
-			snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_regs_pcie", asic->instance);
-			asic->fd.pcie = open(fname, O_RDWR);
-			snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_regs_smc", asic->instance);
-			asic->fd.smc = open(fname, O_RDWR);
-			snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_sensors", asic->instance);
-			asic->fd.sensors = open(fname, O_RDWR);
-			snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_wave", asic->instance);
-			asic->fd.wave = open(fname, O_RDWR);
-			snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_vram", asic->instance);
-			asic->fd.vram = open(fname, O_RDWR);
-			snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_gpr", asic->instance);
-			asic->fd.gpr = open(fname, O_RDWR);
-			snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_iova", asic->instance);
-			asic->fd.iova = open(fname, O_RDWR);
-			snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_iomem", asic->instance);
-			asic->fd.iomem = open(fname, O_RDWR);
-			asic->fd.drm = -1; // default to closed
-			// if appending to the fd list remember to update close_asic() and discover_by_did()...
-		} else {
-			// no files open!
-			asic->fd.mmio = -1;
-			asic->fd.didt = -1;
-			asic->fd.pcie = -1;
-			asic->fd.smc = -1;
-			asic->fd.sensors = -1;
-			asic->fd.wave = -1;
-			asic->fd.vram = -1;
-			asic->fd.gpr = -1;
-			asic->fd.drm = -1;
-			asic->fd.iova = -1;
-			asic->fd.iomem = -1;
-		}
+		umr_open_debugfs(asic);
 
 		if (options->use_pci) {
 			// init PCI mapping
@@ -342,14 +356,13 @@ struct umr_asic *umr_discover_asic(struct umr_options *options)
 				}
 			}
 
-			// scan for a region 256K <= X <= 1024K which is 32-bit, non IO, non prefetchable
+			// scan for a region of at least 256K which is 32-bit, non IO, non prefetchable
 			if (use_region == 6) {
 				for (use_region = 0; use_region < 6; use_region++)
 					if (asic->pci.pdevice->regions[use_region].is_64 == 0 &&
 					    asic->pci.pdevice->regions[use_region].is_prefetchable == 0 &&
 					    asic->pci.pdevice->regions[use_region].is_IO == 0 &&
-					    asic->pci.pdevice->regions[use_region].size >= (256UL * 1024) &&
-					    asic->pci.pdevice->regions[use_region].size <= (1024UL * 1024))
+					    asic->pci.pdevice->regions[use_region].size >= (256UL * 1024))
 						break;
 			}
 
@@ -365,6 +378,7 @@ struct umr_asic *umr_discover_asic(struct umr_options *options)
 				goto err_pci;
 			}
 			asic->pci.mem = pcimem_v;
+			asic->pci.mem_size = asic->pci.pdevice->regions[use_region].size;
 		}
 	}
 
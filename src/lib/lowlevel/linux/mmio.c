@@ -23,72 +23,83 @@
  *
  */
 #include "umr.h"
+#include <errno.h>
 
 
+// index/data windows of the indirect register classes with 'use_pci'
+static const struct {
+	const char *name;
+	enum umr_ind_window_id window;
+} ind_classes[UMR_NUM_REGCLASS] = {
+	[REG_MMIO] = { "MMIO", UMR_NUM_IND_WINDOWS },
+	[REG_DIDT] = { "DIDT", UMR_IND_DIDT },
+	[REG_SMC]  = { "SMC",  UMR_IND_SMC },
+	[REG_PCIE] = { "PCIE", UMR_IND_PCIE },
+};
+
+/* is the MMIO register at byte address @addr inside the mapped PCI BAR */
+static inline int pci_reg_mapped(struct umr_asic *asic, uint64_t addr)
+{
+	return asic->pci.mem && addr < asic->pci.mem_size;
+}
+
+static int ind_class_fd(struct umr_asic *asic, enum regclass type)
+{
+	switch (type) {
+		case REG_DIDT: return asic->fd.didt;
+		case REG_SMC:  return asic->fd.smc;
+		case REG_PCIE: return asic->fd.pcie;
+		default:       return -1;
+	}
+}
+
 /**
- * umr_smc_read - Read an SMC register
+ * umr_ind_reg_read - Read a DIDT, SMC or PCIE register
  *
- * Reads an SMC register via debugfs or direct MMIO.
+ * Reads the register via debugfs or, with 'use_pci', through the
+ * index/data pair of its class.  @addr is the debugfs file offset.
  */
-static uint32_t umr_smc_read(struct umr_asic *asic, uint64_t addr)
+static uint32_t umr_ind_reg_read(struct umr_asic *asic, uint64_t addr, enum regclass type)
 {
-	uint32_t value;
+	struct umr_ind_window *w;
+	uint32_t value = 0;
+
 	if (asic->options.use_pci) {
-		switch (asic->config.gfx.family) {
-			case 110: // SI
-			case 120: // CIK
-			case 125: // KV
-			case 130: // VI
-				umr_write_reg_by_name(asic, "mmSMC_IND_INDEX_1", addr);
-				return umr_read_reg_by_name(asic, "mmSMC_IND_DATA_1");
-			case 135: // CZ
-				umr_write_reg_by_name(asic, "mmMP0PUB_IND_INDEX_1", addr);
-				return umr_read_reg_by_name(asic, "mmMP0PUB_IND_DATA_1");
-			default:
-				fprintf(stderr, "[BUG]: Unsupported family type in umr_smc_read()\n");
-				return 0;
+		w = umr_get_ind_window(asic, ind_classes[type].window);
+		if (!w) {
+			fprintf(stderr, "[BUG]: No %s index/data registers on asic [%s]\n", ind_classes[type].name, asic->asicname);
+			return 0;
 		}
-	} else {
-		if (lseek(asic->fd.smc, addr, SEEK_SET) < 0)
-			perror("Cannot seek to SMC address");
-		if (read(asic->fd.smc, &value, 4) != 4)
-			perror("Cannot read from SMC reg");
-		return value;
+		return umr_ind_read(asic, ind_classes[type].window, addr >> w->addr_shift);
 	}
 
+	if (pread(ind_class_fd(asic, type), &value, 4, addr) != 4)
+		fprintf(stderr, "Cannot read from %s reg: %s\n", ind_classes[type].name, strerror(errno));
+	return value;
 }
 
 /**
- * umr_smc_write - Write an SMC register
+ * umr_ind_reg_write - Write a DIDT, SMC or PCIE register
  *
- * Write an SMC register via debugfs or direct MMIO access.
+ * Writes the register via debugfs or, with 'use_pci', through the
+ * index/data pair of its class.
  */
-static uint32_t umr_smc_write(struct umr_asic *asic, uint64_t addr, uint32_t value)
+static int umr_ind_reg_write(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
 {
+	struct umr_ind_window *w;
+
 	if (asic->options.use_pci) {
-		switch (asic->config.gfx.family) {
-			case 110: // SI
-			case 120: // CIK
-			case 125: // KV
-			case 130: // VI
-				umr_write_reg_by_name(asic, "mmSMC_IND_INDEX_1", addr);
-				return umr_write_reg_by_name(asic, "mmSMC_IND_DATA_1", value);
-			case 135: // CZ
-				umr_write_reg_by_name(asic, "mmMP0PUB_IND_INDEX_1", addr);
-				return umr_write_reg_by_name(asic, "mmMP0PUB_IND_DATA_1", value);
-			default:
-				fprintf(stderr, "[BUG]: Unsupported family type in umr_smc_write()\n");
-				return -1;
-		}
-	} else {
-		if (lseek(asic->fd.smc, addr, SEEK_SET) < 0) {
-			perror("Cannot seek to MMIO address");
-			return -1;
-		}
-		if (write(asic->fd.smc, &value, 4) != 4) {
-			perror("Cannot write to MMIO reg");
+		w = umr_get_ind_window(asic, ind_classes[type].window);
+		if (!w) {
+			fprintf(stderr, "[BUG]: No %s index/data registers on asic [%s]\n", ind_classes[type].name, asic->asicname);
 			return -1;
 		}
+		return umr_ind_write(asic, ind_classes[type].window, addr >> w->addr_shift, value);
+	}
+
+	if (pwrite(ind_class_fd(asic, type), &value, 4, addr) != 4) {
+		fprintf(stderr, "Cannot write to %s reg: %s\n", ind_classes[type].name, strerror(errno));
+		return -1;
 	}
 	return 0;
 }
@@ -96,7 +107,7 @@ static uint32_t umr_smc_write(struct umr_asic *asic, uint64_t addr, uint32_t val
 /**
  * umr_read_reg - Read a register
  *
- * Reads an SMC or MMIO register by address.
+ * Reads an MMIO, DIDT, SMC or PCIE register by address.
  */
 uint32_t umr_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
 {
@@ -110,18 +121,18 @@ uint32_t umr_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
 
 	switch (type) {
 		case REG_MMIO:
-			if (asic->pci.mem && !(addr & ~0xFFFFFULL)) { // only use pci if enabled and not using high bits
+			if (pci_reg_mapped(asic, addr)) { // only use pci if enabled and not using high bits
 				return asic->pci.mem[addr/4];
 			} else {
-				if (lseek(asic->fd.mmio, addr, SEEK_SET) < 0)
-					perror("Cannot seek to MMIO address");
-				if (read(asic->fd.mmio, &value, 4) != 4)
+				if (pread(asic->fd.mmio, &value, 4, addr) != 4)
 					perror("Cannot read from MMIO reg");
 				return value;
 			}
 			break;
+		case REG_DIDT:
 		case REG_SMC:
-			return umr_smc_read(asic, addr);
+		case REG_PCIE:
+			return umr_ind_reg_read(asic, addr, type);
 		default:
 			fprintf(stderr, "[BUG]: Unsupported register type in umr_read_reg().\n");
 			return 0;
@@ -131,7 +142,7 @@ uint32_t umr_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
 /**
  * umr_write_reg - Write a register
  *
- * Write to an SMC or MMIO register by address.
+ * Write to an MMIO, DIDT, SMC or PCIE register by address.
  */
 int umr_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
 {
@@ -144,24 +155,230 @@ int umr_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum reg
 
 	switch (type) {
 		case REG_MMIO:
-			if (asic->pci.mem && !(addr & ~0xFFFFFULL)) {
+			umr_ind_note_write(asic, addr, value);
+			if (pci_reg_mapped(asic, addr)) {
 				asic->pci.mem[addr/4] = value;
 			} else {
-				if (lseek(asic->fd.mmio, addr, SEEK_SET) < 0) {
-					perror("Cannot seek to MMIO address");
-					return -1;
-				}
-				if (write(asic->fd.mmio, &value, 4) != 4) {
+				if (pwrite(asic->fd.mmio, &value, 4, addr) != 4) {
 					perror("Cannot write to MMIO reg");
 					return -1;
 				}
 			}
 			break;
+		case REG_DIDT:
 		case REG_SMC:
-			return umr_smc_write(asic, addr, value);
+		case REG_PCIE:
+			return umr_ind_reg_write(asic, addr, value, type);
 		default:
 			fprintf(stderr, "[BUG]: Unsupported register type in umr_write_reg().\n");
 			return -1;
 	}
 	return 0;
 }
+
+/**
+ * umr_pread_regs - Read a list of registers from debugfs files
+ *
+ * @fds: The register files indexed by register class
+ * @regs: The byte addresses (including any bank selection bits) and
+ * classes of the registers
+ * @values: Receives the register values
+ * @n: The number of registers
+ *
+ * Runs of registers that are adjacent in the same file are read with a
+ * single pread() since the debugfs register files advance one register
+ * per word read.  Returns the number of registers read which is less
+ * than @n if a read failed (errno is left set by the failing read).
+ */
+int umr_pread_regs(const int *fds, const struct umr_reg_addr *regs, uint32_t *values, int n)
+{
+	int x, run, got;
+	ssize_t r;
+
+	for (x = 0; x < n; x += run) {
+		for (run = 1; x + run < n &&
+			regs[x + run].type == regs[x].type &&
+			regs[x + run].addr == regs[x].addr + 4 * run; run++);
+
+		r = pread(fds[regs[x].type], &values[x], 4 * run, regs[x].addr);
+		got = r > 0 ? r / 4 : 0;
+		if (got < run) {
+			// the kernel may stop early, retry the rest one at a time
+			for (x += got, run -= got; run; x++, run--) {
+				if (pread(fds[regs[x].type], &values[x], 4, regs[x].addr) != 4)
+					return x;
+			}
+		}
+	}
+	return n;
+}
+
+/**
+ * umr_read_regs_batch - Read a list of registers
+ *
+ * @regs: The byte addresses and classes of the registers
+ * @values: Receives the register values
+ * @n: The number of registers
+ *
+ * Reads the same registers as calling umr_read_reg() on each entry but
+ * with adjacent registers read from debugfs in one access and separate
+ * runs read concurrently.  Registers
+ * that could not be read are reported and return 0.  Returns 0 on
+ * success or -1 if any register could not be read.
+ */
+int umr_read_regs_batch(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n)
+{
+	struct umr_reg_addr *run;
+	struct umr_ind_window *w;
+	int x, y, k, got, fds[UMR_NUM_REGCLASS], r = 0;
+	uint64_t addr;
+
+	run = calloc(n, sizeof run[0]);
+	if (!run) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return -1;
+	}
+
+	fds[REG_MMIO] = asic->fd.mmio;
+	fds[REG_DIDT] = asic->fd.didt;
+	fds[REG_SMC] = asic->fd.smc;
+	fds[REG_PCIE] = asic->fd.pcie;
+
+	for (x = 0; x < n; ) {
+		if ((unsigned)regs[x].type >= UMR_NUM_REGCLASS) {
+			fprintf(stderr, "[BUG]: Unsupported register type in umr_read_regs_batch().\n");
+			values[x++] = 0;
+			r = -1;
+			continue;
+		}
+
+		addr = regs[x].addr;
+		if (asic->options.no_kernel)
+			addr &= 0xFFFFFF;
+
+		// consecutive indirect registers share one index write
+		if (regs[x].type != REG_MMIO && asic->options.use_pci) {
+			w = umr_get_ind_window(asic, ind_classes[regs[x].type].window);
+			for (k = 1; w && x + k < n && regs[x + k].type == regs[x].type; k++) {
+				if ((asic->options.no_kernel ? regs[x + k].addr & 0xFFFFFF : regs[x + k].addr) != addr + 4 * k)
+					break;
+			}
+			if (w && k > 1) {
+				if (umr_ind_access(asic, ind_classes[regs[x].type].window, addr >> w->addr_shift, &values[x], k, 0))
+					r = -1;
+			} else {
+				values[x] = umr_ind_reg_read(asic, addr, regs[x].type);
+				k = 1;
+			}
+			x += k;
+			continue;
+		}
+
+		// direct PCI accesses are done one at a time
+		if (regs[x].type == REG_MMIO && pci_reg_mapped(asic, addr)) {
+			values[x] = umr_read_reg(asic, regs[x].addr, regs[x].type);
+			++x;
+			continue;
+		}
+
+		// gather registers that go to the same file
+		for (k = 0, y = x; y < n && regs[y].type == regs[x].type; y++, k++) {
+			run[k] = regs[y];
+			if (asic->options.no_kernel)
+				run[k].addr &= 0xFFFFFF;
+			if (regs[y].type == REG_MMIO && pci_reg_mapped(asic, run[k].addr))
+				break;
+		}
+
+		got = umr_aio_read_regs(umr_get_aio(asic), fds, run, &values[x], k);
+		if (got < k) {
+			perror("Cannot read from register");
+			values[x + got] = 0;
+			r = -1;
+			++got;
+		}
+		x += got;
+	}
+
+	free(run);
+	return r;
+}
+
+/**
+ * umr_write_regs_batch - Write a list of registers
+ *
+ * @regs: The byte addresses and classes of the registers
+ * @values: The values to write
+ * @n: The number of registers
+ *
+ * Writes the registers in order like calling umr_write_reg() on each
+ * entry but runs of adjacent registers in the same debugfs file are
+ * written with one pwrite() and direct MMIO stores are followed by a
+ * single memory barrier instead of being ordered one by one.  Returns 0
+ * on success or -1 if any register could not be written.
+ */
+int umr_write_regs_batch(struct umr_asic *asic, const struct umr_reg_addr *regs, const uint32_t *values, int n)
+{
+	int x, y, run, fds[UMR_NUM_REGCLASS], stores = 0, r = 0;
+	uint64_t addr;
+	ssize_t w;
+
+	fds[REG_MMIO] = asic->fd.mmio;
+	fds[REG_DIDT] = asic->fd.didt;
+	fds[REG_SMC] = asic->fd.smc;
+	fds[REG_PCIE] = asic->fd.pcie;
+
+	for (x = 0; x < n; x += run) {
+		run = 1;
+		if ((unsigned)regs[x].type >= UMR_NUM_REGCLASS) {
+			fprintf(stderr, "[BUG]: Unsupported register type in umr_write_regs_batch().\n");
+			r = -1;
+			continue;
+		}
+
+		addr = regs[x].addr;
+		if (asic->options.no_kernel)
+			addr &= 0xFFFFFF;
+		if (regs[x].type == REG_MMIO)
+			umr_ind_note_write(asic, addr, values[x]);
+
+		if (regs[x].type == REG_MMIO && pci_reg_mapped(asic, addr)) {
+			asic->pci.mem[addr/4] = values[x];
+			stores = 1;
+			continue;
+		}
+
+		// stores must land before anything issued through the kernel
+		if (stores) {
+			__sync_synchronize();
+			stores = 0;
+		}
+
+		if (regs[x].type != REG_MMIO && asic->options.use_pci) {
+			if (umr_ind_reg_write(asic, addr, values[x], regs[x].type))
+				r = -1;
+			continue;
+		}
+
+		// the debugfs files advance one register per word written
+		for (; x + run < n && regs[x + run].type == regs[x].type; run++) {
+			if ((asic->options.no_kernel ? regs[x + run].addr & 0xFFFFFF : regs[x + run].addr) != addr + 4 * run)
+				break;
+		}
+
+		w = pwrite(fds[regs[x].type], &values[x], 4 * run, addr);
+		if (w != 4 * run) {
+			// the kernel may stop early, retry the rest one at a time
+			for (y = w > 0 ? w / 4 : 0; y < run; y++) {
+				if (pwrite(fds[regs[x].type], &values[x + y], 4, addr + 4 * y) != 4) {
+					perror("Cannot write to register");
+					r = -1;
+				}
+			}
+		}
+	}
+
+	if (stores)
+		__sync_synchronize();
+	return r;
+}
@@ -28,22 +28,18 @@ static void wave_read_regs_via_mmio(struct umr_asic *asic, uint32_t simd,
 			   uint32_t wave, uint32_t thread,
 			   uint32_t regno, uint32_t num, uint32_t *out)
 {
-	struct umr_reg *ind_index, *ind_data;
+	const struct umr_sq_ind_handles *h;
 	uint32_t data;
 
-	ind_index = umr_find_reg_data(asic, "mmSQ_IND_INDEX");
-	ind_data  = umr_find_reg_data(asic, "mmSQ_IND_DATA");
-
-	if (ind_index && ind_data) {
-		data = umr_bitslice_compose_value(asic, ind_index, "WAVE_ID", wave);
-		data |= umr_bitslice_compose_value(asic, ind_index, "SIMD_ID", simd);
-		data |= umr_bitslice_compose_value(asic, ind_index, "INDEX", regno);
-		data |= umr_bitslice_compose_value(asic, ind_index, "THREAD_ID", thread);
-		data |= umr_bitslice_compose_value(asic, ind_index, "FORCE_READ", 1);
-		data |= umr_bitslice_compose_value(asic, ind_index, "AUTO_INCR", 1);
-		umr_write_reg(asic, ind_index->addr * 4, data, REG_MMIO);
-		while (num--)
-			*(out++) = umr_read_reg(asic, ind_data->addr * 4, REG_MMIO);
+	h = umr_get_sq_ind_handles(asic);
+	if (h) {
+		data = umr_bitslice_compose_by_handle(&h->wave_id, wave);
+		data |= umr_bitslice_compose_by_handle(&h->simd_id, simd);
+		data |= umr_bitslice_compose_by_handle(&h->index_field, regno);
+		data |= umr_bitslice_compose_by_handle(&h->thread_id, thread);
+		data |= umr_bitslice_compose_by_handle(&h->force_read, 1);
+		data |= umr_bitslice_compose_by_handle(&h->auto_incr, 1);
+		umr_ind_access(asic, UMR_IND_SQ, data, out, num, 0);
 	} else {
 		fprintf(stderr, "[BUG]: The required SQ_IND_{INDEX,DATA} registers are not found on the asic <%s>\n", asic->asicname);
 		return;
@@ -58,6 +54,7 @@ int umr_read_sgprs(struct umr_asic *asic, struct umr_wave_status *ws, uint32_t *
 	uint64_t addr, shift;
 	int r;
 
+	umr_flush_writes(asic);
 	if (asic->family <= FAMILY_CIK)
 		shift = 3;  // on SI..CIK allocations were done in 8-dword blocks
 	else
@@ -74,19 +71,18 @@ int umr_read_sgprs(struct umr_asic *asic, struct umr_wave_status *ws, uint32_t *
 			((uint64_t)ws->hw_id.simd_id << 44)      |
 			(0ULL << 52); // thread_id
 
-		lseek(asic->fd.gpr, addr, SEEK_SET);
-		r = read(asic->fd.gpr, dst, 4 * ((ws->gpr_alloc.sgpr_size + 1) << shift));
+		r = umr_trace_pread(asic, "amdgpu_gpr", asic->fd.gpr, dst, 4 * ((ws->gpr_alloc.sgpr_size + 1) << shift), addr);
 		if (r < 0)
 			return r;
 
 		// read trap if any
 		if (ws->wave_status.trap_en || ws->wave_status.priv) {
 			addr += 0x6C;
-			lseek(asic->fd.gpr, addr, SEEK_SET);
-			r = read(asic->fd.gpr, &dst[0x6C], 4 * 16);
+			r = umr_trace_pread(asic, "amdgpu_gpr", asic->fd.gpr, &dst[0x6C], 4 * 16, addr);
 		}
 		return r;
 	} else {
+		umr_lock_hw(asic);
 		umr_grbm_select_index(asic, ws->hw_id.se_id, ws->hw_id.sh_id, ws->hw_id.cu_id);
 		wave_read_regs_via_mmio(asic, ws->hw_id.simd_id, ws->hw_id.wave_id, 0, 0x200,
 					(ws->gpr_alloc.sgpr_size + 1) << shift, dst);
@@ -94,6 +90,7 @@ int umr_read_sgprs(struct umr_asic *asic, struct umr_wave_status *ws, uint32_t *
 			wave_read_regs_via_mmio(asic, ws->hw_id.simd_id, ws->hw_id.wave_id, 0, 0x26C,
 						16, &dst[0x6C]);
 		umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
+		umr_unlock_hw(asic);
 		return 0;
 	}
 }
@@ -109,6 +106,7 @@ int umr_read_vgprs(struct umr_asic *asic, struct umr_wave_status *ws, uint32_t t
 	if (asic->family < FAMILY_AI)
 		return -1;
 
+	umr_flush_writes(asic);
 	if (!asic->options.no_kernel) {
 		addr =
 			(0ULL << 60)                             | // reading VGPRs
@@ -120,13 +118,78 @@ int umr_read_vgprs(struct umr_asic *asic, struct umr_wave_status *ws, uint32_t t
 			((uint64_t)ws->hw_id.simd_id << 44)      |
 			((uint64_t)thread << 52);
 
-		lseek(asic->fd.gpr, addr, SEEK_SET);
-		return read(asic->fd.gpr, dst, 4 * ((ws->gpr_alloc.vgpr_size + 1) << 2));
+		return umr_trace_pread(asic, "amdgpu_gpr", asic->fd.gpr, dst, 4 * ((ws->gpr_alloc.vgpr_size + 1) << 2), addr);
 	} else {
+		umr_lock_hw(asic);
 		umr_grbm_select_index(asic, ws->hw_id.se_id, ws->hw_id.sh_id, ws->hw_id.cu_id);
 		wave_read_regs_via_mmio(asic, ws->hw_id.simd_id, ws->hw_id.wave_id, thread, 0x400,
 					(ws->gpr_alloc.vgpr_size + 1) << 2, dst);
 		umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
+		umr_unlock_hw(asic);
 		return 0;
 	}
 }
+
+static void vgpr_read_done(void *data, int result)
+{
+	if (result < 0)
+		*(int *)data = 0;
+}
+
+/**
+ * umr_queue_gprs - Queue the reads of the GPRs of a wave
+ *
+ * @aio: The reader to queue the reads on
+ * @ws: The wave status of the wave
+ * @sgprs: Receives the SGPRs like umr_read_sgprs()
+ * @vgprs: Receives the VGPRs of all 64 threads (256 per thread) or NULL
+ * @have_vgprs: Set to 1, cleared once a VGPR read fails
+ *
+ * The data is only valid after umr_aio_wait().  Returns -1 if the GPRs
+ * can't be read through debugfs (the caller then uses umr_read_sgprs()
+ * and umr_read_vgprs()).
+ */
+int umr_queue_gprs(struct umr_asic *asic, struct umr_aio *aio, struct umr_wave_status *ws,
+		   uint32_t *sgprs, uint32_t *vgprs, int *have_vgprs)
+{
+	uint64_t addr, base, shift, n;
+	uint32_t thread;
+
+	if (asic->options.no_kernel)
+		return -1;
+
+	umr_flush_writes(asic);
+	if (asic->family <= FAMILY_CIK)
+		shift = 3;
+	else
+		shift = 4;
+
+	base =
+		((uint64_t)ws->hw_id.se_id << 12)        |
+		((uint64_t)ws->hw_id.sh_id << 20)        |
+		((uint64_t)ws->hw_id.cu_id << 28)        |
+		((uint64_t)ws->hw_id.wave_id << 36)      |
+		((uint64_t)ws->hw_id.simd_id << 44);
+
+	// the trap registers are read over the SGPRs so split the read around them
+	addr = (1ULL << 60) | base;
+	n = (ws->gpr_alloc.sgpr_size + 1) << shift;
+	if (ws->wave_status.trap_en || ws->wave_status.priv) {
+		umr_aio_read(aio, asic->fd.gpr, sgprs, 4 * (n < 0x6C ? n : 0x6C), addr, NULL, NULL);
+		umr_aio_read(aio, asic->fd.gpr, &sgprs[0x6C], 4 * 16, addr + 0x6C, NULL, NULL);
+		if (n > 0x7C)
+			umr_aio_read(aio, asic->fd.gpr, &sgprs[0x7C], 4 * (n - 0x7C), addr + 0x7C, NULL, NULL);
+	} else {
+		umr_aio_read(aio, asic->fd.gpr, sgprs, 4 * n, addr, NULL, NULL);
+	}
+
+	// reading VGPR is not supported on pre GFX9 devices
+	*have_vgprs = vgprs && asic->family >= FAMILY_AI;
+	if (!*have_vgprs)
+		return 0;
+	n = (ws->gpr_alloc.vgpr_size + 1) << 2;
+	for (thread = 0; thread < 64; thread++)
+		umr_aio_read(aio, asic->fd.gpr, &vgprs[256 * thread], 4 * n, base | ((uint64_t)thread << 52),
+			     vgpr_read_done, have_vgprs);
+	return 0;
+}
@@ -31,9 +31,10 @@ int umr_read_sensor(struct umr_asic *asic, int sensor, void *dst, int *size)
 {
 	int r;
 
+	umr_flush_writes(asic);
+
 	// multiply sensor index by 4 to get byte address
-	lseek(asic->fd.sensors, sensor*4, SEEK_SET);
-	r = read(asic->fd.sensors, dst, *size);
+	r = umr_trace_pread(asic, "amdgpu_sensors", asic->fd.sensors, dst, *size, sensor*4);
 	if (r != *size) {
 		return -1;
 	}
@@ -30,17 +30,37 @@
 void umr_free_asic(struct umr_asic *asic)
 {
         int x;
+
+        // deferred writes still need the device
+        umr_defer_writes(asic, 0);
+
+        umr_aio_destroy(asic->aio);
+        umr_vm_cache_disable(asic);
+
+        // a clone only owns its callbacks and private lookup tables
+        if (asic->parent) {
+                umr_disable_access_stats(asic);
+                umr_close_trace(asic);
+                umr_invalidate_reg_indices(asic);
+                umr_free_hw_lock(asic);
+                free(asic);
+                return;
+        }
+
         if (asic->pci.mem != NULL) {
                 // free PCI mapping
                 pci_device_unmap_range(asic->pci.pdevice, asic->pci.mem, asic->pci.pdevice->regions[asic->pci.region].size);
                 pci_system_cleanup();
         }
         for (x = 0; x < asic->no_blocks; x++) {
-                free(asic->blocks[x]->regs);
+                umr_release_ip_block_regs(asic->blocks[x]);
                 free(asic->blocks[x]);
         }
         free(asic->blocks);
-        free(asic->mmio_accel.reglist);
-        free(asic->mmio_accel.iplist);
+        umr_disable_access_stats(asic);
+        umr_close_trace(asic);
+        umr_invalidate_reg_indices(asic);
+        umr_free_regdb(asic);
+        umr_free_hw_lock(asic);
         free(asic);
 }
@@ -26,24 +26,27 @@
 
 static int umr_get_wave_sq_info_vi(struct umr_asic *asic, unsigned se, unsigned sh, unsigned cu, struct umr_wave_status *ws)
 {
+	const struct umr_sq_ind_handles *h;
 	uint32_t value;
-	uint64_t index, data, bank;
+	uint64_t bank;
 
-	index = umr_find_reg(asic, "mmSQ_IND_INDEX") * 4;
-	data = umr_find_reg(asic, "mmSQ_IND_DATA") * 4;
+	h = umr_get_sq_ind_handles(asic);
 	bank =
 		(1ULL << 62) |
 		(((uint64_t)se) << 24) |
 		(((uint64_t)sh) << 34) |
 		(((uint64_t)cu) << 44);
 
-	if (!index || !data) {
+	if (!h) {
 		fprintf(stderr, "[BUG]: Cannot find SQ indirect registers on this asic!\n");
 		return -1;
 	}
 
-	umr_write_reg(asic, index|bank, 8 << 16, REG_MMIO);
-	value = umr_read_reg(asic, data|bank, REG_MMIO);
+	// an index/data pair even through debugfs
+	umr_lock_hw(asic);
+	asic->reg_funcs.write_reg(asic, ((uint64_t)h->index->addr * 4)|bank, 8 << 16, REG_MMIO);
+	value = asic->reg_funcs.read_reg(asic, ((uint64_t)h->data->addr * 4)|bank, REG_MMIO);
+	umr_unlock_hw(asic);
 	ws->sq_info.busy = value & 1;
 	ws->sq_info.wave_level = (value >> 4) & 0x3F;
 	return 0;
@@ -51,19 +54,18 @@ static int umr_get_wave_sq_info_vi(struct umr_asic *asic, unsigned se, unsigned
 
 static uint32_t wave_read_ind(struct umr_asic *asic, uint32_t simd, uint32_t wave, uint32_t address)
 {
-	struct umr_reg *ind_index, *ind_data;
+	const struct umr_sq_ind_handles *h;
 	uint32_t data;
 
-	ind_index = umr_find_reg_data(asic, "mmSQ_IND_INDEX");
-	ind_data  = umr_find_reg_data(asic, "mmSQ_IND_DATA");
-
-	if (ind_index && ind_data) {
-		data = umr_bitslice_compose_value(asic, ind_index, "WAVE_ID", wave);
-		data |= umr_bitslice_compose_value(asic, ind_index, "SIMD_ID", simd);
-		data |= umr_bitslice_compose_value(asic, ind_index, "INDEX", address);
-		data |= umr_bitslice_compose_value(asic, ind_index, "FORCE_READ", 1);
-		umr_write_reg(asic, ind_index->addr * 4, data, REG_MMIO);
-		return umr_read_reg(asic, ind_data->addr * 4, REG_MMIO);
+	h = umr_get_sq_ind_handles(asic);
+	if (h) {
+		// with auto increment a following read of address+1 needs no index write
+		data = umr_bitslice_compose_by_handle(&h->wave_id, wave);
+		data |= umr_bitslice_compose_by_handle(&h->simd_id, simd);
+		data |= umr_bitslice_compose_by_handle(&h->index_field, address);
+		data |= umr_bitslice_compose_by_handle(&h->force_read, 1);
+		data |= umr_bitslice_compose_by_handle(&h->auto_incr, 1);
+		return umr_ind_read(asic, UMR_IND_SQ, data);
 	} else {
 		fprintf(stderr, "[BUG]: The required SQ_IND_{INDEX,DATA} registers are not found on the asic <%s>\n", asic->asicname);
 		return -1;
@@ -99,30 +101,9 @@ static int read_wave_status_via_mmio(struct umr_asic *asic, uint32_t simd, uint3
 	return 0;
 }
 
-static int umr_get_wave_status_vi(struct umr_asic *asic, unsigned se, unsigned sh, unsigned cu, unsigned simd, unsigned wave, struct umr_wave_status *ws)
+static int umr_parse_wave_status_vi(const uint32_t *buf, struct umr_wave_status *ws)
 {
-	uint32_t x, value, buf[32];
-	int r;
-
-	memset(buf, 0, sizeof buf);
-
-	if (!asic->options.no_kernel) {
-		lseek(asic->fd.wave,
-			0 |
-			((uint64_t)se << 7) |
-			((uint64_t)sh << 15) |
-			((uint64_t)cu << 23) |
-			((uint64_t)wave << 31) |
-			((uint64_t)simd << 37), SEEK_SET);
-		r = read(asic->fd.wave, &buf, 32*4);
-		if (r <= 0)
-			return -1;
-	} else {
-		int n = 0;
-		umr_grbm_select_index(asic, se, sh, cu);
-		read_wave_status_via_mmio(asic, simd, wave, &buf[0], &n);
-		umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
-	}
+	uint32_t x, value;
 
 	if (buf[0] != 0) {
 		fprintf(stderr, "[ERROR]: Was expecting type 0 wave data on a CZ/VI part!\n");
@@ -207,31 +188,39 @@ static int umr_get_wave_status_vi(struct umr_asic *asic, unsigned se, unsigned s
 	return 0;
 }
 
-static int umr_get_wave_status_ai(struct umr_asic *asic, unsigned se, unsigned sh, unsigned cu, unsigned simd, unsigned wave, struct umr_wave_status *ws)
+static int umr_get_wave_status_vi(struct umr_asic *asic, unsigned se, unsigned sh, unsigned cu, unsigned simd, unsigned wave, struct umr_wave_status *ws)
 {
-	uint32_t x, value, buf[32];
+	uint32_t buf[32];
 	int r;
 
 	memset(buf, 0, sizeof buf);
 
 	if (!asic->options.no_kernel) {
-		lseek(asic->fd.wave,
+		r = umr_trace_pread(asic, "amdgpu_wave", asic->fd.wave, &buf, 32*4,
 			0 |
 			((uint64_t)se << 7) |
 			((uint64_t)sh << 15) |
 			((uint64_t)cu << 23) |
 			((uint64_t)wave << 31) |
-			((uint64_t)simd << 37), SEEK_SET);
-		r = read(asic->fd.wave, &buf, 32*4);
-		if (r < 0)
+			((uint64_t)simd << 37));
+		if (r <= 0)
 			return -1;
 	} else {
 		int n = 0;
+		umr_lock_hw(asic);
 		umr_grbm_select_index(asic, se, sh, cu);
 		read_wave_status_via_mmio(asic, simd, wave, &buf[0], &n);
 		umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
+		umr_unlock_hw(asic);
 	}
 
+	return umr_parse_wave_status_vi(buf, ws);
+}
+
+static int umr_parse_wave_status_ai(const uint32_t *buf, struct umr_wave_status *ws)
+{
+	uint32_t x, value;
+
 	if (buf[0] != 1) {
 		fprintf(stderr, "[ERROR]: Was expecting type 1 wave data on a FAMILY_AI part!\n");
 		return -1;
@@ -310,6 +299,35 @@ static int umr_get_wave_status_ai(struct umr_asic *asic, unsigned se, unsigned s
 	return 0;
 }
 
+static int umr_get_wave_status_ai(struct umr_asic *asic, unsigned se, unsigned sh, unsigned cu, unsigned simd, unsigned wave, struct umr_wave_status *ws)
+{
+	uint32_t buf[32];
+	int r;
+
+	memset(buf, 0, sizeof buf);
+
+	if (!asic->options.no_kernel) {
+		r = umr_trace_pread(asic, "amdgpu_wave", asic->fd.wave, &buf, 32*4,
+			0 |
+			((uint64_t)se << 7) |
+			((uint64_t)sh << 15) |
+			((uint64_t)cu << 23) |
+			((uint64_t)wave << 31) |
+			((uint64_t)simd << 37));
+		if (r < 0)
+			return -1;
+	} else {
+		int n = 0;
+		umr_lock_hw(asic);
+		umr_grbm_select_index(asic, se, sh, cu);
+		read_wave_status_via_mmio(asic, simd, wave, &buf[0], &n);
+		umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
+		umr_unlock_hw(asic);
+	}
+
+	return umr_parse_wave_status_ai(buf, ws);
+}
+
 /**
  * umr_get_wave_status - Read the SQ wave status (et al.) data
  *
@@ -319,6 +337,7 @@ static int umr_get_wave_status_ai(struct umr_asic *asic, unsigned se, unsigned s
  */
 int umr_get_wave_status(struct umr_asic *asic, unsigned se, unsigned sh, unsigned cu, unsigned simd, unsigned wave, struct umr_wave_status *ws)
 {
+	umr_flush_writes(asic);
 	if (asic->family == FAMILY_AI || asic->family == FAMILY_RV)
 		return umr_get_wave_status_ai(asic, se, sh, cu, simd, wave, ws);
 	else if (asic->family <= FAMILY_VI)
@@ -328,7 +347,50 @@ int umr_get_wave_status(struct umr_asic *asic, unsigned se, unsigned sh, unsigne
 
 int umr_get_wave_sq_info(struct umr_asic *asic, unsigned se, unsigned sh, unsigned cu, struct umr_wave_status *ws)
 {
+	umr_flush_writes(asic);
 	if (asic->family <= FAMILY_RV)
 		return umr_get_wave_sq_info_vi(asic, se, sh, cu, ws);
 	return -1;
 }
+
+/**
+ * umr_queue_wave_status - Queue the read of a wave status
+ *
+ * @aio: The reader to queue the read on
+ * @se, @sh, @cu, @simd, @wave - Identification of the specific wave to read
+ * @buf: Receives the 32 words to pass to umr_parse_wave_status()
+ * @cb, @data: Completion callback of the read (see umr_aio_read())
+ *
+ * Returns -1 if the wave status can't be read through debugfs (the
+ * caller then uses umr_get_wave_status()).
+ */
+int umr_queue_wave_status(struct umr_asic *asic, struct umr_aio *aio, unsigned se, unsigned sh, unsigned cu, unsigned simd, unsigned wave,
+			  uint32_t *buf, umr_aio_callback cb, void *data)
+{
+	if (asic->options.no_kernel || asic->family > FAMILY_RV)
+		return -1;
+
+	umr_flush_writes(asic);
+	memset(buf, 0, 32 * 4);
+	return umr_aio_read(aio, asic->fd.wave, buf, 32 * 4,
+		0 |
+		((uint64_t)se << 7) |
+		((uint64_t)sh << 15) |
+		((uint64_t)cu << 23) |
+		((uint64_t)wave << 31) |
+		((uint64_t)simd << 37), cb, data);
+}
+
+/**
+ * umr_parse_wave_status - Decode a wave status read with umr_queue_wave_status()
+ *
+ * Stores the wave data in @ws if successful.
+ */
+int umr_parse_wave_status(struct umr_asic *asic, const uint32_t *buf, struct umr_wave_status *ws)
+{
+	if (asic->family == FAMILY_AI || asic->family == FAMILY_RV)
+		return umr_parse_wave_status_ai(buf, ws);
+	else if (asic->family <= FAMILY_VI)
+		return umr_parse_wave_status_vi(buf, ws);
+	return -1;
+}
@@ -42,6 +42,71 @@ uint32_t umr_read_reg_by_name_by_ip(struct umr_asic *asic, char *ip, char *name)
 		return 0;
 }
 
+/**
+ * umr_read_regs - Read a list of registers
+ *
+ * Reads @n registers described by @regs into @values through the
+ * asic's read_regs() callback or read_reg() for each register if the
+ * backend doesn't batch accesses.  Returns 0 on success.
+ */
+int umr_read_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n)
+{
+	int x;
+
+	if (asic->reg_funcs.read_regs)
+		return asic->reg_funcs.read_regs(asic, regs, values, n);
+
+	for (x = 0; x < n; x++)
+		values[x] = asic->reg_funcs.read_reg(asic, regs[x].addr, regs[x].type);
+	return 0;
+}
+
+/**
+ * umr_read_regs_by_name_by_ip - Read a list of registers by name
+ *
+ * Reads the registers named by @names from the @ip block (or the first
+ * block that contains them if @ip is NULL) into @values with a single
+ * umr_read_regs() call.  Registers that are not found read as 0 the same
+ * as with umr_read_reg_by_name_by_ip().  Returns 0 on success.
+ */
+int umr_read_regs_by_name_by_ip(struct umr_asic *asic, char *ip, char **names, uint32_t *values, int n)
+{
+	struct umr_reg_addr *regs;
+	struct umr_reg *reg;
+	int x, k, r, *slot;
+
+	regs = calloc(n, sizeof regs[0]);
+	slot = calloc(n, sizeof slot[0]);
+	if (!regs || !slot) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		free(regs);
+		free(slot);
+		return -1;
+	}
+
+	for (k = x = 0; x < n; x++) {
+		values[x] = 0;
+		reg = umr_find_reg_data_by_ip(asic, ip, names[x]);
+		if (reg) {
+			regs[k].addr = reg->addr * (reg->type == REG_MMIO ? 4 : 1);
+			regs[k].type = reg->type;
+			slot[k++] = x;
+		}
+	}
+
+	// read into the front of values then move them into place
+	r = umr_read_regs(asic, regs, values, k);
+	while (k--) {
+		uint32_t v = values[k];
+		values[k] = 0;
+		values[slot[k]] = v;
+	}
+
+	free(regs);
+	free(slot);
+	return r;
+}
+
 /**
  * umr_read_reg_by_name - Read a register by name
  *
@@ -182,6 +247,110 @@ uint32_t umr_bitslice_compose_value_by_name(struct umr_asic *asic, char *regname
 	return umr_bitslice_compose_value_by_name_by_ip(asic, NULL, regname, bitname, regvalue);
 }
 
+/**
+ * umr_bitfield_handle_init - Resolve a bitfield of a register
+ *
+ * Looks up the bitfield named @bitname in @reg once and stores its
+ * mask and shift in @h so that umr_bitslice_by_handle() and
+ * umr_bitslice_compose_by_handle() do not have to search the
+ * bitfields by name on every call.
+ *
+ * Returns -1 if the bitfield does not exist in which case @h
+ * composes and slices to zero.
+ */
+int umr_bitfield_handle_init(struct umr_asic *asic, struct umr_reg *reg, const char *bitname, struct umr_bitfield_handle *h)
+{
+	int i;
+
+	h->reg = reg;
+	h->mask = 0;
+	h->shift = 0;
+	for (i = 0; i < reg->no_bits; i++) {
+		if (!strcmp(bitname, reg->bits[i].regname)) {
+			h->shift = reg->bits[i].start;
+			h->mask = (1ULL << (reg->bits[i].stop - reg->bits[i].start + 1)) - 1;
+			return 0;
+		}
+	}
+	fprintf(stderr, "[BUG]: Bitfield [%s] not found in reg [%s] on asic [%s]\n", bitname, reg->regname, asic->asicname);
+	return -1;
+}
+
+/**
+ * umr_bitfield_handle_by_name_by_ip - Resolve a bitfield by IP and register name
+ *
+ * The @ip name can be NULL to search for the first matching
+ * register in the ASIC.
+ */
+int umr_bitfield_handle_by_name_by_ip(struct umr_asic *asic, char *ip, char *regname, const char *bitname, struct umr_bitfield_handle *h)
+{
+	struct umr_reg *reg;
+
+	reg = umr_find_reg_data_by_ip(asic, ip, regname);
+	if (!reg) {
+		memset(h, 0, sizeof *h);
+		return -1;
+	}
+	return umr_bitfield_handle_init(asic, reg, bitname, h);
+}
+
+/**
+ * umr_get_sq_ind_handles - Get the SQ_IND_{INDEX,DATA} registers
+ *
+ * The registers and bitfields used to access SQ indirect registers
+ * are resolved on first use and kept until the register database
+ * changes.
+ *
+ * Returns NULL if the registers do not exist on this ASIC.
+ */
+const struct umr_sq_ind_handles *umr_get_sq_ind_handles(struct umr_asic *asic)
+{
+	struct umr_sq_ind_handles *h = &asic->handle_cache.sq_ind;
+
+	if (asic->handle_cache.sq_ind_valid)
+		return h;
+
+	h->index = umr_find_reg_data(asic, "mmSQ_IND_INDEX");
+	h->data  = umr_find_reg_data(asic, "mmSQ_IND_DATA");
+	if (!h->index || !h->data)
+		return NULL;
+
+	umr_bitfield_handle_init(asic, h->index, "WAVE_ID", &h->wave_id);
+	umr_bitfield_handle_init(asic, h->index, "SIMD_ID", &h->simd_id);
+	umr_bitfield_handle_init(asic, h->index, "THREAD_ID", &h->thread_id);
+	umr_bitfield_handle_init(asic, h->index, "AUTO_INCR", &h->auto_incr);
+	umr_bitfield_handle_init(asic, h->index, "FORCE_READ", &h->force_read);
+	umr_bitfield_handle_init(asic, h->index, "INDEX", &h->index_field);
+	asic->handle_cache.sq_ind_valid = 1;
+	return h;
+}
+
+/**
+ * umr_get_grbm_index_handles - Get the GRBM_GFX_INDEX register
+ *
+ * Returns NULL if the register does not exist on this ASIC.
+ */
+const struct umr_grbm_index_handles *umr_get_grbm_index_handles(struct umr_asic *asic)
+{
+	struct umr_grbm_index_handles *h = &asic->handle_cache.grbm_index;
+
+	if (asic->handle_cache.grbm_index_valid)
+		return h;
+
+	h->reg = umr_find_reg_data(asic, "mmGRBM_GFX_INDEX");
+	if (!h->reg)
+		return NULL;
+
+	umr_bitfield_handle_init(asic, h->reg, "INSTANCE_INDEX", &h->instance_index);
+	umr_bitfield_handle_init(asic, h->reg, "INSTANCE_BROADCAST_WRITES", &h->instance_broadcast);
+	umr_bitfield_handle_init(asic, h->reg, "SE_INDEX", &h->se_index);
+	umr_bitfield_handle_init(asic, h->reg, "SE_BROADCAST_WRITES", &h->se_broadcast);
+	umr_bitfield_handle_init(asic, h->reg, "SH_INDEX", &h->sh_index);
+	umr_bitfield_handle_init(asic, h->reg, "SH_BROADCAST_WRITES", &h->sh_broadcast);
+	asic->handle_cache.grbm_index_valid = 1;
+	return h;
+}
+
 /**
  * umr_grbm_select_index - Select a GRBM instance
  *
@@ -190,28 +359,99 @@ uint32_t umr_bitslice_compose_value_by_name(struct umr_asic *asic, char *regname
  */
 int umr_grbm_select_index(struct umr_asic *asic, uint32_t se, uint32_t sh, uint32_t instance)
 {
-	struct umr_reg *grbm_idx;
+	const struct umr_grbm_index_handles *h;
 	uint32_t data = 0;
 
-	grbm_idx = umr_find_reg_data(asic, "mmGRBM_GFX_INDEX");
-	if (grbm_idx) {
+	h = umr_get_grbm_index_handles(asic);
+	if (h) {
 		if (instance >= 0x3FF) {
-			data |= umr_bitslice_compose_value(asic, grbm_idx, "INSTANCE_BROADCAST_WRITES", 1);
+			data |= umr_bitslice_compose_by_handle(&h->instance_broadcast, 1);
 		} else {
-			data |= umr_bitslice_compose_value(asic, grbm_idx, "INSTANCE_INDEX", instance);
+			data |= umr_bitslice_compose_by_handle(&h->instance_index, instance);
 		}
 		if (se >= 0x3FF) {
-			data |= umr_bitslice_compose_value(asic, grbm_idx, "SE_BROADCAST_WRITES", 1);
+			data |= umr_bitslice_compose_by_handle(&h->se_broadcast, 1);
 		} else {
-			data |= umr_bitslice_compose_value(asic, grbm_idx, "SE_INDEX", se);
+			data |= umr_bitslice_compose_by_handle(&h->se_index, se);
 		}
 		if (sh >= 0x3FF) {
-			data |= umr_bitslice_compose_value(asic, grbm_idx, "SH_BROADCAST_WRITES", 1);
+			data |= umr_bitslice_compose_by_handle(&h->sh_broadcast, 1);
 		} else {
-			data |= umr_bitslice_compose_value(asic, grbm_idx, "SH_INDEX", sh);
+			data |= umr_bitslice_compose_by_handle(&h->sh_index, sh);
 		}
-		return umr_write_reg(asic, grbm_idx->addr * 4, data, REG_MMIO);
+		// SQ_IND_INDEX is per instance
+		umr_ind_invalidate(asic, UMR_IND_SQ);
+		return asic->reg_funcs.write_reg(asic, h->reg->addr * 4, data, REG_MMIO);
 	} else {
 		return -1;
 	}
 }
+
+/**
+ * umr_read_regs_all_banks - Read a list of registers in every GRBM bank
+ *
+ * @regs: The byte addresses and classes of the registers
+ * @values: Receives @n values per bank, the banks ordered by SE, SH
+ * and then instance
+ * @n: The number of registers
+ * @no_se, @no_sh, @no_instances: The number of banks to read in each
+ * dimension
+ *
+ * With the 'no_kernel' or 'use_pci' options each bank is selected once
+ * with umr_grbm_select_index(), all of the registers are read and the
+ * broadcast selection is restored once at the end.  Otherwise the bank
+ * is encoded in the debugfs address of the MMIO registers and the reads
+ * of every bank are made with a single umr_read_regs() call.
+ *
+ * Returns 0 on success or -1 if any register could not be read.
+ */
+int umr_read_regs_all_banks(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n,
+			    uint32_t no_se, uint32_t no_sh, uint32_t no_instances)
+{
+	struct umr_reg_addr *banked;
+	uint32_t se, sh, instance;
+	uint64_t bank;
+	int x, b, r = 0;
+
+	if (asic->options.no_kernel || asic->options.use_pci) {
+		umr_lock_hw(asic);
+		b = 0;
+		for (se = 0; se < no_se; se++)
+		for (sh = 0; sh < no_sh; sh++)
+		for (instance = 0; instance < no_instances; instance++) {
+			if (umr_grbm_select_index(asic, se, sh, instance) ||
+			    umr_read_regs(asic, regs, &values[n * b++], n))
+				r = -1;
+		}
+		if (umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF))
+			r = -1;
+		umr_unlock_hw(asic);
+		return r;
+	}
+
+	banked = calloc((size_t)n * no_se * no_sh * no_instances, sizeof banked[0]);
+	if (!banked) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return -1;
+	}
+
+	b = 0;
+	for (se = 0; se < no_se; se++)
+	for (sh = 0; sh < no_sh; sh++)
+	for (instance = 0; instance < no_instances; instance++) {
+		bank =
+			(1ULL << 62) |
+			(((uint64_t)se) << 24) |
+			(((uint64_t)sh) << 34) |
+			(((uint64_t)instance) << 44);
+		for (x = 0; x < n; x++, b++) {
+			banked[b] = regs[x];
+			if (regs[x].type == REG_MMIO)
+				banked[b].addr |= bank;
+		}
+	}
+
+	r = umr_read_regs(asic, banked, values, b);
+	free(banked);
+	return r;
+}
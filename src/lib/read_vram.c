@@ -24,6 +24,7 @@
  */
 #include "umrapp.h"
 #include <inttypes.h>
+#include <stddef.h>
 
 #if 0
 #define DEBUG(...) fprintf(stderr, "DEBUG:" __VA_ARGS__)
@@ -31,36 +32,354 @@
 #define DEBUG(...)
 #endif
 
+/*
+ * Page table walks keep the decoded VM context registers of a (hub,
+ * VMID) and the page directory and table blocks read recently in a
+ * context.  The first entry needed from a block is read alone, once a
+ * second one is needed the whole block (4KB, or 256 bytes when VRAM is
+ * read through MM_INDEX/DATA) is read so a walk over consecutive pages
+ * reads each page table block about once instead of once per entry.
+ * Without umr_vm_cache_enable() the context only lives for one
+ * umr_access_vram() call.  With it the contexts of the device are kept
+ * across calls until they are invalidated with
+ * umr_vm_cache_invalidate() or are older than the expiry time.
+ */
+#define VM_CACHE_LEVELS     4
+#define VM_CACHE_PDE_BLOCKS 2
+#define VM_CACHE_PTE_BLOCKS 8
+#define VM_CACHE_BLOCK_SIZE 4096
+#define VM_CACHE_CONTEXTS   64
+
+struct umr_vm_context {
+	uint32_t vmid;      // hub and VMID
+	uint64_t loaded;    // time the registers were read in ns (0 if not yet)
+	uint32_t block_size;
+	union {
+		struct {
+			uint32_t
+				mmVM_CONTEXTx_PAGE_TABLE_START_ADDR,
+				mmVM_CONTEXTx_CNTL,
+				mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR,
+				mmMC_VM_FB_LOCATION,
+				mmMC_VM_FB_OFFSET;
+		} vi;
+		struct {
+			uint32_t
+				mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_LO32,
+				mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_HI32,
+				mmVM_CONTEXTx_CNTL,
+				mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_LO32,
+				mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_HI32,
+				mmVM_CONTEXTx_PAGE_TABLE_END_ADDR_LO32,
+				mmVM_CONTEXTx_PAGE_TABLE_END_ADDR_HI32,
+				mmVGA_MEMORY_BASE_ADDRESS,
+				mmVGA_MEMORY_BASE_ADDRESS_HIGH,
+				mmMC_VM_FB_OFFSET,
+				mmMC_VM_MX_L1_TLB_CNTL,
+				mmMC_VM_SYSTEM_APERTURE_LOW_ADDR,
+				mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR;
+		} ai;
+	} registers;
+	uint64_t page_table_start_addr, page_table_end_addr, page_table_base_addr,
+		 page_table_size, vm_fb_base, vm_fb_offset, system_aperture_low, system_aperture_high;
+	int page_table_depth;
+	uint32_t system_access_mode;
+
+	// directories per level so a walk through page table blocks keeps them
+	struct vm_cache_block {
+		uint64_t tag;        // block address << 2 | system << 1 | 1 (0 if not read)
+		uint64_t probe,      // tag of a block only one entry was read from
+			 entry_addr,
+			 entry;
+	} pdes[VM_CACHE_LEVELS][VM_CACHE_PDE_BLOCKS], ptes[VM_CACHE_PTE_BLOCKS];
+
+	// not cleared with the rest of the context
+	uint8_t pde_blocks[VM_CACHE_LEVELS][VM_CACHE_PDE_BLOCKS][VM_CACHE_BLOCK_SIZE],
+		pte_blocks[VM_CACHE_PTE_BLOCKS][VM_CACHE_BLOCK_SIZE];
+};
+
+struct umr_vm_cache {
+	int enabled;
+	uint64_t expiry;    // ns, 0 to keep contexts until invalidated
+	int next;           // slot replaced when all are in use
+	// context of the current call when contexts are not kept
+	struct umr_vm_context *scratch;
+	struct umr_vm_context *contexts[VM_CACHE_CONTEXTS];
+};
+
+static uint64_t vm_cache_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct umr_vm_context *vm_reset_context(struct umr_asic *asic, struct umr_vm_context **ctx, uint32_t vmid)
+{
+	if (!*ctx) {
+		*ctx = malloc(sizeof **ctx);
+		if (!*ctx) {
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+			return NULL;
+		}
+	}
+	memset(*ctx, 0, offsetof(struct umr_vm_context, pde_blocks));
+	(*ctx)->vmid = vmid;
+	// every dword of a block is a register read through MM_INDEX/DATA
+	(*ctx)->block_size = asic->mem_funcs.access_linear_vram == umr_access_vram_via_mmio ? 256 : VM_CACHE_BLOCK_SIZE;
+	return *ctx;
+}
+
 /**
- * access_vram_via_mmio - Access VRAM via direct MMIO control
+ * vm_get_context - Find the context of a (hub, VMID)
+ *
+ * Returns the cached context of @vmid if the cache is enabled or else
+ * the emptied scratch context of the device (NULL if out of memory).
+ * The registers of the context must be read if its 'loaded' time is 0.
  */
-int umr_access_vram_via_mmio(struct umr_asic *asic, uint64_t address, uint32_t size, void *dst, int write_en)
+static struct umr_vm_context *vm_get_context(struct umr_asic *asic, uint32_t vmid)
+{
+	struct umr_vm_cache *vc = asic->vm_cache;
+	int x;
+
+	if (!vc) {
+		vc = asic->vm_cache = calloc(1, sizeof *vc);
+		if (!vc) {
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+			return NULL;
+		}
+	}
+
+	// the registers of a user hub depend on the hub name
+	if (!vc->enabled || (vmid & 0xFF00) == UMR_USER_HUB)
+		return vm_reset_context(asic, &vc->scratch, vmid);
+
+	for (x = 0; x < VM_CACHE_CONTEXTS; x++) {
+		if (vc->contexts[x] && vc->contexts[x]->vmid == vmid) {
+			if (vc->expiry && vm_cache_now() - vc->contexts[x]->loaded > vc->expiry)
+				return vm_reset_context(asic, &vc->contexts[x], vmid);
+			return vc->contexts[x];
+		}
+	}
+
+	for (x = 0; x < VM_CACHE_CONTEXTS && vc->contexts[x]; x++);
+	if (x == VM_CACHE_CONTEXTS) {
+		x = vc->next;
+		vc->next = (vc->next + 1) % VM_CACHE_CONTEXTS;
+	}
+	return vm_reset_context(asic, &vc->contexts[x], vmid);
+}
+
+/**
+ * vm_read_entry - Read a page directory or table entry through a context
+ *
+ * @level: The level of the page directory the entry is in (0 for a
+ *         page table)
+ * @system: The entry is in system memory rather than VRAM
+ * @addr: The address of the entry
+ *
+ * The block holding the entry is read (or the entry alone if it is the
+ * first one needed from the block) unless the context has it.
+ */
+static int vm_read_entry(struct umr_asic *asic, struct umr_vm_context *ctx, int level, int system, uint64_t addr, uint64_t *entry)
+{
+	uint64_t base = addr & ~(uint64_t)(ctx->block_size - 1),
+		 tag = (base << 2) | ((uint64_t)!!system << 1) | 1;
+	struct vm_cache_block *b;
+	uint8_t *block;
+	int r, slot;
+
+	if (level > VM_CACHE_LEVELS)
+		level = VM_CACHE_LEVELS;
+	if (level) {
+		slot = (base / ctx->block_size) % VM_CACHE_PDE_BLOCKS;
+		b = &ctx->pdes[level - 1][slot];
+		block = ctx->pde_blocks[level - 1][slot];
+	} else {
+		slot = (base / ctx->block_size) % VM_CACHE_PTE_BLOCKS;
+		b = &ctx->ptes[slot];
+		block = ctx->pte_blocks[slot];
+	}
+
+	if (b->tag == tag) {
+		memcpy(entry, &block[addr - base], 8);
+		return 0;
+	}
+	if (b->probe == tag && b->entry_addr == addr) {
+		*entry = b->entry;
+		return 0;
+	}
+
+	if (b->probe == tag) {
+		if (system)
+			r = asic->mem_funcs.access_sram(asic, base, ctx->block_size, block, 0);
+		else
+			r = umr_read_vram(asic, UMR_LINEAR_HUB, base, ctx->block_size, block);
+		if (r >= 0) {
+			b->tag = tag;
+			b->probe = 0;
+			memcpy(entry, &block[addr - base], 8);
+			return 0;
+		}
+		// the rest of the block may not be readable
+	}
+
+	if (system)
+		r = asic->mem_funcs.access_sram(asic, addr, 8, entry, 0);
+	else
+		r = umr_read_vram(asic, UMR_LINEAR_HUB, addr, 8, entry);
+	if (r < 0)
+		return -1;
+	// the block read in full (if any) is kept until the next one is
+	b->probe = tag;
+	b->entry_addr = addr;
+	b->entry = *entry;
+	return 0;
+}
+
+/**
+ * umr_vm_cache_enable - Keep page table walk state across accesses
+ *
+ * @expiry_ms: Re-read the registers and entries of a (hub, VMID) that
+ *             were read longer ago than this (0 to never expire them)
+ *
+ * The VM context registers and page table entries read by
+ * umr_access_vram() are kept so later accesses to the same VMID need
+ * not read them again.  Changes to the page tables (including writes
+ * made with umr_access_vram()) are not noticed until the cache is
+ * invalidated with umr_vm_cache_invalidate() or expires.
+ *
+ * Returns 0 on success.
+ */
+int umr_vm_cache_enable(struct umr_asic *asic, uint32_t expiry_ms)
+{
+	if (!asic->vm_cache) {
+		asic->vm_cache = calloc(1, sizeof *asic->vm_cache);
+		if (!asic->vm_cache) {
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+			return -1;
+		}
+	}
+	asic->vm_cache->enabled = 1;
+	asic->vm_cache->expiry = (uint64_t)expiry_ms * 1000000ULL;
+	return 0;
+}
+
+/**
+ * umr_vm_cache_invalidate - Forget cached page table walk state
+ *
+ * @vmid: The hub and VMID (as passed to umr_access_vram()) to forget,
+ *        or -1 for all of them
+ */
+void umr_vm_cache_invalidate(struct umr_asic *asic, int vmid)
 {
-	uint32_t MM_INDEX, MM_INDEX_HI, MM_DATA;
-	uint32_t *out = dst;
+	struct umr_vm_cache *vc = asic->vm_cache;
+	int x;
+
+	if (!vc)
+		return;
+	for (x = 0; x < VM_CACHE_CONTEXTS; x++) {
+		if (vc->contexts[x] && (vmid < 0 || vc->contexts[x]->vmid == (uint32_t)(vmid & 0xFFFF))) {
+			free(vc->contexts[x]);
+			vc->contexts[x] = NULL;
+		}
+	}
+}
 
-	// find registers
-	MM_INDEX    = umr_find_reg(asic, "mmMM_INDEX") * 4;
-	MM_INDEX_HI = umr_find_reg(asic, "mmMM_INDEX_HI") * 4;
-	MM_DATA     = umr_find_reg(asic, "mmMM_DATA") * 4;
+/**
+ * umr_vm_cache_disable - Stop keeping page table walk state
+ *
+ * Frees the cache, called by umr_free_asic().
+ */
+void umr_vm_cache_disable(struct umr_asic *asic)
+{
+	if (!asic->vm_cache)
+		return;
+	umr_vm_cache_invalidate(asic, -1);
+	free(asic->vm_cache->scratch);
+	free(asic->vm_cache);
+	asic->vm_cache = NULL;
+}
 
-	if (MM_INDEX == 0xFFFFFFFF    ||
-	    MM_INDEX_HI == 0xFFFFFFFF ||
-	    MM_DATA == 0xFFFFFFFF) {
+/**
+ * access_vram_via_mmio - Access VRAM via direct MMIO control
+ *
+ * Returns 0 on success, -1 if an index or data register access failed.
+ */
+int umr_access_vram_via_mmio(struct umr_asic *asic, uint64_t address, uint32_t size, void *dst, int write_en)
+{
+	if (!umr_get_ind_window(asic, UMR_IND_MM)) {
 		fprintf(stderr, "[BUG]: Cannot find MM access registers for this asic!\n");
 		return -1;
 	}
 
-	while (size) {
-		asic->reg_funcs.write_reg(asic, MM_INDEX, address | 0x80000000, REG_MMIO);
-		asic->reg_funcs.write_reg(asic, MM_INDEX_HI, address >> 31, REG_MMIO);
-		if (write_en == 0)
-			*out++ = asic->reg_funcs.read_reg(asic, MM_DATA, REG_MMIO);
-		else
-			asic->reg_funcs.write_reg(asic, MM_DATA, *out++, REG_MMIO);
-		size -= 4;
-		address += 4;
+	// MM_INDEX_HI is only written when the address crosses into a new 2GB window
+	return umr_ind_access(asic, UMR_IND_MM, address, dst, size / 4, write_en);
+}
+
+/*
+ * Pages that follow each other in VRAM or system memory are accessed
+ * with one call.  The pages of a walk are added to a run which is
+ * accessed once the next page does not continue it or the walk ends.
+ */
+struct vm_run {
+	uint64_t addr;
+	uint32_t size;
+	int system;
+	unsigned char *dst;
+};
+
+/**
+ * vm_run_flush - Access the pages of a run
+ */
+static int vm_run_flush(struct umr_asic *asic, struct vm_run *run, int write_en)
+{
+	if (!run->size)
+		return 0;
+
+	DEBUG("Accessing run: %s:%" PRIx64 " (%" PRIu32 " bytes)\n", run->system ? "sys" : "vram", run->addr, run->size);
+	if (run->system) {
+		if (asic->mem_funcs.access_sram(asic, run->addr, run->size, run->dst, write_en) < 0) {
+			fprintf(stderr, "[ERROR]: Cannot access system ram, perhaps CONFIG_STRICT_DEVMEM is set in your kernel config?\n");
+			fprintf(stderr, "[ERROR]: Alternatively download and install /dev/fmem\n");
+			return -1;
+		}
+	} else {
+		if (umr_access_vram(asic, UMR_LINEAR_HUB, run->addr, run->size, run->dst, write_en) < 0) {
+			fprintf(stderr, "[ERROR]: Cannot access VRAM\n");
+			return -1;
+		}
 	}
+	run->size = 0;
+	return 0;
+}
+
+/**
+ * vm_run_add - Add a page (or part of one) to a run
+ *
+ * @addr: The CPU address of the memory
+ * @dst: Where in the caller's buffer the memory goes
+ *
+ * Accesses the current run first if the memory does not continue it.
+ */
+static int vm_run_add(struct umr_asic *asic, struct vm_run *run, int system,
+		      uint64_t addr, uint32_t size, unsigned char *dst, int write_en)
+{
+	if (run->size && run->system == system &&
+	    run->addr + run->size == addr && run->dst + run->size == dst &&
+	    // the XGMI node is picked by the start of the access and nodes begin on 64MB boundaries
+	    !(asic->options.use_xgmi && !system && !(addr & 0x3FFFFFFULL))) {
+		run->size += size;
+		return 0;
+	}
+
+	if (vm_run_flush(asic, run, write_en) < 0)
+		return -1;
+	run->addr = addr;
+	run->size = size;
+	run->system = system;
+	run->dst = dst;
 	return 0;
 }
 
@@ -89,18 +408,12 @@ static int umr_access_vram_vi(struct umr_asic *asic, uint32_t vmid,
 			system,
 			valid;
 	} pte_fields;
-	struct {
-		uint32_t
-			mmVM_CONTEXTx_PAGE_TABLE_START_ADDR,
-			mmVM_CONTEXTx_CNTL,
-			mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR,
-			mmMC_VM_FB_LOCATION,
-			mmMC_VM_FB_OFFSET;
-	} registers;
-	char buf[64];
+	struct umr_vm_context *ctx;
+	char buf[3][64], *names[5];
+	uint32_t values[5];
 	unsigned char *pdst = dst;
+	struct vm_run run = { 0 };
 
-	memset(&registers, 0, sizeof registers);
 	memset(&pde_copy, 0xff, sizeof pde_copy);
 
 	/*
@@ -124,25 +437,44 @@ static int umr_access_vram_vi(struct umr_asic *asic, uint32_t vmid,
 	 * 0 valid
 	 */
 
-	// read vm registers
-	sprintf(buf, "mmVM_CONTEXT%d_PAGE_TABLE_START_ADDR", vmid ? 1 : 0);
-		registers.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR = umr_read_reg_by_name(asic, buf);
-		page_table_start_addr = (uint64_t)registers.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR << 12;
-
-	sprintf(buf, "mmVM_CONTEXT%d_CNTL", vmid ? 1 : 0);
-		tmp = registers.mmVM_CONTEXTx_CNTL = umr_read_reg_by_name(asic, buf);
-		page_table_depth      = umr_bitslice_reg_by_name(asic, buf, "PAGE_TABLE_DEPTH", tmp);
-		page_table_size       = umr_bitslice_reg_by_name(asic, buf, "PAGE_TABLE_BLOCK_SIZE", tmp);
-
-	sprintf(buf, "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_BASE_ADDR", vmid);
-		registers.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR = umr_read_reg_by_name(asic, buf);
-		page_table_base_addr  = (uint64_t)registers.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR << 12;
-
-	registers.mmMC_VM_FB_LOCATION = umr_read_reg_by_name(asic, "mmMC_VM_FB_LOCATION");
-	vm_fb_base  = ((uint64_t)registers.mmMC_VM_FB_LOCATION & 0xFFFF) << 24;
-
-	registers.mmMC_VM_FB_OFFSET = umr_read_reg_by_name(asic, "mmMC_VM_FB_OFFSET");
-	vm_fb_offset  = ((uint64_t)registers.mmMC_VM_FB_OFFSET & 0xFFFF) << 22;
+	ctx = vm_get_context(asic, vmid);
+	if (!ctx)
+		return -1;
+	if (!ctx->loaded) {
+		// read vm registers (in one batch)
+		sprintf(buf[0], "mmVM_CONTEXT%d_PAGE_TABLE_START_ADDR", vmid ? 1 : 0);
+		sprintf(buf[1], "mmVM_CONTEXT%d_CNTL", vmid ? 1 : 0);
+		sprintf(buf[2], "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_BASE_ADDR", vmid);
+		names[0] = buf[0];
+		names[1] = buf[1];
+		names[2] = buf[2];
+		names[3] = "mmMC_VM_FB_LOCATION";
+		names[4] = "mmMC_VM_FB_OFFSET";
+		umr_read_regs_by_name_by_ip(asic, NULL, names, values, 5);
+
+		ctx->registers.vi.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR = values[0];
+		ctx->page_table_start_addr = (uint64_t)ctx->registers.vi.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR << 12;
+
+		tmp = ctx->registers.vi.mmVM_CONTEXTx_CNTL = values[1];
+		ctx->page_table_depth = umr_bitslice_reg_by_name(asic, buf[1], "PAGE_TABLE_DEPTH", tmp);
+		ctx->page_table_size  = umr_bitslice_reg_by_name(asic, buf[1], "PAGE_TABLE_BLOCK_SIZE", tmp);
+
+		ctx->registers.vi.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR = values[2];
+		ctx->page_table_base_addr = (uint64_t)ctx->registers.vi.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR << 12;
+
+		ctx->registers.vi.mmMC_VM_FB_LOCATION = values[3];
+		ctx->vm_fb_base = ((uint64_t)ctx->registers.vi.mmMC_VM_FB_LOCATION & 0xFFFF) << 24;
+
+		ctx->registers.vi.mmMC_VM_FB_OFFSET = values[4];
+		ctx->vm_fb_offset = ((uint64_t)ctx->registers.vi.mmMC_VM_FB_OFFSET & 0xFFFF) << 22;
+		ctx->loaded = vm_cache_now();
+	}
+	page_table_start_addr = ctx->page_table_start_addr;
+	page_table_depth      = ctx->page_table_depth;
+	page_table_size       = ctx->page_table_size;
+	page_table_base_addr  = ctx->page_table_base_addr;
+	vm_fb_base            = ctx->vm_fb_base;
+	vm_fb_offset          = ctx->vm_fb_offset;
 
 	if (asic->options.verbose)
 		asic->mem_funcs.vm_message(
@@ -152,13 +484,13 @@ static int umr_access_vram_vi(struct umr_asic *asic, uint32_t vmid,
 				"mmMC_VM_FB_LOCATION=0x%" PRIx32 "\n"
 				"mmMC_VM_FB_OFFSET=0x%" PRIx32 "\n",
 			vmid ? 1 : 0,
-			registers.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR,
+			ctx->registers.vi.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR,
 			vmid ? 1 : 0,
-			registers.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR,
+			ctx->registers.vi.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR,
 			vmid ? 1 : 0,
-			registers.mmVM_CONTEXTx_CNTL,
-			registers.mmMC_VM_FB_LOCATION,
-			registers.mmMC_VM_FB_OFFSET);
+			ctx->registers.vi.mmVM_CONTEXTx_CNTL,
+			ctx->registers.vi.mmMC_VM_FB_LOCATION,
+			ctx->registers.vi.mmMC_VM_FB_OFFSET);
 
 	address -= page_table_start_addr;
 
@@ -176,7 +508,8 @@ static int umr_access_vram_vi(struct umr_asic *asic, uint32_t vmid,
 			pde_mask <<= (12 + 9 + page_table_size);
 
 			// read PDE entry
-			umr_read_vram(asic, UMR_LINEAR_HUB, page_table_base_addr + pde_idx * 8 - vm_fb_base, 8, &pde_entry);
+			if (vm_read_entry(asic, ctx, 1, 0, page_table_base_addr + pde_idx * 8 - vm_fb_base, &pde_entry) < 0)
+				return -1;
 
 			// decode PDE values
 			pde_fields.frag_size     = (pde_entry >> 59) & 0x1F;
@@ -201,7 +534,7 @@ static int umr_access_vram_vi(struct umr_asic *asic, uint32_t vmid,
 			}
 
 			// now read PTE entry for this page
-			if (umr_read_vram(asic, UMR_LINEAR_HUB, pde_fields.pte_base_addr + pte_idx*8 - vm_fb_base, 8, &pte_entry) < 0)
+			if (vm_read_entry(asic, ctx, 0, 0, pde_fields.pte_base_addr + pte_idx*8 - vm_fb_base, &pte_entry) < 0)
 				return -1;
 
 			// decode PTE values
@@ -230,7 +563,7 @@ static int umr_access_vram_vi(struct umr_asic *asic, uint32_t vmid,
 			// depth == 0 == PTE only
 			pte_idx = (address >> 12);
 
-			if (umr_read_vram(asic, UMR_LINEAR_HUB, page_table_base_addr + pte_idx * 8 - vm_fb_base, 8, &pte_entry) < 0)
+			if (vm_read_entry(asic, ctx, 0, 0, page_table_base_addr + pte_idx * 8 - vm_fb_base, &pte_entry) < 0)
 				return -1;
 
 			// decode PTE values
@@ -264,32 +597,121 @@ next_page:
 
 		// allow destination to be NULL to simply use decoder
 		if (pdst) {
-			if (pte_fields.system) {
-				int r;
-				r = asic->mem_funcs.access_sram(asic, start_addr, chunk_size, pdst, write_en);
-				if (r < 0) {
-					fprintf(stderr, "[ERROR]: Cannot access system ram, perhaps CONFIG_STRICT_DEVMEM is set in your kernel config?\n");
-					fprintf(stderr, "[ERROR]: Alternatively download and install /dev/fmem\n");
-					return -1;
-				}
-			} else {
-				if (umr_access_vram(asic, UMR_LINEAR_HUB, start_addr, chunk_size, pdst, write_en) < 0) {
-					fprintf(stderr, "[ERROR]: Cannot access VRAM\n");
-					return -1;
-				}
-			}
+			if (vm_run_add(asic, &run, pte_fields.system, start_addr, chunk_size, pdst, write_en) < 0)
+				return -1;
 			pdst += chunk_size;
 		}
 		size -= chunk_size;
 		address += chunk_size;
 	} while (size);
-	return 0;
+	return vm_run_flush(asic, &run, write_en);
 
 invalid_page:
+	// pages before the invalid one are still accessed
+	if (vm_run_flush(asic, &run, write_en) < 0)
+		return -1;
 	asic->mem_funcs.vm_message("[ERROR]: No valid mapping for %u@%" PRIx64 "\n", vmid, address);
 	return -1;
 }
 
+/**
+ * vm_hub_name - Name of the IP block holding the VM registers of a hub
+ */
+static char *vm_hub_name(struct umr_asic *asic, uint32_t hubid)
+{
+	switch (hubid) {
+		case UMR_MM_HUB:
+			return "mmhub";
+		case UMR_GFX_HUB:
+			return "gfx";
+		case UMR_USER_HUB:
+			return asic->options.hub_name;
+		default:
+			fprintf(stderr, "[ERROR]: Invalid hub specified in umr_read_vram_ai()\n");
+			return NULL;
+	}
+}
+
+/**
+ * vm_load_context_ai - Read the VM context registers of a VMID on AI+
+ *
+ * @hub: The IP block holding the VM registers of the hub
+ * @vmid: The VMID (without hub bits)
+ */
+static void vm_load_context_ai(struct umr_asic *asic, struct umr_vm_context *ctx, char *hub, uint32_t vmid)
+{
+	char buf[7][64], *names[10];
+	uint32_t values[10], tmp;
+	int n;
+
+	// read vm registers (in one batch per block)
+	sprintf(buf[0], "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_START_ADDR_LO32", vmid);
+	sprintf(buf[1], "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_START_ADDR_HI32", vmid);
+	sprintf(buf[2], "mmVM_CONTEXT%" PRIu32 "_CNTL", vmid);
+	sprintf(buf[3], "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_BASE_ADDR_LO32", vmid);
+	sprintf(buf[4], "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_BASE_ADDR_HI32", vmid);
+	sprintf(buf[5], "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_END_ADDR_LO32", vmid);
+	sprintf(buf[6], "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_END_ADDR_HI32", vmid);
+	for (n = 0; n < 7; n++)
+		names[n] = buf[n];
+	if (vmid == 0) {
+		// only need system aperture registers if we're using VMID 0
+		names[n++] = "mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR";
+		names[n++] = "mmMC_VM_SYSTEM_APERTURE_LOW_ADDR";
+		names[n++] = "mmMC_VM_MX_L1_TLB_CNTL";
+	}
+	umr_read_regs_by_name_by_ip(asic, hub, names, values, n);
+
+	if (vmid == 0) {
+		ctx->registers.ai.mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR = values[7];
+		ctx->registers.ai.mmMC_VM_SYSTEM_APERTURE_LOW_ADDR = values[8];
+		ctx->system_aperture_low = ((uint64_t)ctx->registers.ai.mmMC_VM_SYSTEM_APERTURE_LOW_ADDR) << 18;
+		ctx->system_aperture_high = ((uint64_t)ctx->registers.ai.mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR) << 18;
+		ctx->registers.ai.mmMC_VM_MX_L1_TLB_CNTL = values[9];
+		ctx->system_access_mode = umr_bitslice_reg_by_name_by_ip(asic, hub, "mmMC_VM_MX_L1_TLB_CNTL", "SYSTEM_ACCESS_MODE", ctx->registers.ai.mmMC_VM_MX_L1_TLB_CNTL);
+	}
+	ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_LO32 = values[0];
+	ctx->page_table_start_addr = (uint64_t)ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_LO32 << 12;
+	ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_HI32 = values[1];
+	ctx->page_table_start_addr |= (uint64_t)ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_HI32 << 44;
+	ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_END_ADDR_LO32 = values[5];
+	ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_END_ADDR_HI32 = values[6];
+	// the end address is the last page of the VM
+	ctx->page_table_end_addr = (((uint64_t)values[6] << 32 | values[5]) + 1) << 12;
+
+	tmp = ctx->registers.ai.mmVM_CONTEXTx_CNTL = values[2];
+	ctx->page_table_depth = umr_bitslice_reg_by_name_by_ip(asic, hub, buf[2], "PAGE_TABLE_DEPTH", tmp);
+	ctx->page_table_size  = umr_bitslice_reg_by_name_by_ip(asic, hub, buf[2], "PAGE_TABLE_BLOCK_SIZE", tmp);
+
+	ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_LO32 = values[3];
+	ctx->page_table_base_addr  = (uint64_t)ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_LO32 << 0;
+	ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_HI32 = values[4];
+	ctx->page_table_base_addr |= (uint64_t)ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_HI32 << 32;
+
+	// update addresses for APUs
+	n = 0;
+	if (asic->config.gfx.family == 142) {
+		DEBUG("Reading vram config...\n");
+		names[n++] = "mmVGA_MEMORY_BASE_ADDRESS";
+		names[n++] = "mmVGA_MEMORY_BASE_ADDRESS_HIGH";
+		names[n++] = "mmMC_VM_FB_OFFSET";
+	}
+	names[n++] = "mmMC_VM_FB_LOCATION_BASE";
+	umr_read_regs_by_name_by_ip(asic, NULL, names, values, n);
+
+	if (asic->config.gfx.family == 142) {
+		ctx->registers.ai.mmVGA_MEMORY_BASE_ADDRESS = values[0];
+		ctx->registers.ai.mmVGA_MEMORY_BASE_ADDRESS_HIGH = values[1];
+		ctx->registers.ai.mmMC_VM_FB_OFFSET = values[2];
+		ctx->vm_fb_offset = (uint64_t)ctx->registers.ai.mmMC_VM_FB_OFFSET << 24;
+	}
+	ctx->vm_fb_base = (uint64_t)values[n - 1] << 24;
+
+	// transform page_table_base
+	ctx->page_table_base_addr -= ctx->vm_fb_offset;
+	ctx->loaded = vm_cache_now();
+}
+
 /**
  * umr_access_vram_ai - Access GPU mapped memory for AI..RV platforms
  */
@@ -299,24 +721,10 @@ static int umr_access_vram_ai(struct umr_asic *asic, uint32_t vmid,
 {
 	uint64_t start_addr, page_table_start_addr, page_table_base_addr,
 		 page_table_size, pte_idx, pde_idx, pte_entry, pde_entry,
-		 pde_address, vga_base_address, vm_fb_offset, vm_fb_base,
-		 va_mask, offset_mask, system_aperture_low, system_aperture_high;
-	uint32_t chunk_size, tmp;
+		 pde_address, vm_fb_offset, va_mask, offset_mask, page_size;
+	uint32_t chunk_size;
 	int pde_cnt, current_depth, page_table_depth, first;
-	struct {
-		uint32_t
-			mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_LO32,
-			mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_HI32,
-			mmVM_CONTEXTx_CNTL,
-			mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_LO32,
-			mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_HI32,
-			mmVGA_MEMORY_BASE_ADDRESS,
-			mmVGA_MEMORY_BASE_ADDRESS_HIGH,
-			mmMC_VM_FB_OFFSET,
-			mmMC_VM_MX_L1_TLB_CNTL,
-			mmMC_VM_SYSTEM_APERTURE_LOW_ADDR,
-			mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR;
-	} registers;
+	struct umr_vm_context *ctx;
 	struct {
 		uint64_t
 			frag_size,
@@ -335,13 +743,12 @@ static int umr_access_vram_ai(struct umr_asic *asic, uint32_t vmid,
 			prt,
 			further;
 	} pte_fields;
-	char buf[64];
 	unsigned char *pdst = dst;
+	struct vm_run run = { 0 };
 	char *hub;
 	unsigned hubid;
 	static const char *indentation = "            \\->";
 
-	memset(&registers, 0, sizeof registers);
 	memset(&pde_array, 0xff, sizeof pde_array);
 
 	/*
@@ -368,63 +775,20 @@ static int umr_access_vram_ai(struct umr_asic *asic, uint32_t vmid,
 	hubid = vmid & 0xFF00;
 	vmid &= 0xFF;
 
-	switch (hubid) {
-		case UMR_MM_HUB:
-			hub = "mmhub";
-			break;
-		case UMR_GFX_HUB:
-			hub = "gfx";
-			break;
-		case UMR_USER_HUB:
-			hub = asic->options.hub_name;
-			break;
-		default:
-			fprintf(stderr, "[ERROR]: Invalid hub specified in umr_read_vram_ai()\n");
-			return -1;
-	}
-
-	// read vm registers
-	if (vmid == 0) {
-		// only need system aperture registers if we're using VMID 0
-		registers.mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR = umr_read_reg_by_name_by_ip(asic, hub, "mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR");
-		registers.mmMC_VM_SYSTEM_APERTURE_LOW_ADDR = umr_read_reg_by_name_by_ip(asic, hub, "mmMC_VM_SYSTEM_APERTURE_LOW_ADDR");
-		system_aperture_low = ((uint64_t)registers.mmMC_VM_SYSTEM_APERTURE_LOW_ADDR) << 18;
-		system_aperture_high = ((uint64_t)registers.mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR) << 18;
-		registers.mmMC_VM_MX_L1_TLB_CNTL = umr_read_reg_by_name_by_ip(asic, hub, "mmMC_VM_MX_L1_TLB_CNTL");
-	}
-	sprintf(buf, "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_START_ADDR_LO32", vmid);
-		registers.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_LO32 = umr_read_reg_by_name_by_ip(asic, hub, buf);
-		page_table_start_addr = (uint64_t)registers.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_LO32 << 12;
-	sprintf(buf, "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_START_ADDR_HI32", vmid);
-		registers.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_HI32 = umr_read_reg_by_name_by_ip(asic, hub, buf);
-		page_table_start_addr |= (uint64_t)registers.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_HI32 << 44;
-
-	sprintf(buf, "mmVM_CONTEXT%" PRIu32 "_CNTL", vmid);
-		tmp = registers.mmVM_CONTEXTx_CNTL = umr_read_reg_by_name_by_ip(asic, hub, buf);
-		page_table_depth      = umr_bitslice_reg_by_name_by_ip(asic, hub, buf, "PAGE_TABLE_DEPTH", tmp);
-		page_table_size       = umr_bitslice_reg_by_name_by_ip(asic, hub, buf, "PAGE_TABLE_BLOCK_SIZE", tmp);
-
-	sprintf(buf, "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_BASE_ADDR_LO32", vmid);
-		registers.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_LO32 = umr_read_reg_by_name_by_ip(asic, hub, buf);
-		page_table_base_addr  = (uint64_t)registers.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_LO32 << 0;
-	sprintf(buf, "mmVM_CONTEXT%" PRIu32 "_PAGE_TABLE_BASE_ADDR_HI32", vmid);
-		registers.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_HI32 = umr_read_reg_by_name_by_ip(asic, hub, buf);
-		page_table_base_addr  |= (uint64_t)registers.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_HI32 << 32;
+	hub = vm_hub_name(asic, hubid);
+	if (!hub)
+		return -1;
 
-	// update addresses for APUs
-	if (asic->config.gfx.family == 142) {
-		DEBUG("Reading vram config...\n");
-		registers.mmVGA_MEMORY_BASE_ADDRESS = umr_read_reg_by_name(asic, "mmVGA_MEMORY_BASE_ADDRESS");
-		registers.mmVGA_MEMORY_BASE_ADDRESS_HIGH = umr_read_reg_by_name(asic, "mmVGA_MEMORY_BASE_ADDRESS_HIGH");
-		registers.mmMC_VM_FB_OFFSET = umr_read_reg_by_name(asic, "mmMC_VM_FB_OFFSET");
-		vga_base_address  = (uint64_t)registers.mmVGA_MEMORY_BASE_ADDRESS << 0;
-		vga_base_address |= (uint64_t)registers.mmVGA_MEMORY_BASE_ADDRESS_HIGH << 32;
-		vm_fb_offset      = (uint64_t)registers.mmMC_VM_FB_OFFSET << 24;
-	} else {
-		vga_base_address = 0;
-		vm_fb_offset = 0;
-	}
-	vm_fb_base = (uint64_t)umr_read_reg_by_name(asic, "mmMC_VM_FB_LOCATION_BASE") << 24;
+	ctx = vm_get_context(asic, hubid | vmid);
+	if (!ctx)
+		return -1;
+	if (!ctx->loaded)
+		vm_load_context_ai(asic, ctx, hub, vmid);
+	page_table_start_addr = ctx->page_table_start_addr;
+	page_table_depth      = ctx->page_table_depth;
+	page_table_size       = ctx->page_table_size;
+	page_table_base_addr  = ctx->page_table_base_addr;
+	vm_fb_offset          = ctx->vm_fb_offset;
 
 	if (asic->options.verbose)
 		asic->mem_funcs.vm_message(
@@ -440,41 +804,37 @@ static int umr_access_vram_ai(struct umr_asic *asic, uint32_t vmid,
 				"mmMC_VM_MX_L1_TLB_CNTL=0x%" PRIx32 "\n"
 				"mmMC_VM_SYSTEM_APERTURE_LOW_ADDR=0x%" PRIx32 "\n"
 				"mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR=0x%" PRIx32 "\n",
-			vmid, registers.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_LO32,
-			vmid, registers.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_HI32,
-			vmid, registers.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_LO32,
-			vmid, registers.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_HI32,
-			vmid, registers.mmVM_CONTEXTx_CNTL,
-			registers.mmVGA_MEMORY_BASE_ADDRESS,
-			registers.mmVGA_MEMORY_BASE_ADDRESS_HIGH,
-			registers.mmMC_VM_FB_OFFSET,
-			vm_fb_base,
-			registers.mmMC_VM_MX_L1_TLB_CNTL,
-			registers.mmMC_VM_SYSTEM_APERTURE_LOW_ADDR,
-			registers.mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR
+			vmid, ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_LO32,
+			vmid, ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_START_ADDR_HI32,
+			vmid, ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_LO32,
+			vmid, ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_BASE_ADDR_HI32,
+			vmid, ctx->registers.ai.mmVM_CONTEXTx_CNTL,
+			ctx->registers.ai.mmVGA_MEMORY_BASE_ADDRESS,
+			ctx->registers.ai.mmVGA_MEMORY_BASE_ADDRESS_HIGH,
+			ctx->registers.ai.mmMC_VM_FB_OFFSET,
+			ctx->vm_fb_base,
+			ctx->registers.ai.mmMC_VM_MX_L1_TLB_CNTL,
+			ctx->registers.ai.mmMC_VM_SYSTEM_APERTURE_LOW_ADDR,
+			ctx->registers.ai.mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR
 			);
 
-	// transform page_table_base
-	page_table_base_addr -= vm_fb_offset;
-
 	if (vmid == 0) {
-		uint32_t sam = umr_bitslice_reg_by_name_by_ip(asic, hub, "mmMC_VM_MX_L1_TLB_CNTL", "SYSTEM_ACCESS_MODE", registers.mmMC_VM_MX_L1_TLB_CNTL);
 		// addresses in VMID0 need special handling w.r.t. PAGE_TABLE_START_ADDR
-		switch (sam) {
+		switch (ctx->system_access_mode) {
 			case 0: // physical access
 				return umr_access_vram(asic, UMR_LINEAR_HUB, address, size, dst, write_en);
 			case 1: // always VM access
 				break;
 			case 2: // inside system aperture is mapped, otherwise unmapped
-				if (!(address >= system_aperture_low && address < system_aperture_high))
+				if (!(address >= ctx->system_aperture_low && address < ctx->system_aperture_high))
 					return umr_access_vram(asic, UMR_LINEAR_HUB, address, size, dst, write_en);
 				break;
 			case 3: // inside system aperture is unmapped, otherwise mapped
-				if (address >= system_aperture_low && address < system_aperture_high)
+				if (address >= ctx->system_aperture_low && address < ctx->system_aperture_high)
 					return umr_access_vram(asic, UMR_LINEAR_HUB, address, size, dst, write_en);
 				break;
 			default:
-				asic->mem_funcs.vm_message("[WARNING]: Unhandled SYSTEM_ACCESS_MODE mode [%" PRIu32 "]\n", sam);
+				asic->mem_funcs.vm_message("[WARNING]: Unhandled SYSTEM_ACCESS_MODE mode [%" PRIu32 "]\n", ctx->system_access_mode);
 				break;
 		}
 	}
@@ -529,15 +889,8 @@ static int umr_access_vram_ai(struct umr_asic *asic, uint32_t vmid,
 				DEBUG("selector mask == %llx\n", va_mask);
 
 				// read PDE entry
-				if (pde_fields.system == 0) {
-					if (umr_read_vram(asic, UMR_LINEAR_HUB, pde_address + pde_idx * 8, 8, &pde_entry) < 0)
-						return -1;
-				} else {
-					int r;
-					r = asic->mem_funcs.access_sram(asic, pde_address + pde_idx * 8, 8, &pde_entry, 0);
-					if (r < 0)
-						return -1;
-				}
+				if (vm_read_entry(asic, ctx, current_depth, pde_fields.system, pde_address + pde_idx * 8, &pde_entry) < 0)
+					return -1;
 
 				// decode PDE values
 				pde_fields.frag_size     = (pde_entry >> 59) & 0x1F;
@@ -574,7 +927,9 @@ static int umr_access_vram_ai(struct umr_asic *asic, uint32_t vmid,
 					// vm-decode mode
 					pte_fields.prt = 0;
 					pte_fields.valid = 0;
+					pte_fields.system = 0;
 					start_addr = address & 0xFFF; // grab page offset so we can advance to next page
+					page_size = 0x1000;
 					goto next_page;
 				}
 
@@ -588,15 +943,8 @@ static int umr_access_vram_ai(struct umr_asic *asic, uint32_t vmid,
 			pte_idx = (address >> (12 + pde_fields.frag_size + page_table_size)) & ((1ULL << (9 + page_table_size - pde_fields.frag_size)) - 1);
 pte_further:
 			// now read PTE entry for this page
-			if (pde_fields.system == 0) {
-				if (umr_read_vram(asic, UMR_LINEAR_HUB, pde_fields.pte_base_addr + pte_idx*8, 8, &pte_entry) < 0)
-					return -1;
-			} else {
-				int r;
-				r = asic->mem_funcs.access_sram(asic, pde_fields.pte_base_addr + pte_idx*8, 8, &pte_entry, 0);
-				if (r < 0)
-					return -1;
-			}
+			if (vm_read_entry(asic, ctx, 0, pde_fields.system, pde_fields.pte_base_addr + pte_idx*8, &pte_entry) < 0)
+				return -1;
 
 			// decode PTE values
 pde_is_pte:
@@ -637,6 +985,9 @@ pde_is_pte:
 
 			start_addr = asic->mem_funcs.gpu_bus_to_cpu_address(asic, pte_fields.page_base_addr) + (address & offset_mask);
 			DEBUG("phys address to read from: %" PRIx64 "\n\n\n", start_addr);
+
+			// a PDE used as a PTE maps all of the memory below it
+			page_size = offset_mask + 1;
 		} else {
 			// in AI+ the BASE_ADDR is treated like a PDE entry...
 			// decode PDE values
@@ -662,7 +1013,7 @@ pde_is_pte:
 			// PTE addr = baseaddr[47:6] + (logical - start) >> fragsize)
 			pte_idx = (address >> (12 + pde_fields.frag_size));
 
-			if (umr_read_vram(asic, UMR_LINEAR_HUB, pde_fields.pte_base_addr + pte_idx * 8, 8, &pte_entry) < 0)
+			if (vm_read_entry(asic, ctx, 0, 0, pde_fields.pte_base_addr + pte_idx * 8, &pte_entry) < 0)
 				return -1;
 
 			// decode PTE values
@@ -686,36 +1037,34 @@ pde_is_pte:
 
 			// compute starting address
 			start_addr = asic->mem_funcs.gpu_bus_to_cpu_address(asic, pte_fields.page_base_addr) + (address & 0xFFF);
+			page_size = 0x1000;
 		}
 
 next_page:
-		// read upto 4K from it
-		// TODO: Support page sizes >4KB
-		if (((start_addr & 0xFFF) + size) & ~0xFFF) {
-			chunk_size = 0x1000 - (start_addr & 0xFFF);
-		} else {
+		// the pages of a fragment are physically contiguous
+		if (pte_fields.valid && (0x1000ULL << pte_fields.fragment) > page_size)
+			page_size = 0x1000ULL << pte_fields.fragment;
+		// system pages are translated one 4K page at a time and
+		// verbose decoding reports every 4K page
+		if (pte_fields.system || asic->options.verbose)
+			page_size = 0x1000;
+		// XGMI nodes begin on 64MB boundaries
+		if (asic->options.use_xgmi && page_size > 0x4000000ULL)
+			page_size = 0x4000000ULL;
+
+		// read up to the end of the page
+		if (size > page_size - (address & (page_size - 1)))
+			chunk_size = page_size - (address & (page_size - 1));
+		else
 			chunk_size = size;
-		}
 		DEBUG("Computed address we will read from: %s:%" PRIx64 " (reading: %" PRIu32 " bytes)\n", pte_fields.system ? "sys" : "vram",
 			start_addr, chunk_size);
 
 		// allow destination to be NULL to simply use decoder
 		if (pte_fields.valid) {
 			if (pdst) {
-				if (pte_fields.system) {
-					int r;
-					r = asic->mem_funcs.access_sram(asic, start_addr, chunk_size, pdst, write_en);
-					if (r < 0) {
-						fprintf(stderr, "[ERROR]: Cannot access system ram, perhaps CONFIG_STRICT_DEVMEM is set in your kernel config?\n");
-						fprintf(stderr, "[ERROR]: Alternatively download and install /dev/fmem\n");
-						return -1;
-					}
-				} else {
-					if (umr_access_vram(asic, UMR_LINEAR_HUB, start_addr, chunk_size, pdst, write_en) < 0) {
-						fprintf(stderr, "[ERROR]: Cannot access VRAM\n");
-						return -1;
-					}
-				}
+				if (vm_run_add(asic, &run, pte_fields.system, start_addr, chunk_size, pdst, write_en) < 0)
+					return -1;
 				pdst += chunk_size;
 			}
 		} else {
@@ -728,13 +1077,64 @@ next_page:
 		size -= chunk_size;
 		address += chunk_size;
 	} while (size);
-	return 0;
+	return vm_run_flush(asic, &run, write_en);
 
 invalid_page:
+	// pages before the invalid one are still accessed
+	if (vm_run_flush(asic, &run, write_en) < 0)
+		return -1;
 	asic->mem_funcs.vm_message("[ERROR]: No valid mapping for %u@%" PRIx64 "\n", vmid, address);
 	return -1;
 }
 
+/**
+ * umr_vm_read_layout - Read the page table layout of a VMID
+ *
+ * @vmid: The hub and VMID as passed to umr_access_vram()
+ * @layout: Receives the layout
+ *
+ * Decodes the VM context registers of @vmid (from the page walk cache
+ * if they are kept) for callers walking the page tables themselves.
+ * Only AI and newer are supported.  Returns 0 on success.
+ */
+int umr_vm_read_layout(struct umr_asic *asic, uint32_t vmid, struct umr_vm_layout *layout)
+{
+	struct umr_vm_context *ctx;
+	char *hub;
+
+	if (asic->family != FAMILY_AI && asic->family != FAMILY_RV) {
+		fprintf(stderr, "[ERROR]: VM page table layouts are only supported on AI and newer\n");
+		return -1;
+	}
+
+	hub = vm_hub_name(asic, vmid & 0xFF00);
+	if (!hub)
+		return -1;
+	ctx = vm_get_context(asic, vmid & 0xFFFF);
+	if (!ctx)
+		return -1;
+	if (!ctx->loaded)
+		vm_load_context_ai(asic, ctx, hub, vmid & 0xFF);
+
+	memset(layout, 0, sizeof *layout);
+	layout->start_addr = ctx->page_table_start_addr;
+	layout->end_addr = ctx->page_table_end_addr;
+	// registers that are not found read as zero
+	if (!(ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_END_ADDR_LO32 | ctx->registers.ai.mmVM_CONTEXTx_PAGE_TABLE_END_ADDR_HI32) ||
+	    layout->end_addr <= layout->start_addr || layout->end_addr > (1ULL << 48))
+		layout->end_addr = 1ULL << 48;
+	layout->base_addr = ctx->page_table_base_addr;
+	layout->fb_offset = ctx->vm_fb_offset;
+	layout->depth = ctx->page_table_depth;
+	layout->block_size = ctx->page_table_size;
+	if (!(vmid & 0xFF)) {
+		layout->system_access_mode = ctx->system_access_mode;
+		layout->system_aperture_low = ctx->system_aperture_low;
+		layout->system_aperture_high = ctx->system_aperture_high;
+	}
+	return 0;
+}
+
 /** round_up_pot -- Round up value to next power of two */
 static uint64_t round_up_pot(uint64_t x)
 {
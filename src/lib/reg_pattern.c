@@ -0,0 +1,245 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <ctype.h>
+
+/*
+ * A pattern is compiled into the literal segments found between '*'
+ * wildcards.  Since '*' matches any run of characters a string matches
+ * if the first segment matches at the start (unless the pattern begins
+ * with '*'), the last segment matches at the end (unless the pattern
+ * ends with '*') and the remaining segments can be found in order in
+ * between.  Taking the leftmost match of each middle segment is always
+ * sufficient so no backtracking is required.  '?' matches any single
+ * character within a segment.  Matching is case insensitive.
+ */
+enum pattern_kind {
+	PATTERN_ANY,        // "*"
+	PATTERN_EXACT,      // "abc"
+	PATTERN_PREFIX,     // "abc*"
+	PATTERN_SUFFIX,     // "*abc"
+	PATTERN_SUBSTRING,  // "*abc*"
+	PATTERN_GLOB,       // everything else
+};
+
+struct umr_reg_pattern_seg {
+	char *str;
+	int len, wild;
+};
+
+struct umr_reg_pattern {
+	enum pattern_kind kind;
+	int anchor_start, anchor_end, min_len;
+	int no_segs;
+	struct umr_reg_pattern_seg *segs;
+	char *buf;
+};
+
+/* does @seg match @str at the start (@str must hold at least seg->len characters) */
+static int seg_at(const struct umr_reg_pattern_seg *seg, const char *str)
+{
+	int x;
+
+	if (!seg->wild) {
+		for (x = 0; x < seg->len; x++)
+			if (toupper((unsigned char)str[x]) != seg->str[x])
+				return 0;
+	} else {
+		for (x = 0; x < seg->len; x++)
+			if (seg->str[x] != '?' && toupper((unsigned char)str[x]) != seg->str[x])
+				return 0;
+	}
+	return 1;
+}
+
+/* leftmost position of @seg in the first @len characters of @str or -1 */
+static int seg_find(const struct umr_reg_pattern_seg *seg, const char *str, int len)
+{
+	int x;
+
+	for (x = 0; x + seg->len <= len; x++)
+		if ((seg->wild || toupper((unsigned char)str[x]) == seg->str[0]) && seg_at(seg, str + x))
+			return x;
+	return -1;
+}
+
+/**
+ * umr_compile_reg_pattern - Compile a wildcard pattern
+ *
+ * @pattern: A pattern where '*' matches any number of characters
+ * and '?' matches any one character.
+ *
+ * Returns a matcher for umr_reg_pattern_matches() which must be freed
+ * with umr_free_reg_pattern(), or NULL if out of memory.
+ */
+struct umr_reg_pattern *umr_compile_reg_pattern(const char *pattern)
+{
+	struct umr_reg_pattern *pat;
+	int x, len, wild;
+	char *p;
+
+	pat = calloc(1, sizeof *pat);
+	len = strlen(pattern);
+	if (!pat || !(pat->buf = calloc(1, len + 1)) ||
+	    !(pat->segs = calloc(len / 2 + 1, sizeof pat->segs[0]))) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		umr_free_reg_pattern(pat);
+		return NULL;
+	}
+
+	pat->anchor_start = pattern[0] != '*';
+	pat->anchor_end = !len || pattern[len - 1] != '*';
+
+	// split into segments (NUL terminated in buf)
+	p = pat->buf;
+	for (x = 0; x < len;) {
+		if (pattern[x] == '*') {
+			++x;
+			continue;
+		}
+		pat->segs[pat->no_segs].str = p;
+		for (wild = 0; x < len && pattern[x] != '*'; x++) {
+			*p++ = toupper((unsigned char)pattern[x]);
+			wild |= pattern[x] == '?';
+		}
+		*p++ = 0;
+		pat->segs[pat->no_segs].len = strlen(pat->segs[pat->no_segs].str);
+		pat->segs[pat->no_segs].wild = wild;
+		pat->min_len += pat->segs[pat->no_segs].len;
+		++pat->no_segs;
+	}
+
+	if (!pat->no_segs)
+		pat->kind = len ? PATTERN_ANY : PATTERN_EXACT;
+	else if (pat->no_segs > 1 || pat->segs[0].wild)
+		pat->kind = PATTERN_GLOB;
+	else if (pat->anchor_start && pat->anchor_end)
+		pat->kind = PATTERN_EXACT;
+	else if (pat->anchor_start)
+		pat->kind = PATTERN_PREFIX;
+	else if (pat->anchor_end)
+		pat->kind = PATTERN_SUFFIX;
+	else
+		pat->kind = PATTERN_SUBSTRING;
+
+	return pat;
+}
+
+/**
+ * umr_free_reg_pattern - Free a compiled pattern
+ */
+void umr_free_reg_pattern(struct umr_reg_pattern *pat)
+{
+	if (pat) {
+		free(pat->segs);
+		free(pat->buf);
+		free(pat);
+	}
+}
+
+/**
+ * umr_reg_pattern_matches - Test a string against a compiled pattern
+ *
+ * Returns non-zero if @str matches the pattern.  A NULL @str never
+ * matches.
+ */
+int umr_reg_pattern_matches(const struct umr_reg_pattern *pat, const char *str)
+{
+	const struct umr_reg_pattern_seg *seg;
+	int len, pos, end, first, last, x;
+
+	if (!str)
+		return 0;
+	if (pat->kind == PATTERN_ANY)
+		return 1;
+
+	len = strlen(str);
+	if (len < pat->min_len)
+		return 0;
+
+	seg = &pat->segs[0];
+	switch (pat->kind) {
+		case PATTERN_EXACT:
+			return len == pat->min_len && (!pat->no_segs || seg_at(seg, str));
+		case PATTERN_PREFIX:
+			return seg_at(seg, str);
+		case PATTERN_SUFFIX:
+			return seg_at(seg, str + len - seg->len);
+		case PATTERN_SUBSTRING:
+			return seg_find(seg, str, len) >= 0;
+		default:
+			break;
+	}
+
+	// anchored ends first, the middle segments must fit between them
+	pos = 0;
+	end = len;
+	first = 0;
+	last = pat->no_segs;
+	if (pat->anchor_start) {
+		if (!seg_at(&pat->segs[0], str))
+			return 0;
+		pos = pat->segs[0].len;
+		first = 1;
+	}
+	if (pat->anchor_end && last > first) {
+		seg = &pat->segs[--last];
+		end = len - seg->len;
+		if (end < pos || !seg_at(seg, str + end))
+			return 0;
+	} else if (pat->anchor_end && len != pos) {
+		return 0;
+	}
+
+	for (; first < last; first++) {
+		x = seg_find(&pat->segs[first], str + pos, end - pos);
+		if (x < 0)
+			return 0;
+		pos += x + pat->segs[first].len;
+	}
+	return 1;
+}
+
+/**
+ * umr_reg_pattern_literals - Return the literal runs of a pattern
+ *
+ * Calls @cb for every run of characters in the pattern that contains
+ * no wildcards.  The runs are upper case and any string matching the
+ * pattern contains every one of them.  Used to pick index keys.
+ */
+void umr_reg_pattern_literals(const struct umr_reg_pattern *pat, void (*cb)(void *data, const char *str, int len), void *data)
+{
+	int x, y, start;
+
+	for (x = 0; x < pat->no_segs; x++) {
+		for (start = y = 0; y <= pat->segs[x].len; y++) {
+			if (y == pat->segs[x].len || pat->segs[x].str[y] == '?') {
+				if (y > start)
+					cb(data, &pat->segs[x].str[start], y - start);
+				start = y + 1;
+			}
+		}
+	}
+}
@@ -0,0 +1,465 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <sys/mman.h>
+
+/*
+ * Binary register database
+ *
+ * A regdb file is a snapshot of the register database of an asic
+ * laid out so it can be mapped and used in place.  It holds flat
+ * tables of IP blocks, registers and bitfields that refer to each
+ * other by index, a pool of NUL terminated strings, and copies of the
+ * name and address lookup tables (see find_reg.c) so they need not
+ * be rebuilt when the file is loaded.
+ *
+ * The file is written in host byte order.  UMR_REGDB_VERSION must be
+ * bumped whenever any structure below or the hash used by the name
+ * index changes.
+ */
+#define UMR_REGDB_VERSION    1
+#define UMR_REGDB_BYTE_ORDER 0x01020304UL
+#define UMR_REGDB_NO_STRING  0xFFFFFFFFUL
+
+struct umr_regdb_header {
+	char magic[8];
+	uint32_t version, byte_order;
+	uint32_t family, asicname;
+	uint32_t no_blocks, no_regs, no_bits;
+	uint32_t name_index_mask;
+	uint32_t no_addr_entries[UMR_NUM_REGCLASS];
+	uint64_t file_size, size_strings;
+	// file offsets of the sections
+	uint64_t blocks, regs, bits, strings, name_index, addr_index[UMR_NUM_REGCLASS];
+};
+
+struct umr_regdb_block {
+	uint32_t ipname, first_reg, no_regs;
+};
+
+struct umr_regdb_reg {
+	uint32_t regname, type, addr, first_bit, no_bits;
+};
+
+struct umr_regdb_bit {
+	uint32_t regname;
+	uint16_t start, stop;
+};
+
+struct string_pool {
+	char *data;
+	uint32_t size, alloc;
+	uint32_t *hash, mask;
+	int error;
+};
+
+static uint32_t str_hash(const char *s)
+{
+	uint32_t h = 2166136261UL;
+
+	while (*s)
+		h = (h ^ (uint8_t)*s++) * 16777619UL;
+	return h;
+}
+
+/* add a string to the pool (only once) and return its offset */
+static uint32_t pool_add(struct string_pool *pool, const char *s)
+{
+	uint32_t x, len;
+	void *tmp;
+
+	if (!s)
+		return UMR_REGDB_NO_STRING;
+
+	// the hash slots hold offset + 1 so zero marks an empty slot
+	for (x = str_hash(s) & pool->mask; pool->hash[x]; x = (x + 1) & pool->mask)
+		if (!strcmp(&pool->data[pool->hash[x] - 1], s))
+			return pool->hash[x] - 1;
+
+	len = strlen(s) + 1;
+	if (pool->size + len > pool->alloc) {
+		tmp = realloc(pool->data, pool->alloc * 2 + len);
+		if (!tmp) {
+			pool->error = 1;
+			return UMR_REGDB_NO_STRING;
+		}
+		pool->data = tmp;
+		pool->alloc = pool->alloc * 2 + len;
+	}
+	memcpy(&pool->data[pool->size], s, len);
+	pool->hash[x] = pool->size + 1;
+	pool->size += len;
+	return pool->hash[x] - 1;
+}
+
+/* pad the file out to an 8 byte boundary and return the offset */
+static uint64_t align_file(FILE *f)
+{
+	static const char zero[8];
+	long pos = ftell(f);
+
+	if (pos & 7)
+		fwrite(zero, 1, 8 - (pos & 7), f);
+	return ftell(f);
+}
+
+/**
+ * umr_regdb_write - Write the register database of an asic to a regdb file
+ *
+ * @asic: The device whose register database is to be written
+ * @filename: Path of the file to create
+ *
+ * Works with any device (built-in, NPI script or another regdb) so it
+ * doubles as a converter from the script syntax.  The resulting file
+ * can be loaded with umr_create_asic_from_regdb().
+ *
+ * Returns 0 on success.
+ */
+int umr_regdb_write(struct umr_asic *asic, const char *filename)
+{
+	struct umr_regdb_header hdr;
+	struct umr_regdb_block blk;
+	struct umr_regdb_reg reg;
+	struct umr_regdb_bit bit;
+	struct string_pool pool;
+	uint32_t n, nbits, size;
+	int i, j, k, t;
+	FILE *f;
+
+	// the indices are written as they are found in memory
+	if (umr_materialize_asic(asic) ||
+	    (!asic->name_index.table && umr_create_name_index(asic)) ||
+	    (!asic->mmio_accel.built && umr_create_mmio_accel(asic))) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, UMR_REGDB_MAGIC, sizeof hdr.magic);
+	hdr.version = UMR_REGDB_VERSION;
+	hdr.byte_order = UMR_REGDB_BYTE_ORDER;
+	hdr.family = asic->family;
+	hdr.no_blocks = asic->no_blocks;
+	for (i = 0; i < asic->no_blocks; i++) {
+		hdr.no_regs += asic->blocks[i]->no_regs;
+		for (j = 0; j < asic->blocks[i]->no_regs; j++)
+			hdr.no_bits += asic->blocks[i]->regs[j].no_bits;
+	}
+	hdr.name_index_mask = asic->name_index.mask;
+	for (t = 0; t < UMR_NUM_REGCLASS; t++)
+		hdr.no_addr_entries[t] = asic->mmio_accel.no_entries[t];
+
+	// the string pool hash is sized for one (distinct) name per register and bit
+	memset(&pool, 0, sizeof pool);
+	for (size = 16; size < 2 * (hdr.no_blocks + hdr.no_regs + hdr.no_bits + 1); size <<= 1);
+	pool.mask = size - 1;
+	pool.hash = calloc(size, sizeof pool.hash[0]);
+	pool.alloc = 4096;
+	pool.data = calloc(1, pool.alloc);
+	if (!pool.hash || !pool.data) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		goto error;
+	}
+
+	f = fopen(filename, "wb");
+	if (!f) {
+		perror("Cannot create regdb file");
+		goto error;
+	}
+
+	// header is rewritten once the offsets are known
+	fwrite(&hdr, sizeof hdr, 1, f);
+
+	hdr.asicname = pool_add(&pool, asic->asicname);
+
+	hdr.blocks = align_file(f);
+	for (n = i = 0; i < asic->no_blocks; i++) {
+		blk.ipname = pool_add(&pool, asic->blocks[i]->ipname);
+		blk.first_reg = n;
+		blk.no_regs = asic->blocks[i]->no_regs;
+		fwrite(&blk, sizeof blk, 1, f);
+		n += blk.no_regs;
+	}
+
+	hdr.regs = align_file(f);
+	for (nbits = i = 0; i < asic->no_blocks; i++) {
+		for (j = 0; j < asic->blocks[i]->no_regs; j++) {
+			memset(&reg, 0, sizeof reg);
+			reg.regname = pool_add(&pool, asic->blocks[i]->regs[j].regname);
+			reg.type = asic->blocks[i]->regs[j].type;
+			reg.addr = asic->blocks[i]->regs[j].addr;
+			reg.first_bit = nbits;
+			reg.no_bits = asic->blocks[i]->regs[j].no_bits;
+			fwrite(&reg, sizeof reg, 1, f);
+			nbits += reg.no_bits;
+		}
+	}
+
+	hdr.bits = align_file(f);
+	for (i = 0; i < asic->no_blocks; i++) {
+		for (j = 0; j < asic->blocks[i]->no_regs; j++) {
+			for (k = 0; k < asic->blocks[i]->regs[j].no_bits; k++) {
+				memset(&bit, 0, sizeof bit);
+				bit.regname = pool_add(&pool, asic->blocks[i]->regs[j].bits[k].regname);
+				bit.start = asic->blocks[i]->regs[j].bits[k].start;
+				bit.stop = asic->blocks[i]->regs[j].bits[k].stop;
+				fwrite(&bit, sizeof bit, 1, f);
+			}
+		}
+	}
+
+	hdr.name_index = align_file(f);
+	fwrite(asic->name_index.table, sizeof asic->name_index.table[0], hdr.name_index_mask + 1, f);
+
+	for (t = 0; t < UMR_NUM_REGCLASS; t++) {
+		hdr.addr_index[t] = align_file(f);
+		fwrite(asic->mmio_accel.entries[t], sizeof asic->mmio_accel.entries[t][0], hdr.no_addr_entries[t], f);
+	}
+
+	hdr.strings = align_file(f);
+	hdr.size_strings = pool.size + 1;
+	fwrite(pool.data, 1, pool.size, f);
+	fputc(0, f);
+
+	hdr.file_size = align_file(f);
+	fseek(f, 0, SEEK_SET);
+	fwrite(&hdr, sizeof hdr, 1, f);
+
+	if (pool.error) {
+		fclose(f);
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		goto error;
+	}
+	if (ferror(f) | fclose(f)) {
+		fprintf(stderr, "[ERROR]: Could not write regdb file <%s>\n", filename);
+		goto error;
+	}
+
+	free(pool.hash);
+	free(pool.data);
+	return 0;
+error:
+	free(pool.hash);
+	free(pool.data);
+	return -1;
+}
+
+/* is the range [off, off + size) inside the mapping */
+static int in_file(const struct umr_regdb_header *hdr, uint64_t off, uint64_t size)
+{
+	return !(off & 7) && off <= hdr->file_size && size <= hdr->file_size - off;
+}
+
+static int check_header(const struct umr_regdb_header *hdr, uint64_t file_size)
+{
+	int t;
+
+	if (file_size < sizeof *hdr || memcmp(hdr->magic, UMR_REGDB_MAGIC, sizeof hdr->magic)) {
+		fprintf(stderr, "[ERROR]: Not a regdb file\n");
+		return -1;
+	}
+	if (hdr->byte_order != UMR_REGDB_BYTE_ORDER || hdr->version != UMR_REGDB_VERSION) {
+		fprintf(stderr, "[ERROR]: Unsupported regdb version %lu\n", (unsigned long)hdr->version);
+		return -1;
+	}
+	if (hdr->file_size != file_size ||
+	    !in_file(hdr, hdr->blocks, (uint64_t)hdr->no_blocks * sizeof(struct umr_regdb_block)) ||
+	    !in_file(hdr, hdr->regs, (uint64_t)hdr->no_regs * sizeof(struct umr_regdb_reg)) ||
+	    !in_file(hdr, hdr->bits, (uint64_t)hdr->no_bits * sizeof(struct umr_regdb_bit)) ||
+	    !in_file(hdr, hdr->name_index, ((uint64_t)hdr->name_index_mask + 1) * sizeof(struct umr_name_index_entry)) ||
+	    (hdr->name_index_mask & (hdr->name_index_mask + 1)) ||
+	    !in_file(hdr, hdr->strings, hdr->size_strings) || !hdr->size_strings)
+		goto corrupt;
+	for (t = 0; t < UMR_NUM_REGCLASS; t++)
+		if (!in_file(hdr, hdr->addr_index[t], (uint64_t)hdr->no_addr_entries[t] * sizeof(struct umr_addr_index_entry)))
+			goto corrupt;
+	return 0;
+corrupt:
+	fprintf(stderr, "[ERROR]: Corrupt regdb file\n");
+	return -1;
+}
+
+/**
+ * umr_create_asic_from_regdb - Create an asic device from a regdb file
+ *
+ * @options: The options to bind to the asic
+ * @name: The path to the regdb file
+ *
+ * The file is mapped into memory and all names and lookup tables are
+ * used in place.  The only allocations made are the asic, its IP
+ * blocks and their register arrays, and one array for every bitfield.
+ *
+ * Returns an asic device on success or NULL if failure
+ */
+struct umr_asic *umr_create_asic_from_regdb(struct umr_options *options, const char *name)
+{
+	const struct umr_regdb_header *hdr;
+	const struct umr_regdb_block *blk;
+	const struct umr_regdb_reg *reg;
+	const struct umr_regdb_bit *bit;
+	struct umr_name_index_entry *nidx;
+	struct umr_addr_index_entry *aidx;
+	struct umr_asic *asic;
+	struct stat st;
+	char *map, *strings;
+	uint32_t x, r, b;
+	int fd, i, t;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		perror("Cannot open regdb file");
+		return NULL;
+	}
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof *hdr) {
+		fprintf(stderr, "[ERROR]: Not a regdb file\n");
+		close(fd);
+		return NULL;
+	}
+	// private so the rest of umr may treat names as writable like it does elsewhere
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("Cannot map regdb file");
+		return NULL;
+	}
+
+	hdr = (const void *)map;
+	if (check_header(hdr, st.st_size)) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	blk = (const void *)(map + hdr->blocks);
+	reg = (const void *)(map + hdr->regs);
+	bit = (const void *)(map + hdr->bits);
+	strings = map + hdr->strings;
+
+#define STR(o) ((o) == UMR_REGDB_NO_STRING ? NULL : &strings[(o)])
+#define BAD_STR(o) ((o) != UMR_REGDB_NO_STRING && (o) >= hdr->size_strings)
+
+	asic = calloc(1, sizeof *asic);
+	if (!asic) {
+		munmap(map, st.st_size);
+		goto out_of_mem;
+	}
+	asic->regdb.map = map;
+	asic->regdb.size = st.st_size;
+	asic->options = *options;
+	asic->family = hdr->family;
+	asic->asicname = BAD_STR(hdr->asicname) ? NULL : STR(hdr->asicname);
+	if (!asic->asicname || strings[hdr->size_strings - 1])
+		goto corrupt;
+
+	asic->blocks = calloc(hdr->no_blocks, sizeof asic->blocks[0]);
+	asic->regdb.bits = calloc(hdr->no_bits, sizeof asic->regdb.bits[0]);
+	if ((hdr->no_blocks && !asic->blocks) || (hdr->no_bits && !asic->regdb.bits))
+		goto out_of_mem_free;
+
+	for (i = 0; i < (int)hdr->no_blocks; i++) {
+		struct umr_ip_block *ip;
+
+		if (BAD_STR(blk[i].ipname) || blk[i].first_reg > hdr->no_regs ||
+		    blk[i].no_regs > hdr->no_regs - blk[i].first_reg)
+			goto corrupt;
+
+		ip = asic->blocks[asic->no_blocks] = calloc(1, sizeof *ip);
+		if (!ip)
+			goto out_of_mem_free;
+		++asic->no_blocks;
+		ip->ipname = STR(blk[i].ipname);
+		ip->no_regs = blk[i].no_regs;
+		ip->regs = calloc(ip->no_regs, sizeof ip->regs[0]);
+		if (ip->no_regs && !ip->regs)
+			goto out_of_mem_free;
+
+		for (x = 0; x < blk[i].no_regs; x++) {
+			r = blk[i].first_reg + x;
+			if (BAD_STR(reg[r].regname) || reg[r].type >= UMR_NUM_REGCLASS ||
+			    reg[r].first_bit > hdr->no_bits || reg[r].no_bits > hdr->no_bits - reg[r].first_bit)
+				goto corrupt;
+			ip->regs[x].regname = STR(reg[r].regname);
+			ip->regs[x].type = reg[r].type;
+			ip->regs[x].addr = reg[r].addr;
+			ip->regs[x].no_bits = reg[r].no_bits;
+			ip->regs[x].bits = reg[r].no_bits ? &asic->regdb.bits[reg[r].first_bit] : NULL;
+		}
+	}
+
+	for (b = 0; b < hdr->no_bits; b++) {
+		if (BAD_STR(bit[b].regname))
+			goto corrupt;
+		asic->regdb.bits[b].regname = STR(bit[b].regname);
+		asic->regdb.bits[b].start = bit[b].start;
+		asic->regdb.bits[b].stop = bit[b].stop;
+		asic->regdb.bits[b].bitfield_print = umr_bitfield_default;
+	}
+
+	// adopt the prebuilt lookup tables once they're known to point at valid registers
+	nidx = (void *)(map + hdr->name_index);
+	for (x = 0; x <= hdr->name_index_mask; x++)
+		if (nidx[x].ip && (nidx[x].ip > hdr->no_blocks || nidx[x].reg >= blk[nidx[x].ip - 1].no_regs))
+			goto corrupt;
+	for (t = 0; t < UMR_NUM_REGCLASS; t++) {
+		aidx = (void *)(map + hdr->addr_index[t]);
+		for (x = 0; x < hdr->no_addr_entries[t]; x++)
+			if (aidx[x].ip >= hdr->no_blocks || aidx[x].reg >= blk[aidx[x].ip].no_regs)
+				goto corrupt;
+		asic->mmio_accel.entries[t] = aidx;
+		asic->mmio_accel.no_entries[t] = hdr->no_addr_entries[t];
+	}
+	asic->mmio_accel.built = 1;
+	asic->mmio_accel.mapped = 1;
+	asic->name_index.table = nidx;
+	asic->name_index.mask = hdr->name_index_mask;
+	asic->name_index.mapped = 1;
+
+#undef STR
+#undef BAD_STR
+
+	return asic;
+
+corrupt:
+	fprintf(stderr, "[ERROR]: Corrupt regdb file\n");
+	umr_free_asic(asic);
+	return NULL;
+out_of_mem_free:
+	umr_free_asic(asic);
+out_of_mem:
+	fprintf(stderr, "[ERROR]: Out of memory\n");
+	return NULL;
+}
+
+/**
+ * umr_free_regdb - Release the regdb file backing an asic (if any)
+ */
+void umr_free_regdb(struct umr_asic *asic)
+{
+	if (asic->regdb.map) {
+		free(asic->regdb.bits);
+		munmap(asic->regdb.map, asic->regdb.size);
+		asic->regdb.bits = NULL;
+		asic->regdb.map = NULL;
+		asic->regdb.size = 0;
+	}
+}
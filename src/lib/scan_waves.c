@@ -98,6 +98,66 @@ static void umr_scan_wave_simd(struct umr_asic *asic, uint32_t se, uint32_t sh,
 	}
 }
 
+static void wave_status_done(void *data, int result)
+{
+	*(int *)data = result;
+}
+
+/**
+ * Scan all wave slots of a CU with the debugfs reads in flight at once
+ * (the status of every slot, then the GPRs of every wave found).
+ *
+ * Returns -1 without adding any wave if the slots must be scanned one
+ * at a time instead.
+ */
+static int umr_scan_wave_cu_aio(struct umr_asic *asic, struct umr_aio *aio, uint32_t se, uint32_t sh, uint32_t cu,
+				struct umr_wave_data ***pppwd)
+{
+	uint32_t simd, wave, bufs[4 * 10][32];
+	int res[4 * 10];
+	struct umr_wave_data *pwd;
+
+	for (simd = 0; simd < 4; simd++)
+	for (wave = 0; wave < 10; wave++) {
+		if (umr_queue_wave_status(asic, aio, se, sh, cu, simd, wave, bufs[simd * 10 + wave],
+					  wave_status_done, &res[simd * 10 + wave])) {
+			umr_aio_wait(aio);
+			return -1;
+		}
+	}
+	umr_aio_wait(aio);
+
+	for (simd = 0; simd < 4; simd++)
+	for (wave = 0; wave < 10; wave++) {
+		pwd = **pppwd;
+		if (res[simd * 10 + wave] <= 0 ||
+		    umr_parse_wave_status(asic, bufs[simd * 10 + wave], &pwd->ws))
+			continue;
+		if (!pwd->ws.wave_status.valid &&
+		    (!pwd->ws.wave_status.halt))
+			continue;
+
+		pwd->se = se;
+		pwd->sh = sh;
+		pwd->cu = cu;
+		pwd->simd = simd;
+		pwd->wave = wave;
+		if (!asic->options.skip_gprs)
+			umr_queue_gprs(asic, aio, &pwd->ws, &pwd->sgprs[0], &pwd->vgprs[0], &pwd->have_vgprs);
+		else
+			pwd->have_vgprs = 0;
+
+		pwd->next = calloc(1, sizeof(*pwd));
+		if (!pwd->next) {
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+			break;
+		}
+		*pppwd = &pwd->next;
+	}
+	umr_aio_wait(aio);
+	return 0;
+}
+
 /**
  * umr_scan_wave_data - Scan for any halted valid waves
  *
@@ -107,6 +167,7 @@ struct umr_wave_data *umr_scan_wave_data(struct umr_asic *asic)
 {
 	uint32_t se, sh, cu, simd;
 	struct umr_wave_data *head, **ptail;
+	struct umr_aio *aio;
 
 	head = calloc(1, sizeof *head);
 	if (!head) {
@@ -115,11 +176,18 @@ struct umr_wave_data *umr_scan_wave_data(struct umr_asic *asic)
 	}
 	ptail = &head;
 
+	// with io_uring the reads of a CU are made concurrently
+	aio = umr_get_aio(asic);
+	if (aio && !umr_aio_is_async(aio))
+		aio = NULL;
+
 	for (se = 0; se < asic->config.gfx.max_shader_engines; se++)
 	for (sh = 0; sh < asic->config.gfx.max_sh_per_se; sh++)
 	for (cu = 0; cu < asic->config.gfx.max_cu_per_sh; cu++) {
 		umr_get_wave_sq_info(asic, se, sh, cu, &(*ptail)->ws);
 		if ((*ptail)->ws.sq_info.busy) {
+			if (aio && !umr_scan_wave_cu_aio(asic, aio, se, sh, cu, &ptail))
+				continue;
 			for (simd = 0; simd < 4; simd++)
 				umr_scan_wave_simd(asic, se, sh, cu, simd, &ptail);
 		}
@@ -0,0 +1,406 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <pthread.h>
+
+/*
+ * The register array of a SOC15 IP block only depends on its constant
+ * register table and the five base offsets of the IP instance so every
+ * device using the same pair (e.g. each node of an XGMI hive) can use
+ * the same array.  Likewise the lookup tables of a device only depend
+ * on the register arrays of its blocks.  Both are kept in reference
+ * counted lists so that additional devices only cost their IP block
+ * structures.
+ *
+ * Shared register arrays must not be modified, callers that edit the
+ * register database use umr_unshare_ip_block() first.  That includes
+ * the value fields, register values read by a device are kept in its
+ * own arrays (umr_get_reg_values()).
+ */
+struct umr_soc15_shared {
+	const struct umr_reg_soc15 *table;
+	uint32_t offset[5];
+	int no_regs, refcount;
+	struct umr_reg *regs;
+	struct umr_soc15_shared *next;
+};
+
+struct umr_shared_indices_key {
+	const struct umr_reg_soc15 *table;
+	uint32_t offset[5];
+	int no_regs;
+};
+
+struct umr_shared_indices {
+	int refcount, no_blocks;
+	struct umr_shared_indices_key *key;
+
+	struct umr_addr_index_entry *entries[UMR_NUM_REGCLASS];
+	uint32_t no_entries[UMR_NUM_REGCLASS];
+	int accel_built;
+	struct umr_name_index_entry *name_table;
+	uint32_t name_mask;
+	uint32_t *trigram_offsets, *trigram_ids;
+
+	struct umr_shared_indices *next;
+};
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct umr_soc15_shared *shared_regs;
+static struct umr_shared_indices *shared_indices;
+
+/**
+ * umr_share_soc15_regs - Attach a shared register array to an IP block
+ *
+ * Finds the register array built for the same SOC15 table and
+ * offsets or builds it.  Returns 0 on success.
+ */
+int umr_share_soc15_regs(struct umr_ip_block *ip)
+{
+	struct umr_soc15_shared *s;
+	const struct umr_reg_soc15 *regs;
+	int y;
+
+	pthread_mutex_lock(&shared_lock);
+	for (s = shared_regs; s; s = s->next)
+		if (s->table == ip->soc15.regs && s->no_regs == ip->no_regs &&
+		    !memcmp(s->offset, ip->soc15.offset, sizeof s->offset))
+			break;
+
+	if (!s) {
+		s = calloc(1, sizeof *s);
+		if (s)
+			s->regs = calloc(ip->no_regs, sizeof(s->regs[0]));
+		if (!s || !s->regs) {
+			pthread_mutex_unlock(&shared_lock);
+			free(s);
+			fprintf(stderr, "[ERROR]: Out of memory building IP block '%s'\n", ip->ipname);
+			return -1;
+		}
+
+		// start copying them
+		regs = ip->soc15.regs;
+		for (y = 0; y < ip->no_regs; y++) {
+			if (regs[y].type == REG_MMIO)
+				s->regs[y].addr = regs[y].addr + ip->soc15.offset[regs[y].idx];
+			else
+				s->regs[y].addr = regs[y].addr;
+			s->regs[y].bits = regs[y].bits;
+			s->regs[y].no_bits = regs[y].no_bits;
+			s->regs[y].regname = regs[y].regname;
+			s->regs[y].type = regs[y].type;
+		}
+		s->table = ip->soc15.regs;
+		memcpy(s->offset, ip->soc15.offset, sizeof s->offset);
+		s->no_regs = ip->no_regs;
+		s->next = shared_regs;
+		shared_regs = s;
+	}
+	++s->refcount;
+	pthread_mutex_unlock(&shared_lock);
+
+	ip->regs = s->regs;
+	ip->soc15.shared = s;
+	return 0;
+}
+
+static void put_soc15_regs(struct umr_soc15_shared *s)
+{
+	struct umr_soc15_shared **p;
+
+	pthread_mutex_lock(&shared_lock);
+	if (!--s->refcount) {
+		for (p = &shared_regs; *p != s; p = &(*p)->next);
+		*p = s->next;
+		free(s->regs);
+		free(s);
+	}
+	pthread_mutex_unlock(&shared_lock);
+}
+
+/**
+ * umr_release_ip_block_regs - Free the register array of an IP block
+ *
+ * Drops the reference to a shared array or frees a private one.
+ */
+void umr_release_ip_block_regs(struct umr_ip_block *ip)
+{
+	if (ip->soc15.shared)
+		put_soc15_regs(ip->soc15.shared);
+	else
+		free(ip->regs);
+	ip->soc15.shared = NULL;
+	ip->regs = NULL;
+}
+
+/**
+ * umr_unshare_ip_block - Give an IP block a private register array
+ *
+ * Copies a shared register array so the block can be edited without
+ * affecting other devices.  The block is no longer tied to its SOC15
+ * table afterwards.  Returns 0 on success.
+ */
+int umr_unshare_ip_block(struct umr_ip_block *ip)
+{
+	struct umr_reg *regs;
+
+	if (umr_materialize_ip_block(ip))
+		return -1;
+	if (!ip->soc15.shared) {
+		ip->soc15.regs = NULL;
+		return 0;
+	}
+
+	regs = calloc(ip->no_regs, sizeof regs[0]);
+	if (!regs) {
+		fprintf(stderr, "[ERROR]: Out of memory copying IP block '%s'\n", ip->ipname);
+		return -1;
+	}
+	memcpy(regs, ip->regs, ip->no_regs * sizeof regs[0]);
+	put_soc15_regs(ip->soc15.shared);
+	ip->soc15.shared = NULL;
+	ip->soc15.regs = NULL;
+	ip->regs = regs;
+	return 0;
+}
+
+/**
+ * umr_get_reg_values - Register values of an IP block kept by a device
+ *
+ * @i: Index of the block in @asic->blocks
+ *
+ * The register arrays may be shared with other devices (e.g. the nodes
+ * of an XGMI hive) and clones so the values a handle reads, for
+ * instance with umr_scan_asic(), are kept in arrays of its own indexed
+ * like the registers of the block.  They are allocated zeroed on first
+ * use and freed by umr_invalidate_reg_indices().  Returns NULL if out
+ * of memory.
+ */
+uint32_t *umr_get_reg_values(struct umr_asic *asic, int i)
+{
+	uint32_t **values;
+
+	if (i >= asic->reg_values.no_blocks) {
+		values = realloc(asic->reg_values.values, asic->no_blocks * sizeof values[0]);
+		if (!values) {
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+			return NULL;
+		}
+		memset(&values[asic->reg_values.no_blocks], 0, (asic->no_blocks - asic->reg_values.no_blocks) * sizeof values[0]);
+		asic->reg_values.values = values;
+		asic->reg_values.no_blocks = asic->no_blocks;
+	}
+	if (!asic->reg_values.values[i]) {
+		asic->reg_values.values[i] = calloc(asic->blocks[i]->no_regs ? asic->blocks[i]->no_regs : 1, sizeof(uint32_t));
+		if (!asic->reg_values.values[i])
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+	}
+	return asic->reg_values.values[i];
+}
+
+/**
+ * umr_free_reg_values - Free the register values kept by a device
+ */
+void umr_free_reg_values(struct umr_asic *asic)
+{
+	int i;
+
+	for (i = 0; i < asic->reg_values.no_blocks; i++)
+		free(asic->reg_values.values[i]);
+	free(asic->reg_values.values);
+	asic->reg_values.values = NULL;
+	asic->reg_values.no_blocks = 0;
+}
+
+/* lookup tables can only be shared if every block is an unmodified SOC15 block */
+static int asic_is_shareable(struct umr_asic *asic)
+{
+	int i;
+
+	if (!asic->no_blocks)
+		return 0;
+	for (i = 0; i < asic->no_blocks; i++)
+		if (!asic->blocks[i]->soc15.regs ||
+		    (asic->blocks[i]->regs && !asic->blocks[i]->soc15.shared))
+			return 0;
+	return 1;
+}
+
+static int key_matches(struct umr_shared_indices *si, struct umr_asic *asic)
+{
+	int i;
+
+	if (si->no_blocks != asic->no_blocks)
+		return 0;
+	for (i = 0; i < asic->no_blocks; i++)
+		if (si->key[i].table != asic->blocks[i]->soc15.regs ||
+		    si->key[i].no_regs != asic->blocks[i]->no_regs ||
+		    memcmp(si->key[i].offset, asic->blocks[i]->soc15.offset, sizeof si->key[i].offset))
+			return 0;
+	return 1;
+}
+
+/* copy the tables another device has built, caller holds shared_lock */
+static void adopt_indices(struct umr_asic *asic, struct umr_shared_indices *si)
+{
+	int t;
+
+	if (!asic->mmio_accel.built && si->accel_built) {
+		for (t = 0; t < UMR_NUM_REGCLASS; t++) {
+			asic->mmio_accel.entries[t] = si->entries[t];
+			asic->mmio_accel.no_entries[t] = si->no_entries[t];
+		}
+		asic->mmio_accel.built = 1;
+		asic->mmio_accel.mapped = 1;
+	}
+	if (!asic->name_index.table && si->name_table) {
+		asic->name_index.table = si->name_table;
+		asic->name_index.mask = si->name_mask;
+		asic->name_index.mapped = 1;
+	}
+	if (!asic->trigram_index.offsets && si->trigram_offsets) {
+		asic->trigram_index.offsets = si->trigram_offsets;
+		asic->trigram_index.ids = si->trigram_ids;
+		asic->trigram_index.mapped = 1;
+	}
+}
+
+/**
+ * umr_attach_shared_indices - Use lookup tables built by another device
+ *
+ * @asic: The device about to build a lookup table
+ *
+ * If another device has the same register arrays any lookup tables it
+ * built are adopted by @asic.  Called by the table constructors
+ * before building a table.
+ */
+void umr_attach_shared_indices(struct umr_asic *asic)
+{
+	struct umr_shared_indices *si;
+	int i;
+
+	if (!asic->shared_indices) {
+		if (!asic_is_shareable(asic))
+			return;
+
+		pthread_mutex_lock(&shared_lock);
+		for (si = shared_indices; si; si = si->next)
+			if (key_matches(si, asic))
+				break;
+		if (!si) {
+			si = calloc(1, sizeof *si);
+			if (si)
+				si->key = calloc(asic->no_blocks, sizeof si->key[0]);
+			if (!si || !si->key) {
+				// not fatal, the device just keeps private tables
+				pthread_mutex_unlock(&shared_lock);
+				free(si);
+				return;
+			}
+			si->no_blocks = asic->no_blocks;
+			for (i = 0; i < asic->no_blocks; i++) {
+				si->key[i].table = asic->blocks[i]->soc15.regs;
+				si->key[i].no_regs = asic->blocks[i]->no_regs;
+				memcpy(si->key[i].offset, asic->blocks[i]->soc15.offset, sizeof si->key[i].offset);
+			}
+			si->next = shared_indices;
+			shared_indices = si;
+		}
+		++si->refcount;
+		asic->shared_indices = si;
+	} else {
+		pthread_mutex_lock(&shared_lock);
+	}
+	adopt_indices(asic, asic->shared_indices);
+	pthread_mutex_unlock(&shared_lock);
+}
+
+/**
+ * umr_publish_shared_indices - Offer newly built lookup tables to other devices
+ *
+ * @asic: The device that built a lookup table
+ *
+ * Hands ownership of the tables of @asic to its shared entry (if it
+ * has one) so devices with the same register arrays can adopt them.
+ */
+void umr_publish_shared_indices(struct umr_asic *asic)
+{
+	struct umr_shared_indices *si = asic->shared_indices;
+	int t;
+
+	if (!si)
+		return;
+
+	pthread_mutex_lock(&shared_lock);
+	if (asic->mmio_accel.built && !asic->mmio_accel.mapped && !si->accel_built) {
+		for (t = 0; t < UMR_NUM_REGCLASS; t++) {
+			si->entries[t] = asic->mmio_accel.entries[t];
+			si->no_entries[t] = asic->mmio_accel.no_entries[t];
+		}
+		si->accel_built = 1;
+		asic->mmio_accel.mapped = 1;
+	}
+	if (asic->name_index.table && !asic->name_index.mapped && !si->name_table) {
+		si->name_table = asic->name_index.table;
+		si->name_mask = asic->name_index.mask;
+		asic->name_index.mapped = 1;
+	}
+	if (asic->trigram_index.offsets && !asic->trigram_index.mapped && !si->trigram_offsets) {
+		si->trigram_offsets = asic->trigram_index.offsets;
+		si->trigram_ids = asic->trigram_index.ids;
+		asic->trigram_index.mapped = 1;
+	}
+	pthread_mutex_unlock(&shared_lock);
+}
+
+/**
+ * umr_release_shared_indices - Drop the shared lookup tables of a device
+ *
+ * The tables are freed once the last device using them releases
+ * them.  The caller clears the table pointers of @asic.
+ */
+void umr_release_shared_indices(struct umr_asic *asic)
+{
+	struct umr_shared_indices *si = asic->shared_indices, **p;
+	int t;
+
+	if (!si)
+		return;
+	asic->shared_indices = NULL;
+
+	pthread_mutex_lock(&shared_lock);
+	if (!--si->refcount) {
+		for (p = &shared_indices; *p != si; p = &(*p)->next);
+		*p = si->next;
+		for (t = 0; t < UMR_NUM_REGCLASS; t++)
+			free(si->entries[t]);
+		free(si->name_table);
+		free(si->trigram_offsets);
+		free(si->trigram_ids);
+		free(si->key);
+		free(si);
+	}
+	pthread_mutex_unlock(&shared_lock);
+}
@@ -0,0 +1,531 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+
+/*
+ * Snapshot file layout (native byte order, checked with byte_order):
+ *
+ *   header
+ *   uint32_t values[no_regs]
+ *   struct umr_snapshot_entry entries[no_regs]
+ *   char strings[strings_size]   NUL terminated IP and register names
+ */
+#define UMR_SNAPSHOT_VERSION 1
+
+struct umr_snapshot_header {
+	char magic[8];
+	uint32_t version, byte_order;
+	uint32_t no_regs, strings_size;
+	char asicname[32];
+};
+
+struct umr_snapshot_entry {
+	uint32_t ipname, regname, addr, type;
+};
+
+/* (block index, register index) of an entry, used to order registers */
+static uint64_t reg_key(struct umr_asic *asic, const struct umr_find_reg_iter_result *r)
+{
+	int i;
+
+	for (i = 0; i < asic->no_blocks; i++)
+		if (asic->blocks[i] == r->ip)
+			break;
+	return ((uint64_t)i << 32) | (uint32_t)(r->reg - r->ip->regs);
+}
+
+/**
+ * umr_snapshot_free - Free a register snapshot
+ */
+void umr_snapshot_free(struct umr_reg_snapshot *snap)
+{
+	if (snap) {
+		free(snap->regs);
+		free(snap->values);
+		free(snap);
+	}
+}
+
+static struct umr_reg_snapshot *snapshot_alloc(struct umr_asic *asic, uint32_t n)
+{
+	struct umr_reg_snapshot *snap;
+
+	snap = calloc(1, sizeof *snap);
+	if (snap) {
+		snap->asic = asic;
+		snap->regs = calloc(n + 1, sizeof snap->regs[0]);
+		snap->values = calloc(n + 1, sizeof snap->values[0]);
+		if (snap->regs && snap->values)
+			return snap;
+	}
+	fprintf(stderr, "[ERROR]: Out of memory\n");
+	umr_snapshot_free(snap);
+	return NULL;
+}
+
+/*
+ * read the registers of one run of a block (granted by the caller)
+ * with a single umr_read_regs() call, MMIO registers read through
+ * debugfs carry the bank selected with --bank/--sbank in their address
+ */
+static int snapshot_read_run(struct umr_asic *asic, struct umr_reg_snapshot *snap,
+			     uint32_t first, uint32_t last, struct umr_reg_addr *addrs, uint64_t bank)
+{
+	struct umr_reg *reg;
+	uint32_t n;
+
+	for (n = first; n < last; n++) {
+		reg = snap->regs[n].reg;
+		addrs[n - first].addr = reg->addr * (reg->type == REG_MMIO ? 4 : 1);
+		if (reg->type == REG_MMIO)
+			addrs[n - first].addr |= bank;
+		addrs[n - first].type = reg->type;
+	}
+	return umr_read_regs(asic, addrs, &snap->values[first], last - first);
+}
+
+/*
+ * read the values of the registers of @snap the same way umr_scan_asic()
+ * does: each IP block is granted and released around its registers
+ * (those of blocks that can't be granted are dropped), SMC registers are
+ * only read with the "read_smc" option and the selected GRBM bank is
+ * applied.  The snapshot is compacted to the registers that were read.
+ */
+static int snapshot_read_values(struct umr_asic *asic, struct umr_reg_snapshot *snap)
+{
+	struct umr_reg_addr *addrs;
+	struct umr_ip_block *ip;
+	struct umr_reg *reg;
+	uint64_t bank;
+	uint32_t x, y, n, first;
+	int selected, r;
+
+	addrs = calloc(snap->no_regs, sizeof addrs[0]);
+	if (!addrs) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return -1;
+	}
+
+	// the registers are read through the callbacks so without debugfs
+	// the GRBM bank is selected once for the whole capture instead
+	bank = 0;
+	selected = 0;
+	if (asic->fd.mmio < 0 || asic->pci.mem) {
+		if (asic->options.use_bank == 1) {
+			umr_lock_hw(asic);
+			umr_grbm_select_index(asic, asic->options.bank.grbm.se, asic->options.bank.grbm.sh, asic->options.bank.grbm.instance);
+			selected = 1;
+		}
+	} else {
+		bank = umr_apply_bank_selection_address(asic);
+	}
+
+	r = 0;
+	for (n = x = 0; x < snap->no_regs && !r; x = y) {
+		ip = snap->regs[x].ip;
+		first = n;
+
+		// drop the registers that are not read
+		for (y = x; y < snap->no_regs && snap->regs[y].ip == ip; y++) {
+			reg = snap->regs[y].reg;
+			if (reg->type > REG_PCIE && !asic->pci.mem)
+				continue;
+			if (reg->type == REG_SMC && !asic->options.read_smc && !asic->pci.mem)
+				continue;
+			snap->regs[n++] = snap->regs[y];
+		}
+		if (n == first)
+			continue;
+
+		// only grant if any register of the block is read
+		if (ip->grant && ip->grant(asic)) {
+			fprintf(stderr, "[WARNING]: Could not grant access to IP block <%s>, skipping it\n", ip->ipname);
+			n = first;
+			continue;
+		}
+		r = snapshot_read_run(asic, snap, first, n, addrs, bank);
+		if (ip->release && ip->release(asic))
+			r = -1;
+	}
+	snap->no_regs = n;
+
+	if (selected) {
+		umr_grbm_select_index(asic, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF);
+		umr_unlock_hw(asic);
+	}
+	free(addrs);
+	if (r)
+		fprintf(stderr, "[ERROR]: Could not read the snapshot registers\n");
+	return r;
+}
+
+/**
+ * umr_snapshot_capture - Read a set of registers into a snapshot
+ *
+ * @asic: The device to read
+ * @ip: Pattern IP block names must match (or NULL for any)
+ * @reg: Pattern register names must match
+ *
+ * Every register matched by the patterns (see umr_find_reg_wild_first())
+ * is read through @asic->reg_funcs and stored in a dense array along
+ * with pointers to its register and IP block.  Like umr_scan_asic() the
+ * IP blocks are granted while they are read, SMC registers need the
+ * "read_smc" option and the --bank selection applies.  Returns NULL if
+ * no register was read or on error.
+ */
+struct umr_reg_snapshot *umr_snapshot_capture(struct umr_asic *asic, const char *ip, const char *reg)
+{
+	struct umr_reg_snapshot *snap;
+	struct umr_find_reg_iter *iter;
+	struct umr_find_reg_iter_result r, *regs;
+	uint32_t n, max;
+
+	iter = umr_find_reg_wild_first(asic, ip, reg);
+	if (!iter)
+		return NULL;
+
+	snap = snapshot_alloc(asic, max = 256);
+	if (!snap) {
+		while (umr_find_reg_wild_next(iter).reg);
+		return NULL;
+	}
+	n = 0;
+	while ((r = umr_find_reg_wild_next(iter)).reg) {
+		if (n == max) {
+			max *= 2;
+			regs = realloc(snap->regs, max * sizeof snap->regs[0]);
+			if (!regs) {
+				fprintf(stderr, "[ERROR]: Out of memory\n");
+				while (umr_find_reg_wild_next(iter).reg);
+				umr_snapshot_free(snap);
+				return NULL;
+			}
+			snap->regs = regs;
+		}
+		snap->regs[n++] = r;
+	}
+	snap->no_regs = n;
+	if (!n) {
+		umr_snapshot_free(snap);
+		return NULL;
+	}
+
+	if (n > 256) {
+		free(snap->values);
+		snap->values = calloc(n, sizeof snap->values[0]);
+		if (!snap->values) {
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+			umr_snapshot_free(snap);
+			return NULL;
+		}
+	}
+
+	// read them in one pass after the (slower) name matching
+	if (snapshot_read_values(asic, snap) || !snap->no_regs) {
+		umr_snapshot_free(snap);
+		return NULL;
+	}
+	return snap;
+}
+
+/**
+ * umr_snapshot_write - Save a register snapshot to a file
+ *
+ * The file records register and IP block names so that it can be
+ * loaded with umr_snapshot_read() by a later umr session.
+ * Returns 0 on success.
+ */
+int umr_snapshot_write(struct umr_reg_snapshot *snap, const char *filename)
+{
+	struct umr_snapshot_header hdr;
+	struct umr_snapshot_entry *ent;
+	struct umr_ip_block *last_ip;
+	char *strings;
+	uint32_t n, size, len, ipname;
+	FILE *f;
+	int r;
+
+	// worst case size of the name strings
+	for (size = n = 0; n < snap->no_regs; n++)
+		size += strlen(snap->regs[n].ip->ipname) + strlen(snap->regs[n].reg->regname) + 2;
+
+	ent = calloc(snap->no_regs + 1, sizeof ent[0]);
+	strings = calloc(1, size + 1);
+	if (!ent || !strings) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		free(ent);
+		free(strings);
+		return -1;
+	}
+
+	// IP names are stored once per run of registers from the same block
+	last_ip = NULL;
+	ipname = 0;
+	for (size = n = 0; n < snap->no_regs; n++) {
+		if (snap->regs[n].ip != last_ip) {
+			last_ip = snap->regs[n].ip;
+			ipname = size;
+			len = strlen(last_ip->ipname) + 1;
+			memcpy(strings + size, last_ip->ipname, len);
+			size += len;
+		}
+		ent[n].ipname = ipname;
+		ent[n].regname = size;
+		len = strlen(snap->regs[n].reg->regname) + 1;
+		memcpy(strings + size, snap->regs[n].reg->regname, len);
+		size += len;
+		ent[n].addr = snap->regs[n].reg->addr;
+		ent[n].type = snap->regs[n].reg->type;
+	}
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, UMR_SNAPSHOT_MAGIC, sizeof hdr.magic);
+	hdr.version = UMR_SNAPSHOT_VERSION;
+	hdr.byte_order = 0x01020304;
+	hdr.no_regs = snap->no_regs;
+	hdr.strings_size = size;
+	strncpy(hdr.asicname, snap->asic->asicname, sizeof(hdr.asicname) - 1);
+
+	r = -1;
+	f = fopen(filename, "wb");
+	if (!f) {
+		perror("Cannot create snapshot file");
+	} else {
+		if (fwrite(&hdr, sizeof hdr, 1, f) == 1 &&
+		    fwrite(snap->values, sizeof snap->values[0], snap->no_regs, f) == snap->no_regs &&
+		    fwrite(ent, sizeof ent[0], snap->no_regs, f) == snap->no_regs &&
+		    fwrite(strings, 1, size, f) == size)
+			r = 0;
+		if (fclose(f))
+			r = -1;
+		if (r)
+			fprintf(stderr, "[ERROR]: Could not write snapshot file <%s>\n", filename);
+	}
+	free(ent);
+	free(strings);
+	return r;
+}
+
+/*
+ * find the register named @regname in the block named exactly @ipname,
+ * files list registers in block and register order so the search
+ * starts at the register following the previous result in @r
+ */
+static int find_snapshot_reg(struct umr_asic *asic, const char *ipname, const char *regname, struct umr_find_reg_iter_result *r)
+{
+	int i, j, start;
+
+	start = 0;
+	if (r->ip && !strcmp(r->ip->ipname, ipname)) {
+		start = r->reg - r->ip->regs + 1;
+	} else {
+		for (i = 0; i < asic->no_blocks; i++)
+			if (!strcmp(asic->blocks[i]->ipname, ipname))
+				break;
+		if (i == asic->no_blocks || umr_materialize_ip_block(asic->blocks[i]))
+			return -1;
+		r->ip = asic->blocks[i];
+	}
+
+	for (i = 0; i < r->ip->no_regs; i++) {
+		j = (start + i) % r->ip->no_regs;
+		if (r->ip->regs[j].regname && !strcmp(r->ip->regs[j].regname, regname)) {
+			r->reg = &r->ip->regs[j];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+ * umr_snapshot_read - Load a register snapshot from a file
+ *
+ * @asic: The device the snapshot was taken of
+ * @filename: A file written by umr_snapshot_write()
+ *
+ * The registers of the file are resolved by name on @asic which must
+ * be the same kind of device.  Registers that do not exist on @asic
+ * (e.g. removed by an update script) are reported and dropped.
+ * Returns NULL on error.
+ */
+struct umr_reg_snapshot *umr_snapshot_read(struct umr_asic *asic, const char *filename)
+{
+	struct umr_snapshot_header hdr;
+	struct umr_snapshot_entry *ent;
+	struct umr_reg_snapshot *snap;
+	struct umr_find_reg_iter_result r;
+	uint32_t *values, n, m;
+	char *strings;
+	FILE *f;
+	long size;
+
+	f = fopen(filename, "rb");
+	if (!f) {
+		perror("Cannot open snapshot file");
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	ent = NULL;
+	values = NULL;
+	strings = NULL;
+	snap = NULL;
+	if (fread(&hdr, sizeof hdr, 1, f) != 1 ||
+	    memcmp(hdr.magic, UMR_SNAPSHOT_MAGIC, sizeof hdr.magic) ||
+	    hdr.version != UMR_SNAPSHOT_VERSION || hdr.byte_order != 0x01020304 ||
+	    (uint64_t)size != sizeof hdr + (uint64_t)hdr.no_regs * (sizeof values[0] + sizeof ent[0]) + hdr.strings_size ||
+	    !hdr.strings_size) {
+		fprintf(stderr, "[ERROR]: <%s> is not a valid snapshot file\n", filename);
+		goto error;
+	}
+	hdr.asicname[sizeof(hdr.asicname) - 1] = 0;
+	if (strcmp(hdr.asicname, asic->asicname)) {
+		fprintf(stderr, "[ERROR]: Snapshot <%s> was taken of a [%s] device not [%s]\n", filename, hdr.asicname, asic->asicname);
+		goto error;
+	}
+
+	values = calloc(hdr.no_regs + 1, sizeof values[0]);
+	ent = calloc(hdr.no_regs + 1, sizeof ent[0]);
+	strings = calloc(1, hdr.strings_size + 1);
+	snap = snapshot_alloc(asic, hdr.no_regs);
+	if (!values || !ent || !strings || !snap)
+		goto error;
+	if (fread(values, sizeof values[0], hdr.no_regs, f) != hdr.no_regs ||
+	    fread(ent, sizeof ent[0], hdr.no_regs, f) != hdr.no_regs ||
+	    fread(strings, 1, hdr.strings_size, f) != hdr.strings_size) {
+		fprintf(stderr, "[ERROR]: Could not read snapshot file <%s>\n", filename);
+		goto error;
+	}
+
+	memset(&r, 0, sizeof r);
+	for (m = n = 0; n < hdr.no_regs; n++) {
+		if (ent[n].ipname >= hdr.strings_size || ent[n].regname >= hdr.strings_size) {
+			fprintf(stderr, "[ERROR]: <%s> is not a valid snapshot file\n", filename);
+			goto error;
+		}
+		if (find_snapshot_reg(asic, strings + ent[n].ipname, strings + ent[n].regname, &r)) {
+			memset(&r, 0, sizeof r);
+			fprintf(stderr, "[WARNING]: Register %s.%s of snapshot <%s> not found on asic [%s]\n",
+				strings + ent[n].ipname, strings + ent[n].regname, filename, asic->asicname);
+			continue;
+		}
+		snap->regs[m] = r;
+		snap->values[m++] = values[n];
+	}
+	snap->no_regs = m;
+
+	fclose(f);
+	free(values);
+	free(ent);
+	free(strings);
+	return snap;
+error:
+	fclose(f);
+	free(values);
+	free(ent);
+	free(strings);
+	umr_snapshot_free(snap);
+	return NULL;
+}
+
+/* index of the first word that differs in a[0..n) and b[0..n) or n */
+static uint32_t first_difference(const uint32_t *a, const uint32_t *b, uint32_t n)
+{
+	uint32_t x, k, d;
+
+	// the OR reduction over fixed size chunks is vectorised by the compiler
+	for (x = 0; x + 16 <= n; x += 16) {
+		for (d = k = 0; k < 16; k++)
+			d |= a[x + k] ^ b[x + k];
+		if (d)
+			break;
+	}
+	for (; x < n; x++)
+		if (a[x] != b[x])
+			break;
+	return x;
+}
+
+/**
+ * umr_snapshot_diff - Compare two register snapshots
+ *
+ * @a, @b: Snapshots of the same device
+ * @cb: Called with the register, its IP block and both values for
+ *      every register present in both snapshots whose value differs
+ * @data: Passed to @cb
+ *
+ * Registers are matched by identity, snapshots of the same register
+ * set (the common case) are compared without any lookups.  Returns the
+ * number of registers that differ or -1 if the snapshots are of
+ * different devices.
+ */
+int umr_snapshot_diff(struct umr_reg_snapshot *a, struct umr_reg_snapshot *b,
+		      void (*cb)(void *data, struct umr_ip_block *ip, struct umr_reg *reg, uint32_t a_value, uint32_t b_value),
+		      void *data)
+{
+	uint64_t ka, kb;
+	uint32_t x, y;
+	int n;
+
+	if (a->asic != b->asic) {
+		fprintf(stderr, "[ERROR]: Cannot compare snapshots of different devices\n");
+		return -1;
+	}
+
+	n = 0;
+	if (a->no_regs == b->no_regs &&
+	    !memcmp(a->regs, b->regs, a->no_regs * sizeof a->regs[0])) {
+		x = 0;
+		while ((x += first_difference(&a->values[x], &b->values[x], a->no_regs - x)) < a->no_regs) {
+			if (cb)
+				cb(data, a->regs[x].ip, a->regs[x].reg, a->values[x], b->values[x]);
+			++n;
+			++x;
+		}
+		return n;
+	}
+
+	// different register sets, walk both in block and register order
+	for (x = y = 0; x < a->no_regs && y < b->no_regs;) {
+		ka = reg_key(a->asic, &a->regs[x]);
+		kb = reg_key(b->asic, &b->regs[y]);
+		if (ka < kb) {
+			++x;
+		} else if (kb < ka) {
+			++y;
+		} else {
+			if (a->values[x] != b->values[y]) {
+				if (cb)
+					cb(data, a->regs[x].ip, a->regs[x].reg, a->values[x], b->values[y]);
+				++n;
+			}
+			++x;
+			++y;
+		}
+	}
+	return n;
+}
@@ -61,7 +61,7 @@ int umr_sq_cmd_halt_waves(struct umr_asic *asic, enum umr_sq_cmd_halt_resume mod
 			(0x3FFULL << 24) |
 			(0x3FFULL << 34) |
 			(0x3FFULL << 44);
-	umr_write_reg(asic, addr, value, reg->type);
+	asic->reg_funcs.write_reg(asic, addr, value, reg->type);
 
 	return 0;
 }
@@ -0,0 +1,948 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <errno.h>
+
+/*
+ * A trace records every access made through the register and memory
+ * callbacks of a device (and the debugfs files read with
+ * umr_trace_pread()) along with its result so that a later run can be
+ * served from the trace instead of the hardware.
+ *
+ * Trace file layout (native byte order, checked with byte_order):
+ *
+ *   header
+ *   records, each a uint8_t kind followed by
+ *     register read/write:   uint8_t type, uint64_t addr, uint32_t value
+ *     sram/vram read/write:  uint64_t addr, uint32_t size, int32_t result,
+ *                            data[size] (reads only if result is 0)
+ *     bus address:           uint64_t dma_addr, uint64_t cpu_addr
+ *     file read:             uint8_t len, char name[len], uint64_t offset,
+ *                            uint32_t size, int32_t result,
+ *                            data[result] (if result > 0)
+ *
+ * On replay the reads are indexed by (kind, address[, size or file])
+ * and the n'th read of a key returns the n'th recorded result (the last
+ * one once they are used up) so the sequence of values a register took
+ * is reproduced even if reads of other registers move around.  Memory
+ * reads that don't match a recorded read are assembled from the last
+ * recorded contents of each byte.  Writes are recorded but ignored on
+ * replay.
+ */
+#define UMR_TRACE_VERSION 1
+#define TRACE_PAGE_SIZE   4096
+
+enum trace_kind {
+	TRACE_REG_READ = 1,
+	TRACE_REG_WRITE,
+	TRACE_SRAM_READ,
+	TRACE_SRAM_WRITE,
+	TRACE_VRAM_READ,
+	TRACE_VRAM_WRITE,
+	TRACE_BUS_ADDR,
+	TRACE_FILE_READ,
+};
+
+struct umr_trace_header {
+	char magic[8];
+	uint32_t version, byte_order, flags, gfx_words;
+	char asicname[32];
+	uint32_t gfx[sizeof(struct umr_gfx_config) / sizeof(unsigned)];
+	uint32_t pci[4];
+	uint64_t vram_size, vis_vram_size, gtt_size;
+};
+
+#define TRACE_FLAG_NO_KERNEL 1
+#define TRACE_FLAG_USE_PCI   2
+
+struct trace_rec {
+	uint64_t addr;
+	uint32_t size, value;
+	int32_t result;
+	uint8_t kind, type, name_len;
+	const char *name;
+	const uint8_t *data;
+};
+
+/* the records read with the same key, in recorded order */
+struct trace_key {
+	struct trace_rec *rec;   // first record (NULL if the slot is free)
+	uint32_t first, count, next;
+};
+
+struct trace_page {
+	uint64_t pfn;            // (page << 1) | is_vram
+	uint8_t *data, *valid;
+	int used;
+};
+
+struct umr_trace {
+	// the device that installed the callbacks (NULL once closed)
+	struct umr_asic *owner;
+	// devices using this trace (clones and XGMI nodes share the owner's)
+	int refs;
+	struct umr_register_access_funcs reg_funcs;
+	struct umr_memory_access_funcs mem_funcs;
+	pthread_mutex_t lock;
+
+	// recording
+	FILE *f;
+	int write_error;
+
+	// replaying
+	uint8_t *buf;
+	struct trace_rec *recs;
+	uint32_t no_recs, *order;
+	struct trace_key *keys;
+	uint32_t keys_mask;
+	struct trace_page *pages;
+	uint32_t no_pages, pages_mask;
+	uint64_t misses;
+};
+
+/* ---- recording ---- */
+
+static void trace_put(struct umr_trace *t, const void *p, size_t n)
+{
+	if (n && fwrite(p, 1, n, t->f) != n && !t->write_error) {
+		perror("Cannot write to trace file");
+		t->write_error = 1;
+	}
+}
+
+static void trace_put_reg(struct umr_trace *t, uint8_t kind, uint64_t addr, uint32_t value, enum regclass type)
+{
+	uint8_t ty = type;
+
+	trace_put(t, &kind, 1);
+	trace_put(t, &ty, 1);
+	trace_put(t, &addr, 8);
+	trace_put(t, &value, 4);
+}
+
+static void trace_put_mem(struct umr_trace *t, uint8_t kind, uint64_t addr, uint32_t size, int32_t result, const void *data, int with_data)
+{
+	trace_put(t, &kind, 1);
+	trace_put(t, &addr, 8);
+	trace_put(t, &size, 4);
+	trace_put(t, &result, 4);
+	if (with_data)
+		trace_put(t, data, size);
+}
+
+static uint32_t record_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
+{
+	struct umr_trace *t = asic->trace;
+	uint32_t value;
+
+	value = t->reg_funcs.read_reg(asic, addr, type);
+	pthread_mutex_lock(&t->lock);
+	trace_put_reg(t, TRACE_REG_READ, addr, value, type);
+	pthread_mutex_unlock(&t->lock);
+	return value;
+}
+
+static int record_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
+{
+	struct umr_trace *t = asic->trace;
+
+	pthread_mutex_lock(&t->lock);
+	trace_put_reg(t, TRACE_REG_WRITE, addr, value, type);
+	pthread_mutex_unlock(&t->lock);
+	return t->reg_funcs.write_reg(asic, addr, value, type);
+}
+
+static int record_read_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n)
+{
+	struct umr_trace *t = asic->trace;
+	int r, x;
+
+	r = t->reg_funcs.read_regs(asic, regs, values, n);
+	pthread_mutex_lock(&t->lock);
+	for (x = 0; x < n; x++)
+		trace_put_reg(t, TRACE_REG_READ, regs[x].addr, values[x], regs[x].type);
+	pthread_mutex_unlock(&t->lock);
+	return r;
+}
+
+static int record_write_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, const uint32_t *values, int n)
+{
+	struct umr_trace *t = asic->trace;
+	int x;
+
+	pthread_mutex_lock(&t->lock);
+	for (x = 0; x < n; x++)
+		trace_put_reg(t, TRACE_REG_WRITE, regs[x].addr, values[x], regs[x].type);
+	pthread_mutex_unlock(&t->lock);
+	return t->reg_funcs.write_regs(asic, regs, values, n);
+}
+
+static int record_access_sram(struct umr_asic *asic, uint64_t address, uint32_t size, void *dst, int write_en)
+{
+	struct umr_trace *t = asic->trace;
+	int r;
+
+	r = t->mem_funcs.access_sram(asic, address, size, dst, write_en);
+	pthread_mutex_lock(&t->lock);
+	trace_put_mem(t, write_en ? TRACE_SRAM_WRITE : TRACE_SRAM_READ, address, size, r, dst, write_en || !r);
+	pthread_mutex_unlock(&t->lock);
+	return r;
+}
+
+static int record_access_linear_vram(struct umr_asic *asic, uint64_t address, uint32_t size, void *data, int write_en)
+{
+	struct umr_trace *t = asic->trace;
+	int r;
+
+	r = t->mem_funcs.access_linear_vram(asic, address, size, data, write_en);
+	pthread_mutex_lock(&t->lock);
+	trace_put_mem(t, write_en ? TRACE_VRAM_WRITE : TRACE_VRAM_READ, address, size, r, data, write_en || !r);
+	pthread_mutex_unlock(&t->lock);
+	return r;
+}
+
+static uint64_t record_gpu_bus_to_cpu_address(struct umr_asic *asic, uint64_t dma_addr)
+{
+	struct umr_trace *t = asic->trace;
+	uint64_t addr;
+	uint8_t kind = TRACE_BUS_ADDR;
+
+	addr = t->mem_funcs.gpu_bus_to_cpu_address(asic, dma_addr);
+	pthread_mutex_lock(&t->lock);
+	trace_put(t, &kind, 1);
+	trace_put(t, &dma_addr, 8);
+	trace_put(t, &addr, 8);
+	pthread_mutex_unlock(&t->lock);
+	return addr;
+}
+
+/* ---- replaying ---- */
+
+static uint32_t trace_hash(uint8_t kind, uint64_t addr, uint32_t size, const char *name, uint8_t name_len)
+{
+	uint64_t h = (addr ^ ((uint64_t)kind << 56) ^ ((uint64_t)size << 24)) * 0x9E3779B97F4A7C15ULL;
+	uint8_t x;
+
+	for (x = 0; x < name_len; x++)
+		h = (h ^ (uint8_t)name[x]) * 0x100000001B3ULL;
+	return h >> 32;
+}
+
+/* registers are keyed by class and address, memory also by size and files by name */
+static int trace_key_cmp(const struct trace_rec *a, uint8_t kind, uint8_t type, uint64_t addr, uint32_t size, const char *name, uint8_t name_len)
+{
+	if (a->kind != kind)
+		return a->kind < kind ? -1 : 1;
+	if (a->type != type)
+		return a->type < type ? -1 : 1;
+	if (a->addr != addr)
+		return a->addr < addr ? -1 : 1;
+	if (a->size != size)
+		return a->size < size ? -1 : 1;
+	if (a->name_len != name_len)
+		return a->name_len < name_len ? -1 : 1;
+	return name_len ? memcmp(a->name, name, name_len) : 0;
+}
+
+/* a record to sort, carrying its own record so the comparator needs no other state */
+struct trace_sort {
+	const struct trace_rec *rec;
+	uint32_t x;
+};
+
+static int trace_order_cmp(const void *a, const void *b)
+{
+	const struct trace_sort *sa = a, *sb = b;
+	int r;
+
+	r = trace_key_cmp(sa->rec, sb->rec->kind, sb->rec->type, sb->rec->addr, sb->rec->size, sb->rec->name, sb->rec->name_len);
+	if (r)
+		return r;
+	// then in recorded order
+	return sa->x < sb->x ? -1 : 1;
+}
+
+static struct trace_key *trace_find_key(struct umr_trace *t, uint8_t kind, uint8_t type, uint64_t addr, uint32_t size, const char *name, uint8_t name_len)
+{
+	struct trace_key *k;
+	uint32_t slot;
+
+	if (!t->keys)
+		return NULL;
+	slot = trace_hash(kind, addr, size, name, name_len) & t->keys_mask;
+	for (;;) {
+		k = &t->keys[slot];
+		if (!k->rec || !trace_key_cmp(k->rec, kind, type, addr, size, name, name_len))
+			return k;
+		slot = (slot + 1) & t->keys_mask;
+	}
+}
+
+/* the next recorded result of a key or NULL if it was never recorded */
+static struct trace_rec *trace_next(struct umr_trace *t, uint8_t kind, uint8_t type, uint64_t addr, uint32_t size, const char *name, uint8_t name_len)
+{
+	struct trace_key *k;
+	uint32_t n;
+
+	k = trace_find_key(t, kind, type, addr, size, name, name_len);
+	if (!k || !k->rec)
+		return NULL;
+	n = k->next < k->count ? k->next++ : k->count - 1;
+	return &t->recs[t->order[k->first + n]];
+}
+
+static struct trace_page *trace_find_page(struct umr_trace *t, uint64_t pfn, int add)
+{
+	struct trace_page *p, *old;
+	uint32_t x, n, slot;
+
+	if (add && t->no_pages * 2 >= t->pages_mask) {
+		old = t->pages;
+		n = t->pages_mask + 1;
+		p = calloc(n * 2, sizeof p[0]);
+		if (!p)
+			return NULL;
+		t->pages = p;
+		t->pages_mask = n * 2 - 1;
+		for (x = 0; old && x < n; x++) {
+			if (!old[x].used)
+				continue;
+			slot = trace_hash(0, old[x].pfn, 0, NULL, 0) & t->pages_mask;
+			while (t->pages[slot].used)
+				slot = (slot + 1) & t->pages_mask;
+			t->pages[slot] = old[x];
+		}
+		free(old);
+	}
+	if (!t->pages)
+		return NULL;
+
+	slot = trace_hash(0, pfn, 0, NULL, 0) & t->pages_mask;
+	for (;;) {
+		p = &t->pages[slot];
+		if (p->used && p->pfn == pfn)
+			return p;
+		if (!p->used) {
+			if (!add)
+				return NULL;
+			p->data = calloc(1, TRACE_PAGE_SIZE + TRACE_PAGE_SIZE / 8);
+			if (!p->data)
+				return NULL;
+			p->valid = p->data + TRACE_PAGE_SIZE;
+			p->pfn = pfn;
+			p->used = 1;
+			++t->no_pages;
+			return p;
+		}
+		slot = (slot + 1) & t->pages_mask;
+	}
+}
+
+/* copy memory contents between the trace pages and @data, returns -1 if a byte is missing */
+static int trace_access_pages(struct umr_trace *t, int vram, uint64_t address, uint32_t size, uint8_t *data, int store)
+{
+	struct trace_page *p;
+	uint32_t off, n, x;
+
+	while (size) {
+		off = address & (TRACE_PAGE_SIZE - 1);
+		n = TRACE_PAGE_SIZE - off;
+		if (n > size)
+			n = size;
+		p = trace_find_page(t, ((address / TRACE_PAGE_SIZE) << 1) | vram, store);
+		if (!p)
+			return -1;
+		if (store) {
+			memcpy(&p->data[off], data, n);
+			for (x = off; x < off + n; x++)
+				p->valid[x / 8] |= 1 << (x & 7);
+		} else {
+			for (x = off; x < off + n; x++)
+				if (!(p->valid[x / 8] & (1 << (x & 7))))
+					return -1;
+			memcpy(data, &p->data[off], n);
+		}
+		address += n;
+		data += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static uint32_t replay_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
+{
+	struct umr_trace *t = asic->trace;
+	struct trace_rec *rec;
+	uint32_t value = 0;
+
+	pthread_mutex_lock(&t->lock);
+	rec = trace_next(t, TRACE_REG_READ, type, addr, 0, NULL, 0);
+	if (rec)
+		value = rec->value;
+	else
+		++t->misses;
+	pthread_mutex_unlock(&t->lock);
+	return value;
+}
+
+static int replay_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
+{
+	(void)asic;
+	(void)addr;
+	(void)value;
+	(void)type;
+	return 0;
+}
+
+static int replay_read_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n)
+{
+	int x;
+
+	for (x = 0; x < n; x++)
+		values[x] = replay_read_reg(asic, regs[x].addr, regs[x].type);
+	return 0;
+}
+
+static int replay_write_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, const uint32_t *values, int n)
+{
+	(void)asic;
+	(void)regs;
+	(void)values;
+	(void)n;
+	return 0;
+}
+
+static int replay_access_mem(struct umr_asic *asic, int vram, uint64_t address, uint32_t size, void *data, int write_en)
+{
+	struct umr_trace *t = asic->trace;
+	struct trace_rec *rec;
+	int r;
+
+	if (write_en)
+		return 0;
+
+	pthread_mutex_lock(&t->lock);
+	rec = trace_next(t, vram ? TRACE_VRAM_READ : TRACE_SRAM_READ, 0, address, size, NULL, 0);
+	if (rec) {
+		r = rec->result;
+		if (!r)
+			memcpy(data, rec->data, size);
+	} else {
+		r = trace_access_pages(t, vram, address, size, data, 0);
+		if (r) {
+			memset(data, 0, size);
+			++t->misses;
+		}
+	}
+	pthread_mutex_unlock(&t->lock);
+	return r;
+}
+
+static int replay_access_sram(struct umr_asic *asic, uint64_t address, uint32_t size, void *dst, int write_en)
+{
+	return replay_access_mem(asic, 0, address, size, dst, write_en);
+}
+
+static int replay_access_linear_vram(struct umr_asic *asic, uint64_t address, uint32_t size, void *data, int write_en)
+{
+	return replay_access_mem(asic, 1, address, size, data, write_en);
+}
+
+static uint64_t replay_gpu_bus_to_cpu_address(struct umr_asic *asic, uint64_t dma_addr)
+{
+	struct umr_trace *t = asic->trace;
+	struct trace_rec *rec;
+	uint64_t addr = dma_addr;
+
+	pthread_mutex_lock(&t->lock);
+	rec = trace_next(t, TRACE_BUS_ADDR, 0, dma_addr, 0, NULL, 0);
+	if (rec)
+		memcpy(&addr, rec->data, sizeof addr);
+	else
+		++t->misses;
+	pthread_mutex_unlock(&t->lock);
+	return addr;
+}
+
+/* split the records of a trace loaded into @t->buf, returns -1 if it is malformed */
+static int trace_parse(struct umr_trace *t, size_t size)
+{
+	struct trace_rec *rec;
+	uint8_t *p = t->buf + sizeof(struct umr_trace_header), *end = t->buf + size;
+	uint32_t max = 0;
+	size_t need;
+
+#define TRACE_TAKE(dst, n) do { if ((size_t)(end - p) < (n)) return -1; memcpy((dst), p, (n)); p += (n); } while (0)
+	while (p < end) {
+		if (t->no_recs == max) {
+			max = max ? max * 2 : 4096;
+			rec = realloc(t->recs, max * sizeof rec[0]);
+			if (!rec) {
+				fprintf(stderr, "[ERROR]: Out of memory\n");
+				return -1;
+			}
+			t->recs = rec;
+		}
+		rec = &t->recs[t->no_recs++];
+		memset(rec, 0, sizeof *rec);
+		rec->kind = *p++;
+		switch (rec->kind) {
+		case TRACE_REG_READ:
+		case TRACE_REG_WRITE:
+			TRACE_TAKE(&rec->type, 1);
+			TRACE_TAKE(&rec->addr, 8);
+			TRACE_TAKE(&rec->value, 4);
+			break;
+		case TRACE_SRAM_READ:
+		case TRACE_SRAM_WRITE:
+		case TRACE_VRAM_READ:
+		case TRACE_VRAM_WRITE:
+			TRACE_TAKE(&rec->addr, 8);
+			TRACE_TAKE(&rec->size, 4);
+			TRACE_TAKE(&rec->result, 4);
+			need = (rec->kind == TRACE_SRAM_WRITE || rec->kind == TRACE_VRAM_WRITE || !rec->result) ? rec->size : 0;
+			if ((size_t)(end - p) < need)
+				return -1;
+			rec->data = p;
+			p += need;
+			break;
+		case TRACE_BUS_ADDR:
+			TRACE_TAKE(&rec->addr, 8);
+			if (end - p < 8)
+				return -1;
+			rec->data = p;
+			p += 8;
+			break;
+		case TRACE_FILE_READ:
+			TRACE_TAKE(&rec->name_len, 1);
+			if (end - p < rec->name_len)
+				return -1;
+			rec->name = (const char *)p;
+			p += rec->name_len;
+			TRACE_TAKE(&rec->addr, 8);
+			TRACE_TAKE(&rec->size, 4);
+			TRACE_TAKE(&rec->result, 4);
+			need = rec->result > 0 ? (size_t)rec->result : 0;
+			if (need > rec->size || (size_t)(end - p) < need)
+				return -1;
+			rec->data = p;
+			p += need;
+			break;
+		default:
+			return -1;
+		}
+	}
+#undef TRACE_TAKE
+	return 0;
+}
+
+/* index the reads by key and build the memory contents */
+static int trace_index(struct umr_trace *t)
+{
+	struct trace_sort *sort;
+	struct trace_rec *rec;
+	struct trace_key *k;
+	uint32_t x, n, no_keys;
+
+	t->order = calloc(t->no_recs + 1, sizeof t->order[0]);
+	sort = calloc(t->no_recs + 1, sizeof sort[0]);
+	if (!t->order || !sort)
+		goto oom;
+	for (n = x = 0; x < t->no_recs; x++) {
+		rec = &t->recs[x];
+		switch (rec->kind) {
+		case TRACE_SRAM_WRITE:
+		case TRACE_VRAM_WRITE:
+			if (trace_access_pages(t, rec->kind == TRACE_VRAM_WRITE, rec->addr, rec->size, (uint8_t *)rec->data, 1))
+				goto oom;
+			break;
+		case TRACE_SRAM_READ:
+		case TRACE_VRAM_READ:
+			if (!rec->result && trace_access_pages(t, rec->kind == TRACE_VRAM_READ, rec->addr, rec->size, (uint8_t *)rec->data, 1))
+				goto oom;
+			sort[n].rec = rec;
+			sort[n++].x = x;
+			break;
+		case TRACE_REG_READ:
+		case TRACE_BUS_ADDR:
+		case TRACE_FILE_READ:
+			sort[n].rec = rec;
+			sort[n++].x = x;
+			break;
+		}
+	}
+
+	qsort(sort, n, sizeof sort[0], trace_order_cmp);
+	for (x = 0; x < n; x++)
+		t->order[x] = sort[x].x;
+	free(sort);
+	sort = NULL;
+
+	for (no_keys = x = 0; x < n; x++) {
+		rec = &t->recs[t->order[x]];
+		if (!x || trace_key_cmp(&t->recs[t->order[x - 1]], rec->kind, rec->type, rec->addr, rec->size, rec->name, rec->name_len))
+			++no_keys;
+	}
+
+	for (t->keys_mask = 15; t->keys_mask < no_keys * 2; t->keys_mask = t->keys_mask * 2 + 1);
+	t->keys = calloc(t->keys_mask + 1, sizeof t->keys[0]);
+	if (!t->keys)
+		goto oom;
+	for (x = 0; x < n; x++) {
+		rec = &t->recs[t->order[x]];
+		k = trace_find_key(t, rec->kind, rec->type, rec->addr, rec->size, rec->name, rec->name_len);
+		if (!k->rec) {
+			k->rec = rec;
+			k->first = x;
+		}
+		++k->count;
+	}
+	return 0;
+oom:
+	free(sort);
+	fprintf(stderr, "[ERROR]: Out of memory\n");
+	return -1;
+}
+
+static void trace_free(struct umr_trace *t)
+{
+	uint32_t x;
+
+	if (t->f && fclose(t->f) && !t->write_error)
+		perror("Cannot write to trace file");
+	for (x = 0; t->pages && x <= t->pages_mask; x++)
+		free(t->pages[x].data);
+	pthread_mutex_destroy(&t->lock);
+	free(t->pages);
+	free(t->keys);
+	free(t->order);
+	free(t->recs);
+	free(t->buf);
+	free(t);
+}
+
+static struct umr_trace *trace_alloc(struct umr_asic *asic)
+{
+	struct umr_trace *t;
+
+	if (asic->trace) {
+		fprintf(stderr, "[ERROR]: A trace is already active on asic [%s]\n", asic->asicname);
+		return NULL;
+	}
+	t = calloc(1, sizeof *t);
+	if (!t) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return NULL;
+	}
+	t->owner = asic;
+	t->refs = 1;
+	t->reg_funcs = asic->reg_funcs;
+	t->mem_funcs = asic->mem_funcs;
+	pthread_mutex_init(&t->lock, NULL);
+	return t;
+}
+
+/**
+ * umr_record_trace - Record the hardware accesses of a device to a file
+ *
+ * @filename: The trace file to create
+ *
+ * Wraps the register and memory callbacks of @asic so that every access
+ * and its result is written to @filename.  The callbacks must be
+ * assigned before this is called and anything else wrapping them
+ * (access statistics, deferred writes) installed afterwards.  The file
+ * is complete once umr_close_trace() (or umr_close_asic()) is called.
+ *
+ * Returns 0 on success.
+ */
+int umr_record_trace(struct umr_asic *asic, const char *filename)
+{
+	struct umr_trace_header hdr;
+	struct umr_trace *t;
+	unsigned *gfx = (unsigned *)&asic->config.gfx;
+	uint32_t x;
+
+	t = trace_alloc(asic);
+	if (!t)
+		return -1;
+	t->f = fopen(filename, "wb");
+	if (!t->f) {
+		perror("Cannot create trace file");
+		trace_free(t);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, UMR_TRACE_MAGIC, sizeof hdr.magic);
+	hdr.version = UMR_TRACE_VERSION;
+	hdr.byte_order = 0x01020304;
+	hdr.flags = (asic->options.no_kernel ? TRACE_FLAG_NO_KERNEL : 0) |
+		    (asic->options.use_pci ? TRACE_FLAG_USE_PCI : 0);
+	strncpy(hdr.asicname, asic->asicname, sizeof(hdr.asicname) - 1);
+	hdr.gfx_words = sizeof(hdr.gfx) / sizeof(hdr.gfx[0]);
+	for (x = 0; x < hdr.gfx_words; x++)
+		hdr.gfx[x] = gfx[x];
+	hdr.pci[0] = asic->config.pci.device;
+	hdr.pci[1] = asic->config.pci.revision;
+	hdr.pci[2] = asic->config.pci.subsystem_device;
+	hdr.pci[3] = asic->config.pci.subsystem_vendor;
+	hdr.vram_size = asic->config.vram_size;
+	hdr.vis_vram_size = asic->config.vis_vram_size;
+	hdr.gtt_size = asic->config.gtt_size;
+	trace_put(t, &hdr, sizeof hdr);
+	if (t->write_error) {
+		trace_free(t);
+		return -1;
+	}
+
+	if (asic->reg_funcs.read_reg)
+		asic->reg_funcs.read_reg = record_read_reg;
+	if (asic->reg_funcs.write_reg)
+		asic->reg_funcs.write_reg = record_write_reg;
+	if (asic->reg_funcs.read_regs)
+		asic->reg_funcs.read_regs = record_read_regs;
+	if (asic->reg_funcs.write_regs)
+		asic->reg_funcs.write_regs = record_write_regs;
+	if (asic->mem_funcs.access_sram)
+		asic->mem_funcs.access_sram = record_access_sram;
+	if (asic->mem_funcs.access_linear_vram)
+		asic->mem_funcs.access_linear_vram = record_access_linear_vram;
+	if (asic->mem_funcs.gpu_bus_to_cpu_address)
+		asic->mem_funcs.gpu_bus_to_cpu_address = record_gpu_bus_to_cpu_address;
+	asic->trace = t;
+	return 0;
+}
+
+/**
+ * umr_replay_trace - Serve the hardware accesses of a device from a trace
+ *
+ * @filename: A trace written by umr_record_trace()
+ *
+ * Replaces the register and memory callbacks of @asic (which must be
+ * the same kind of device the trace was recorded on, for instance a
+ * virtual one) with callbacks that return the recorded results.  The
+ * 'no_kernel' and 'use_pci' options and the GFX configuration of the
+ * recording are restored so the same access paths are taken.
+ *
+ * Returns 0 on success.
+ */
+int umr_replay_trace(struct umr_asic *asic, const char *filename)
+{
+	struct umr_trace_header hdr;
+	struct umr_trace *t;
+	unsigned *gfx = (unsigned *)&asic->config.gfx;
+	uint32_t x;
+	FILE *f;
+	long size;
+
+	t = trace_alloc(asic);
+	if (!t)
+		return -1;
+
+	f = fopen(filename, "rb");
+	if (!f) {
+		perror("Cannot open trace file");
+		trace_free(t);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	t->buf = size > 0 ? malloc(size) : NULL;
+	if (!t->buf || fread(t->buf, 1, size, f) != (size_t)size) {
+		fprintf(stderr, "[ERROR]: Could not read trace file <%s>\n", filename);
+		fclose(f);
+		trace_free(t);
+		return -1;
+	}
+	fclose(f);
+
+	if ((size_t)size < sizeof hdr)
+		goto invalid;
+	memcpy(&hdr, t->buf, sizeof hdr);
+	if (memcmp(hdr.magic, UMR_TRACE_MAGIC, sizeof hdr.magic) ||
+	    hdr.version != UMR_TRACE_VERSION || hdr.byte_order != 0x01020304 ||
+	    hdr.gfx_words != sizeof(hdr.gfx) / sizeof(hdr.gfx[0]) ||
+	    trace_parse(t, size))
+		goto invalid;
+	hdr.asicname[sizeof(hdr.asicname) - 1] = 0;
+	if (strcmp(hdr.asicname, asic->asicname)) {
+		fprintf(stderr, "[ERROR]: Trace <%s> was recorded on a [%s] device not [%s]\n", filename, hdr.asicname, asic->asicname);
+		trace_free(t);
+		return -1;
+	}
+	if (trace_index(t)) {
+		trace_free(t);
+		return -1;
+	}
+
+	asic->options.no_kernel = !!(hdr.flags & TRACE_FLAG_NO_KERNEL);
+	asic->options.use_pci = !!(hdr.flags & TRACE_FLAG_USE_PCI);
+	for (x = 0; x < hdr.gfx_words; x++)
+		gfx[x] = hdr.gfx[x];
+	asic->config.pci.device = hdr.pci[0];
+	asic->config.pci.revision = hdr.pci[1];
+	asic->config.pci.subsystem_device = hdr.pci[2];
+	asic->config.pci.subsystem_vendor = hdr.pci[3];
+	asic->config.vram_size = hdr.vram_size;
+	asic->config.vis_vram_size = hdr.vis_vram_size;
+	asic->config.gtt_size = hdr.gtt_size;
+
+	asic->reg_funcs.read_reg = replay_read_reg;
+	asic->reg_funcs.write_reg = replay_write_reg;
+	asic->reg_funcs.read_regs = replay_read_regs;
+	asic->reg_funcs.write_regs = replay_write_regs;
+	asic->mem_funcs.access_sram = replay_access_sram;
+	asic->mem_funcs.access_linear_vram = replay_access_linear_vram;
+	asic->mem_funcs.gpu_bus_to_cpu_address = replay_gpu_bus_to_cpu_address;
+	asic->trace = t;
+	return 0;
+
+invalid:
+	fprintf(stderr, "[ERROR]: <%s> is not a valid trace file\n", filename);
+	trace_free(t);
+	return -1;
+}
+
+/**
+ * umr_share_trace - Trace the accesses of another device handle
+ *
+ * Used when the callbacks of @asic are copied to @node (a clone or an
+ * XGMI node) so the callbacks called on behalf of @node find the trace
+ * of @asic.
+ */
+void umr_share_trace(struct umr_asic *asic, struct umr_asic *node)
+{
+	if (node == asic || node->trace == asic->trace)
+		return;
+	umr_close_trace(node);
+	node->trace = asic->trace;
+	if (node->trace) {
+		pthread_mutex_lock(&node->trace->lock);
+		++node->trace->refs;
+		pthread_mutex_unlock(&node->trace->lock);
+	}
+}
+
+/**
+ * umr_close_trace - Stop recording or replaying a trace
+ *
+ * Restores the callbacks that were in place when the trace was started.
+ * The trace file is completed (or the number of accesses a replay could
+ * not serve reported) once no device refers to the trace anymore.
+ */
+void umr_close_trace(struct umr_asic *asic)
+{
+	struct umr_trace *t = asic->trace;
+	int refs;
+
+	if (!t)
+		return;
+	asic->trace = NULL;
+	pthread_mutex_lock(&t->lock);
+	if (t->owner == asic) {
+		asic->reg_funcs = t->reg_funcs;
+		asic->mem_funcs = t->mem_funcs;
+		t->owner = NULL;
+	}
+	refs = --t->refs;
+	pthread_mutex_unlock(&t->lock);
+	if (refs)
+		return;
+
+	if (t->misses)
+		fprintf(stderr, "[WARNING]: %" PRIu64 " accesses were not found in the trace\n", t->misses);
+	trace_free(t);
+}
+
+/**
+ * umr_trace_pread - Read from a debugfs file of a device
+ *
+ * @file: The name of the file (for instance "amdgpu_wave")
+ * @fd: The open file
+ *
+ * Like pread() but the read is recorded in or served from the trace of
+ * @asic if there is one.  Returns the number of bytes read or -1 with
+ * errno set.
+ */
+int umr_trace_pread(struct umr_asic *asic, const char *file, int fd, void *buf, uint32_t size, uint64_t offset)
+{
+	struct umr_trace *t = asic->trace;
+	struct trace_rec *rec;
+	uint8_t kind = TRACE_FILE_READ, len = strlen(file);
+	int32_t r;
+
+	if (t && t->buf) {
+		pthread_mutex_lock(&t->lock);
+		rec = trace_next(t, TRACE_FILE_READ, 0, offset, size, file, len);
+		if (!rec)
+			++t->misses;
+		pthread_mutex_unlock(&t->lock);
+		if (!rec || rec->result < 0) {
+			errno = rec ? EIO : ENOENT;
+			return -1;
+		}
+		memcpy(buf, rec->data, rec->result);
+		return rec->result;
+	}
+
+	r = pread(fd, buf, size, offset);
+	if (t) {
+		pthread_mutex_lock(&t->lock);
+		trace_put(t, &kind, 1);
+		trace_put(t, &len, 1);
+		trace_put(t, file, len);
+		trace_put(t, &offset, 8);
+		trace_put(t, &size, 4);
+		trace_put(t, &r, 4);
+		if (r > 0)
+			trace_put(t, buf, r);
+		pthread_mutex_unlock(&t->lock);
+	}
+	return r;
+}
+
+/**
+ * umr_trace_file_size - Size of a debugfs file in the replayed trace
+ *
+ * Returns the end of the furthest read of @file recorded in the trace
+ * of @asic, or -1 if no trace is being replayed (or @file was not read).
+ */
+int64_t umr_trace_file_size(struct umr_asic *asic, const char *file)
+{
+	struct umr_trace *t = asic->trace;
+	int64_t size = -1;
+	uint32_t x;
+	size_t len = strlen(file);
+
+	if (!t || !t->buf)
+		return -1;
+	for (x = 0; x < t->no_recs; x++)
+		if (t->recs[x].kind == TRACE_FILE_READ && t->recs[x].name_len == len &&
+		    !memcmp(t->recs[x].name, file, len) && t->recs[x].result > 0 &&
+		    (int64_t)(t->recs[x].addr + t->recs[x].result) > size)
+			size = t->recs[x].addr + t->recs[x].result;
+	return size;
+}
@@ -29,8 +29,9 @@
  *
  * For AI+ hardware the SOC15 interface offsets registers by
  * potentially relocating IP blocks in the address map.  This will
- * apply an offset table to an array of registers and assign them to an
- * IP block.
+ * assign an array of registers and the matching row of an offset
+ * table to an IP block.  The block's register array is not built
+ * until umr_materialize_ip_block() is called on it.
  */
 int umr_transfer_soc15_to_reg(struct umr_options *options, struct umr_ip_offsets_soc15 *ip, char *ipname, const struct umr_reg_soc15 *regs, struct umr_ip_block *dst)
 {
@@ -45,16 +46,45 @@ int umr_transfer_soc15_to_reg(struct umr_options *options, struct umr_ip_offsets
 		return -1;
 	}
 
-	// start copying them
-	for (y = 0; y < dst->no_regs; y++) {
-		if (regs[y].type == REG_MMIO)
-			dst->regs[y].addr = regs[y].addr + ip[x].offset[regs[y].idx][options->hw_inst];
-		else
-			dst->regs[y].addr = regs[y].addr;
-		dst->regs[y].bits = regs[y].bits;
-		dst->regs[y].no_bits = regs[y].no_bits;
-		dst->regs[y].regname = regs[y].regname;
-		dst->regs[y].type = regs[y].type;
-	}
+	dst->soc15.regs = regs;
+	for (y = 0; y < 5; y++)
+		dst->soc15.offset[y] = ip[x].offset[y][options->hw_inst];
+	return 0;
+}
+
+/**
+ * umr_materialize_ip_block - Build the register array of an IP block
+ *
+ * @ip: The IP block to build
+ *
+ * SOC15 IP blocks are created with only a pointer to their constant
+ * register table.  This attaches the (offset applied) register array
+ * the first time it is needed.  The array is shared with every other
+ * block built from the same table and offsets and must be treated as
+ * read-only.  It is a no-op for blocks that already have one.
+ * Returns 0 on success.
+ */
+int umr_materialize_ip_block(struct umr_ip_block *ip)
+{
+	if (ip->regs || !ip->soc15.regs || !ip->no_regs)
+		return 0;
+	return umr_share_soc15_regs(ip);
+}
+
+/**
+ * umr_materialize_asic - Build the register arrays of every IP block
+ *
+ * @asic: The device to build
+ *
+ * Used by callers that walk or modify the entire register database.
+ * Returns 0 on success.
+ */
+int umr_materialize_asic(struct umr_asic *asic)
+{
+	int i;
+
+	for (i = 0; i < asic->no_blocks; i++)
+		if (umr_materialize_ip_block(asic->blocks[i]))
+			return -1;
 	return 0;
 }
@@ -32,8 +32,11 @@ void umr_apply_callbacks(struct umr_asic *asic,
 
 	n = 0;
 	while (asic->config.xgmi.nodes[n].asic) {
+		umr_share_trace(asic, asic->config.xgmi.nodes[n].asic);
+		umr_share_access_stats(asic, asic->config.xgmi.nodes[n].asic);
 		asic->config.xgmi.nodes[n].asic->mem_funcs = *mems;
-		asic->config.xgmi.nodes[n++].asic->reg_funcs = *regs;
+		asic->config.xgmi.nodes[n].asic->reg_funcs = *regs;
+		umr_share_write_queue(asic, asic->config.xgmi.nodes[n++].asic);
 	}
 	asic->config.xgmi.callbacks_applied = 1;
 }
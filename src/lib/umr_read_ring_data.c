@@ -40,28 +40,39 @@ void *umr_read_ring_data(struct umr_asic *asic, char *ringname, uint32_t *ringsi
 {
 	int fd;
 	uint32_t r;
+	int64_t size;
 	void *ring_data;
 	char fname[128];
 
-	snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_ring_%s", asic->instance, ringname);
-	fd = open(fname, O_RDWR);
-	if (fd < 0) {
-		fprintf(stderr, "[ERROR]: Could not open ring debugfs file");
-		return NULL;
-	}
+	/* a replayed trace has the contents of the ring */
+	snprintf(fname, sizeof(fname)-1, "amdgpu_ring_%s", ringname);
+	size = umr_trace_file_size(asic, fname);
+	if (size >= 12) {
+		fd = -1;
+		*ringsize = size - 12;
+	} else {
+		snprintf(fname, sizeof(fname)-1, "/sys/kernel/debug/dri/%d/amdgpu_ring_%s", asic->instance, ringname);
+		fd = open(fname, O_RDWR);
+		if (fd < 0) {
+			fprintf(stderr, "[ERROR]: Could not open ring debugfs file");
+			return NULL;
+		}
 
-	/* determine file size */
-	*ringsize = lseek(fd, 0, SEEK_END) - 12;
-	lseek(fd, 0, SEEK_SET);
+		/* determine file size */
+		*ringsize = lseek(fd, 0, SEEK_END) - 12;
+		snprintf(fname, sizeof(fname)-1, "amdgpu_ring_%s", ringname);
+	}
 
 	ring_data = calloc(1, *ringsize + 12);
 	if (!ring_data) {
-		close(fd);
+		if (fd >= 0)
+			close(fd);
 		fprintf(stderr, "[ERROR]: Out of memory\n");
 		return NULL;
 	}
-	r = read(fd, ring_data, *ringsize + 12);
-	close(fd);
+	r = umr_trace_pread(asic, fname, fd, ring_data, *ringsize + 12, 0);
+	if (fd >= 0)
+		close(fd);
 	if (r != *ringsize + 12) {
 		free(ring_data);
 		return NULL;
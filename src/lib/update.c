@@ -24,7 +24,41 @@
  */
 #include "umr.h"
 
-#define BUFLEN 512
+/*
+ * Scripts are applied in two passes.  The whole script is first parsed
+ * into a list of operations so that syntax errors are reported before
+ * anything is changed.  The operations are then applied using a hash
+ * table of the register names of every block so each command costs a
+ * constant amount of time.  Deleted registers are only marked during
+ * the second pass and removed from their blocks once at the end and
+ * the lookup tables are rebuilt on the next lookup after the update.
+ */
+enum update_cmd {
+	UPDATE_ADD,
+	UPDATE_EDIT,
+	UPDATE_DEL,
+};
+
+struct update_op {
+	enum update_cmd cmd;
+	int is_bit, ip;
+	char *asic, *ipname, *reg, *bit; // point into the tokenized script
+	enum regclass type;
+	uint32_t addr, start, stop;
+};
+
+struct update_slot {
+	uint32_t hash;
+	int ip, reg;   // reg < 0 marks a deleted entry, ip == 0 an empty slot
+	int bits_cap;  // capacity of a private bits array, 0 if not yet copied
+};
+
+struct update_state {
+	struct umr_asic *asic;
+	struct update_slot *table;
+	uint32_t mask;
+	unsigned char **dead;
+};
 
 static void consume_whitespace(char **ptr)
 {
@@ -34,393 +68,433 @@ static void consume_whitespace(char **ptr)
 	*ptr = p;
 }
 
-static void consume_str(char **ptr, char *str)
+/* NUL terminate the next whitespace delimited token in place and return it */
+static char *consume_str(char **ptr)
 {
-	char *p;
-	int i;
+	char *p, *str;
 
 	consume_whitespace(ptr);
-
-	// now we're at the address
-	memset(str, 0, BUFLEN);
-	i = 0;
-	p = *ptr;
+	str = p = *ptr;
 	while (*p && !(*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
-		str[i++] = *p++;
+		++p;
+	if (*p)
+		*p++ = 0;
 	*ptr = p;
 
-	if (!strlen(str))
+	if (!*str)
 		fprintf(stderr, "[ERROR]: Premature end of file\n");
+	return str;
 }
 
-static void parse_regpath(char **ptr, char *asic, char *ip, char *reg)
-{
-	char *p, *op, path[BUFLEN];
-
-	// now were at the intended path, e.g. tonga.uvd5.mmFOO so let's extract that first
-	memset(asic, 0, BUFLEN);
-	memset(ip,   0, BUFLEN);
-	memset(reg,  0, BUFLEN);
-
-	consume_whitespace(ptr);
-	consume_str(ptr, path);
-	consume_whitespace(ptr);
-
-	// tokenize path...
-	p = strstr(path, ".");
-	if (p) {
-		memcpy(asic, path, p - path);
-		op = ++p;
-		p = strstr(p, ".");
-		if (p) {
-			memcpy(ip, op, p - op);
-			strcpy(reg, p + 1);
-		}
-	}
-}
-
-static void parse_bitpath(char **ptr, char *asic, char *ip, char *reg, char *bit)
+/* split a path such as tonga.uvd5.mmFOO (or tonga.uvd5.mmFOO.BAR) */
+static void parse_path(char **ptr, struct update_op *op)
 {
 	char *p;
 
-	// now were at the intended path, e.g. tonga.uvd5.mmFOO so let's extract that first
-	memset(bit,  0, BUFLEN);
-	parse_regpath(ptr, asic, ip, reg);
-
-	// reg has reg.bit now so lets split it
-	p = strstr(reg, ".");
-	if (p) {
-		*p = 0;
-		strcpy(bit, p + 1);
-	}
-}
-
-static void find_reg(struct umr_asic *as, char *ip, char *reg, int *i, int *j)
-{
-	// now scan for the IP block
-	for (*i = 0; *i < as->no_blocks; (*i)++) {
-		if (!strcmp(as->blocks[*i]->ipname, ip))
-			break;
-	}
+	op->asic = consume_str(ptr);
+	op->ipname = op->reg = op->bit = "";
 
-	if (*i == as->no_blocks) {
-		*i = -1;
+	p = strchr(op->asic, '.');
+	if (!p) {
+		op->asic = "";
 		return;
 	}
-
-	// make sure the register doesn't exist already
-	for (*j = 0; *j < as->blocks[*i]->no_regs; (*j)++) {
-		if (!strcmp(reg, as->blocks[*i]->regs[*j].regname))
-			return;
+	*p++ = 0;
+	op->ipname = p;
+	p = strchr(p, '.');
+	if (!p)
+		return;
+	*p++ = 0;
+	op->reg = p;
+	if (op->is_bit) {
+		p = strchr(p, '.');
+		if (p) {
+			*p++ = 0;
+			op->bit = p;
+		}
 	}
-	*j = -1;
 }
 
-static void find_bit(struct umr_asic *as, char *ip, char *reg, char *bit, int *i, int *j, int *k)
+static int parse_op(char **ptr, struct update_op *op)
 {
-	find_reg(as, ip, reg, i, j);
+	static const char *cmds[] = { "add", "edit", "del" };
+	char *type;
 
-	if (*i >= 0 && *j >= 0) {
-		for (*k = 0; *k < as->blocks[*i]->regs[*j].no_bits; (*k)++) {
-			if (!strcmp(bit, as->blocks[*i]->regs[*j].bits[*k].regname))
-				return;
-		}
-	}
-	*k = -1;
-}
+	consume_whitespace(ptr);
 
-static int do_add_reg(char **ptr, struct umr_asic *as)
-{
-	char	asic[BUFLEN], ip[BUFLEN],
-		reg[BUFLEN], addr[BUFLEN], type[BUFLEN];
-	int i, j, mtype = REG_MMIO;
-	struct umr_reg newreg;
-
-	parse_regpath(ptr, asic, ip, reg);
-	consume_str(ptr, type);
-	if (!strcmp(type, "pci") || !strcmp(type, "smc")) {
-		consume_str(ptr, addr);
-		if (!strcmp(type, "pci"))
-			mtype = REG_PCIE;
-		else
-			mtype = REG_SMC;
+	// now we're pointing at reg or bit
+	if (!memcmp(*ptr, "reg", 3)) {
+		op->is_bit = 0;
+	} else if (!memcmp(*ptr, "bit", 3)) {
+		op->is_bit = 1;
 	} else {
-		strcpy(addr, type);
+		fprintf(stderr, "[ERROR]: Invalid %s command\n", cmds[op->cmd]);
+		return -1;
 	}
+	*ptr += 3;
+	parse_path(ptr, op);
 
-	// now try to find that asic/ip block
-	if (strcmp(as->asicname, asic)) {
-		// ignore asics that don't apply
+	if (op->cmd == UPDATE_DEL)
 		return 0;
-	}
-
-	find_reg(as, ip, reg, &i, &j);
 
-	if (i < 0 || j >= 0) {
-		fprintf(stderr, "[ERROR]: Invalid regpath %s.%s for add command\n", ip, reg);
-		return -1;
+	if (op->is_bit) {
+		sscanf(consume_str(ptr), "%"SCNu32, &op->start);
+		sscanf(consume_str(ptr), "%"SCNu32, &op->stop);
+	} else {
+		op->type = REG_MMIO;
+		type = consume_str(ptr);
+		if (op->cmd == UPDATE_ADD && (!strcmp(type, "pci") || !strcmp(type, "smc"))) {
+			op->type = strcmp(type, "pci") ? REG_SMC : REG_PCIE;
+			type = consume_str(ptr);
+		}
+		sscanf(type, "%"SCNx32, &op->addr);
 	}
-
-	// create new register entry
-	memset(&newreg, 0, sizeof(newreg));
-	newreg.regname = calloc(1, strlen(reg)+1);
-	strcpy(newreg.regname, reg);
-	newreg.type = mtype;
-	sscanf(addr, "%"SCNx32, &newreg.addr);
-
-	// extend array
-	as->blocks[i]->regs = realloc(as->blocks[i]->regs, sizeof(struct umr_reg) * (as->blocks[i]->no_regs + 1));
-	as->blocks[i]->regs[as->blocks[i]->no_regs++] = newreg;
-
 	return 0;
 }
 
-static int do_add_bit(char **ptr, struct umr_asic *as)
+/* parse a whole script, returns the number of operations or -1 on error */
+static int parse_script(char *sdata, struct update_op **ops)
 {
-	char	asic[BUFLEN], ip[BUFLEN],
-		reg[BUFLEN], bit[BUFLEN], start[BUFLEN], stop[BUFLEN];
-	int i, j, k;
-	struct umr_bitfield newbit;
-	uint32_t nstart, nstop;
-
-	parse_bitpath(ptr, asic, ip, reg, bit);
-	consume_str(ptr, start);
-	consume_str(ptr, stop);
-
-	// now try to find that asic/ip block
-	if (strcmp(as->asicname, asic)) {
-		// ignore asics that don't apply
-		return 0;
-	}
+	struct update_op *op, *tmp;
+	int no_ops, max_ops;
 
-	find_bit(as, ip, reg, bit, &i, &j, &k);
+	*ops = NULL;
+	no_ops = max_ops = 0;
+	while (*sdata) {
+		consume_whitespace(&sdata);
+		if (!*sdata)
+			break;
 
-	if (i < 0 || j < 0 || k >= 0) {
-		fprintf(stderr, "[ERROR]: Invalid regpath %s.%s.%s for add command\n", ip, reg, bit);
-		return -1;
-	}
+		if (no_ops == max_ops) {
+			max_ops = max_ops ? max_ops * 2 : 256;
+			tmp = realloc(*ops, max_ops * sizeof **ops);
+			if (!tmp) {
+				fprintf(stderr, "[ERROR]: Out of memory\n");
+				return -1;
+			}
+			*ops = tmp;
+		}
+		op = &(*ops)[no_ops];
+		memset(op, 0, sizeof *op);
 
-	// create new register entry
-	memset(&newbit, 0, sizeof(newbit));
-	newbit.regname = calloc(1, strlen(bit)+1);
-	strcpy(newbit.regname, bit);
-	sscanf(start, "%"SCNu32, &nstart);
-	sscanf(stop, "%"SCNu32, &nstop);
-	newbit.start = nstart;
-	newbit.stop = nstop;
-	newbit.bitfield_print = umr_bitfield_default;
-
-	// extend bits
-	if (as->blocks[i]->regs[j].no_bits == 0) {
-		// empty array so lets populate it
-		as->blocks[i]->regs[j].bits = calloc(1, sizeof(struct umr_bitfield));
-		as->blocks[i]->regs[j].bits[0] = newbit;
-		as->blocks[i]->regs[j].no_bits = 1;
-	} else {
-		as->blocks[i]->regs[j].bits = realloc(as->blocks[i]->regs[j].bits, sizeof(struct umr_bitfield) * (as->blocks[i]->regs[j].no_bits + 1));
-		as->blocks[i]->regs[j].bits[as->blocks[i]->regs[j].no_bits++] = newbit;
+		// should be pointing to "add/edit/del" now
+		if (!memcmp(sdata, "add", 3)) {
+			sdata += 3;
+			op->cmd = UPDATE_ADD;
+		} else if (!memcmp(sdata, "edit", 4)) {
+			sdata += 4;
+			op->cmd = UPDATE_EDIT;
+		} else if (!memcmp(sdata, "del", 3)) {
+			sdata += 3;
+			op->cmd = UPDATE_DEL;
+		} else {
+			fprintf(stderr, "[ERROR]: Unknown update command [%s]\n", sdata);
+			return -1;
+		}
+		if (parse_op(&sdata, op))
+			return -1;
+		++no_ops;
 	}
-
-	return 0;
+	return no_ops;
 }
 
-static int do_add(char **ptr, struct umr_asic *asic)
+/* case sensitive FNV-1a hash of a register name mixed with its block */
+static uint32_t update_hash(int ip, const char *str)
 {
-	consume_whitespace(ptr);
+	uint32_t h = 2166136261UL ^ (uint32_t)ip;
 
-	// now we're pointing at reg or bit
-	if (!memcmp(*ptr, "reg", 3)) {
-		*ptr += 3;
-		do_add_reg(ptr, asic);
-	} else if (!memcmp(*ptr, "bit", 3)) {
-		*ptr += 3;
-		do_add_bit(ptr, asic);
-	} else {
-		fprintf(stderr, "[ERROR]: Invalid add command\n");
-		return -1;
+	while (*str) {
+		h ^= (unsigned char)*str++;
+		h *= 16777619UL;
 	}
-	return 0;
+	return h;
 }
 
-static int do_edit_reg(char **ptr, struct umr_asic *as)
+static struct update_slot *find_slot(struct update_state *st, int ip, const char *reg)
 {
-	char	asic[BUFLEN], ip[BUFLEN],
-		reg[BUFLEN], addr[BUFLEN];
-	int i, j;
-
-	parse_regpath(ptr, asic, ip, reg);
-	consume_str(ptr, addr);
-
-	// now try to find that asic/ip block
-	if (strcmp(as->asicname, asic)) {
-		// ignore asics that don't apply
-		return 0;
+	struct update_slot *e;
+	uint32_t h, x;
+
+	h = update_hash(ip, reg);
+	for (x = h & st->mask; st->table[x].ip; x = (x + 1) & st->mask) {
+		e = &st->table[x];
+		if (e->hash == h && e->ip == ip + 1 && e->reg >= 0 &&
+		    !strcmp(st->asic->blocks[ip]->regs[e->reg].regname, reg))
+			return e;
 	}
+	return NULL;
+}
 
-	find_reg(as, ip, reg, &i, &j);
-
-	if (i < 0 || j < 0) {
-		fprintf(stderr, "[ERROR]: Invalid regpath %s.%s for edit command\n", ip, reg);
-		return -1;
-	}
-
-	// replace address
-	sscanf(addr, "%"SCNx32, &as->blocks[i]->regs[j].addr);
-
-	return 0;
+static void insert_slot(struct update_state *st, int ip, int reg)
+{
+	uint32_t h, x;
+
+	h = update_hash(ip, st->asic->blocks[ip]->regs[reg].regname);
+	for (x = h & st->mask; st->table[x].ip; x = (x + 1) & st->mask);
+	st->table[x].hash = h;
+	st->table[x].ip = ip + 1;
+	st->table[x].reg = reg;
+	st->table[x].bits_cap = 0;
 }
 
-static int do_edit_bit(char **ptr, struct umr_asic *as)
+/* make room for one more bitfield, bits that did not come from this update are copied first */
+static int grow_bits(struct update_slot *e, struct umr_reg *reg, int extra)
 {
-	char	asic[BUFLEN], ip[BUFLEN],
-		reg[BUFLEN], bit[BUFLEN], start[BUFLEN], stop[BUFLEN];
-	int i, j, k;
-	uint32_t nstart, nstop;
-
-	parse_bitpath(ptr, asic, ip, reg, bit);
-	consume_str(ptr, start);
-	consume_str(ptr, stop);
-
-	// now try to find that asic/ip block
-	if (strcmp(as->asicname, asic)) {
-		// ignore asics that don't apply
-		return 0;
-	}
+	struct umr_bitfield *bits;
+	int cap;
 
-	find_bit(as, ip, reg, bit, &i, &j, &k);
+	if (e->bits_cap && reg->no_bits + extra <= e->bits_cap)
+		return 0;
 
-	if (i < 0 || j < 0 || k < 0) {
-		fprintf(stderr, "[ERROR]: Invalid regpath %s.%s.%s for edit command\n", ip, reg, bit);
+	cap = e->bits_cap ? e->bits_cap * 2 : reg->no_bits + 4;
+	if (e->bits_cap) {
+		bits = realloc(reg->bits, cap * sizeof bits[0]);
+	} else {
+		bits = calloc(cap, sizeof bits[0]);
+		if (bits && reg->no_bits)
+			memcpy(bits, reg->bits, reg->no_bits * sizeof bits[0]);
+	}
+	if (!bits) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
 		return -1;
 	}
-
-	sscanf(start, "%"SCNu32, &nstart);
-	sscanf(stop, "%"SCNu32, &nstop);
-	as->blocks[i]->regs[j].bits[k].start = nstart;
-	as->blocks[i]->regs[j].bits[k].stop = nstop;
+	reg->bits = bits;
+	e->bits_cap = cap;
 	return 0;
 }
 
-static int do_edit(char **ptr, struct umr_asic *asic)
+static int find_bit(struct umr_reg *reg, const char *bit)
 {
-	consume_whitespace(ptr);
+	int k;
 
-	// now we're pointing at reg or bit
-	if (!memcmp(*ptr, "reg", 3)) {
-		*ptr += 3;
-		do_edit_reg(ptr, asic);
-	} else if (!memcmp(*ptr, "bit", 3)) {
-		*ptr += 3;
-		do_edit_bit(ptr, asic);
-	} else {
-		fprintf(stderr, "[ERROR]: Invalid edit command\n");
-		return -1;
-	}
-	return 0;
+	for (k = 0; k < reg->no_bits; k++)
+		if (!strcmp(bit, reg->bits[k].regname))
+			return k;
+	return -1;
 }
 
-static int do_del_reg(char **ptr, struct umr_asic *as)
+static int apply_op(struct update_state *st, struct update_op *op)
 {
-	char	asic[BUFLEN], ip[BUFLEN], reg[BUFLEN];
-	int i, j;
+	static const char *cmds[] = { "add", "edit", "del" };
+	struct umr_ip_block *ip;
+	struct update_slot *e;
+	struct umr_reg *reg;
+	int j, k;
+
+	// ignore asics that don't apply
+	if (strcmp(st->asic->asicname, op->asic))
+		return 0;
 
-	parse_regpath(ptr, asic, ip, reg);
+	e = NULL;
+	if (op->ip >= 0)
+		e = find_slot(st, op->ip, op->reg);
 
-	// now try to find that asic/ip block
-	if (strcmp(as->asicname, asic)) {
-		// ignore asics that don't apply
+	if (!op->is_bit) {
+		if (op->ip < 0 || (op->cmd == UPDATE_ADD) != !e) {
+			fprintf(stderr, "[ERROR]: Invalid regpath %s.%s for %s command\n", op->ipname, op->reg, cmds[op->cmd]);
+			return -1;
+		}
+		ip = st->asic->blocks[op->ip];
+		switch (op->cmd) {
+			case UPDATE_ADD:
+				// the array was grown for every add before applying
+				reg = &ip->regs[ip->no_regs];
+				memset(reg, 0, sizeof *reg);
+				reg->regname = strdup(op->reg);
+				if (!reg->regname) {
+					fprintf(stderr, "[ERROR]: Out of memory\n");
+					return -1;
+				}
+				reg->type = op->type;
+				reg->addr = op->addr;
+				insert_slot(st, op->ip, ip->no_regs++);
+				break;
+			case UPDATE_EDIT:
+				ip->regs[e->reg].addr = op->addr;
+				break;
+			case UPDATE_DEL:
+				// note: we potentially leak bits memory if the bits were added by the user...
+				st->dead[op->ip][e->reg] = 1;
+				e->reg = -1;
+				break;
+		}
 		return 0;
 	}
 
-	find_reg(as, ip, reg, &i, &j);
-
-	if (i < 0 || j < 0) {
-		fprintf(stderr, "[ERROR]: Invalid regpath %s.%s for del command\n", ip, reg);
+	reg = e ? &st->asic->blocks[op->ip]->regs[e->reg] : NULL;
+	k = reg ? find_bit(reg, op->bit) : -1;
+	if (!reg || (op->cmd == UPDATE_ADD) != (k < 0)) {
+		fprintf(stderr, "[ERROR]: Invalid regpath %s.%s.%s for %s command\n", op->ipname, op->reg, op->bit, cmds[op->cmd]);
 		return -1;
 	}
 
-	// now we have to delete the register (note: we potentially leak bits memory if the bits were added by the user...)
-	memmove(&as->blocks[i]->regs[j], &as->blocks[i]->regs[j+1], sizeof(struct umr_reg) * (as->blocks[i]->no_regs - j - 1));
-	as->blocks[i]->no_regs--;
+	// never modify bitfields that may be shared with other registers or devices
+	if (grow_bits(e, reg, op->cmd == UPDATE_ADD))
+		return -1;
 
+	switch (op->cmd) {
+		case UPDATE_ADD:
+			k = reg->no_bits++;
+			memset(&reg->bits[k], 0, sizeof reg->bits[k]);
+			reg->bits[k].regname = strdup(op->bit);
+			if (!reg->bits[k].regname) {
+				--reg->no_bits;
+				fprintf(stderr, "[ERROR]: Out of memory\n");
+				return -1;
+			}
+			reg->bits[k].bitfield_print = umr_bitfield_default;
+			// fall through
+		case UPDATE_EDIT:
+			reg->bits[k].start = op->start;
+			reg->bits[k].stop = op->stop;
+			break;
+		case UPDATE_DEL:
+			for (j = k + 1; j < reg->no_bits; j++)
+				reg->bits[j - 1] = reg->bits[j];
+			reg->no_bits--;
+			break;
+	}
 	return 0;
 }
 
-static int do_del_bit(char **ptr, struct umr_asic *as)
+/* resolve the blocks, grow register arrays for the adds and hash every register */
+static int prepare_state(struct update_state *st, struct update_op *ops, int no_ops)
 {
-	char	asic[BUFLEN], ip[BUFLEN], reg[BUFLEN], bit[BUFLEN];
-	int i, j, k;
-
-	parse_bitpath(ptr, asic, ip, reg, bit);
-
-	// now try to find that asic/ip block
-	if (strcmp(as->asicname, asic)) {
-		// ignore asics that don't apply
-		return 0;
+	struct umr_reg *regs;
+	int *adds, *dels, i, j, n, last;
+	uint32_t size;
+
+	adds = calloc(st->asic->no_blocks + 1, sizeof adds[0]);
+	dels = calloc(st->asic->no_blocks + 1, sizeof dels[0]);
+	st->dead = calloc(st->asic->no_blocks + 1, sizeof st->dead[0]);
+	if (!adds || !dels || !st->dead)
+		goto oom;
+
+	last = 0;
+	for (n = 0; n < no_ops; n++) {
+		ops[n].ip = -1;
+		if (strcmp(st->asic->asicname, ops[n].asic))
+			continue;
+		for (i = 0; i < st->asic->no_blocks; i++) {
+			j = (last + i) % st->asic->no_blocks;
+			if (!strcmp(st->asic->blocks[j]->ipname, ops[n].ipname)) {
+				ops[n].ip = last = j;
+				break;
+			}
+		}
+		if (ops[n].ip >= 0 && ops[n].cmd == UPDATE_ADD && !ops[n].is_bit)
+			++adds[ops[n].ip];
+		if (ops[n].ip >= 0 && ops[n].cmd == UPDATE_DEL && !ops[n].is_bit)
+			++dels[ops[n].ip];
 	}
 
-	find_bit(as, ip, reg, bit, &i, &j, &k);
-
-	if (i < 0 || j < 0 || k < 0) {
-		fprintf(stderr, "[ERROR]: Invalid regpath %s.%s.%s for del command\n", ip, reg, bit);
-		return -1;
+	for (n = i = 0; i < st->asic->no_blocks; i++) {
+		if (adds[i]) {
+			regs = realloc(st->asic->blocks[i]->regs, sizeof(regs[0]) * (st->asic->blocks[i]->no_regs + adds[i]));
+			if (!regs)
+				goto oom;
+			st->asic->blocks[i]->regs = regs;
+		}
+		if (dels[i]) {
+			st->dead[i] = calloc(st->asic->blocks[i]->no_regs + adds[i], 1);
+			if (!st->dead[i])
+				goto oom;
+		}
+		n += st->asic->blocks[i]->no_regs + adds[i];
 	}
 
-	// remove bit
-	memmove(&as->blocks[i]->regs[j].bits[k], &as->blocks[i]->regs[j].bits[k+1], sizeof(struct umr_bitfield) * (as->blocks[i]->regs[j].no_bits - k - 1));
-	as->blocks[i]->regs[j].no_bits--;
-
+	// keep the load factor at or below 50%
+	for (size = 16; size < 2 * (uint32_t)n; size <<= 1);
+	st->table = calloc(size, sizeof st->table[0]);
+	if (!st->table)
+		goto oom;
+	st->mask = size - 1;
+
+	// inserted in block order so duplicate names resolve to the first one
+	for (i = 0; i < st->asic->no_blocks; i++)
+		for (j = 0; j < st->asic->blocks[i]->no_regs; j++)
+			if (st->asic->blocks[i]->regs[j].regname)
+				insert_slot(st, i, j);
+	free(adds);
+	free(dels);
 	return 0;
+oom:
+	fprintf(stderr, "[ERROR]: Out of memory\n");
+	free(adds);
+	free(dels);
+	return -1;
 }
 
-static int do_del(char **ptr, struct umr_asic *asic)
+/* drop the registers deleted by the script */
+static void compact_blocks(struct update_state *st)
 {
-	consume_whitespace(ptr);
-
-	// now we're pointing at reg or bit
-	if (!memcmp(*ptr, "reg", 3)) {
-		*ptr += 3;
-		do_del_reg(ptr, asic);
-	} else if (!memcmp(*ptr, "bit", 3)) {
-		*ptr += 3;
-		do_del_bit(ptr, asic);
-	} else {
-		fprintf(stderr, "[ERROR]: Invalid del command\n");
-		return -1;
+	struct umr_ip_block *ip;
+	int i, j, n;
+
+	for (i = 0; i < st->asic->no_blocks; i++) {
+		if (!st->dead[i])
+			continue;
+		ip = st->asic->blocks[i];
+		for (n = j = 0; j < ip->no_regs; j++)
+			if (!st->dead[i][j])
+				ip->regs[n++] = ip->regs[j];
+		ip->no_regs = n;
 	}
-	return 0;
 }
 
+/**
+ * umr_update_string - Update an ASIC device from a script in memory
+ *
+ * @asic: The device to update
+ * @sdata: The script (see umr_update())
+ *
+ * Returns -1 if the script could not be parsed in which case the
+ * device is left unchanged.  Commands that refer to missing
+ * registers or bitfields are reported and skipped.
+ */
 int umr_update_string(struct umr_asic *asic, char *sdata)
 {
-	int r;
-
-	// parse script
-	while (*sdata) {
-		consume_whitespace(&sdata);
-
-		// should be pointing to "add/edit/del" now
-		if (!memcmp(sdata, "add", 3)) {
-			sdata += 3;
-			if ((r = do_add(&sdata, asic)))
-				return r;
-		} else if (!memcmp(sdata, "edit", 4)) {
-			sdata += 4;
-			r = do_edit(&sdata, asic);
-			if (r)
-				return r;
-		} else if (!memcmp(sdata, "del", 3)) {
-			sdata += 3;
-			r = do_del(&sdata, asic);
-			if (r)
-				return r;
-		} else if (*sdata) {
-			fprintf(stderr, "[ERROR]: Unknown update command [%s]\n", sdata);
-			*sdata = 0;
-			return -1;
-		}
+	struct update_state st;
+	struct update_op *ops;
+	char *script;
+	int no_ops, n, i, r;
+
+	memset(&st, 0, sizeof st);
+	st.asic = asic;
+	ops = NULL;
+	script = strdup(sdata);
+	if (!script) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return -1;
 	}
-	return 0;
+	no_ops = parse_script(script, &ops);
+	r = -1;
+	if (no_ops < 0)
+		goto error;
+
+	// the register database is about to change, stop sharing it
+	umr_invalidate_reg_indices(asic);
+	for (i = 0; i < asic->no_blocks; i++)
+		if (umr_unshare_ip_block(asic->blocks[i]))
+			goto error;
+
+	if (prepare_state(&st, ops, no_ops))
+		goto error;
+
+	for (n = 0; n < no_ops; n++)
+		apply_op(&st, &ops[n]);
+	compact_blocks(&st);
+	r = 0;
+
+error:
+	if (st.dead)
+		for (i = 0; i < asic->no_blocks; i++)
+			free(st.dead[i]);
+	free(st.dead);
+	free(st.table);
+	free(ops);
+	free(script);
+	return r;
 }
 
 /**
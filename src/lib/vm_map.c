@@ -0,0 +1,548 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+
+/*
+ * An address space map is built by walking the page tables of a VMID
+ * depth first.  Each page directory and table is read with one access,
+ * the subtrees of invalid PDEs are skipped and consecutive pages that
+ * are physically contiguous with the same attributes are merged into
+ * one range.  The tables are decoded the same way as by
+ * umr_access_vram() on AI and newer.
+ *
+ * umr_vm_map_capture_many() walks several VMIDs on a pool of threads
+ * (each using its own clone of the device).  Page tables reached from
+ * more than one VMID, such as a VM bound on both hubs, are read once:
+ * the tables read are kept in a cache shared by the workers and a
+ * worker needing a table that another one is reading waits for it.
+ *
+ * Map file layout (native byte order, checked with byte_order):
+ *
+ *   header
+ *   struct umr_vm_range ranges[no_ranges]
+ */
+#define UMR_VM_MAP_VERSION 1
+
+struct umr_vm_map_header {
+	char magic[8];
+	uint32_t version, byte_order;
+	uint32_t vmid, reserved;
+	uint64_t no_ranges;
+	char asicname[32];
+};
+
+// bits of a PDE or PTE that are not attributes of the memory mapped
+#define VM_ADDR_MASK     0x0000FFFFFFFFF000ULL
+#define VM_FRAGMENT_MASK (0x1FULL << 7)
+#define VM_PDE_IS_PTE    (1ULL << 54)
+#define VM_PTE_FURTHER   (1ULL << 56)
+#define VM_PTE_PRT       (1ULL << 61)
+
+// largest root table walked (in entries)
+#define VM_MAP_MAX_ROOT_ENTRIES (1ULL << 21)
+
+#define VM_MAP_CACHE_BUCKETS 4096
+#define VM_MAP_CACHE_MAX     (256ULL << 20) // bytes of page tables kept
+
+enum vm_map_block_state {
+	VM_MAP_BLOCK_READING,
+	VM_MAP_BLOCK_READY,
+	VM_MAP_BLOCK_FAILED,
+};
+
+struct vm_map_block {
+	struct vm_map_block *next;
+	uint64_t key;    // address | system
+	uint32_t size;
+	enum vm_map_block_state state;
+	uint64_t data[];
+};
+
+struct vm_map_cache {
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	uint64_t bytes, reads;
+	struct vm_map_block *buckets[VM_MAP_CACHE_BUCKETS];
+};
+
+struct vm_map_walk {
+	struct umr_asic *asic;
+	struct umr_vm_layout layout;
+	struct umr_vm_map *map;
+	struct vm_map_cache *cache; // NULL to read every table
+};
+
+/* work shared by the threads of umr_vm_map_capture_many() */
+struct vm_map_job {
+	const uint32_t *vmids;
+	struct umr_vm_layout *layouts;
+	int *have_layout;
+	struct umr_vm_map **maps;
+	int no_vmids, next;
+	struct vm_map_cache cache;
+};
+
+struct vm_map_worker {
+	pthread_t thread;
+	struct umr_asic *asic;
+	struct vm_map_job *job;
+};
+
+/**
+ * vm_map_add - Add a page (or large page) to a map
+ *
+ * Extends the last range of the map if the page follows it.
+ */
+static int vm_map_add(struct umr_vm_map *map, uint64_t va, uint64_t pa, uint64_t size, uint64_t flags)
+{
+	struct umr_vm_range *r;
+
+	if (map->no_ranges) {
+		r = &map->ranges[map->no_ranges - 1];
+		// PRT pages without a valid mapping have no physical address
+		if (r->va + r->size == va && r->flags == flags &&
+		    (!(flags & 1) || r->pa + r->size == pa)) {
+			r->size += size;
+			return 0;
+		}
+	}
+
+	if (map->no_ranges == map->max_ranges) {
+		uint64_t max = map->max_ranges ? map->max_ranges * 2 : 256;
+
+		r = realloc(map->ranges, max * sizeof *r);
+		if (!r) {
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+			return -1;
+		}
+		map->ranges = r;
+		map->max_ranges = max;
+	}
+	r = &map->ranges[map->no_ranges++];
+	r->va = va;
+	r->pa = pa;
+	r->size = size;
+	r->flags = flags;
+	return 0;
+}
+
+/**
+ * vm_map_leaf - Add the memory mapped by a PTE (or PDE used as one)
+ */
+static int vm_map_leaf(struct vm_map_walk *w, uint64_t entry, uint64_t va, uint64_t size)
+{
+	uint64_t pa, flags;
+
+	if (!(entry & 1) && !(entry & VM_PTE_PRT))
+		return 0;
+
+	flags = entry & ~(VM_ADDR_MASK | VM_FRAGMENT_MASK | VM_PDE_IS_PTE | VM_PTE_FURTHER);
+	pa = 0;
+	if (entry & 1) {
+		pa = entry & VM_ADDR_MASK;
+		if (!(entry & 2))
+			pa -= w->layout.fb_offset;
+	}
+	return vm_map_add(w->map, va, pa, size, flags);
+}
+
+/**
+ * vm_map_read - Read a page directory or table from the device
+ */
+static int vm_map_read(struct umr_asic *asic, int system, uint64_t addr, uint32_t size, void *dst)
+{
+	int r;
+
+	if (system)
+		r = asic->mem_funcs.access_sram(asic, addr, size, dst, 0);
+	else
+		r = umr_read_vram(asic, UMR_LINEAR_HUB, addr, size, dst);
+	if (r < 0)
+		fprintf(stderr, "[ERROR]: Cannot read page table at %s 0x%" PRIx64 "\n", system ? "sys" : "vram", addr);
+	return r < 0 ? -1 : 0;
+}
+
+/**
+ * vm_map_read_table - Read a page directory or table through the cache
+ *
+ * Copies the table from the shared cache if it holds it (waiting for
+ * another worker reading it) or else reads it and adds it to the cache
+ * unless the cache is full.
+ */
+static int vm_map_read_table(struct vm_map_walk *w, int system, uint64_t addr, uint32_t size, void *dst)
+{
+	struct vm_map_cache *c = w->cache;
+	struct vm_map_block *b;
+	uint64_t key = addr | !!system;
+	unsigned h;
+	int r;
+
+	if (!c)
+		return vm_map_read(w->asic, system, addr, size, dst);
+
+	h = (unsigned)((key >> 12) ^ (key >> 24)) % VM_MAP_CACHE_BUCKETS;
+	pthread_mutex_lock(&c->lock);
+	for (b = c->buckets[h]; b; b = b->next)
+		if (b->key == key && b->size == size)
+			break;
+	if (b) {
+		while (b->state == VM_MAP_BLOCK_READING)
+			pthread_cond_wait(&c->done, &c->lock);
+		if (b->state == VM_MAP_BLOCK_READY) {
+			memcpy(dst, b->data, size);
+			pthread_mutex_unlock(&c->lock);
+			return 0;
+		}
+		b = NULL;
+	} else if (c->bytes + size <= VM_MAP_CACHE_MAX) {
+		b = calloc(1, sizeof *b + size);
+		if (b) {
+			b->key = key;
+			b->size = size;
+			b->state = VM_MAP_BLOCK_READING;
+			b->next = c->buckets[h];
+			c->buckets[h] = b;
+			c->bytes += size;
+		}
+	}
+	++c->reads;
+	pthread_mutex_unlock(&c->lock);
+
+	r = vm_map_read(w->asic, system, addr, size, dst);
+	if (b) {
+		pthread_mutex_lock(&c->lock);
+		if (!r)
+			memcpy(b->data, dst, size);
+		b->state = r ? VM_MAP_BLOCK_FAILED : VM_MAP_BLOCK_READY;
+		pthread_cond_broadcast(&c->done);
+		pthread_mutex_unlock(&c->lock);
+	}
+	return r;
+}
+
+/**
+ * vm_map_table - Walk a page directory or table
+ *
+ * @level: Levels of page directories below this table, 0 for a page
+ *         table and -1 for the page table of a PTE with the F bit set
+ * @system: The table is in system memory rather than VRAM
+ * @addr: The address of the table
+ * @entries: The number of entries in the table
+ * @va: The virtual address of the first entry
+ * @entry_size: The memory mapped by each entry
+ * @frag: The block fragment size of the PDE pointing at a page table
+ */
+static int vm_map_table(struct vm_map_walk *w, int level, int system, uint64_t addr,
+			uint64_t entries, uint64_t va, uint64_t entry_size, int frag)
+{
+	uint64_t *table, x, entry, child;
+	int r, pts = w->layout.block_size, cfrag;
+
+	table = calloc(entries, sizeof table[0]);
+	if (!table) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return -1;
+	}
+	r = vm_map_read_table(w, system, addr, entries * 8, table);
+	if (r) {
+		free(table);
+		return -1;
+	}
+	++w->map->no_tables;
+
+	for (x = 0; x < entries && !r; x++, va += entry_size) {
+		entry = table[x];
+
+		// page tables
+		if (level <= 0) {
+			if (level == 0 && (entry & VM_PTE_FURTHER)) {
+				// the page table of this PTE maps its range in 4KB pages
+				r = vm_map_table(w, -1, system, entry & VM_ADDR_MASK,
+						 1ULL << frag, va, 0x1000, 0);
+			} else {
+				r = vm_map_leaf(w, entry, va, entry_size);
+			}
+			continue;
+		}
+
+		// page directories
+		if (!(entry & 1))
+			continue;
+		if (entry & VM_PDE_IS_PTE) {
+			r = vm_map_leaf(w, entry, va, entry_size);
+			continue;
+		}
+
+		child = entry & VM_ADDR_MASK;
+		if (!(entry & 2))
+			child -= w->layout.fb_offset;
+		if (level > 1) {
+			r = vm_map_table(w, level - 1, (entry >> 1) & 1, child,
+					 512, va, entry_size >> 9, 0);
+		} else {
+			// a page table holds 512 << block_size entries of 4KB << fragment
+			cfrag = (entry >> 59) & 0x1F;
+			if (cfrag > 9 + pts)
+				cfrag = 9 + pts;
+			r = vm_map_table(w, 0, (entry >> 1) & 1, child,
+					 1ULL << (9 + pts - cfrag), va, 0x1000ULL << (pts + cfrag), cfrag);
+		}
+	}
+	free(table);
+	return r;
+}
+
+/**
+ * umr_vm_map_free - Free an address space map
+ */
+void umr_vm_map_free(struct umr_vm_map *map)
+{
+	if (map) {
+		free(map->ranges);
+		free(map);
+	}
+}
+
+/**
+ * vm_map_build - Walk the page tables of a VMID with a known layout
+ */
+static struct umr_vm_map *vm_map_build(struct umr_asic *asic, uint32_t vmid,
+				       struct umr_vm_layout *layout, struct vm_map_cache *cache)
+{
+	struct vm_map_walk w;
+	uint64_t span, entry_size, entries, base;
+	int r, frag;
+
+	memset(&w, 0, sizeof w);
+	w.asic = asic;
+	w.layout = *layout;
+	w.cache = cache;
+
+	w.map = calloc(1, sizeof *w.map);
+	if (!w.map) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return NULL;
+	}
+	w.map->asic = asic;
+	w.map->vmid = vmid;
+
+	// the base address is treated as a PDE
+	base = w.layout.base_addr;
+	span = w.layout.end_addr - w.layout.start_addr;
+	frag = 0;
+	if (w.layout.depth) {
+		entry_size = 1ULL << ((w.layout.depth - 1) * 9 + 21 + w.layout.block_size);
+	} else {
+		frag = (base >> 59) & 0x1F;
+		entry_size = 0x1000ULL << frag;
+	}
+
+	// the root table has as many entries as the VM needs
+	entries = (span + entry_size - 1) / entry_size;
+	if (entries > VM_MAP_MAX_ROOT_ENTRIES) {
+		fprintf(stderr, "[WARNING]: Only mapping the first %llu entries of the root page table\n", VM_MAP_MAX_ROOT_ENTRIES);
+		entries = VM_MAP_MAX_ROOT_ENTRIES;
+	}
+
+	r = 0;
+	if (base & 1)
+		r = vm_map_table(&w, w.layout.depth, 0, base & VM_ADDR_MASK,
+				 entries, w.layout.start_addr, entry_size, frag);
+	if (r) {
+		umr_vm_map_free(w.map);
+		return NULL;
+	}
+	return w.map;
+}
+
+/**
+ * umr_vm_map_capture - Build the address space map of a VMID
+ *
+ * @vmid: The hub and VMID as passed to umr_access_vram()
+ *
+ * Walks the page tables of @vmid and returns the mapped (or PRT)
+ * memory as ranges ordered by virtual address.  Only AI and newer are
+ * supported.  Returns NULL on error.
+ */
+struct umr_vm_map *umr_vm_map_capture(struct umr_asic *asic, uint32_t vmid)
+{
+	struct umr_vm_layout layout;
+
+	if (umr_vm_read_layout(asic, vmid, &layout))
+		return NULL;
+	return vm_map_build(asic, vmid, &layout, NULL);
+}
+
+static void *vm_map_work(void *data)
+{
+	struct vm_map_worker *wk = data;
+	struct vm_map_job *job = wk->job;
+	int x;
+
+	for (;;) {
+		pthread_mutex_lock(&job->cache.lock);
+		x = job->next++;
+		pthread_mutex_unlock(&job->cache.lock);
+		if (x >= job->no_vmids)
+			break;
+		if (job->have_layout[x])
+			job->maps[x] = vm_map_build(wk->asic, job->vmids[x], &job->layouts[x], &job->cache);
+	}
+	return NULL;
+}
+
+/**
+ * umr_vm_map_capture_many - Build the address space maps of several VMIDs
+ *
+ * @vmids: The hubs and VMIDs as passed to umr_access_vram()
+ * @no_vmids: The number of VMIDs
+ * @nthreads: The number of threads to walk with (0 for one per CPU)
+ * @maps: Receives the map of each VMID (NULL if it could not be built)
+ *
+ * The VM context registers are read on the calling thread, the page
+ * tables are then walked by up to @nthreads threads (the calling one
+ * included) and each table is read once however many VMIDs use it.
+ * @asic may not be a clone.  Free the maps with umr_vm_map_free().
+ *
+ * Returns the number of page tables read from the device or -1 on
+ * error.
+ */
+int64_t umr_vm_map_capture_many(struct umr_asic *asic, const uint32_t *vmids, int no_vmids,
+				int nthreads, struct umr_vm_map **maps)
+{
+	struct vm_map_worker *workers;
+	struct vm_map_block *b, *next;
+	struct vm_map_job job;
+	int64_t r;
+	int x;
+
+	if (asic->family != FAMILY_AI && asic->family != FAMILY_RV) {
+		fprintf(stderr, "[ERROR]: VM maps are only supported on AI and newer\n");
+		return -1;
+	}
+
+	memset(&job, 0, sizeof job);
+	memset(maps, 0, no_vmids * sizeof maps[0]);
+	job.vmids = vmids;
+	job.no_vmids = no_vmids;
+	job.maps = maps;
+	job.layouts = calloc(no_vmids, sizeof job.layouts[0]);
+	job.have_layout = calloc(no_vmids, sizeof job.have_layout[0]);
+	if (nthreads < 1)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	// XGMI nodes are accessed through their own (unshared) handles
+	if (nthreads < 1 || asic->parent || asic->options.use_xgmi)
+		nthreads = 1;
+	if (nthreads > no_vmids)
+		nthreads = no_vmids;
+	workers = calloc(nthreads ? nthreads : 1, sizeof workers[0]);
+	if (!job.layouts || !job.have_layout || !workers) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		free(job.layouts);
+		free(job.have_layout);
+		free(workers);
+		return -1;
+	}
+
+	for (x = 0; x < no_vmids; x++)
+		job.have_layout[x] = !umr_vm_read_layout(asic, vmids[x], &job.layouts[x]);
+
+	pthread_mutex_init(&job.cache.lock, NULL);
+	pthread_cond_init(&job.cache.done, NULL);
+
+	// worker 0 runs on the calling thread with the device itself
+	workers[0].asic = asic;
+	workers[0].job = &job;
+	for (x = 1; x < nthreads; x++) {
+		workers[x].job = &job;
+		workers[x].asic = umr_clone_asic(asic);
+		if (workers[x].asic && pthread_create(&workers[x].thread, NULL, vm_map_work, &workers[x])) {
+			umr_close_asic(workers[x].asic);
+			workers[x].asic = NULL;
+		}
+		if (!workers[x].asic)
+			break;
+	}
+	nthreads = x;
+	vm_map_work(&workers[0]);
+	for (x = 1; x < nthreads; x++) {
+		pthread_join(workers[x].thread, NULL);
+		umr_close_asic(workers[x].asic);
+	}
+
+	// the maps refer to the device rather than the clones
+	for (x = 0; x < no_vmids; x++)
+		if (maps[x])
+			maps[x]->asic = asic;
+
+	r = job.cache.reads;
+	for (x = 0; x < VM_MAP_CACHE_BUCKETS; x++) {
+		for (b = job.cache.buckets[x]; b; b = next) {
+			next = b->next;
+			free(b);
+		}
+	}
+	pthread_cond_destroy(&job.cache.done);
+	pthread_mutex_destroy(&job.cache.lock);
+	free(job.layouts);
+	free(job.have_layout);
+	free(workers);
+	return r;
+}
+
+/**
+ * umr_vm_map_write - Save an address space map to a file
+ *
+ * Returns 0 on success.
+ */
+int umr_vm_map_write(struct umr_vm_map *map, const char *filename)
+{
+	struct umr_vm_map_header hdr;
+	FILE *f;
+	int r;
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, UMR_VM_MAP_MAGIC, sizeof hdr.magic);
+	hdr.version = UMR_VM_MAP_VERSION;
+	hdr.byte_order = 0x01020304;
+	hdr.vmid = map->vmid;
+	hdr.no_ranges = map->no_ranges;
+	strncpy(hdr.asicname, map->asic->asicname, sizeof(hdr.asicname) - 1);
+
+	r = -1;
+	f = fopen(filename, "wb");
+	if (!f) {
+		perror("Cannot create VM map file");
+	} else {
+		if (fwrite(&hdr, sizeof hdr, 1, f) == 1 &&
+		    fwrite(map->ranges, sizeof map->ranges[0], map->no_ranges, f) == map->no_ranges)
+			r = 0;
+		if (fclose(f))
+			r = -1;
+		if (r)
+			fprintf(stderr, "[ERROR]: Could not write VM map file <%s>\n", filename);
+	}
+	return r;
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+
+/*
+ * Deferred writes replace the register and VRAM callbacks of a device
+ * with versions that queue register writes and flush the queue before
+ * anything that could observe them.  The writes are handed to the
+ * original write_regs() callback in one call so the backend can merge
+ * them (adjacent debugfs registers in one syscall, a single fence for
+ * BAR stores).
+ *
+ * Register classes aren't independent (SMC and DIDT registers can be
+ * reached through MMIO index/data pairs) so any read flushes every
+ * queued write, not just those of the same class.
+ */
+
+#define UMR_WRITE_QUEUE_SIZE 64
+
+struct umr_write_queue {
+	// callbacks the queue was installed over
+	struct umr_register_access_funcs reg_funcs;
+	struct umr_memory_access_funcs mem_funcs;
+
+	int no_writes, flushing;
+	struct umr_reg_addr regs[UMR_WRITE_QUEUE_SIZE];
+	uint32_t values[UMR_WRITE_QUEUE_SIZE];
+};
+
+static int wq_flush(struct umr_asic *asic)
+{
+	struct umr_write_queue *wq = asic->write_queue;
+	int r, x, n;
+
+	if (!wq || !wq->no_writes || wq->flushing)
+		return 0;
+
+	// backends may issue register accesses of their own while flushing
+	wq->flushing = 1;
+	n = wq->no_writes;
+	wq->no_writes = 0;
+	r = 0;
+	if (wq->reg_funcs.write_regs) {
+		r = wq->reg_funcs.write_regs(asic, wq->regs, wq->values, n);
+	} else {
+		for (x = 0; x < n; x++)
+			if (wq->reg_funcs.write_reg(asic, wq->regs[x].addr, wq->values[x], wq->regs[x].type))
+				r = -1;
+	}
+	wq->flushing = 0;
+	return r;
+}
+
+static uint32_t wq_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
+{
+	wq_flush(asic);
+	return asic->write_queue->reg_funcs.read_reg(asic, addr, type);
+}
+
+static int wq_read_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n)
+{
+	wq_flush(asic);
+	return asic->write_queue->reg_funcs.read_regs(asic, regs, values, n);
+}
+
+static int wq_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
+{
+	struct umr_write_queue *wq = asic->write_queue;
+
+	if (wq->flushing)
+		return wq->reg_funcs.write_reg(asic, addr, value, type);
+
+	if (wq->no_writes == UMR_WRITE_QUEUE_SIZE && wq_flush(asic))
+		return -1;
+	wq->regs[wq->no_writes].addr = addr;
+	wq->regs[wq->no_writes].type = type;
+	wq->values[wq->no_writes++] = value;
+	return 0;
+}
+
+static int wq_write_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, const uint32_t *values, int n)
+{
+	int x, r = 0;
+
+	for (x = 0; x < n; x++)
+		if (wq_write_reg(asic, regs[x].addr, values[x], regs[x].type))
+			r = -1;
+	return r;
+}
+
+static int wq_access_sram(struct umr_asic *asic, uint64_t address, uint32_t size, void *dst, int write_en)
+{
+	wq_flush(asic);
+	return asic->write_queue->mem_funcs.access_sram(asic, address, size, dst, write_en);
+}
+
+static int wq_access_linear_vram(struct umr_asic *asic, uint64_t address, uint32_t size, void *data, int write_en)
+{
+	wq_flush(asic);
+	return asic->write_queue->mem_funcs.access_linear_vram(asic, address, size, data, write_en);
+}
+
+/**
+ * umr_defer_writes - Enable or disable deferred register writes
+ *
+ * @enable: non-zero to queue register writes, zero to flush them and
+ * restore immediate writes
+ *
+ * While enabled, register writes made through @asic->reg_funcs are
+ * queued and issued in order (with the original write_regs() callback
+ * if there is one) by umr_flush_writes(), before any register read,
+ * VRAM or system memory access through the callbacks, or when the queue
+ * fills up.  The
+ * callbacks must be assigned before this is called.
+ *
+ * Returns 0 on success.
+ */
+int umr_defer_writes(struct umr_asic *asic, int enable)
+{
+	struct umr_write_queue *wq = asic->write_queue;
+	int r;
+
+	if (enable) {
+		if (wq)
+			return 0;
+		wq = calloc(1, sizeof *wq);
+		if (!wq) {
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+			return -1;
+		}
+		wq->reg_funcs = asic->reg_funcs;
+		wq->mem_funcs = asic->mem_funcs;
+		asic->reg_funcs.read_reg = wq_read_reg;
+		asic->reg_funcs.write_reg = wq_write_reg;
+		asic->reg_funcs.write_regs = wq_write_regs;
+		if (asic->reg_funcs.read_regs)
+			asic->reg_funcs.read_regs = wq_read_regs;
+		if (asic->mem_funcs.access_sram)
+			asic->mem_funcs.access_sram = wq_access_sram;
+		if (asic->mem_funcs.access_linear_vram)
+			asic->mem_funcs.access_linear_vram = wq_access_linear_vram;
+		asic->write_queue = wq;
+		return 0;
+	}
+
+	if (!wq)
+		return 0;
+	r = wq_flush(asic);
+	asic->reg_funcs = wq->reg_funcs;
+	asic->mem_funcs = wq->mem_funcs;
+	asic->write_queue = NULL;
+	free(wq);
+	return r;
+}
+
+/**
+ * umr_share_write_queue - Defer writes on a device given another's callbacks
+ *
+ * Used when the callbacks of @asic are copied to @node (an XGMI node or
+ * a clone) so that @node queues its writes the same way with a queue of
+ * its own.  If the queue can't be allocated @node is given the original
+ * callbacks of @asic instead so its writes are issued immediately.
+ *
+ * Returns 0 on success or -1 if @node does not defer its writes.
+ */
+int umr_share_write_queue(struct umr_asic *asic, struct umr_asic *node)
+{
+	struct umr_write_queue *wq;
+
+	if (node == asic || !asic->write_queue || node->write_queue)
+		return 0;
+	wq = calloc(1, sizeof *wq);
+	if (!wq) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		node->reg_funcs = asic->write_queue->reg_funcs;
+		node->mem_funcs = asic->write_queue->mem_funcs;
+		return -1;
+	}
+	wq->reg_funcs = asic->write_queue->reg_funcs;
+	wq->mem_funcs = asic->write_queue->mem_funcs;
+	node->write_queue = wq;
+	return 0;
+}
+
+/**
+ * umr_flush_writes - Issue any deferred register writes
+ *
+ * Must be called before accessing the hardware without going through
+ * the asic callbacks (for instance through debugfs files) if writes
+ * may be deferred.  Returns 0 on success or -1 if a write failed.
+ */
+int umr_flush_writes(struct umr_asic *asic)
+{
+	return wq_flush(asic);
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <time.h>
+
+/*
+ * Throughput of the asynchronous debugfs reader with io_uring against
+ * its pread() fallback, using an ordinary temporary file as a stand-in
+ * for amdgpu_vram/amdgpu_regs.  Batches of scattered page reads (like
+ * the page table walker and wave scanner issue) and register lists of
+ * short runs (like the register dumper) are timed.  Both engines are
+ * checked against the file contents before timing.
+ *
+ * Reads from the page cache complete as soon as they are submitted so
+ * this mostly measures the submission overhead; debugfs reads that
+ * block in the driver gain from being in flight concurrently.
+ *
+ * usage: bench_aio [file size in MB] [iterations]
+ */
+
+#define PAGE_SIZE   4096
+#define NO_RUNS     64
+#define RUN_LENGTH  8
+
+static uint32_t file_value(uint64_t offset)
+{
+	uint32_t x = (uint32_t)offset * 2654435761U;
+
+	return x ^ (x >> 16);
+}
+
+static uint64_t bench_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int create_file(uint64_t size)
+{
+	char name[] = "/tmp/umr_bench_aioXXXXXX";
+	uint32_t *buf;
+	uint64_t off;
+	int fd, x;
+
+	fd = mkstemp(name);
+	if (fd < 0)
+		return -1;
+	unlink(name);
+
+	buf = calloc(1, PAGE_SIZE);
+	if (!buf) {
+		close(fd);
+		return -1;
+	}
+	for (off = 0; off < size; off += PAGE_SIZE) {
+		for (x = 0; x < PAGE_SIZE / 4; x++)
+			buf[x] = file_value(off + 4 * x);
+		if (write(fd, buf, PAGE_SIZE) != PAGE_SIZE) {
+			free(buf);
+			close(fd);
+			return -1;
+		}
+	}
+	free(buf);
+	return fd;
+}
+
+static void count_read(void *data, int result)
+{
+	if (result == PAGE_SIZE)
+		++*(int *)data;
+}
+
+/* read 'depth' random pages per batch, returns the pages read */
+static int read_pages(struct umr_aio *aio, int fd, uint64_t no_pages, uint32_t (*pages)[PAGE_SIZE / 4],
+		      uint64_t *offsets, int depth)
+{
+	int x, done = 0;
+
+	for (x = 0; x < depth; x++) {
+		offsets[x] = (uint64_t)(rand() % no_pages) * PAGE_SIZE;
+		umr_aio_read(aio, fd, pages[x], PAGE_SIZE, offsets[x], count_read, &done);
+	}
+	umr_aio_wait(aio);
+	return done;
+}
+
+static int check(struct umr_aio *aio, int fd, uint64_t no_pages, uint32_t (*pages)[PAGE_SIZE / 4],
+		 uint64_t *offsets, int *fds, struct umr_reg_addr *regs, uint32_t *values)
+{
+	int x, k;
+
+	if (read_pages(aio, fd, no_pages, pages, offsets, UMR_AIO_DEPTH) != UMR_AIO_DEPTH)
+		return -1;
+	for (x = 0; x < UMR_AIO_DEPTH; x++)
+		for (k = 0; k < PAGE_SIZE / 4; k++)
+			if (pages[x][k] != file_value(offsets[x] + 4 * k))
+				return -1;
+
+	memset(values, 0, NO_RUNS * RUN_LENGTH * 4);
+	if (umr_aio_read_regs(aio, fds, regs, values, NO_RUNS * RUN_LENGTH) != NO_RUNS * RUN_LENGTH)
+		return -1;
+	for (x = 0; x < NO_RUNS * RUN_LENGTH; x++)
+		if (values[x] != file_value(regs[x].addr))
+			return -1;
+	return 0;
+}
+
+static void bench(struct umr_aio *aio, const char *name, int fd, uint64_t no_pages, int iters,
+		  uint32_t (*pages)[PAGE_SIZE / 4], uint64_t *offsets,
+		  int *fds, struct umr_reg_addr *regs, uint32_t *values)
+{
+	uint64_t t, bytes = 0;
+	int x;
+
+	srand(1);
+	t = bench_clock();
+	for (x = 0; x < iters; x++)
+		bytes += (uint64_t)read_pages(aio, fd, no_pages, pages, offsets, UMR_AIO_DEPTH) * PAGE_SIZE;
+	t = bench_clock() - t;
+	printf("  %-9s %d x %d scattered pages  %10.1f MB/s\n",
+	       name, iters, UMR_AIO_DEPTH, bytes / (t / 1e9) / 1e6);
+
+	t = bench_clock();
+	for (x = 0; x < iters; x++)
+		umr_aio_read_regs(aio, fds, regs, values, NO_RUNS * RUN_LENGTH);
+	t = bench_clock() - t;
+	printf("  %-9s %d x %d registers in %d runs  %10.1f us per list\n",
+	       name, iters, NO_RUNS * RUN_LENGTH, NO_RUNS, t / 1e3 / iters);
+}
+
+int main(int argc, char **argv)
+{
+	struct umr_reg_addr regs[NO_RUNS * RUN_LENGTH];
+	uint32_t values[NO_RUNS * RUN_LENGTH];
+	uint32_t (*pages)[PAGE_SIZE / 4];
+	uint64_t offsets[UMR_AIO_DEPTH], size, no_pages;
+	struct umr_aio *uring, *sync;
+	int fd, iters, x, fds[REG_PCIE + 1];
+
+	size = (uint64_t)(argc > 1 ? atoi(argv[1]) : 64) << 20;
+	iters = argc > 2 ? atoi(argv[2]) : 2000;
+	no_pages = size / PAGE_SIZE;
+	if (!no_pages || iters <= 0) {
+		fprintf(stderr, "usage: %s [file size in MB] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	fd = create_file(size);
+	pages = calloc(UMR_AIO_DEPTH, PAGE_SIZE);
+	uring = umr_aio_create(UMR_AIO_DEPTH, 0);
+	sync = umr_aio_create(UMR_AIO_DEPTH, UMR_AIO_NO_URING);
+	if (fd < 0 || !pages || !uring || !sync) {
+		fprintf(stderr, "[ERROR]: Could not create the temporary file or the readers\n");
+		return 1;
+	}
+
+	// runs of registers spread over the file, like an IP block dump
+	for (x = 0; x <= REG_PCIE; x++)
+		fds[x] = fd;
+	for (x = 0; x < NO_RUNS * RUN_LENGTH; x++) {
+		regs[x].addr = (x / RUN_LENGTH) * (size / NO_RUNS) + (x % RUN_LENGTH) * 4;
+		regs[x].type = REG_MMIO;
+	}
+
+	if (check(uring, fd, no_pages, pages, offsets, fds, regs, values) ||
+	    check(sync, fd, no_pages, pages, offsets, fds, regs, values)) {
+		fprintf(stderr, "[ERROR]: Read the wrong data from the temporary file\n");
+		return 1;
+	}
+
+	printf("%lu MB temporary file, io_uring is %savailable:\n",
+	       (unsigned long)(size >> 20), umr_aio_is_async(uring) ? "" : "not ");
+	if (umr_aio_is_async(uring))
+		bench(uring, "io_uring", fd, no_pages, iters, pages, offsets, fds, regs, values);
+	bench(sync, "pread", fd, no_pages, iters, pages, offsets, fds, regs, values);
+
+	umr_aio_destroy(uring);
+	umr_aio_destroy(sync);
+	free(pages);
+	close(fd);
+	return 0;
+}
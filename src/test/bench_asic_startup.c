@@ -0,0 +1,108 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <time.h>
+
+/*
+ * Time to create and free every built-in ASIC with
+ * umr_discover_asic_by_name(), as created (SOC15 register arrays built
+ * on first use) and with umr_materialize_asic() building every block up
+ * front like every start did before the arrays were built lazily.  Both
+ * are also timed with one register looked up by name, which builds the
+ * name index and (lazily) only the block holding the register.  Startup of the umr binary additionally depends on how it is
+ * linked (see UMR_NO_PIE) which this does not measure.
+ *
+ * usage: bench_asic_startup [repeats]
+ */
+
+static const char *bench_asics[] = {
+	"kabini", "kaveri", "mullins", "oland", "bonaire", "hainan", "hawaii",
+	"tahiti", "polaris10", "polaris11", "polaris12", "pitcairn", "verde",
+	"topaz", "tonga", "fiji", "carrizo", "stoney", "vega10", "vega12",
+	"vega20", "vegam", "raven1", NULL,
+};
+
+#define STARTUP_MATERIALIZE 1
+#define STARTUP_LOOKUP      2
+
+static uint64_t bench_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* best time of @repeats create/free cycles in ns, 0 on error */
+static uint64_t time_startup(const char *name, int mode, int repeats)
+{
+	struct umr_options options;
+	struct umr_asic *asic;
+	uint64_t t, best = ~0ULL;
+	int k;
+
+	memset(&options, 0, sizeof options);
+	for (k = 0; k < repeats; k++) {
+		t = bench_clock();
+		asic = umr_discover_asic_by_name(&options, (char *)name);
+		if (!asic)
+			return 0;
+		if ((mode & STARTUP_MATERIALIZE) && umr_materialize_asic(asic))
+			return 0;
+		if ((mode & STARTUP_LOOKUP) && !umr_find_reg_data(asic, "mmGRBM_STATUS"))
+			return 0;
+		umr_close_asic(asic);
+		t = bench_clock() - t;
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t t[4], sum[4] = { 0 };
+	int a, mode, repeats;
+
+	repeats = argc > 1 ? atoi(argv[1]) : 15;
+	if (repeats < 1)
+		repeats = 1;
+
+	printf("best of %d create/free cycles, ms:\n", repeats);
+	printf("  %-10s %8s %12s %10s %14s\n", "asic", "lazy", "materialized", "lazy+find", "material.+find");
+	for (a = 0; bench_asics[a]; a++) {
+		for (mode = 0; mode < 4; mode++) {
+			t[mode] = time_startup(bench_asics[a], mode, repeats);
+			if (!t[mode]) {
+				fprintf(stderr, "[ERROR]: Could not create the %s device\n", bench_asics[a]);
+				return 1;
+			}
+			sum[mode] += t[mode];
+		}
+		printf("  %-10s %8.3f %12.3f %10.3f %14.3f\n", bench_asics[a], t[0] / 1e6, t[1] / 1e6, t[2] / 1e6, t[3] / 1e6);
+	}
+	printf("  %-10s %8.3f %12.3f %10.3f %14.3f\n", "total", sum[0] / 1e6, sum[1] / 1e6, sum[2] / 1e6, sum[3] / 1e6);
+	return 0;
+}
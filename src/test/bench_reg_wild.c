@@ -0,0 +1,106 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "old_wild_match.h"
+#include <time.h>
+
+/*
+ * Time of umr_find_reg_wild_first()/next() against the old backtracking
+ * iterator, summed over every built-in ASIC.  Each search runs to the
+ * end of its results.  The trigram index is built before timing (it is
+ * built once per device on the first search that can use it).
+ *
+ * usage: bench_reg_wild [repeats]
+ */
+
+static const char *bench_patterns[][2] = {
+	{ NULL, "mmGRBM_STATUS" },
+	{ NULL, "*GRBM*" },
+	{ NULL, "mmSQ_*" },
+	{ NULL, "*_CNTL" },
+	{ "gfx*", "*PERFCOUNTER?_LO" },
+	{ NULL, "mm?DMA*STATUS*" },
+	{ NULL, "*a*" },
+	{ NULL, "*" },
+};
+
+#define NO_BENCH_PATTERNS ((int)(sizeof bench_patterns / sizeof bench_patterns[0]))
+
+static uint64_t bench_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t t, t_old[NO_BENCH_PATTERNS] = { 0 }, t_new[NO_BENCH_PATTERNS] = { 0 };
+	int n_old[NO_BENCH_PATTERNS] = { 0 }, n_new[NO_BENCH_PATTERNS] = { 0 };
+	struct umr_options options;
+	struct umr_asic *asic;
+	int a, p, k, repeats, bad = 0;
+
+	repeats = argc > 1 ? atoi(argv[1]) : 20;
+	if (repeats < 1)
+		repeats = 1;
+	memset(&options, 0, sizeof options);
+
+	for (a = 0; old_asic_names[a]; a++) {
+		asic = umr_discover_asic_by_name(&options, (char *)old_asic_names[a]);
+		if (!asic || umr_materialize_asic(asic)) {
+			fprintf(stderr, "[ERROR]: Could not create the %s device\n", old_asic_names[a]);
+			return 1;
+		}
+		// build the trigram index
+		new_find_regs(asic, NULL, "xyz", NULL);
+
+		for (p = 0; p < NO_BENCH_PATTERNS; p++) {
+			t = bench_clock();
+			for (k = 0; k < repeats; k++)
+				n_old[p] += old_find_regs(asic, bench_patterns[p][0], bench_patterns[p][1], NULL);
+			t_old[p] += bench_clock() - t;
+
+			t = bench_clock();
+			for (k = 0; k < repeats; k++)
+				n_new[p] += new_find_regs(asic, bench_patterns[p][0], bench_patterns[p][1], NULL);
+			t_new[p] += bench_clock() - t;
+		}
+		umr_close_asic(asic);
+	}
+
+	printf("one search over all %d built-in ASICs, old -> new:\n", a);
+	for (p = 0; p < NO_BENCH_PATTERNS; p++) {
+		printf("  %-6s %-18s %8d regs %9.3f ms -> %9.3f ms  %7.1fx\n",
+		       bench_patterns[p][0] ? bench_patterns[p][0] : "*", bench_patterns[p][1],
+		       n_new[p] / repeats, t_old[p] / 1e6 / repeats, t_new[p] / 1e6 / repeats,
+		       (double)t_old[p] / t_new[p]);
+		if (n_old[p] != n_new[p])
+			bad = 1;
+	}
+	if (bad)
+		fprintf(stderr, "[ERROR]: The iterators found a different number of registers\n");
+	return bad;
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umrapp.h"
+#include <time.h>
+
+/*
+ * Time of umr_scan_asic() with the threads=<n> option against mocked
+ * register callbacks which spin for a fixed time per access to stand
+ * in for the latency of a register read.  Spinning threads only run in
+ * parallel with as many CPUs, "sleep" blocks instead like a debugfs
+ * read waiting on the hardware does.  Every register reads as a
+ * value derived from its address so the printed output (with names and
+ * bitfields) of each thread count is compared to the single thread run
+ * and must be byte-identical.
+ *
+ * usage: bench_scan_threads [max threads] [ns per register access] [spin|sleep] [ip block]
+ */
+
+// umr_scan_asic() and umr_print_asic() live in the application library
+struct umr_options options;
+
+static unsigned latency_ns;
+static int sleep_access;
+
+static uint64_t bench_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sim_access(void)
+{
+	struct timespec ts;
+	uint64_t end;
+
+	if (latency_ns && sleep_access) {
+		ts.tv_sec = latency_ns / 1000000000;
+		ts.tv_nsec = latency_ns % 1000000000;
+		nanosleep(&ts, NULL);
+	} else if (latency_ns)
+		for (end = bench_clock() + latency_ns; bench_clock() < end;);
+}
+
+/* called from several scan threads at once so it only depends on @addr */
+static uint32_t sim_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
+{
+	uint32_t x = (uint32_t)addr * 2654435761U ^ type;
+
+	(void)asic;
+	sim_access();
+	return x ^ (x >> 13);
+}
+
+static int sim_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
+{
+	(void)asic;
+	(void)addr;
+	(void)value;
+	(void)type;
+	sim_access();
+	return 0;
+}
+
+/* scan with @nthreads into @file, returns the time taken in ns or 0 on error */
+static uint64_t scan_to_file(struct umr_asic *asic, char *ipname, int nthreads, FILE *file)
+{
+	uint64_t t;
+	int out, r;
+
+	asic->options.dump_threads = nthreads;
+	fflush(stdout);
+	out = dup(STDOUT_FILENO);
+	rewind(file);
+	if (out < 0 || ftruncate(fileno(file), 0) || dup2(fileno(file), STDOUT_FILENO) < 0)
+		return 0;
+	t = bench_clock();
+	r = umr_scan_asic(asic, "", ipname, "*");
+	fflush(stdout);
+	t = bench_clock() - t;
+	dup2(out, STDOUT_FILENO);
+	close(out);
+	return r ? 0 : t;
+}
+
+static char *read_file(FILE *file, long *size)
+{
+	char *buf;
+
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	rewind(file);
+	buf = calloc(1, *size + 1);
+	if (buf && fread(buf, 1, *size, file) != (size_t)*size) {
+		free(buf);
+		buf = NULL;
+	}
+	return buf;
+}
+
+int main(int argc, char **argv)
+{
+	struct umr_asic *asic;
+	FILE *file;
+	char *ipname, *ref, *out;
+	long ref_size, out_size;
+	uint64_t t, t1 = 0;
+	int max_threads, n, bad = 0;
+
+	max_threads = argc > 1 ? atoi(argv[1]) : 8;
+	latency_ns = argc > 2 ? atoi(argv[2]) : 1000;
+	sleep_access = argc > 3 && !strcmp(argv[3], "sleep");
+	ipname = argc > 4 ? argv[4] : "";
+
+	memset(&options, 0, sizeof options);
+	asic = umr_discover_asic_by_name(&options, "vega20");
+	file = tmpfile();
+	if (!asic || !file || max_threads < 1) {
+		fprintf(stderr, "[ERROR]: Could not create the vega20 device or the output file\n");
+		return 1;
+	}
+	asic->fd.mmio = asic->fd.didt = asic->fd.pcie = asic->fd.smc = -1;
+	asic->reg_funcs.read_reg = sim_read_reg;
+	asic->reg_funcs.write_reg = sim_write_reg;
+	asic->reg_funcs.read_regs = NULL;
+	asic->reg_funcs.write_regs = NULL;
+	asic->options.named = 1;
+	asic->options.bitfields = 1;
+
+	// the output of one thread is the reference
+	if (!scan_to_file(asic, ipname, 1, file) || !(ref = read_file(file, &ref_size))) {
+		fprintf(stderr, "[ERROR]: Could not scan <%s>\n", ipname);
+		return 1;
+	}
+
+	printf("vega20 %s, %u ns %s per register access, %ld bytes of output:\n",
+	       ipname[0] ? ipname : "all blocks", latency_ns, sleep_access ? "sleeping" : "spinning", ref_size);
+	for (n = 1; n <= max_threads; n *= 2) {
+		t = scan_to_file(asic, ipname, n, file);
+		out = t ? read_file(file, &out_size) : NULL;
+		if (!out) {
+			fprintf(stderr, "[ERROR]: Could not scan <%s> with %d threads\n", ipname, n);
+			return 1;
+		}
+		if (n == 1)
+			t1 = t;
+		printf("  %2d threads %10.2f ms  %5.2fx  output %s\n", n, t / 1e6, (double)t1 / t,
+		       out_size == ref_size && !memcmp(out, ref, ref_size) ? "identical" : "DIFFERS");
+		if (out_size != ref_size || memcmp(out, ref, ref_size))
+			bad = 1;
+		free(out);
+	}
+
+	free(ref);
+	fclose(file);
+	umr_close_asic(asic);
+	return bad;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <time.h>
+
+/*
+ * Throughput of umr_access_vram() through the GFX hub with and without
+ * umr_vm_cache_enable().  VRAM is a buffer in process memory (like
+ * UMR_PROCESS_HUB accesses) holding a 4 level page table that maps a
+ * buffer of VMID 1 onto scattered pages.  The VM context registers are
+ * mocked and each linear VRAM access can spin for a fixed time to stand
+ * in for the cost of a debugfs read.  The buffer is read in one call
+ * and then 4KB at a time, the way a caller reading a buffer object
+ * piecewise would.  A memcpy through UMR_PROCESS_HUB is the ceiling.
+ *
+ * usage: bench_vm_walk [size in MB] [ns per linear VRAM access]
+ */
+
+#define VM_BASE      0x100000000ULL
+#define BENCH_VMID   (UMR_GFX_HUB | 1)
+
+static struct {
+	uint32_t regs[1 << 18];
+	uint8_t *vram;
+	uint64_t vram_size, pt_next, root;
+	uint64_t accesses;
+	unsigned latency_ns;
+} sim;
+
+static uint64_t bench_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t sim_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
+{
+	(void)asic;
+	(void)type;
+	return sim.regs[(addr / 4) % (sizeof sim.regs / sizeof sim.regs[0])];
+}
+
+static int sim_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
+{
+	(void)asic;
+	(void)type;
+	sim.regs[(addr / 4) % (sizeof sim.regs / sizeof sim.regs[0])] = value;
+	return 0;
+}
+
+static int sim_access_vram(struct umr_asic *asic, uint64_t addr, uint32_t size, void *data, int write_en)
+{
+	uint64_t end;
+
+	(void)asic;
+	++sim.accesses;
+	if (sim.latency_ns)
+		for (end = bench_clock() + sim.latency_ns; bench_clock() < end;);
+	if (addr + size > sim.vram_size)
+		return -1;
+	if (write_en)
+		memcpy(sim.vram + addr, data, size);
+	else
+		memcpy(data, sim.vram + addr, size);
+	return 0;
+}
+
+static uint64_t sim_bus_address(struct umr_asic *asic, uint64_t dma_addr)
+{
+	(void)asic;
+	return dma_addr;
+}
+
+static int sim_vm_message(const char *fmt, ...)
+{
+	(void)fmt;
+	return 0;
+}
+
+static int set_reg(struct umr_asic *asic, const char *name, uint32_t value)
+{
+	struct umr_reg *reg;
+
+	reg = umr_find_reg_data_by_ip(asic, "gfx", name);
+	if (!reg)
+		return -1;
+	sim.regs[reg->addr] = value;
+	return 0;
+}
+
+/* page directory and table blocks are placed after the data */
+static uint64_t pt_alloc(void)
+{
+	uint64_t addr = sim.pt_next;
+
+	sim.pt_next += 4096;
+	memset(sim.vram + addr, 0, 4096);
+	return addr;
+}
+
+/* map the 4KB page at @va to @pa */
+static void pt_map(uint64_t va, uint64_t pa)
+{
+	uint64_t *table, entry;
+	int level;
+
+	table = (uint64_t *)(sim.vram + sim.root);
+	for (level = 3; level > 0; level--) {
+		entry = table[(va >> (12 + 9 * level)) & 511];
+		if (!(entry & 1)) {
+			entry = pt_alloc() | 1;
+			table[(va >> (12 + 9 * level)) & 511] = entry;
+		}
+		table = (uint64_t *)(sim.vram + (entry & 0xFFFFFFFFF000ULL));
+	}
+	table[(va >> 12) & 511] = pa | 1;
+}
+
+static int read_whole(struct umr_asic *asic, uint64_t size, uint8_t *buf)
+{
+	return umr_read_vram(asic, BENCH_VMID, VM_BASE, size, buf);
+}
+
+static int read_pages(struct umr_asic *asic, uint64_t size, uint8_t *buf)
+{
+	uint64_t x;
+
+	for (x = 0; x < size; x += 4096)
+		if (umr_read_vram(asic, BENCH_VMID, VM_BASE + x, 4096, buf + x))
+			return -1;
+	return 0;
+}
+
+static int read_process(struct umr_asic *asic, uint64_t size, uint8_t *buf)
+{
+	return umr_read_vram(asic, UMR_PROCESS_HUB, (uint64_t)(uintptr_t)sim.vram, size, buf);
+}
+
+static int bench(struct umr_asic *asic, const char *name,
+		 int (*read)(struct umr_asic *, uint64_t, uint8_t *),
+		 uint64_t size, uint8_t *buf, const uint8_t *expect)
+{
+	uint64_t t, best = ~0ULL, accesses = 0;
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		memset(buf, 0, size);
+		sim.accesses = 0;
+		t = bench_clock();
+		if (read(asic, size, buf))
+			return -1;
+		t = bench_clock() - t;
+		if (memcmp(buf, expect, size)) {
+			fprintf(stderr, "[ERROR]: %s read the wrong data\n", name);
+			return -1;
+		}
+		if (t < best) {
+			best = t;
+			accesses = sim.accesses;
+		}
+	}
+	printf("  %-28s %8.2f GB/s  %8lu linear VRAM accesses\n",
+	       name, size / (best / 1e9) / 1e9, (unsigned long)accesses);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct umr_options options;
+	struct umr_asic *asic;
+	struct umr_reg *cntl;
+	uint64_t size, x, no_pages, pa;
+	uint8_t *buf, *expect;
+	char name[64];
+	int vmid, r = 0;
+
+	size = (uint64_t)(argc > 1 ? atoi(argv[1]) : 64) << 20;
+	sim.latency_ns = argc > 2 ? atoi(argv[2]) : 0;
+	no_pages = size / 4096;
+
+	memset(&options, 0, sizeof options);
+	asic = umr_discover_asic_by_name(&options, "vega20");
+	if (!asic || !no_pages) {
+		fprintf(stderr, "[ERROR]: Could not create the vega20 device\n");
+		return 1;
+	}
+	asic->fd.mmio = asic->fd.didt = asic->fd.pcie = asic->fd.smc = -1;
+	asic->reg_funcs.read_reg = sim_read_reg;
+	asic->reg_funcs.write_reg = sim_write_reg;
+	asic->reg_funcs.read_regs = NULL;
+	asic->reg_funcs.write_regs = NULL;
+	asic->mem_funcs.access_linear_vram = sim_access_vram;
+	asic->mem_funcs.access_sram = sim_access_vram;
+	asic->mem_funcs.gpu_bus_to_cpu_address = sim_bus_address;
+	asic->mem_funcs.vm_message = sim_vm_message;
+
+	// the data, then room for the page table blocks
+	sim.vram_size = size + (no_pages / 512 + 16) * 4096;
+	sim.vram = calloc(1, sim.vram_size);
+	buf = calloc(1, size);
+	expect = calloc(1, size);
+	if (!sim.vram || !buf || !expect) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return 1;
+	}
+	for (x = 0; x < size; x++)
+		sim.vram[x] = (uint8_t)(x * 13 + (x >> 12));
+	sim.pt_next = size;
+	sim.root = pt_alloc();
+
+	// every page of the buffer lands on a different page of VRAM
+	for (x = 0; x < no_pages; x++) {
+		pa = ((x * 7919) % no_pages) * 4096;
+		pt_map(VM_BASE + x * 4096, pa);
+		memcpy(expect + x * 4096, sim.vram + pa, 4096);
+	}
+
+	cntl = umr_find_reg_data_by_ip(asic, "gfx", "mmVM_CONTEXT1_CNTL");
+	if (!cntl) {
+		fprintf(stderr, "[ERROR]: No VM context registers on vega20\n");
+		return 1;
+	}
+	for (vmid = 0; vmid < 16; vmid++) {
+		sprintf(name, "mmVM_CONTEXT%d_CNTL", vmid);
+		r |= set_reg(asic, name, umr_bitslice_compose_value(asic, cntl, "PAGE_TABLE_DEPTH", 3) |
+					 umr_bitslice_compose_value(asic, cntl, "ENABLE_CONTEXT", 1));
+		sprintf(name, "mmVM_CONTEXT%d_PAGE_TABLE_BASE_ADDR_LO32", vmid);
+		r |= set_reg(asic, name, (uint32_t)sim.root | 1);
+		sprintf(name, "mmVM_CONTEXT%d_PAGE_TABLE_BASE_ADDR_HI32", vmid);
+		r |= set_reg(asic, name, 0);
+	}
+	if (r) {
+		fprintf(stderr, "[ERROR]: No VM context registers on vega20\n");
+		return 1;
+	}
+
+	printf("%lu MB through VMID 1, %u ns per linear VRAM access:\n",
+	       (unsigned long)(size >> 20), sim.latency_ns);
+	r = bench(asic, "process memory (ceiling)", read_process, size, buf, sim.vram);
+	r |= bench(asic, "one read, no cache", read_whole, size, buf, expect);
+	r |= bench(asic, "4KB reads, no cache", read_pages, size, buf, expect);
+	if (umr_vm_cache_enable(asic, 0))
+		return 1;
+	r |= bench(asic, "one read, cached", read_whole, size, buf, expect);
+	r |= bench(asic, "4KB reads, cached", read_pages, size, buf, expect);
+
+	umr_close_asic(asic);
+	free(sim.vram);
+	free(buf);
+	free(expect);
+	return r ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <time.h>
+
+/*
+ * Throughput of umr_access_vram_via_mmio() against a simulated MMIO
+ * backend.  The register callbacks implement MM_INDEX, MM_INDEX_HI and
+ * MM_DATA over a buffer in memory and optionally spin for a fixed time
+ * per register access to stand in for the cost of a real MMIO access.
+ * A per-dword loop that writes both index registers for every dword
+ * (how VRAM used to be accessed through MM_INDEX) is timed as a
+ * reference.
+ *
+ * usage: bench_vram_mmio [size in KB] [ns per register access]
+ */
+
+static struct {
+	uint32_t *vram;
+	uint64_t vram_size;
+	uint64_t index, index_hi, data;
+	uint32_t index_lo_value, index_hi_value;
+	uint64_t accesses;
+	unsigned latency_ns;
+} sim;
+
+static uint64_t bench_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sim_access(void)
+{
+	uint64_t end;
+
+	++sim.accesses;
+	if (sim.latency_ns)
+		for (end = bench_clock() + sim.latency_ns; bench_clock() < end;);
+}
+
+static uint32_t *sim_dword(void)
+{
+	uint64_t addr;
+
+	addr = ((uint64_t)sim.index_hi_value << 31) | (sim.index_lo_value & 0x7FFFFFFF);
+	return &sim.vram[(addr < sim.vram_size ? addr : 0) / 4];
+}
+
+static uint32_t sim_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
+{
+	(void)asic;
+	(void)type;
+	sim_access();
+	return addr == sim.data ? *sim_dword() : 0;
+}
+
+static int sim_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
+{
+	(void)type;
+	sim_access();
+	umr_ind_note_write(asic, addr, value);
+	if (addr == sim.index)
+		sim.index_lo_value = value;
+	else if (addr == sim.index_hi)
+		sim.index_hi_value = value;
+	else if (addr == sim.data)
+		*sim_dword() = value;
+	return 0;
+}
+
+static int sim_write_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, const uint32_t *values, int n)
+{
+	int x;
+
+	for (x = 0; x < n; x++)
+		sim_write_reg(asic, regs[x].addr, values[x], regs[x].type);
+	return 0;
+}
+
+/* every dword programs both index registers */
+static int per_dword_access(struct umr_asic *asic, uint64_t address, uint32_t size, void *dst, int write_en)
+{
+	uint32_t *out = dst;
+
+	for (; size; size -= 4, address += 4) {
+		asic->reg_funcs.write_reg(asic, sim.index, (uint32_t)address | 0x80000000, REG_MMIO);
+		asic->reg_funcs.write_reg(asic, sim.index_hi, address >> 31, REG_MMIO);
+		if (write_en)
+			asic->reg_funcs.write_reg(asic, sim.data, *out++, REG_MMIO);
+		else
+			*out++ = asic->reg_funcs.read_reg(asic, sim.data, REG_MMIO);
+	}
+	return 0;
+}
+
+static void bench(struct umr_asic *asic, const char *name,
+		  int (*access)(struct umr_asic *, uint64_t, uint32_t, void *, int),
+		  void *buf, uint32_t size, int write_en)
+{
+	uint64_t t, best = ~0ULL, accesses = 0;
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		sim.accesses = 0;
+		t = bench_clock();
+		access(asic, 0x100000, size, buf, write_en);
+		t = bench_clock() - t;
+		if (t < best) {
+			best = t;
+			accesses = sim.accesses;
+		}
+	}
+	printf("  %-24s %10.1f MB/s  %5.2f register accesses per dword\n",
+	       name, size / (best / 1e9) / 1e6, (double)accesses / (size / 4));
+}
+
+int main(int argc, char **argv)
+{
+	struct umr_options options;
+	struct umr_ind_window *w;
+	struct umr_asic *asic;
+	uint32_t size, x, *buf;
+
+	size = (argc > 1 ? atoi(argv[1]) : 4096) * 1024;
+	sim.latency_ns = argc > 2 ? atoi(argv[2]) : 0;
+
+	memset(&options, 0, sizeof options);
+	asic = umr_discover_asic_by_name(&options, "vega20");
+	if (!asic || !size) {
+		fprintf(stderr, "[ERROR]: Could not create the vega20 device\n");
+		return 1;
+	}
+	asic->fd.mmio = asic->fd.didt = asic->fd.pcie = asic->fd.smc = -1;
+	asic->reg_funcs.read_reg = sim_read_reg;
+	asic->reg_funcs.write_reg = sim_write_reg;
+	asic->reg_funcs.read_regs = NULL;
+	asic->reg_funcs.write_regs = sim_write_regs;
+
+	w = umr_get_ind_window(asic, UMR_IND_MM);
+	sim.vram_size = 0x100000 + (uint64_t)size;
+	sim.vram = calloc(1, sim.vram_size);
+	buf = calloc(1, size);
+	if (!w || !sim.vram || !buf) {
+		fprintf(stderr, "[ERROR]: Out of memory\n");
+		return 1;
+	}
+	sim.index = w->index;
+	sim.index_hi = w->index_hi;
+	sim.data = w->data;
+
+	// check the streamed accesses before timing them
+	for (x = 0; x < sim.vram_size / 4; x++)
+		sim.vram[x] = x * 2654435761U;
+	umr_access_vram_via_mmio(asic, 0x100000, size, buf, 0);
+	for (x = 0; x < size / 4; x++)
+		if (buf[x] != sim.vram[0x40000 + x]) {
+			fprintf(stderr, "[ERROR]: Read mismatch at dword %lu\n", (unsigned long)x);
+			return 1;
+		}
+	for (x = 0; x < size / 4; x++)
+		buf[x] = ~x;
+	umr_access_vram_via_mmio(asic, 0x100000, size, buf, 1);
+	for (x = 0; x < size / 4; x++)
+		if (sim.vram[0x40000 + x] != ~x) {
+			fprintf(stderr, "[ERROR]: Write mismatch at dword %lu\n", (unsigned long)x);
+			return 1;
+		}
+
+	printf("%lu KB through MM_INDEX/MM_DATA, %u ns per register access:\n",
+	       (unsigned long)size / 1024, sim.latency_ns);
+	bench(asic, "per dword read", per_dword_access, buf, size, 0);
+	bench(asic, "streamed read", umr_access_vram_via_mmio, buf, size, 0);
+	bench(asic, "per dword write", per_dword_access, buf, size, 1);
+	bench(asic, "streamed write", umr_access_vram_via_mmio, buf, size, 1);
+
+	free(buf);
+	free(sim.vram);
+	umr_close_asic(asic);
+	return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <time.h>
+
+/*
+ * Wave status and SGPR reads per second with the 'no_kernel' option,
+ * the registers being accessed through a heap buffer standing in for
+ * the mapped MMIO BAR.  The GRBM_GFX_INDEX and SQ_IND_INDEX values the
+ * library composes with bitfield handles are first checked against
+ * umr_bitslice_compose_value() (by name) and the cost of composing an
+ * SQ_IND_INDEX value both ways is reported, composing by name being
+ * what every indirect SQ access did before the handles.
+ *
+ * usage: bench_wave_status [calls]
+ */
+
+#define BAR_SIZE  (4 << 20)
+#define MAX_LOG   256
+
+static const char *bench_asics[] = { "vega10", "raven1", "vega20", NULL };
+
+static struct {
+	uint64_t grbm, sq_index;
+	uint32_t grbm_values[MAX_LOG], sq_values[MAX_LOG];
+	int no_grbm, no_sq;
+	int (*write_reg)(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type);
+} log_writes;
+
+static uint64_t bench_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* records the index writes then writes to the BAR */
+static int log_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
+{
+	if (type == REG_MMIO && addr == log_writes.grbm && log_writes.no_grbm < MAX_LOG)
+		log_writes.grbm_values[log_writes.no_grbm++] = value;
+	if (type == REG_MMIO && addr == log_writes.sq_index && log_writes.no_sq < MAX_LOG)
+		log_writes.sq_values[log_writes.no_sq++] = value;
+	return log_writes.write_reg(asic, addr, value, type);
+}
+
+static uint32_t grbm_by_name(struct umr_asic *asic, struct umr_reg *reg, uint32_t se, uint32_t sh, uint32_t instance)
+{
+	if (se == 0xFFFFFFFF)
+		return umr_bitslice_compose_value(asic, reg, "INSTANCE_BROADCAST_WRITES", 1) |
+		       umr_bitslice_compose_value(asic, reg, "SE_BROADCAST_WRITES", 1) |
+		       umr_bitslice_compose_value(asic, reg, "SH_BROADCAST_WRITES", 1);
+	return umr_bitslice_compose_value(asic, reg, "INSTANCE_INDEX", instance) |
+	       umr_bitslice_compose_value(asic, reg, "SE_INDEX", se) |
+	       umr_bitslice_compose_value(asic, reg, "SH_INDEX", sh);
+}
+
+/* how an SQ_IND_INDEX value was composed before the handles */
+static uint32_t sq_index_by_name(struct umr_asic *asic, uint32_t simd, uint32_t wave, uint32_t thread, uint32_t index)
+{
+	struct umr_reg *reg = umr_find_reg_data(asic, "mmSQ_IND_INDEX");
+
+	return umr_bitslice_compose_value(asic, reg, "WAVE_ID", wave) |
+	       umr_bitslice_compose_value(asic, reg, "SIMD_ID", simd) |
+	       umr_bitslice_compose_value(asic, reg, "INDEX", index) |
+	       umr_bitslice_compose_value(asic, reg, "THREAD_ID", thread) |
+	       umr_bitslice_compose_value(asic, reg, "FORCE_READ", 1) |
+	       umr_bitslice_compose_value(asic, reg, "AUTO_INCR", 1);
+}
+
+static uint32_t sq_index_by_handle(const struct umr_sq_ind_handles *h, uint32_t simd, uint32_t wave, uint32_t thread, uint32_t index)
+{
+	return umr_bitslice_compose_by_handle(&h->wave_id, wave) |
+	       umr_bitslice_compose_by_handle(&h->simd_id, simd) |
+	       umr_bitslice_compose_by_handle(&h->index_field, index) |
+	       umr_bitslice_compose_by_handle(&h->thread_id, thread) |
+	       umr_bitslice_compose_by_handle(&h->force_read, 1) |
+	       umr_bitslice_compose_by_handle(&h->auto_incr, 1);
+}
+
+/* check the index values written for one wave status and one SGPR read */
+static int check_index_writes(struct umr_asic *asic, struct umr_reg *grbm, struct umr_reg *sq_index)
+{
+	struct umr_wave_status ws;
+	uint32_t sgprs[1024];
+	int x, bad = 0;
+
+	log_writes.write_reg = asic->reg_funcs.write_reg;
+	asic->reg_funcs.write_reg = log_write_reg;
+
+	log_writes.no_grbm = log_writes.no_sq = 0;
+	umr_get_wave_status(asic, 1, 0, 3, 2, 5, &ws);
+	if (log_writes.no_grbm < 2 ||
+	    log_writes.grbm_values[0] != grbm_by_name(asic, grbm, 1, 0, 3) ||
+	    log_writes.grbm_values[log_writes.no_grbm - 1] != grbm_by_name(asic, grbm, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF))
+		bad = 1;
+	if (!log_writes.no_sq ||
+	    log_writes.sq_values[0] != sq_index_by_name(asic, 2, 5, 0, umr_find_reg_data(asic, "ixSQ_WAVE_STATUS")->addr))
+		bad = 1;
+	for (x = 0; x < log_writes.no_sq; x++)
+		if (log_writes.sq_values[x] != sq_index_by_name(asic, 2, 5, 0, umr_bitslice_reg(asic, sq_index, "INDEX", log_writes.sq_values[x])))
+			bad = 1;
+
+	memset(&ws, 0, sizeof ws);
+	ws.hw_id.se_id = 1;
+	ws.hw_id.cu_id = 3;
+	ws.hw_id.simd_id = 2;
+	ws.hw_id.wave_id = 5;
+	ws.gpr_alloc.sgpr_size = 6;
+	log_writes.no_grbm = log_writes.no_sq = 0;
+	umr_read_sgprs(asic, &ws, sgprs);
+	if (log_writes.no_grbm != 2 ||
+	    log_writes.grbm_values[0] != grbm_by_name(asic, grbm, 1, 0, 3) ||
+	    log_writes.grbm_values[1] != grbm_by_name(asic, grbm, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF) ||
+	    log_writes.no_sq != 1 ||
+	    log_writes.sq_values[0] != sq_index_by_name(asic, 2, 5, 0, 0x200))
+		bad = 1;
+
+	asic->reg_funcs.write_reg = log_writes.write_reg;
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	const struct umr_sq_ind_handles *h;
+	struct umr_options options;
+	struct umr_wave_status ws;
+	struct umr_reg *grbm, *sq_index;
+	struct umr_asic *asic;
+	uint32_t sgprs[1024], sum = 0;
+	uint64_t t, t_status, t_sgprs, t_name, t_handle;
+	long calls, k;
+	int a, bad = 0;
+
+	calls = argc > 1 ? atol(argv[1]) : 200000;
+	if (calls < 1)
+		calls = 1;
+
+	printf("%ld calls per ASIC, registers in a heap buffer:\n", calls);
+	for (a = 0; bench_asics[a]; a++) {
+		memset(&options, 0, sizeof options);
+		options.no_kernel = 1;
+		asic = umr_discover_asic_by_name(&options, (char *)bench_asics[a]);
+		if (!asic) {
+			fprintf(stderr, "[ERROR]: Could not create the %s device\n", bench_asics[a]);
+			return 1;
+		}
+		asic->options.no_kernel = 1;
+		asic->fd.mmio = asic->fd.didt = asic->fd.pcie = asic->fd.smc = asic->fd.wave = asic->fd.gpr = -1;
+		asic->pci.mem = calloc(1, BAR_SIZE);
+		asic->pci.mem_size = BAR_SIZE;
+		asic->reg_funcs.read_reg = umr_read_reg;
+		asic->reg_funcs.write_reg = umr_write_reg;
+		asic->reg_funcs.read_regs = umr_read_regs_batch;
+		asic->reg_funcs.write_regs = umr_write_regs_batch;
+
+		grbm = umr_find_reg_data(asic, "mmGRBM_GFX_INDEX");
+		sq_index = umr_find_reg_data(asic, "mmSQ_IND_INDEX");
+		h = umr_get_sq_ind_handles(asic);
+		if (!asic->pci.mem || !grbm || !sq_index || !h ||
+		    grbm->addr * 4 >= BAR_SIZE || sq_index->addr * 4 >= BAR_SIZE) {
+			fprintf(stderr, "[ERROR]: No GRBM_GFX_INDEX or SQ_IND_INDEX on %s\n", bench_asics[a]);
+			return 1;
+		}
+		log_writes.grbm = (uint64_t)grbm->addr * 4;
+		log_writes.sq_index = (uint64_t)sq_index->addr * 4;
+		if (check_index_writes(asic, grbm, sq_index)) {
+			fprintf(stderr, "[ERROR]: %s: index values differ from umr_bitslice_compose_value()\n", bench_asics[a]);
+			bad = 1;
+		}
+
+		t = bench_clock();
+		for (k = 0; k < calls; k++)
+			umr_get_wave_status(asic, 0, 0, k & 7, k & 3, k & 7, &ws);
+		t_status = bench_clock() - t;
+
+		memset(&ws, 0, sizeof ws);
+		ws.gpr_alloc.sgpr_size = 6;
+		t = bench_clock();
+		for (k = 0; k < calls; k++)
+			umr_read_sgprs(asic, &ws, sgprs);
+		t_sgprs = bench_clock() - t;
+
+		t = bench_clock();
+		for (k = 0; k < calls; k++)
+			sum += sq_index_by_name(asic, k & 3, k & 7, 0, k & 0x1FF);
+		t_name = bench_clock() - t;
+		t = bench_clock();
+		for (k = 0; k < calls; k++)
+			sum += sq_index_by_handle(h, k & 3, k & 7, 0, k & 0x1FF);
+		t_handle = bench_clock() - t;
+
+		printf("  %-8s %10.0f wave status/s  %10.0f SGPR reads/s  SQ_IND_INDEX by name %6.1f ns, by handle %5.1f ns\n",
+		       bench_asics[a], calls / (t_status / 1e9), calls / (t_sgprs / 1e9),
+		       (double)t_name / calls, (double)t_handle / calls);
+
+		free((void *)asic->pci.mem);
+		asic->pci.mem = NULL;
+		umr_close_asic(asic);
+	}
+	// keep the compose loops from being optimised away
+	if (sum == 0x12345678)
+		printf("\n");
+	return bad;
+}
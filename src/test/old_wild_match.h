@@ -0,0 +1,118 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#ifndef OLD_WILD_MATCH_H_
+#define OLD_WILD_MATCH_H_
+
+#include "umr.h"
+#include <ctype.h>
+
+/*
+ * The backtracking matcher and full scan iterator umr_find_reg_wild_*()
+ * used before patterns were compiled (reg_pattern.c).  Kept as the
+ * reference the compiled matcher is tested and benchmarked against.
+ */
+
+static const char *old_asic_names[] = {
+	"kabini", "kaveri", "mullins", "oland", "bonaire", "hainan", "hawaii",
+	"tahiti", "polaris10", "polaris11", "polaris12", "pitcairn", "verde",
+	"topaz", "tonga", "fiji", "carrizo", "stoney", "vega10", "vega12",
+	"vega20", "vegam", "raven1", NULL,
+};
+
+static int old_expression_matches(const char* str, const char* pattern)
+{
+	const char *cp = NULL, *mp = NULL;
+
+	while ((*str) && (*pattern != '*')) {
+		if ((toupper(*pattern) != toupper(*str)) && (*pattern != '?')) {
+			return 0;
+		}
+		str++;
+		pattern++;
+	}
+
+	while (*str) {
+		if (*pattern == '*') {
+			if (!*++pattern) {
+				return 1;
+			}
+			mp = pattern;
+			cp = str + 1;
+		} else if ((toupper(*pattern) == toupper(*str)) || (*pattern == '?')) {
+			pattern++;
+			str++;
+		} else {
+			pattern = mp;
+			str = cp++;
+		}
+	}
+
+	while (*pattern == '*') {
+		pattern++;
+	}
+	return !*pattern;
+}
+
+/* registers matching @ip/@reg in the order the old iterator returned them, @out may be NULL */
+static int old_find_regs(struct umr_asic *asic, const char *ip, const char *reg, struct umr_reg **out)
+{
+	int i, j, n = 0;
+
+	for (i = 0; i < asic->no_blocks; i++) {
+		if ((ip && !old_expression_matches(asic->blocks[i]->ipname, ip)) ||
+		    umr_materialize_ip_block(asic->blocks[i]))
+			continue;
+		for (j = 0; j < asic->blocks[i]->no_regs; j++)
+			if (old_expression_matches(asic->blocks[i]->regs[j].regname, reg)) {
+				if (out)
+					out[n] = &asic->blocks[i]->regs[j];
+				++n;
+			}
+	}
+	return n;
+}
+
+/* the same through umr_find_reg_wild_first()/next() */
+static int new_find_regs(struct umr_asic *asic, const char *ip, const char *reg, struct umr_reg **out)
+{
+	struct umr_find_reg_iter *iter;
+	struct umr_find_reg_iter_result res;
+	int n = 0;
+
+	iter = umr_find_reg_wild_first(asic, ip, reg);
+	if (!iter)
+		return -1;
+	for (;;) {
+		res = umr_find_reg_wild_next(iter);
+		if (!res.reg)
+			break;
+		if (out)
+			out[n] = res.reg;
+		++n;
+	}
+	return n;
+}
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <sched.h>
+
+/*
+ * Runs threads doing banked register reads and MM_INDEX window reads
+ * on clones of one device against a mocked backend that, like the
+ * hardware, has a single GRBM_GFX_INDEX and a single MM_INDEX shared
+ * by every handle.  Any value read in the wrong bank or at the wrong
+ * index is cross-talk between the threads.  It then checks that the
+ * device caches the window index again once its clones are closed.
+ */
+
+#define NO_THREADS 8
+#define NO_ITERS   2000
+#define NO_SE      4
+#define NO_SH      2
+#define NO_INST    2
+
+// two banked registers that are not otherwise used by the test
+#define BANKED_REG_A 0x100000
+#define BANKED_REG_B 0x100004
+
+static struct {
+	pthread_mutex_t lock;
+	uint32_t grbm, mm_index, mm_index_hi;
+	uint64_t mm_index_writes;
+	uint64_t grbm_addr, index, index_hi, data;
+} hw = { PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+static const struct umr_grbm_index_handles *grbm;
+
+static uint32_t vram_value(uint64_t addr)
+{
+	uint32_t x = (uint32_t)(addr ^ (addr >> 32)) * 0x9E3779B1U;
+
+	return x ^ (x >> 15);
+}
+
+static uint32_t mock_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
+{
+	uint32_t value = 0;
+
+	(void)asic;
+	(void)type;
+	pthread_mutex_lock(&hw.lock);
+	if (addr == BANKED_REG_A)
+		value = hw.grbm;
+	else if (addr == BANKED_REG_B)
+		value = ~hw.grbm;
+	else if (addr == hw.data)
+		value = vram_value(((uint64_t)hw.mm_index_hi << 31) | (hw.mm_index & 0x7FFFFFFF));
+	pthread_mutex_unlock(&hw.lock);
+	return value;
+}
+
+static int mock_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
+{
+	(void)type;
+	pthread_mutex_lock(&hw.lock);
+	if (addr == hw.grbm_addr) {
+		hw.grbm = value;
+	} else if (addr == hw.index) {
+		hw.mm_index = value;
+		++hw.mm_index_writes;
+	} else if (addr == hw.index_hi) {
+		hw.mm_index_hi = value;
+	}
+	pthread_mutex_unlock(&hw.lock);
+	umr_ind_note_write(asic, addr, value);
+
+	// give another thread the chance to interfere
+	sched_yield();
+	return 0;
+}
+
+static uint64_t mm_index_writes(void)
+{
+	uint64_t n;
+
+	pthread_mutex_lock(&hw.lock);
+	n = hw.mm_index_writes;
+	pthread_mutex_unlock(&hw.lock);
+	return n;
+}
+
+struct worker {
+	struct umr_asic *asic;
+	pthread_t thread;
+	int id, bad_bank, bad_index;
+};
+
+static void *worker_run(void *data)
+{
+	struct worker *w = data;
+	struct umr_reg_addr regs[2] = { { BANKED_REG_A, REG_MMIO }, { BANKED_REG_B, REG_MMIO } };
+	uint32_t values[2 * NO_SE * NO_SH * NO_INST], se, sh, instance, v;
+	uint64_t addr;
+	int x, b;
+
+	for (x = 0; x < NO_ITERS; x++) {
+		if (umr_read_regs_all_banks(w->asic, regs, values, 2, NO_SE, NO_SH, NO_INST))
+			++w->bad_bank;
+		b = 0;
+		for (se = 0; se < NO_SE; se++)
+		for (sh = 0; sh < NO_SH; sh++)
+		for (instance = 0; instance < NO_INST; instance++, b++) {
+			v = values[2 * b];
+			if (umr_bitslice_by_handle(&grbm->se_index, v) != se ||
+			    umr_bitslice_by_handle(&grbm->sh_index, v) != sh ||
+			    umr_bitslice_by_handle(&grbm->instance_index, v) != instance ||
+			    values[2 * b + 1] != ~v)
+				++w->bad_bank;
+		}
+
+		// each thread reads its own addresses, some of them above 2GB
+		addr = ((uint64_t)w->id << 32) | ((uint64_t)(x % 64) << 2);
+		if (umr_ind_read(w->asic, UMR_IND_MM, addr) != vram_value(addr))
+			++w->bad_index;
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	struct umr_options options;
+	struct umr_ind_window *mm;
+	struct worker workers[NO_THREADS];
+	struct umr_asic *asic;
+	uint64_t n;
+	int x, bad = 0;
+
+	memset(&options, 0, sizeof options);
+	asic = umr_discover_asic_by_name(&options, "vega20");
+	if (!asic) {
+		fprintf(stderr, "[ERROR]: Could not create the vega20 device\n");
+		return 1;
+	}
+
+	// the bank is selected through GRBM_GFX_INDEX and windows keep their index
+	asic->options.no_kernel = 1;
+	asic->fd.mmio = asic->fd.didt = asic->fd.pcie = asic->fd.smc = -1;
+	asic->reg_funcs.read_reg = mock_read_reg;
+	asic->reg_funcs.write_reg = mock_write_reg;
+	asic->reg_funcs.read_regs = NULL;
+	asic->reg_funcs.write_regs = NULL;
+
+	grbm = umr_get_grbm_index_handles(asic);
+	mm = umr_get_ind_window(asic, UMR_IND_MM);
+	if (!grbm || !mm) {
+		fprintf(stderr, "[ERROR]: No GRBM_GFX_INDEX or MM_INDEX on vega20\n");
+		return 1;
+	}
+	hw.grbm_addr = (uint64_t)grbm->reg->addr * 4;
+	hw.index = mm->index;
+	hw.index_hi = mm->index_hi;
+	hw.data = mm->data;
+
+	// without clones the index is only written once
+	umr_ind_read(asic, UMR_IND_MM, 0x1000);
+	n = mm_index_writes();
+	umr_ind_read(asic, UMR_IND_MM, 0x1000);
+	if (mm_index_writes() != n) {
+		fprintf(stderr, "[ERROR]: The MM_INDEX was written again without clones\n");
+		bad = 1;
+	}
+
+	for (x = 0; x < NO_THREADS; x++) {
+		memset(&workers[x], 0, sizeof workers[x]);
+		workers[x].id = x;
+		workers[x].asic = umr_clone_asic(asic);
+		if (!workers[x].asic) {
+			fprintf(stderr, "[ERROR]: Could not clone the device\n");
+			return 1;
+		}
+	}
+	for (x = 1; x < NO_THREADS; x++)
+		if (pthread_create(&workers[x].thread, NULL, worker_run, &workers[x])) {
+			fprintf(stderr, "[ERROR]: Could not create a thread\n");
+			return 1;
+		}
+	worker_run(&workers[0]);
+	for (x = 1; x < NO_THREADS; x++)
+		pthread_join(workers[x].thread, NULL);
+
+	for (x = 0; x < NO_THREADS; x++) {
+		if (workers[x].bad_bank || workers[x].bad_index) {
+			fprintf(stderr, "[ERROR]: Thread %d read %d values from the wrong bank and %d from the wrong index\n",
+				x, workers[x].bad_bank, workers[x].bad_index);
+			bad = 1;
+		}
+	}
+
+	// while a clone is open the index is written every time
+	n = mm_index_writes();
+	umr_ind_read(asic, UMR_IND_MM, 0x1000);
+	umr_ind_read(asic, UMR_IND_MM, 0x1000);
+	if (mm_index_writes() != n + 2) {
+		fprintf(stderr, "[ERROR]: The MM_INDEX was cached while clones are open\n");
+		bad = 1;
+	}
+
+	// and once they are all closed it is written once more and then cached
+	for (x = 0; x < NO_THREADS; x++)
+		umr_close_asic(workers[x].asic);
+	hw.mm_index = 0;
+	if (umr_ind_read(asic, UMR_IND_MM, 0x1000) != vram_value(0x1000)) {
+		fprintf(stderr, "[ERROR]: Read the wrong index after closing the clones\n");
+		bad = 1;
+	}
+	n = mm_index_writes();
+	umr_ind_read(asic, UMR_IND_MM, 0x1000);
+	if (mm_index_writes() != n) {
+		fprintf(stderr, "[ERROR]: The MM_INDEX is not cached after the clones were closed\n");
+		bad = 1;
+	}
+
+	umr_close_asic(asic);
+	return bad;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "old_wild_match.h"
+
+/*
+ * Checks the compiled wildcard matcher against the old backtracking
+ * matcher on fuzzed patterns (random ones over a small alphabet and
+ * pieces of real register names with wildcards) and register names,
+ * then checks that umr_find_reg_wild_first()/next() return the same
+ * registers in the same order as the old iterator on every built-in
+ * ASIC.
+ */
+
+#define NO_PATTERNS 6000
+
+static const char *iter_patterns[][2] = {
+	{ NULL, "mmGRBM_STATUS" },
+	{ NULL, "*GRBM*" },
+	{ NULL, "mmSQ_*" },
+	{ NULL, "*_CNTL" },
+	{ "gfx*", "*PERFCOUNTER?_LO" },
+	{ NULL, "mm?DMA*STATUS*" },
+	{ "?dma*", "*rb_*" },
+	{ NULL, "*a*" },
+	{ NULL, "*" },
+	{ "nope", "*" },
+};
+
+static void fuzz_pattern(struct umr_asic *asic, int t, char *pat, int size)
+{
+	static const char alphabet[] = "AB_*?mM";
+	struct umr_ip_block *ip;
+	const char *name;
+	int x, len, start, end;
+
+	if (t & 1) {
+		len = rand() % 8;
+		for (x = 0; x < len; x++)
+			pat[x] = alphabet[rand() % (sizeof alphabet - 1)];
+		pat[len] = 0;
+		return;
+	}
+
+	// a piece of a real name, maybe with wildcards around or in it
+	ip = asic->blocks[rand() % asic->no_blocks];
+	name = ip->regs[rand() % ip->no_regs].regname;
+	len = strlen(name);
+	start = rand() % len;
+	end = start + rand() % (len - start + 1);
+	snprintf(pat, size, "%s%.*s%s", rand() % 2 ? "*" : "", end - start > 10 ? 10 : end - start,
+		 name + start, rand() % 2 ? "*" : "");
+	len = strlen(pat);
+	if (len > 2 && !(rand() % 3))
+		pat[1 + rand() % (len - 1)] = '?';
+	if (len > 2 && !(rand() % 3))
+		pat[1 + rand() % (len - 1)] = '*';
+}
+
+int main(void)
+{
+	static const char *short_names[] = { "", "A", "AB", "ABC", "mmA_B", NULL };
+	struct umr_reg **out_old, **out_new;
+	struct umr_reg_pattern *pat;
+	struct umr_options options;
+	struct umr_asic *asic;
+	char buf[32];
+	const char *name;
+	long tests = 0, bad = 0;
+	int t, i, j, a, p, n_old, n_new, max_regs;
+
+	memset(&options, 0, sizeof options);
+	srand(1);
+
+	asic = umr_discover_asic_by_name(&options, "vega10");
+	if (!asic || umr_materialize_asic(asic)) {
+		fprintf(stderr, "[ERROR]: Could not create the vega10 device\n");
+		return 1;
+	}
+	for (t = 0; t < NO_PATTERNS; t++) {
+		fuzz_pattern(asic, t, buf, sizeof buf);
+		pat = umr_compile_reg_pattern(buf);
+		if (!pat) {
+			fprintf(stderr, "[ERROR]: Could not compile <%s>\n", buf);
+			return 1;
+		}
+		for (i = 0; i < asic->no_blocks; i++)
+			for (j = 0; j < asic->blocks[i]->no_regs; j += 7) {
+				name = asic->blocks[i]->regs[j].regname;
+				++tests;
+				if (!umr_reg_pattern_matches(pat, name) != !old_expression_matches(name, buf) && bad++ < 10)
+					fprintf(stderr, "[ERROR]: <%s> against <%s> differs\n", buf, name);
+			}
+		for (j = 0; short_names[j]; j++) {
+			++tests;
+			if (!umr_reg_pattern_matches(pat, short_names[j]) != !old_expression_matches(short_names[j], buf) && bad++ < 10)
+				fprintf(stderr, "[ERROR]: <%s> against <%s> differs\n", buf, short_names[j]);
+		}
+		umr_free_reg_pattern(pat);
+	}
+	umr_close_asic(asic);
+	printf("%ld pattern/name pairs, %ld differ\n", tests, bad);
+
+	for (a = 0; old_asic_names[a]; a++) {
+		asic = umr_discover_asic_by_name(&options, (char *)old_asic_names[a]);
+		if (!asic) {
+			fprintf(stderr, "[ERROR]: Could not create the %s device\n", old_asic_names[a]);
+			return 1;
+		}
+		for (max_regs = i = 0; i < asic->no_blocks; i++)
+			max_regs += asic->blocks[i]->no_regs;
+		out_old = calloc(max_regs + 1, sizeof out_old[0]);
+		out_new = calloc(max_regs + 1, sizeof out_new[0]);
+		if (!out_old || !out_new) {
+			fprintf(stderr, "[ERROR]: Out of memory\n");
+			return 1;
+		}
+		for (p = 0; p < (int)(sizeof iter_patterns / sizeof iter_patterns[0]); p++) {
+			n_old = old_find_regs(asic, iter_patterns[p][0], iter_patterns[p][1], out_old);
+			n_new = new_find_regs(asic, iter_patterns[p][0], iter_patterns[p][1], out_new);
+			if (n_old != n_new || memcmp(out_old, out_new, n_old * sizeof out_old[0])) {
+				fprintf(stderr, "[ERROR]: %s: <%s.%s> found %d registers instead of %d\n", old_asic_names[a],
+					iter_patterns[p][0] ? iter_patterns[p][0] : "*", iter_patterns[p][1], n_new, n_old);
+				++bad;
+			}
+		}
+		free(out_old);
+		free(out_new);
+		umr_close_asic(asic);
+	}
+	return bad ? 1 : 0;
+}
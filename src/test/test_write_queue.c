@@ -0,0 +1,200 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Authors: Tom St Denis <tom.stdenis@amd.com>
+ *
+ */
+#include "umr.h"
+#include <stdarg.h>
+
+/*
+ * Checks that deferred register writes reach a mocked backend in the
+ * order they were made and before any access that could observe them.
+ * Every backend access is appended to a log which is compared against
+ * the expected sequence.
+ */
+
+static char access_log[8192];
+static int no_batches;
+
+static void log_access(const char *fmt, ...)
+{
+	va_list ap;
+	size_t len = strlen(access_log);
+
+	va_start(ap, fmt);
+	vsnprintf(access_log + len, sizeof(access_log) - len, fmt, ap);
+	va_end(ap);
+}
+
+static uint32_t mock_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type)
+{
+	(void)asic;
+	log_access("R%d:%" PRIx64 " ", type, addr);
+	return 0;
+}
+
+static int mock_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type)
+{
+	(void)asic;
+	log_access("W%d:%" PRIx64 "=%" PRIu32 " ", type, addr, value);
+	return 0;
+}
+
+static int mock_write_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, const uint32_t *values, int n)
+{
+	int x;
+
+	++no_batches;
+	log_access("[ ");
+	for (x = 0; x < n; x++)
+		mock_write_reg(asic, regs[x].addr, values[x], regs[x].type);
+	log_access("] ");
+	return 0;
+}
+
+static int mock_access_vram(struct umr_asic *asic, uint64_t address, uint32_t size, void *data, int write_en)
+{
+	(void)asic;
+	(void)data;
+	log_access("V%s:%" PRIx64 "+%" PRIu32 " ", write_en ? "W" : "R", address, size);
+	return 0;
+}
+
+static int mock_access_sram(struct umr_asic *asic, uint64_t address, uint32_t size, void *data, int write_en)
+{
+	(void)asic;
+	(void)data;
+	log_access("S%s:%" PRIx64 "+%" PRIu32 " ", write_en ? "W" : "R", address, size);
+	return 0;
+}
+
+static int check_log(const char *what, const char *expected)
+{
+	int r = 0;
+
+	if (strcmp(access_log, expected)) {
+		fprintf(stderr, "[ERROR]: %s\n\texpected: %s\n\tgot:      %s\n", what, expected, access_log);
+		r = 1;
+	}
+	access_log[0] = 0;
+	no_batches = 0;
+	return r;
+}
+
+static void mock_callbacks(struct umr_asic *asic)
+{
+	asic->fd.mmio = asic->fd.didt = asic->fd.pcie = asic->fd.smc = -1;
+	asic->reg_funcs.read_reg = mock_read_reg;
+	asic->reg_funcs.read_regs = NULL;
+	asic->reg_funcs.write_reg = mock_write_reg;
+	asic->reg_funcs.write_regs = mock_write_regs;
+	asic->mem_funcs.access_linear_vram = mock_access_vram;
+	asic->mem_funcs.access_sram = mock_access_sram;
+}
+
+int main(void)
+{
+	struct umr_options options;
+	struct umr_asic *asic, *node;
+	char expected[4096];
+	uint32_t buf[4];
+	int x, bad = 0;
+
+	memset(&options, 0, sizeof options);
+	asic = umr_discover_asic_by_name(&options, "vega20");
+	node = umr_discover_asic_by_name(&options, "vega20");
+	if (!asic || !node) {
+		fprintf(stderr, "[ERROR]: Could not create the vega20 device\n");
+		return 1;
+	}
+	mock_callbacks(asic);
+	if (umr_defer_writes(asic, 1))
+		return 1;
+
+	// nothing reaches the backend until something could observe it
+	asic->reg_funcs.write_reg(asic, 0x10, 1, REG_MMIO);
+	asic->reg_funcs.write_reg(asic, 0x14, 2, REG_SMC);
+	asic->reg_funcs.write_reg(asic, 0x18, 3, REG_DIDT);
+	bad |= check_log("writes are queued", "");
+
+	// a read of any class flushes every write first, in order
+	asic->reg_funcs.write_reg(asic, 0x10, 1, REG_MMIO);
+	asic->reg_funcs.write_reg(asic, 0x14, 2, REG_SMC);
+	asic->reg_funcs.read_reg(asic, 0x20, REG_PCIE);
+	bad |= check_log("read after writes", "[ W0:10=1 W2:14=2 W1:18=3 W0:10=1 W2:14=2 ] R3:20 ");
+
+	// as does a VRAM or system memory access
+	asic->reg_funcs.write_reg(asic, 0x30, 4, REG_MMIO);
+	asic->mem_funcs.access_linear_vram(asic, 0x1000, sizeof buf, buf, 0);
+	asic->reg_funcs.write_reg(asic, 0x34, 5, REG_MMIO);
+	asic->mem_funcs.access_sram(asic, 0x2000, sizeof buf, buf, 0);
+	asic->mem_funcs.access_sram(asic, 0x2000, sizeof buf, buf, 1);
+	bad |= check_log("memory accesses after writes", "[ W0:30=4 ] VR:1000+16 [ W0:34=5 ] SR:2000+16 SW:2000+16 ");
+
+	// an explicit flush, a second one has nothing to do
+	asic->reg_funcs.write_reg(asic, 0x40, 6, REG_MMIO);
+	umr_flush_writes(asic);
+	umr_flush_writes(asic);
+	bad |= check_log("explicit flush", "[ W0:40=6 ] ");
+
+	// a full queue is flushed as one batch and order is kept across batches
+	expected[0] = 0;
+	for (x = 0; x < 130; x++) {
+		asic->reg_funcs.write_reg(asic, x * 4, x, REG_MMIO);
+		sprintf(expected + strlen(expected), "%sW0:%x=%d %s",
+			(x % 64) ? "" : "[ ", x * 4, x, (x % 64) == 63 ? "] " : "");
+	}
+	if (no_batches != 2) {
+		fprintf(stderr, "[ERROR]: 130 writes took %d batches instead of 2\n", no_batches);
+		bad = 1;
+	}
+	umr_flush_writes(asic);
+	strcat(expected, "] ");
+	bad |= check_log("queue overflow", expected);
+
+	// a node given the callbacks of the device queues its own writes
+	node->reg_funcs = asic->reg_funcs;
+	node->mem_funcs = asic->mem_funcs;
+	if (umr_share_write_queue(asic, node) || !node->write_queue) {
+		fprintf(stderr, "[ERROR]: The node did not get a write queue\n");
+		return 1;
+	}
+	asic->reg_funcs.write_reg(asic, 0x50, 7, REG_MMIO);
+	node->reg_funcs.write_reg(node, 0x60, 8, REG_MMIO);
+	node->mem_funcs.access_sram(node, 0x3000, sizeof buf, buf, 0);
+	asic->reg_funcs.read_reg(asic, 0x70, REG_MMIO);
+	bad |= check_log("shared queue", "[ W0:60=8 ] SR:3000+16 [ W0:50=7 ] R0:70 ");
+
+	// disabling flushes and restores the backend callbacks
+	asic->reg_funcs.write_reg(asic, 0x80, 9, REG_MMIO);
+	umr_defer_writes(asic, 0);
+	asic->reg_funcs.write_reg(asic, 0x84, 10, REG_MMIO);
+	bad |= check_log("disable", "[ W0:80=9 ] W0:84=10 ");
+	if (asic->reg_funcs.write_reg != mock_write_reg || asic->mem_funcs.access_sram != mock_access_sram) {
+		fprintf(stderr, "[ERROR]: The callbacks were not restored\n");
+		bad = 1;
+	}
+
+	umr_close_asic(node);
+	umr_close_asic(asic);
+	return bad;
+}
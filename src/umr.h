@@ -94,6 +94,8 @@ enum regclass {
 	REG_PCIE
 };
 
+#define UMR_NUM_REGCLASS (REG_PCIE + 1)
+
 struct umr_asic;
 
 struct umr_bitfield {
@@ -123,16 +125,103 @@ struct umr_reg_soc15 {
 	uint32_t value, reserved;
 };
 
+/* a bitfield resolved once into a mask and shift, see umr_bitfield_handle_init() */
+struct umr_bitfield_handle {
+	struct umr_reg *reg;
+	uint32_t mask, shift; // mask is not shifted
+};
+
+// SQ indirect register access
+struct umr_sq_ind_handles {
+	struct umr_reg *index, *data;
+	struct umr_bitfield_handle wave_id, simd_id, thread_id, auto_incr, force_read, index_field;
+};
+
+// GRBM_GFX_INDEX select
+struct umr_grbm_index_handles {
+	struct umr_reg *reg;
+	struct umr_bitfield_handle instance_index, instance_broadcast,
+				   se_index, se_broadcast,
+				   sh_index, sh_broadcast;
+};
+
+// index/data register pairs driven by umr_ind_read() and friends
+enum umr_ind_window_id {
+	UMR_IND_SMC,  // SMC_IND_{INDEX,DATA}_1 (MP0PUB_IND_{INDEX,DATA}_1 on CZ), index is the SMC address
+	UMR_IND_MM,   // MM_INDEX{,_HI} and MM_DATA, index is the VRAM address
+	UMR_IND_SQ,   // SQ_IND_{INDEX,DATA}, index is the SQ_IND_INDEX value
+	UMR_IND_DIDT, // DIDT_IND_{INDEX,DATA}, index is the DIDT register number
+	UMR_IND_PCIE, // PCIE_{INDEX,DATA} (PCIE_{INDEX,DATA}2 on SOC15), index as the kernel writes it
+	UMR_NUM_IND_WINDOWS,
+};
+
+struct umr_ind_window {
+	int resolved, present;
+
+	// MMIO byte addresses (index_hi and cntl are 0 if there are none)
+	uint64_t index, index_hi, data, cntl;
+
+	// auto increment enable bit in cntl or, for SQ, in the index value
+	struct umr_bitfield_handle auto_incr;
+
+	// how far the index advances per data access when auto incrementing
+	uint64_t stride;
+
+	// right shift from a debugfs file offset to the index
+	int addr_shift;
+
+	// the kernel uses the window too so nothing is assumed between calls
+	int shared;
+
+	// what was last programmed and whether the hardware still holds it
+	uint32_t last_lo, last_hi;
+	uint64_t last;
+	int valid, incr_on;
+
+	// auto increment enabled in cntl outside of umr_ind_access() runs (read once)
+	int incr_known, incr_hw;
+};
+
+struct umr_reg_pattern;
+
 struct umr_find_reg_iter {
 	struct umr_asic *asic;
 	char *ip, *reg;
 	int ip_i, reg_i, reg_many;
+	struct umr_reg_pattern *ip_pat, *reg_pat;
+	// candidates from the trigram index (if the pattern allows it)
+	const uint32_t *cand;
+	uint32_t no_cand, cand_i;
 };
 
+struct umr_name_index_entry {
+	/* ip is the block index plus one, zero marks an empty slot */
+	uint32_t hash, ip, reg;
+};
+
+struct umr_addr_index_entry {
+	uint32_t addr, ip, reg;
+};
+
+struct umr_soc15_shared;
+struct umr_shared_indices;
+struct umr_access_stats;
+struct umr_write_queue;
+struct umr_hw_lock;
+struct umr_aio;
+struct umr_trace;
+struct umr_vm_cache;
+
 struct umr_ip_block {
 	char *ipname;
 	int no_regs;
 	struct umr_reg *regs;
+	// SOC15 source table, regs is built from it by umr_materialize_ip_block()
+	struct {
+		const struct umr_reg_soc15 *regs;
+		uint32_t offset[5];
+		struct umr_soc15_shared *shared; // non-NULL if regs is shared
+	} soc15;
 	int (*grant)(struct umr_asic *asic);
 	int (*release)(struct umr_asic *asic);
 };
@@ -221,7 +310,14 @@ struct umr_options {
 	    disasm_early_term,
 	    use_xgmi,
 	    disasm_anyways,
-	    skip_gprs;
+	    skip_gprs,
+	    dump_threads,
+	    access_stats,
+	    defer_writes,
+	    no_io_uring,
+	    sweep_banks,
+	    vm_cache,
+	    trace;             // 1 to record accesses to trace_name, 2 to replay them
 
 	union {
 		struct {
@@ -239,11 +335,13 @@ struct umr_options {
 	} bank;
 
 	long forcedid;
+	unsigned vm_cache_ms;
 	char
 		*scanblock,
 		dev_name[32],
 		hub_name[32],
-		ring_name[32];
+		ring_name[32],
+		trace_name[256];
 	struct {
 		unsigned domain,
 		    bus,
@@ -294,6 +392,12 @@ struct umr_memory_access_funcs {
 	void *data;
 };
 
+// a register for batched accesses
+struct umr_reg_addr {
+	uint64_t addr;       // byte address as passed to read_reg()
+	enum regclass type;
+};
+
 struct umr_register_access_funcs {
 	/** read_reg -- Read a register
 	 * @asic: The device the register is from
@@ -310,6 +414,28 @@ struct umr_register_access_funcs {
 	 */
 	int (*write_reg)(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type);
 
+	/** read_regs -- Read a list of registers (optional)
+	 * @asic: The device the registers are from
+	 * @regs: The byte addresses and classes of the registers to read
+	 * @values: Receives the @n register values
+	 * @n: The number of registers
+	 *
+	 * Returns 0 on success.  If NULL read_reg() is called for every
+	 * register instead.
+	 */
+	int (*read_regs)(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n);
+
+	/** write_regs -- Write a list of registers in order (optional)
+	 * @asic: The device the registers are from
+	 * @regs: The byte addresses and classes of the registers to write
+	 * @values: The @n values to write
+	 * @n: The number of registers
+	 *
+	 * Returns 0 on success.  If NULL write_reg() is called for every
+	 * register instead.
+	 */
+	int (*write_regs)(struct umr_asic *asic, const struct umr_reg_addr *regs, const uint32_t *values, int n);
+
 	/** data -- opaque pointer the callbacks can use for state tracking */
 	void *data;
 };
@@ -358,16 +484,71 @@ struct umr_asic {
 	struct {
 		struct pci_device *pdevice;
 		uint32_t *mem; // virtual address
+		uint64_t mem_size; // bytes mapped at mem
 		int region;
 	} pci;
 	struct umr_options options;
 	struct {
-		struct umr_ip_block **iplist;
-		struct umr_reg **reglist;
+		// per regclass tables sorted by address
+		struct umr_addr_index_entry *entries[UMR_NUM_REGCLASS];
+		uint32_t no_entries[UMR_NUM_REGCLASS];
+		int built, mapped;
 	} mmio_accel;
+	struct {
+		struct umr_name_index_entry *table;
+		uint32_t mask;
+		int mapped;
+	} name_index;
+	struct {
+		uint32_t *offsets, *ids;
+		int mapped;
+	} trigram_index;
+	// owner of the tables above when shared with other devices
+	struct umr_shared_indices *shared_indices;
+	// register values read by this handle, see umr_get_reg_values()
+	struct {
+		uint32_t **values;
+		int no_blocks;
+	} reg_values;
+	// regdb file the register database was loaded from
+	struct {
+		void *map;
+		size_t size;
+		struct umr_bitfield *bits;
+	} regdb;
+	// bitfields of frequently programmed registers resolved on first use
+	struct {
+		int sq_ind_valid, grbm_index_valid;
+		struct umr_sq_ind_handles sq_ind;
+		struct umr_grbm_index_handles grbm_index;
+	} handle_cache;
+	// last programmed state of indirect register windows
+	struct umr_ind_window ind_windows[UMR_NUM_IND_WINDOWS];
 	struct umr_dma_maps *maps;
 	struct umr_memory_access_funcs mem_funcs;
 	struct umr_register_access_funcs reg_funcs;
+
+	// access counters when enabled with umr_enable_access_stats()
+	struct umr_access_stats *access_stats;
+
+	// queued register writes when enabled with umr_defer_writes()
+	struct umr_write_queue *write_queue;
+
+	// device a handle was made from with umr_clone_asic() (NULL for the device itself)
+	struct umr_asic *parent;
+	// serialises index/data and GRBM bank sequences once handles are cloned
+	struct umr_hw_lock *hw_lock;
+	// umr_hw_shared() state of the lock when last checked by this handle
+	uint32_t hw_generation;
+
+	// asynchronous debugfs reader created by umr_get_aio()
+	struct umr_aio *aio;
+
+	// access trace being recorded or replayed (see umr_record_trace())
+	struct umr_trace *trace;
+
+	// page table walk state kept when enabled with umr_vm_cache_enable()
+	struct umr_vm_cache *vm_cache;
 };
 
 struct umr_wave_status {
@@ -590,6 +771,13 @@ struct umr_ring_decoder {
 
 /* ip block constructors for soc15 */
 int umr_transfer_soc15_to_reg(struct umr_options *options, struct umr_ip_offsets_soc15 *ip, char *ipname, const struct umr_reg_soc15 *regs, struct umr_ip_block *dst);
+int umr_materialize_ip_block(struct umr_ip_block *ip);
+int umr_materialize_asic(struct umr_asic *asic);
+int umr_share_soc15_regs(struct umr_ip_block *ip);
+void umr_release_ip_block_regs(struct umr_ip_block *ip);
+int umr_unshare_ip_block(struct umr_ip_block *ip);
+uint32_t *umr_get_reg_values(struct umr_asic *asic, int i);
+void umr_free_reg_values(struct umr_asic *asic);
 struct umr_ip_block *umr_create_gfx90(struct umr_ip_offsets_soc15 *soc15_offsets, struct umr_options *options);
 struct umr_ip_block *umr_create_gfx91(struct umr_ip_offsets_soc15 *soc15_offsets, struct umr_options *options);
 struct umr_ip_block *umr_create_gfx921(struct umr_ip_offsets_soc15 *soc15_offsets, struct umr_options *options);
@@ -661,6 +849,30 @@ struct umr_ip_block *umr_create_bif51(struct umr_options *options);
 /* asic constructors */
 struct umr_asic *umr_create_asic_helper(char *name, int family, ...);
 struct umr_asic *umr_create_asic_from_script(struct umr_options *options, char *name);
+
+/* binary register database */
+#define UMR_REGDB_MAGIC "UMRREGDB"
+struct umr_asic *umr_create_asic_from_regdb(struct umr_options *options, const char *name);
+int umr_regdb_write(struct umr_asic *asic, const char *filename);
+void umr_free_regdb(struct umr_asic *asic);
+
+/* register snapshots */
+#define UMR_SNAPSHOT_MAGIC "UMRSNAP"
+struct umr_reg_snapshot {
+	struct umr_asic *asic;
+	uint32_t no_regs;
+	struct umr_find_reg_iter_result *regs; // register and IP block of each value
+	uint32_t *values;
+};
+
+struct umr_reg_snapshot *umr_snapshot_capture(struct umr_asic *asic, const char *ip, const char *reg);
+int umr_snapshot_write(struct umr_reg_snapshot *snap, const char *filename);
+struct umr_reg_snapshot *umr_snapshot_read(struct umr_asic *asic, const char *filename);
+int umr_snapshot_diff(struct umr_reg_snapshot *a, struct umr_reg_snapshot *b,
+		      void (*cb)(void *data, struct umr_ip_block *ip, struct umr_reg *reg, uint32_t a_value, uint32_t b_value),
+		      void *data);
+void umr_snapshot_free(struct umr_reg_snapshot *snap);
+
 struct umr_asic *umr_create_bonaire(struct umr_options *options);
 struct umr_asic *umr_create_carrizo(struct umr_options *options);
 struct umr_asic *umr_create_fiji(struct umr_options *options);
@@ -693,6 +905,24 @@ struct umr_asic *umr_discover_asic_by_name(struct umr_options *options, char *na
 void umr_free_asic(struct umr_asic *asic);
 void umr_free_maps(struct umr_asic *asic);
 void umr_close_asic(struct umr_asic *asic); // call this to close a fully open asic
+void umr_open_debugfs(struct umr_asic *asic);
+struct umr_asic *umr_clone_asic(struct umr_asic *asic); // per thread handle, close with umr_close_asic()
+void umr_lock_hw(struct umr_asic *asic);
+void umr_unlock_hw(struct umr_asic *asic);
+int umr_hw_shared(struct umr_asic *asic);
+void umr_free_hw_lock(struct umr_asic *asic);
+
+/* asynchronous debugfs reads (io_uring with a pread() fallback) */
+#define UMR_AIO_DEPTH 64
+#define UMR_AIO_NO_URING 1
+typedef void (*umr_aio_callback)(void *data, int result);
+struct umr_aio *umr_aio_create(int depth, int flags);
+void umr_aio_destroy(struct umr_aio *aio);
+int umr_aio_is_async(struct umr_aio *aio);
+int umr_aio_read(struct umr_aio *aio, int fd, void *buf, uint32_t size, uint64_t offset, umr_aio_callback cb, void *data);
+int umr_aio_wait(struct umr_aio *aio);
+int umr_aio_read_regs(struct umr_aio *aio, const int *fds, const struct umr_reg_addr *regs, uint32_t *values, int n);
+struct umr_aio *umr_get_aio(struct umr_asic *asic);
 int umr_query_drm(struct umr_asic *asic, int field, void *ret, int size);
 void umr_enumerate_devices(void);
 int umr_update(struct umr_asic *asic, char *script);
@@ -705,10 +935,27 @@ int umr_get_wave_sq_info(struct umr_asic *asic, unsigned se, unsigned sh, unsign
 int umr_read_sgprs(struct umr_asic *asic, struct umr_wave_status *ws, uint32_t *dst);
 int umr_read_vgprs(struct umr_asic *asic, struct umr_wave_status *ws, uint32_t thread, uint32_t *dst);
 int umr_read_sensor(struct umr_asic *asic, int sensor, void *dst, int *size);
+int umr_queue_wave_status(struct umr_asic *asic, struct umr_aio *aio, unsigned se, unsigned sh, unsigned cu, unsigned simd, unsigned wave,
+			  uint32_t *buf, umr_aio_callback cb, void *data);
+int umr_parse_wave_status(struct umr_asic *asic, const uint32_t *buf, struct umr_wave_status *ws);
+int umr_queue_gprs(struct umr_asic *asic, struct umr_aio *aio, struct umr_wave_status *ws,
+		   uint32_t *sgprs, uint32_t *vgprs, int *have_vgprs);
 
 /* mmio helpers */
-// init the mmio lookup table
+// init the register address lookup tables (built on demand by the find functions)
 int umr_create_mmio_accel(struct umr_asic *asic);
+void umr_free_mmio_accel(struct umr_asic *asic);
+
+// init the register name lookup table (built on demand by the find functions)
+int umr_create_name_index(struct umr_asic *asic);
+
+// drop lookup tables after the register database was modified
+void umr_invalidate_reg_indices(struct umr_asic *asic);
+
+// share lookup tables between devices with identical register arrays
+void umr_attach_shared_indices(struct umr_asic *asic);
+void umr_publish_shared_indices(struct umr_asic *asic);
+void umr_release_shared_indices(struct umr_asic *asic);
 
 // find the word address of a register
 uint32_t umr_find_reg(struct umr_asic *asic, const char *regname);
@@ -716,6 +963,13 @@ uint32_t umr_find_reg(struct umr_asic *asic, const char *regname);
 // wildcard searches
 struct umr_find_reg_iter *umr_find_reg_wild_first(struct umr_asic *asic, const char *ip, const char *reg);
 struct umr_find_reg_iter_result umr_find_reg_wild_next(struct umr_find_reg_iter *iter);
+int umr_create_trigram_index(struct umr_asic *asic);
+
+// compiled wildcard patterns ('*' and '?', case insensitive)
+struct umr_reg_pattern *umr_compile_reg_pattern(const char *pattern);
+int umr_reg_pattern_matches(const struct umr_reg_pattern *pat, const char *str);
+void umr_reg_pattern_literals(const struct umr_reg_pattern *pat, void (*cb)(void *data, const char *str, int len), void *data);
+void umr_free_reg_pattern(struct umr_reg_pattern *pat);
 
 
 // find a register and return a printable name (used for human readable output)
@@ -725,11 +979,21 @@ char *umr_reg_name(struct umr_asic *asic, uint64_t addr);
 struct umr_reg *umr_find_reg_data_by_ip(struct umr_asic *asic, const char *ip, const char *regname);
 struct umr_reg *umr_find_reg_data(struct umr_asic *asic, char *regname);
 struct umr_reg *umr_find_reg_by_addr(struct umr_asic *asic, uint64_t addr, struct umr_ip_block **ip);
+struct umr_reg *umr_find_reg_by_addr_type(struct umr_asic *asic, uint64_t addr, enum regclass type, struct umr_ip_block **ip);
 
 // read/write a 32-bit register given a BYTE address
 uint32_t umr_read_reg(struct umr_asic *asic, uint64_t addr, enum regclass type);
 int umr_write_reg(struct umr_asic *asic, uint64_t addr, uint32_t value, enum regclass type);
 
+// read many registers at once, adjacent debugfs registers are read with one access
+int umr_read_regs_batch(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n);
+int umr_pread_regs(const int *fds, const struct umr_reg_addr *regs, uint32_t *values, int n);
+int umr_write_regs_batch(struct umr_asic *asic, const struct umr_reg_addr *regs, const uint32_t *values, int n);
+
+// read many registers through the asic callbacks (read_regs if provided)
+int umr_read_regs(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n);
+int umr_read_regs_by_name_by_ip(struct umr_asic *asic, char *ip, char **names, uint32_t *values, int n);
+
 // read/write a register given a name
 uint32_t umr_read_reg_by_name(struct umr_asic *asic, char *name);
 int umr_write_reg_by_name(struct umr_asic *asic, char *name, uint32_t value);
@@ -748,11 +1012,50 @@ uint32_t umr_bitslice_compose_value(struct umr_asic *asic, struct umr_reg *reg,
 uint32_t umr_bitslice_compose_value_by_name(struct umr_asic *asic, char *reg, char *bitname, uint32_t regvalue);
 uint32_t umr_bitslice_compose_value_by_name_by_ip(struct umr_asic *asic, char *ip, char *regname, char *bitname, uint32_t regvalue);
 
+// resolve a bitfield once then slice/compose without name lookups
+int umr_bitfield_handle_init(struct umr_asic *asic, struct umr_reg *reg, const char *bitname, struct umr_bitfield_handle *h);
+int umr_bitfield_handle_by_name_by_ip(struct umr_asic *asic, char *ip, char *regname, const char *bitname, struct umr_bitfield_handle *h);
+#define umr_bitslice_by_handle(h, regvalue) ((uint32_t)(((regvalue) >> (h)->shift) & (h)->mask))
+#define umr_bitslice_compose_by_handle(h, value) ((uint32_t)(((value) & (h)->mask) << (h)->shift))
+const struct umr_sq_ind_handles *umr_get_sq_ind_handles(struct umr_asic *asic);
+const struct umr_grbm_index_handles *umr_get_grbm_index_handles(struct umr_asic *asic);
+
+// indirect register windows
+struct umr_ind_window *umr_get_ind_window(struct umr_asic *asic, enum umr_ind_window_id id);
+uint32_t umr_ind_read(struct umr_asic *asic, enum umr_ind_window_id id, uint64_t index);
+int umr_ind_write(struct umr_asic *asic, enum umr_ind_window_id id, uint64_t index, uint32_t value);
+int umr_ind_access(struct umr_asic *asic, enum umr_ind_window_id id, uint64_t index, uint32_t *values, int n, int write_en);
+void umr_ind_invalidate(struct umr_asic *asic, enum umr_ind_window_id id);
+void umr_ind_note_write(struct umr_asic *asic, uint64_t addr, uint32_t value);
+
 // bank switching
 uint64_t umr_apply_bank_selection_address(struct umr_asic *asic);
 
+// count and time register and memory accesses made through the callbacks
+int umr_enable_access_stats(struct umr_asic *asic);
+void umr_share_access_stats(struct umr_asic *asic, struct umr_asic *node);
+void umr_disable_access_stats(struct umr_asic *asic);
+void umr_print_access_stats(struct umr_asic *asic, FILE *f, int json);
+void umr_count_reg_reads(struct umr_asic *asic, const struct umr_reg_addr *regs, int n, uint64_t ns);
+
+// record accesses made through the callbacks to a file and replay them
+#define UMR_TRACE_MAGIC "UMRTRACE"
+int umr_record_trace(struct umr_asic *asic, const char *filename);
+int umr_replay_trace(struct umr_asic *asic, const char *filename);
+void umr_share_trace(struct umr_asic *asic, struct umr_asic *node);
+void umr_close_trace(struct umr_asic *asic);
+int umr_trace_pread(struct umr_asic *asic, const char *file, int fd, void *buf, uint32_t size, uint64_t offset);
+int64_t umr_trace_file_size(struct umr_asic *asic, const char *file);
+
+// queue register writes until a read or explicit flush
+int umr_defer_writes(struct umr_asic *asic, int enable);
+int umr_share_write_queue(struct umr_asic *asic, struct umr_asic *node);
+int umr_flush_writes(struct umr_asic *asic);
+
 // select a GRBM_GFX_IDX
 int umr_grbm_select_index(struct umr_asic *asic, uint32_t se, uint32_t sh, uint32_t instance);
+int umr_read_regs_all_banks(struct umr_asic *asic, const struct umr_reg_addr *regs, uint32_t *values, int n,
+			    uint32_t no_se, uint32_t no_sh, uint32_t no_instances);
 
 // halt/resume SQ waves
 int umr_sq_cmd_halt_waves(struct umr_asic *asic, enum umr_sq_cmd_halt_resume mode);
@@ -923,6 +1226,43 @@ int umr_access_vram(struct umr_asic *asic, uint32_t vmid, uint64_t address, uint
 int umr_access_linear_vram(struct umr_asic *asic, uint64_t address, uint32_t size, void *data, int write_en);
 #define umr_read_vram(asic, vmid, address, size, dst) umr_access_vram(asic, vmid, address, size, dst, 0)
 #define umr_write_vram(asic, vmid, address, size, src) umr_access_vram(asic, vmid, address, size, src, 1)
+int umr_vm_cache_enable(struct umr_asic *asic, uint32_t expiry_ms);
+void umr_vm_cache_invalidate(struct umr_asic *asic, int vmid);
+void umr_vm_cache_disable(struct umr_asic *asic);
+
+/* page table layout of a VMID as programmed in its VM context registers */
+struct umr_vm_layout {
+	uint64_t start_addr, end_addr, // range of virtual addresses (end exclusive)
+		 base_addr,            // root page directory as a PDE (VRAM offset applied)
+		 fb_offset;            // subtracted from VRAM addresses in PDEs and PTEs
+	int depth,                     // levels of page directories
+	    block_size;                // log2 of page table size in 4KB units
+	// VMID 0 only
+	uint32_t system_access_mode;
+	uint64_t system_aperture_low, system_aperture_high;
+};
+int umr_vm_read_layout(struct umr_asic *asic, uint32_t vmid, struct umr_vm_layout *layout);
+
+/* address space maps */
+#define UMR_VM_MAP_MAGIC "UMRVMMAP"
+struct umr_vm_range {
+	uint64_t va, pa, size,
+		 flags; // PTE bits other than the address, fragment, P and F bits (0 valid, 1 system, 61 PRT, ...)
+};
+
+struct umr_vm_map {
+	struct umr_asic *asic;
+	uint32_t vmid;
+	uint64_t no_ranges, max_ranges;
+	struct umr_vm_range *ranges; // ordered by virtual address
+	uint64_t no_tables;          // page directories and tables read
+};
+
+struct umr_vm_map *umr_vm_map_capture(struct umr_asic *asic, uint32_t vmid);
+int64_t umr_vm_map_capture_many(struct umr_asic *asic, const uint32_t *vmids, int no_vmids,
+				int nthreads, struct umr_vm_map **maps);
+int umr_vm_map_write(struct umr_vm_map *map, const char *filename);
+void umr_vm_map_free(struct umr_vm_map *map);
 
 
 
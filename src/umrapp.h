@@ -35,6 +35,15 @@ int umr_scan_asic(struct umr_asic *asic, char *asicname, char *ipname, char *reg
 /* print functions */
 void umr_print_asic(struct umr_asic *asic, char *ipname);
 
+/* register snapshots */
+int umr_snapshot_save(struct umr_asic *asic, char *regpath, char *filename);
+int umr_snapshot_print_diff(struct umr_asic *asic, char *file_a, char *file_b);
+
+/* VM address space maps */
+int umr_vm_map_print(struct umr_asic *asic, uint32_t vmid);
+int umr_vm_map_save(struct umr_asic *asic, uint32_t vmid, char *filename);
+int umr_vm_map_print_all(struct umr_asic *asic);
+
 /* set register */
 int umr_set_register(struct umr_asic *asic, char *regpath, char *regvalue);
 int umr_set_register_bit(struct umr_asic *asic, char *regpath, char *regvalue);